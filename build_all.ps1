@@ -25,28 +25,80 @@ Write-Host "=======================================" -ForegroundColor Cyan
 Write-Host "  Building Server..." -ForegroundColor Cyan
 Write-Host "=======================================" -ForegroundColor Cyan
 
-Write-Host "[1/6] Compiling sqlite3.c..." -NoNewline
+Write-Host "[1/19] Compiling sqlite3.c..." -NoNewline
 gcc -c vendor/sqlite3.c -o sqlite3.o 2>$null
 if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
 
-Write-Host "[2/6] Compiling server_main.cpp..." -NoNewline
+Write-Host "[2/19] Compiling server_main.cpp..." -NoNewline
 g++ -c server/server_main.cpp -o server_main.o -std=c++17 -I vendor/asio_lib -I vendor 2>$null
 if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
 
-Write-Host "[3/6] Compiling Auth.cpp..." -NoNewline
+Write-Host "[3/19] Compiling Auth.cpp..." -NoNewline
 g++ -c server/Auth.cpp -o Auth.o -std=c++17 -I vendor 2>$null
 if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
 
-Write-Host "[4/6] Compiling Database.cpp..." -NoNewline
+Write-Host "[4/19] Compiling Database.cpp..." -NoNewline
 g++ -c server/Database.cpp -o Database.o -std=c++17 -I vendor 2>$null
 if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
 
-Write-Host "[5/6] Compiling Crypto.cpp..." -NoNewline
+Write-Host "[5/19] Compiling ConnectionPool.cpp..." -NoNewline
+g++ -c server/ConnectionPool.cpp -o ConnectionPool.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[6/19] Compiling Statements.cpp..." -NoNewline
+g++ -c server/Statements.cpp -o Statements.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[7/19] Compiling ExpirySweeper.cpp..." -NoNewline
+g++ -c server/ExpirySweeper.cpp -o ExpirySweeper.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[8/19] Compiling GroupCommitQueue.cpp..." -NoNewline
+g++ -c server/GroupCommitQueue.cpp -o GroupCommitQueue.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[9/19] Compiling ContentStore.cpp..." -NoNewline
+g++ -c server/ContentStore.cpp -o ContentStore.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[10/19] Compiling SegmentStore.cpp..." -NoNewline
+g++ -c server/SegmentStore.cpp -o SegmentStore.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[11/19] Compiling ContentCompactor.cpp..." -NoNewline
+g++ -c server/ContentCompactor.cpp -o ContentCompactor.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[12/19] Compiling MemoryStorage.cpp..." -NoNewline
+g++ -c server/MemoryStorage.cpp -o MemoryStorage.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[13/19] Compiling ShardedStorage.cpp..." -NoNewline
+g++ -c server/ShardedStorage.cpp -o ShardedStorage.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[14/19] Compiling BackupRunner.cpp..." -NoNewline
+g++ -c server/BackupRunner.cpp -o BackupRunner.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[15/19] Compiling BackfillRunner.cpp..." -NoNewline
+g++ -c server/BackfillRunner.cpp -o BackfillRunner.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[16/19] Compiling ServerConfig.cpp..." -NoNewline
+g++ -c server/ServerConfig.cpp -o ServerConfig.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[17/19] Compiling WireFormat.cpp..." -NoNewline
+g++ -c common/WireFormat.cpp -o WireFormat.o -std=c++17 -I vendor 2>$null
+if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
+
+Write-Host "[18/19] Compiling Crypto.cpp..." -NoNewline
 g++ -c common/Crypto.cpp -o Crypto.o -std=c++17 -I vendor 2>$null
 if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
 
-Write-Host "[6/6] Linking server_app.exe..." -NoNewline
-g++ server_main.o Auth.o Database.o Crypto.o sqlite3.o -o server_app.exe -lws2_32 -lwsock32 -lcrypto -lssl 2>$null
+Write-Host "[19/19] Linking server_app.exe..." -NoNewline
+g++ server_main.o Auth.o Database.o ConnectionPool.o Statements.o ExpirySweeper.o GroupCommitQueue.o ContentStore.o SegmentStore.o ContentCompactor.o MemoryStorage.o ShardedStorage.o BackupRunner.o BackfillRunner.o ServerConfig.o WireFormat.o Crypto.o sqlite3.o -o server_app.exe -lws2_32 -lwsock32 -lcrypto -lssl 2>$null
 if ($LASTEXITCODE -eq 0) { 
     Write-Host " OK" -ForegroundColor Green 
     Write-Host ""
@@ -77,7 +129,7 @@ g++ -c client/network.cpp -o network.o -std=c++17 -I vendor -D_WIN32_WINNT=0x0A0
 if ($LASTEXITCODE -eq 0) { Write-Host " OK" -ForegroundColor Green } else { Write-Host " FAIL" -ForegroundColor Red; $buildFailed = $true }
 
 Write-Host "[4/4] Linking client_app.exe..." -NoNewline
-g++ client_main.o client_app_logic.o network.o Crypto.o -o client_app.exe -lws2_32 -lwsock32 -lcrypto -lssl -lcrypt32 2>$null
+g++ client_main.o client_app_logic.o network.o WireFormat.o Crypto.o -o client_app.exe -lws2_32 -lwsock32 -lcrypto -lssl -lcrypt32 2>$null
 if ($LASTEXITCODE -eq 0) { 
     Write-Host " OK" -ForegroundColor Green 
     Write-Host ""
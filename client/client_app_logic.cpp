@@ -1,14 +1,44 @@
 #include "client_app_logic.h"
 #include "../common/Crypto.h"
 #include "../common/Protocol.h"
+#include <cctype>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include "../vendor/json.hpp"
 
 using json = nlohmann::json;
 
+// File ma hoa tu kich thuoc nay tro len gui qua POST /upload/raw (body nhi phan, khong JSON/base64)
+static const size_t RAW_UPLOAD_MIN_BYTES = 1024 * 1024;
+
+// Ma hoa percent (RFC 3986) cho header X-Filename: header chi chua ASCII
+static std::string percentEncode(const std::string& text) {
+    static const char* HEX = "0123456789ABCDEF";
+    std::string encoded;
+    for (unsigned char c : text) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += static_cast<char>(c);
+        } else {
+            encoded += '%';
+            encoded += HEX[c >> 4];
+            encoded += HEX[c & 15];
+        }
+    }
+    return encoded;
+}
+
 AppLogic::AppLogic() {
     net = new Network("http://localhost:8080");
+
+    // SECURE_NOTES_FORMAT=cbor|msgpack: body nhi phan thay cho JSON (mac dinh json)
+    const char* format_name = std::getenv("SECURE_NOTES_FORMAT");
+    WireFormat::Format format;
+    if (format_name && WireFormat::fromName(format_name, format)) {
+        net->setFormat(format);
+    } else if (format_name) {
+        std::cerr << "[WARN] SECURE_NOTES_FORMAT khong hop le, dung JSON: " << format_name << "\n";
+    }
 }
 
 // --------------------------------------------------------
@@ -193,13 +223,12 @@ void AppLogic::uploadFile(std::string filepath) {
 
     // 3. Encrypt content with File Key (AES-256-CBC).
     std::vector<unsigned char> encrypted_content_bytes = Crypto::encryptAES(plaintext, file_key, iv);
-    std::string encrypted_content_b64 = Crypto::base64Encode(encrypted_content_bytes);
     std::string iv_b64 = Crypto::base64Encode(iv);
 
     // Xóa plaintext khỏi RAM ngay lập tức
     std::fill(plaintext.begin(), plaintext.end(), 0);
 
-    if (encrypted_content_b64.empty()) {
+    if (encrypted_content_bytes.empty()) {
         std::cerr << "[ERROR] Ma hoa noi dung that bai.\n";
         return;
     }
@@ -223,16 +252,29 @@ void AppLogic::uploadFile(std::string filepath) {
         filename = filepath.substr(last_slash + 1);
     }
     
-    NoteData payload;
-    payload.note_id = 0; // Server sẽ tạo ID mới
-    payload.encrypted_content = encrypted_content_b64;
-    payload.wrapped_key = wrapped_key;
-    payload.iv_hex = iv_b64;
-    payload.filename = filename;
-    payload.created_at = 0; // Server sẽ set timestamp 
-
-    json j = payload;
-    std::string response = net->post("/upload", j.dump());
+    std::string response;
+    if (encrypted_content_bytes.size() >= RAW_UPLOAD_MIN_BYTES) {
+        // File lon: ciphertext gui nguyen byte, metadata nam trong header
+        std::string body(encrypted_content_bytes.begin(), encrypted_content_bytes.end());
+        encrypted_content_bytes.clear();
+        encrypted_content_bytes.shrink_to_fit();
+        response = net->postRaw("/upload/raw", body, {
+            {"X-Wrapped-Key", wrapped_key},
+            {"X-IV-Hex", iv_b64},
+            {"X-Filename", percentEncode(filename)}
+        });
+    } else {
+        NoteData payload;
+        payload.note_id = 0; // Server sẽ tạo ID mới
+        payload.encrypted_content = Crypto::base64Encode(encrypted_content_bytes);
+        payload.wrapped_key = wrapped_key;
+        payload.iv_hex = iv_b64;
+        payload.filename = filename;
+        payload.created_at = 0; // Server sẽ set timestamp 
+
+        json j = payload;
+        response = net->post("/upload", j.dump());
+    }
 
     // 6. On success, display note_id to user.
     try {
@@ -320,16 +362,32 @@ void AppLogic::downloadFile(int note_id) {
 void AppLogic::listNotes() {
     // Requirement:
     // 1. Send GET /notes with auth token.
-    std::string response = net->get("/notes");
+    // 2. Server tra ve tung trang {"notes": [...], "next_cursor": ...}; goi lai voi ?after= den khi het trang.
+    std::string path = "/notes";
+    bool printedHeader = false;
 
     try {
-        json j_resp = json::parse(response);
-        // Server returns array of notes directly
-        if (j_resp.is_array()) {
-            std::cout << "\n--- DANH SACH GHI CHU CUA BAN ---\n";
-            std::cout << std::setw(5) << "ID" << " | " << std::setw(30) << std::left << "TEN FILE" << " | " << "NGAY TAO\n";
-            std::cout << "----------------------------------------------------------------------\n";
-            for (const auto& note : j_resp) {
+        while (!path.empty()) {
+            std::string response = net->get(path);
+            json j_resp = json::parse(response);
+
+            if (!j_resp.contains("notes") || !j_resp["notes"].is_array()) {
+                if (j_resp.contains("error")) {
+                    std::cerr << "[ERROR] Liet ke ghi chu that bai: " << j_resp.value("error", "Loi khong xac dinh") << "\n";
+                } else {
+                    std::cerr << "[ERROR] Dinh dang phan hoi server khong hop le.\n";
+                }
+                return;
+            }
+
+            if (!printedHeader) {
+                std::cout << "\n--- DANH SACH GHI CHU CUA BAN ---\n";
+                std::cout << std::setw(5) << "ID" << " | " << std::setw(30) << std::left << "TEN FILE" << " | " << "NGAY TAO\n";
+                std::cout << "----------------------------------------------------------------------\n";
+                printedHeader = true;
+            }
+
+            for (const auto& note : j_resp["notes"]) {
                 int note_id = note.value("note_id", -1);
                 std::string filename = note.value("filename", "N/A");
                 long created_at = note.value("created_at", 0L);
@@ -348,12 +406,14 @@ void AppLogic::listNotes() {
                 
                 std::cout << std::setw(5) << std::right << note_id << " | " << std::setw(30) << std::left << filename << " | " << time_str << "\n";
             }
-            std::cout << "----------------------------------------------------------------------\n";
-        } else if (j_resp.contains("error")) {
-            std::cerr << "[ERROR] Liet ke ghi chu that bai: " << j_resp.value("error", "Loi khong xac dinh") << "\n";
-        } else {
-            std::cerr << "[ERROR] Dinh dang phan hoi server khong hop le.\n";
+
+            // Trang tiep theo (neu con)
+            path.clear();
+            if (j_resp.contains("next_cursor") && j_resp["next_cursor"].is_string()) {
+                path = "/notes?after=" + j_resp["next_cursor"].get<std::string>();
+            }
         }
+        std::cout << "----------------------------------------------------------------------\n";
     } catch (const json::parse_error& e) {
         std::cerr << "[ERROR] Phan tich phan hoi server that bai: " << e.what() << "\n";
     } catch (const std::exception& e) {
@@ -367,22 +427,32 @@ void AppLogic::listMyShares() {
         return;
     }
 
-    std::string response = net->get("/myshares");
+    // Server tra ve tung trang {"shares": [...], "next_cursor": ...}; goi lai voi ?after= den khi het trang.
+    std::string path = "/myshares";
+    bool printedHeader = false;
+    size_t count = 0;
 
     try {
-        json j_resp = json::parse(response);
-        
-        if (j_resp.is_array()) {
-            std::cout << "\n--- GHI CHU BAN DA CHIA SE VOI NGUOI KHAC ---\n";
-            
-            if (j_resp.empty()) {
-                std::cout << "Ban chua chia se ghi chu nao.\n";
+        while (!path.empty()) {
+            std::string response = net->get(path);
+            json j_resp = json::parse(response);
+
+            if (!j_resp.contains("shares") || !j_resp["shares"].is_array()) {
+                if (j_resp.contains("error")) {
+                    std::cerr << "[ERROR] Liet ke chia se that bai: " << j_resp.value("error", "Loi khong xac dinh") << "\n";
+                } else {
+                    std::cerr << "[ERROR] Dinh dang phan hoi server khong hop le.\n";
+                }
                 return;
             }
-            
-            long currentTime = static_cast<long>(std::time(nullptr));
-            
-            for (const auto& share : j_resp) {
+
+            if (!printedHeader) {
+                std::cout << "\n--- GHI CHU BAN DA CHIA SE VOI NGUOI KHAC ---\n";
+                printedHeader = true;
+            }
+
+            for (const auto& share : j_resp["shares"]) {
+                count++;
                 int note_id = share.value("note_id", -1);
                 std::string share_link = share.value("share_link", "");
                 long expiration_time = share.value("expiration_time", 0L);
@@ -418,10 +488,16 @@ void AppLogic::listMyShares() {
                 std::cout << "\n";
                 std::cout << "--------------------------------------------------------\n";
             }
-        } else if (j_resp.contains("error")) {
-            std::cerr << "[ERROR] Liet ke chia se that bai: " << j_resp.value("error", "Loi khong xac dinh") << "\n";
-        } else {
-            std::cerr << "[ERROR] Dinh dang phan hoi server khong hop le.\n";
+
+            // Trang tiep theo (neu con)
+            path.clear();
+            if (j_resp.contains("next_cursor") && j_resp["next_cursor"].is_string()) {
+                path = "/myshares?after=" + j_resp["next_cursor"].get<std::string>();
+            }
+        }
+
+        if (count == 0) {
+            std::cout << "Ban chua chia se ghi chu nao.\n";
         }
     } catch (const json::parse_error& e) {
         std::cerr << "[ERROR] Phan tich phan hoi server that bai: " << e.what() << "\n";
@@ -11,20 +11,42 @@ void Network::setToken(std::string token) {
     auth_token = token;
 }
 
+void Network::setFormat(WireFormat::Format wire_format) {
+    format = wire_format;
+}
+
+// Body phan hoi thanh JSON text cho AppLogic, du server tra CBOR hay MessagePack
+static std::string responseText(const httplib::Result& res) {
+    WireFormat::Format body_format = WireFormat::fromContentType(res->get_header_value("Content-Type"));
+    if (body_format == WireFormat::Format::Json) {
+        return res->body;
+    }
+    try {
+        return WireFormat::decode(res->body, body_format).dump();
+    } catch (const std::exception& e) {
+        std::cerr << "[NET] Khong giai ma duoc phan hoi: " << e.what() << std::endl;
+        return "{\"success\": false, \"message\": \"Invalid response body\"}";
+    }
+}
+
 std::string Network::post(std::string path, std::string json_body) {
     httplib::Client cli(base_url);
     
     // Cài đặt header
     httplib::Headers headers;
-    headers.emplace("Content-Type", "application/json");
+    headers.emplace("Accept", WireFormat::contentType(format));
     if (!auth_token.empty()) {
         headers.emplace("Authorization", "Bearer " + auth_token);
     }
 
-    auto res = cli.Post(path.c_str(), headers, json_body, "application/json");
+    std::string body = json_body;
+    if (format != WireFormat::Format::Json) {
+        body = WireFormat::encode(nlohmann::json::parse(json_body), format);
+    }
+    auto res = cli.Post(path.c_str(), headers, body, WireFormat::contentType(format));
 
     if (res && res->status == 200) {
-        return res->body;
+        return responseText(res);
     } else {
         std::stringstream ss;
         // Đảm bảo phản hồi lỗi cũng là JSON hợp lệ để AppLogic có thể parse
@@ -34,11 +56,36 @@ std::string Network::post(std::string path, std::string json_body) {
     }
 }
 
+std::string Network::postRaw(std::string path, const std::string& body, const std::map<std::string, std::string>& extra_headers) {
+    httplib::Client cli(base_url);
+    
+    httplib::Headers headers;
+    for (const auto& header : extra_headers) {
+        headers.emplace(header.first, header.second);
+    }
+    headers.emplace("Accept", WireFormat::contentType(format));
+    if (!auth_token.empty()) {
+        headers.emplace("Authorization", "Bearer " + auth_token);
+    }
+
+    auto res = cli.Post(path.c_str(), headers, body, "application/octet-stream");
+
+    if (res && res->status == 200) {
+        return responseText(res);
+    } else {
+        std::stringstream ss;
+        ss << "{\"success\": false, \"status\": " << (res ? res->status : 0) << ", \"message\": \"HTTP Error or connection failed (Status: " << (res ? res->status : 0) << ").\"}";
+        std::cerr << "[NET] POST " << path << " failed with status " << (res ? res->status : 0) << std::endl;
+        return ss.str();
+    }
+}
+
 std::string Network::get(std::string path) {
     httplib::Client cli(base_url);
     
     // Cài đặt header
     httplib::Headers headers;
+    headers.emplace("Accept", WireFormat::contentType(format));
     if (!auth_token.empty()) {
         headers.emplace("Authorization", "Bearer " + auth_token);
     }
@@ -46,7 +93,7 @@ std::string Network::get(std::string path) {
     auto res = cli.Get(path.c_str(), headers);
 
     if (res && res->status == 200) {
-        return res->body;
+        return responseText(res);
     } else {
         std::stringstream ss;
         ss << "{\"success\": false, \"status\": " << (res ? res->status : 0) << ", \"message\": \"HTTP Error or connection failed (Status: " << (res ? res->status : 0) << ").\"}";
@@ -60,6 +107,7 @@ std::string Network::del(std::string path) {
     
     // Cài đặt header
     httplib::Headers headers;
+    headers.emplace("Accept", WireFormat::contentType(format));
     if (!auth_token.empty()) {
         headers.emplace("Authorization", "Bearer " + auth_token);
     }
@@ -67,7 +115,7 @@ std::string Network::del(std::string path) {
     auto res = cli.Delete(path.c_str(), headers);
 
     if (res && res->status == 200) {
-        return res->body;
+        return responseText(res);
     } else {
         std::stringstream ss;
         ss << "{\"success\": false, \"status\": " << (res ? res->status : 0) << ", \"message\": \"HTTP Error or connection failed (Status: " << (res ? res->status : 0) << ").\"}";
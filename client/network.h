@@ -1,18 +1,27 @@
 // Client/Network.h
 #pragma once
+#include <map>
 #include <string>
+#include "../common/WireFormat.h"
 
 class Network {
 private:
     std::string base_url; // "http://localhost:8080"
     std::string auth_token;
+    WireFormat::Format format = WireFormat::Format::Json; // Dinh dang body gui/nhan voi server
 
 public:
     Network(std::string url);
     void setToken(std::string token);
+    // JSON (mac dinh), CBOR hoac MessagePack. Ham ben duoi van nhan/tra ve JSON dang text;
+    // viec doi dinh dang lam o day, ciphertext/key di tren mang duoi dang byte tho.
+    void setFormat(WireFormat::Format wire_format);
     
     // Gửi POST request với body JSON
     std::string post(std::string path, std::string json_body);
+
+    // Gửi POST request với body nhị phân (application/octet-stream) và header riêng
+    std::string postRaw(std::string path, const std::string& body, const std::map<std::string, std::string>& extra_headers);
     
     // Gửi GET request
     std::string get(std::string path);
@@ -15,6 +15,7 @@
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <cctype>
 
 // --- Helper Functions (Hex, Base64) ---
 
@@ -61,6 +62,59 @@ std::string Crypto::base64Encode(const std::vector<unsigned char>& data) {
     return encoded;
 }
 
+long long Crypto::base64DecodedSize(const std::string& encoded) {
+    size_t len = encoded.length();
+    if (len % 4 != 0) {
+        return -1;
+    }
+
+    size_t padding = 0;
+    if (len > 0 && encoded[len - 1] == '=') padding++;
+    if (len > 1 && encoded[len - 2] == '=') padding++;
+
+    for (size_t i = 0; i < len - padding; i++) {
+        unsigned char c = static_cast<unsigned char>(encoded[i]);
+        if (!std::isalnum(c) && c != '+' && c != '/') {
+            return -1;
+        }
+    }
+    return static_cast<long long>(len / 4 * 3 - padding);
+}
+
+std::string Crypto::base64UrlEncode(const std::vector<unsigned char>& data) {
+    std::string encoded = base64Encode(data);
+    while (!encoded.empty() && encoded.back() == '=') {
+        encoded.pop_back();
+    }
+    for (char& c : encoded) {
+        if (c == '+') c = '-';
+        else if (c == '/') c = '_';
+    }
+    return encoded;
+}
+
+std::vector<unsigned char> Crypto::base64UrlDecode(const std::string& encoded) {
+    // A single character left over cannot encode a byte
+    if (encoded.empty() || encoded.length() % 4 == 1) {
+        return {};
+    }
+
+    std::string standard = encoded;
+    for (char& c : standard) {
+        if (c == '-') c = '+';
+        else if (c == '_') c = '/';
+        else if (c == '+' || c == '/') return {};
+    }
+    standard.append((4 - standard.length() % 4) % 4, '=');
+
+    long long size = base64DecodedSize(standard);
+    std::vector<unsigned char> bytes = size > 0 ? base64Decode(standard) : std::vector<unsigned char>();
+    if (size <= 0 || static_cast<long long>(bytes.size()) != size) {
+        return {};
+    }
+    return bytes;
+}
+
 std::vector<unsigned char> Crypto::base64Decode(const std::string& encoded) {
     BIO *bio, *b64;
     size_t len = encoded.length();
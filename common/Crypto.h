@@ -62,4 +62,10 @@ public:
     // Chuyển đổi qua lại Base64 (dùng cho Content và IV)
     static std::string base64Encode(const std::vector<unsigned char>& data);
     static std::vector<unsigned char> base64Decode(const std::string& encoded);
+    // Số byte sau khi giải mã chuỗi Base64 chuẩn (có padding, không xuống dòng); -1 nếu không hợp lệ
+    static long long base64DecodedSize(const std::string& encoded);
+    // Base64 an toàn cho URL (RFC 4648 §5: '-' và '_', không padding), dùng cho token share link.
+    // Giải mã trả về rỗng nếu chuỗi không hợp lệ.
+    static std::string base64UrlEncode(const std::vector<unsigned char>& data);
+    static std::vector<unsigned char> base64UrlDecode(const std::string& encoded);
 };
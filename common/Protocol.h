@@ -58,12 +58,13 @@ struct PublicKeyPayload {
 };
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(PublicKeyPayload, username, receive_public_key_hex)
 
-// Cấu trúc phản hồi danh sách ghi chú
+// Cấu trúc phản hồi danh sách ghi chú (chỉ metadata, không có nội dung)
 struct NoteListItem {
     int note_id;
     long created_at;
+    std::string filename;
 };
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(NoteListItem, note_id, created_at)
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(NoteListItem, note_id, created_at, filename)
 
 // Cấu trúc entry trong danh sách truy cập share link
 struct ShareLinkUserAccess {
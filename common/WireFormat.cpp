@@ -0,0 +1,234 @@
+#include "WireFormat.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <vector>
+#include "Crypto.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Fields whose text form is base64 or hex of bytes. In the binary formats
+// they travel as byte strings; everything else keeps its JSON type.
+const char* const BASE64_FIELDS[] = {"encrypted_content", "wrapped_key", "new_wrapped_key", "iv_hex"};
+const char* const HEX_FIELDS[] = {"receive_public_key_hex", "send_public_key_hex", "salt"};
+
+enum class Text { None, Base64, Hex };
+
+Text textOf(const std::string& key) {
+    for (const char* field : BASE64_FIELDS) {
+        if (key == field) {
+            return Text::Base64;
+        }
+    }
+    for (const char* field : HEX_FIELDS) {
+        if (key == field) {
+            return Text::Hex;
+        }
+    }
+    return Text::None;
+}
+
+// Bytes of `text`, only if encoding them gives `text` back; a value that is not
+// canonical base64/hex stays a string, so nothing is ever altered on the way
+bool toBytes(const std::string& text, Text kind, std::vector<std::uint8_t>& bytes) {
+    if (kind == Text::Base64) {
+        if (Crypto::base64DecodedSize(text) < 0) {
+            return false;
+        }
+        bytes = Crypto::base64Decode(text);
+        return Crypto::base64Encode(bytes) == text;
+    }
+    if (text.size() % 2 != 0 || text.find_first_not_of("0123456789abcdef") != std::string::npos) {
+        return false;
+    }
+    bytes = Crypto::fromHex(text);
+    return true;
+}
+
+std::string toText(const std::vector<std::uint8_t>& bytes, Text kind) {
+    return kind == Text::Base64 ? Crypto::base64Encode(bytes) : Crypto::toHex(bytes);
+}
+
+// Walks objects and arrays, converting the known fields in place
+void toBinary(json& value) {
+    if (value.is_array()) {
+        for (auto& item : value) {
+            toBinary(item);
+        }
+        return;
+    }
+    if (!value.is_object()) {
+        return;
+    }
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        Text kind = textOf(it.key());
+        std::vector<std::uint8_t> bytes;
+        if (kind != Text::None && it->is_string() && toBytes(it->get_ref<const std::string&>(), kind, bytes)) {
+            *it = json::binary(std::move(bytes));
+        } else {
+            toBinary(*it);
+        }
+    }
+}
+
+// True if toBinary would change anything; saves copying bodies without byte fields
+bool hasTextBytes(const json& value) {
+    if (value.is_array()) {
+        for (const auto& item : value) {
+            if (hasTextBytes(item)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (!value.is_object()) {
+        return false;
+    }
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        if ((it->is_string() && textOf(it.key()) != Text::None) || hasTextBytes(*it)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void fromBinary(json& value) {
+    if (value.is_array()) {
+        for (auto& item : value) {
+            fromBinary(item);
+        }
+        return;
+    }
+    if (!value.is_object()) {
+        return;
+    }
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        if (it->is_binary()) {
+            // Unknown binary fields are read as base64, like the ciphertext
+            Text kind = textOf(it.key());
+            *it = toText(it->get_binary(), kind == Text::Hex ? Text::Hex : Text::Base64);
+        } else {
+            fromBinary(*it);
+        }
+    }
+}
+
+// Media type without parameters, lower case: "Application/CBOR; q=1" -> "application/cbor"
+std::string mediaType(const std::string& text) {
+    std::string type = text.substr(0, text.find(';'));
+    type.erase(0, type.find_first_not_of(" \t"));
+    type.erase(type.find_last_not_of(" \t") + 1);
+    std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return std::tolower(c); });
+    return type;
+}
+
+bool fromMediaType(const std::string& type, WireFormat::Format& format) {
+    if (type == "application/cbor") {
+        format = WireFormat::Format::Cbor;
+    } else if (type == "application/msgpack" || type == "application/x-msgpack" ||
+               type == "application/vnd.msgpack") {
+        format = WireFormat::Format::MsgPack;
+    } else if (type == "application/json" || type == "application/*" || type == "*/*") {
+        format = WireFormat::Format::Json;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}
+
+WireFormat::Format WireFormat::fromContentType(const std::string& content_type) {
+    Format format = Format::Json;
+    fromMediaType(mediaType(content_type), format);
+    return format;
+}
+
+WireFormat::Format WireFormat::fromAccept(const std::string& accept) {
+    // Quality values are not weighed: clients list the format they want first
+    size_t start = 0;
+    while (start < accept.size()) {
+        size_t end = accept.find(',', start);
+        if (end == std::string::npos) {
+            end = accept.size();
+        }
+        Format format;
+        if (fromMediaType(mediaType(accept.substr(start, end - start)), format)) {
+            return format;
+        }
+        start = end + 1;
+    }
+    return Format::Json;
+}
+
+bool WireFormat::fromName(const std::string& name, Format& format) {
+    if (name == "json") {
+        format = Format::Json;
+    } else if (name == "cbor") {
+        format = Format::Cbor;
+    } else if (name == "msgpack") {
+        format = Format::MsgPack;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* WireFormat::contentType(Format format) {
+    switch (format) {
+    case Format::Cbor:
+        return "application/cbor";
+    case Format::MsgPack:
+        return "application/msgpack";
+    default:
+        return "application/json";
+    }
+}
+
+std::string WireFormat::encode(const json& value, Format format) {
+    if (format == Format::Json) {
+        return value.dump();
+    }
+
+    json converted;
+    const json* binary = &value;
+    if (hasTextBytes(value)) {
+        converted = value;
+        toBinary(converted);
+        binary = &converted;
+    }
+    std::string body;
+    if (format == Format::Cbor) {
+        json::to_cbor(*binary, body);
+    } else {
+        json::to_msgpack(*binary, body);
+    }
+    return body;
+}
+
+json WireFormat::decode(const std::string& body, Format format) {
+    return decode(body, format, std::string());
+}
+
+json WireFormat::decode(const std::string& body, Format format, const std::string& raw_field) {
+    if (format == Format::Json) {
+        return json::parse(body);
+    }
+
+    json value = format == Format::Cbor ? json::from_cbor(body) : json::from_msgpack(body);
+    if (!raw_field.empty() && value.is_object()) {
+        auto raw = value.find(raw_field);
+        if (raw != value.end() && raw->is_binary()) {
+            // Set aside while the other fields are converted, then put back as is
+            json bytes = std::move(*raw);
+            value.erase(raw);
+            fromBinary(value);
+            value[raw_field] = std::move(bytes);
+            return value;
+        }
+    }
+    fromBinary(value);
+    return value;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include "../vendor/json.hpp"
+
+// Định dạng body của API: JSON (mặc định), CBOR hoặc MessagePack.
+// Chọn theo Content-Type (request) và Accept (response).
+// Code hai phía vẫn làm việc với nlohmann::json như JSON; chỉ ở biên (encode/decode):
+//   - CBOR/MessagePack: các trường base64 (ciphertext, wrapped key, IV) và hex (public key, salt)
+//     đi dưới dạng byte string thô
+//   - decode đổi byte string về lại base64/hex như khi nhận JSON
+class WireFormat {
+public:
+    enum class Format { Json, Cbor, MsgPack };
+
+    // Content-Type của request; không có hoặc không biết -> Json
+    static Format fromContentType(const std::string& content_type);
+    // Accept: định dạng hỗ trợ đầu tiên trong danh sách, mặc định Json
+    static Format fromAccept(const std::string& accept);
+    // "json", "cbor", "msgpack" (cấu hình client); false nếu tên lạ
+    static bool fromName(const std::string& name, Format& format);
+    static const char* contentType(Format format);
+
+    static std::string encode(const nlohmann::json& value, Format format);
+    // Ném exception nếu body không hợp lệ (như json::parse)
+    static nlohmann::json decode(const std::string& body, Format format);
+    // Như trên nhưng trường `raw_field` ở cấp ngoài cùng giữ nguyên byte string (json::binary),
+    // để server nhận ciphertext thô mà không đổi qua base64 rồi decode lại
+    static nlohmann::json decode(const std::string& body, Format format, const std::string& raw_field);
+};
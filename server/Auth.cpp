@@ -9,6 +9,11 @@ static const std::string SERVER_SECRET = "SecureNoteApp_ServerSecret_2024";
 // Token time-to-live: 30 minutes
 static const long long TOKEN_TTL_SECONDS = 1800;
 
+// Verified tokens keyed by the whole token: std::hash of it picks the shard and
+// bucket, and the map still compares full keys, so a token whose digest collides
+// with a cached one is verified like any other instead of borrowing its payload
+static LruCache<std::string, TokenPayload> verifiedTokens(Auth::TOKEN_CACHE_CAPACITY);
+
 std::string Auth::generateToken(int user_id, std::string username) {
     // Token format: base64(user_id:username:exp).signature
     // where signature = SHA256(secret + base_part)
@@ -80,6 +85,30 @@ TokenPayload Auth::verifyToken(std::string token) {
     return payload;
 }
 
+TokenPayload Auth::verifyTokenCached(const std::string& token) {
+    TokenPayload payload{-1, "", false, -1};
+    if (verifiedTokens.get(token, payload)) {
+        if (payload.exp > static_cast<long long>(std::time(nullptr))) {
+            return payload;
+        }
+        // Expired since it was cached
+        verifiedTokens.invalidate(token);
+        payload.valid = false;
+        return payload;
+    }
+
+    uint64_t generation = verifiedTokens.generation(token);
+    payload = verifyToken(token);
+    if (payload.valid) {
+        verifiedTokens.put(token, payload, generation);
+    }
+    return payload;
+}
+
+CacheStats Auth::tokenCacheStats() {
+    return verifiedTokens.stats();
+}
+
 std::string Auth::extractToken(const std::string& authHeader) {
     // Handle "Bearer <token>" format
     const std::string prefix = "Bearer ";
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include "LruCache.h"
 
 struct TokenPayload {
     int user_id;
@@ -16,6 +17,15 @@ public:
     // Verify token and extract payload. Returns valid=false if invalid.
     static TokenPayload verifyToken(std::string token);
     
+    // Most verified tokens verifyTokenCached keeps
+    static const size_t TOKEN_CACHE_CAPACITY = 10000;
+
+    // verifyToken behind a sharded LRU of recently verified tokens: a token seen
+    // before costs a hash lookup instead of base64 + SHA-256. Entries past their
+    // exp are rejected and dropped; invalid tokens are never cached.
+    static TokenPayload verifyTokenCached(const std::string& token);
+    static CacheStats tokenCacheStats();
+    
     // Helper to extract token from Authorization header (handles "Bearer " prefix)
     static std::string extractToken(const std::string& authHeader);
 };
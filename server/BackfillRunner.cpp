@@ -0,0 +1,83 @@
+#include "BackfillRunner.h"
+#include <iostream>
+
+namespace {
+// A failed batch (e.g. the write lock stayed busy) is retried after this long
+const int RETRY_SECONDS = 5;
+}
+
+BackfillRunner::BackfillRunner(Storage& db, int batch_size, int pause_ms)
+    : db(db), batchSize(batch_size), pauseMs(pause_ms) {
+}
+
+BackfillRunner::~BackfillRunner() {
+    stop();
+}
+
+void BackfillRunner::start() {
+    if (!worker.joinable()) {
+        started = std::chrono::steady_clock::now();
+        running = true;
+        worker = std::thread(&BackfillRunner::run, this);
+    }
+}
+
+void BackfillRunner::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void BackfillRunner::run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stopping) {
+        lock.unlock();
+        int result = backfillOnce();
+        lock.lock();
+
+        if (result == 0) {
+            break;
+        }
+        auto pause = result < 0 ? std::chrono::milliseconds(RETRY_SECONDS * 1000) : std::chrono::milliseconds(pauseMs);
+        wake.wait_for(lock, pause, [this] { return stopping; });
+    }
+    elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    running = false;
+}
+
+int BackfillRunner::backfillOnce() {
+    auto start = std::chrono::steady_clock::now();
+    int result = db.backfillStep(batchSize);
+    lastBatchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (result < 0) {
+        errors++;
+        std::cerr << "Backfill batch failed, retrying in " << RETRY_SECONDS << " s" << std::endl;
+    } else if (result > 0) {
+        batches++;
+        rows += result;
+    } else if (!finished.exchange(true) && batches > 0) {
+        std::cout << "Backfill finished: " << rows << " rows in " << batches << " batches" << std::endl;
+    }
+    return result;
+}
+
+BackfillRunner::Stats BackfillRunner::stats() const {
+    Stats s;
+    s.running = running;
+    s.finished = finished;
+    s.batches = batches;
+    s.rows = rows;
+    s.errors = errors;
+    s.last_batch_ms = lastBatchMs;
+    s.elapsed_ms = running ? std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count()
+                           : elapsedMs.load();
+    s.batch_size = batchSize;
+    s.pause_ms = pauseMs;
+    return s;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "Storage.h"
+
+// Finishes the row rewrites a schema migration left for after startup
+// (Storage::backfillStep) on a background thread: one short transaction of
+// batch_size rows, then a pause so requests get the write lock in between.
+// The thread ends once nothing is left; the position is kept in the database,
+// so a restart continues with the next batch.
+class BackfillRunner {
+public:
+    // Counters for GET /metrics
+    struct Stats {
+        bool running;
+        bool finished;
+        long long batches;
+        long long rows;
+        long long errors;
+        double last_batch_ms;
+        double elapsed_ms;      // Since start(), up to the end once finished
+        int batch_size;
+        int pause_ms;
+    };
+
+    BackfillRunner(Storage& db, int batch_size, int pause_ms);
+    ~BackfillRunner();
+    BackfillRunner(const BackfillRunner&) = delete;
+    BackfillRunner& operator=(const BackfillRunner&) = delete;
+
+    void start();
+    void stop();
+
+    // One batch on the calling thread; same result as Storage::backfillStep
+    int backfillOnce();
+
+    Stats stats() const;
+
+private:
+    void run();
+
+    Storage& db;
+    const int batchSize;
+    const int pauseMs;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::chrono::steady_clock::time_point started;
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> finished{false};
+    std::atomic<long long> batches{0};
+    std::atomic<long long> rows{0};
+    std::atomic<long long> errors{0};
+    std::atomic<double> lastBatchMs{0};
+    std::atomic<double> elapsedMs{0};
+};
@@ -0,0 +1,100 @@
+#include "BackupRunner.h"
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+
+BackupRunner::BackupRunner(Storage& db, const std::string& directory, int pages_per_step, int pause_ms)
+    : db(db), directory(directory), pagesPerStep(pages_per_step), pauseMs(pause_ms) {
+}
+
+BackupRunner::~BackupRunner() {
+    wait();
+}
+
+std::string BackupRunner::nextDestination() const {
+    std::time_t now = std::time(nullptr);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+    return (std::filesystem::path(directory) / ("secure_notes-" + std::string(stamp) + ".db")).string();
+}
+
+bool BackupRunner::start(std::string& destination) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (running) {
+        return false;
+    }
+    // The previous backup has finished, only its thread is left to collect
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    destination = nextDestination();
+    running = true;
+    worker = std::thread([this, destination] {
+        backupOnce(destination);
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    });
+    return true;
+}
+
+void BackupRunner::wait() {
+    std::thread finished;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        finished.swap(worker);
+    }
+    if (finished.joinable()) {
+        finished.join();
+    }
+}
+
+bool BackupRunner::backupOnce(const std::string& destination) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(destination).parent_path(), ec);
+
+    pagesCopied = 0;
+    pagesTotal = 0;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = db.backup(destination, pagesPerStep, pauseMs, [this](long long copied, long long total) {
+        pagesCopied = copied;
+        pagesTotal = total;
+    });
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    lastDurationMs = ms;
+    lastFinishedAt = static_cast<long>(std::time(nullptr));
+    if (!ok) {
+        failed++;
+        std::cerr << "Backup to " << destination << " failed after " << ms << " ms" << std::endl;
+        return false;
+    }
+
+    completed++;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        lastDestination = destination;
+    }
+    std::cout << "Backup written to " << destination << " (" << pagesTotal.load() << " pages in "
+              << ms << " ms)" << std::endl;
+    return true;
+}
+
+BackupRunner::Stats BackupRunner::stats() const {
+    Stats s;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        s.running = running;
+        s.last_destination = lastDestination;
+    }
+    s.backups_completed = completed;
+    s.backups_failed = failed;
+    s.pages_copied = pagesCopied;
+    s.pages_total = pagesTotal;
+    s.last_duration_ms = lastDurationMs;
+    s.last_finished_at = lastFinishedAt;
+    s.pages_per_step = pagesPerStep;
+    s.pause_ms = pauseMs;
+    return s;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "Storage.h"
+
+// Takes online snapshots of the storage (Storage::backup) on a background
+// thread, one at a time, on request (POST /admin/backup). The copy advances a
+// few pages per step with a pause in between, so uploads and share accesses
+// keep their latency while it runs; writers are never blocked.
+class BackupRunner {
+public:
+    // Counters for GET /metrics
+    struct Stats {
+        bool running;
+        long long backups_completed;
+        long long backups_failed;
+        long long pages_copied;        // Of the running backup, or the last one
+        long long pages_total;
+        double last_duration_ms;
+        long last_finished_at;         // Unix time, 0 before the first backup
+        std::string last_destination;  // Last successful backup
+        int pages_per_step;
+        int pause_ms;
+    };
+
+    // Snapshots go to <directory>/secure_notes-YYYYMMDD-HHMMSS.db
+    BackupRunner(Storage& db, const std::string& directory, int pages_per_step, int pause_ms);
+    // Waits for a running backup
+    ~BackupRunner();
+    BackupRunner(const BackupRunner&) = delete;
+    BackupRunner& operator=(const BackupRunner&) = delete;
+
+    // Starts a backup in the background; false (and nothing started) if one is already running
+    bool start(std::string& destination);
+    // Blocks until the running backup, if any, has finished
+    void wait();
+
+    // One backup on the calling thread
+    bool backupOnce(const std::string& destination);
+
+    Stats stats() const;
+
+private:
+    std::string nextDestination() const;
+
+    Storage& db;
+    const std::string directory;
+    const int pagesPerStep;
+    const int pauseMs;
+
+    mutable std::mutex mtx;        // Guards worker, running and lastDestination
+    std::thread worker;
+    bool running = false;
+    std::string lastDestination;
+
+    std::atomic<long long> completed{0};
+    std::atomic<long long> failed{0};
+    std::atomic<long long> pagesCopied{0};
+    std::atomic<long long> pagesTotal{0};
+    std::atomic<double> lastDurationMs{0};
+    std::atomic<long> lastFinishedAt{0};
+};
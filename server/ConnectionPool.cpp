@@ -0,0 +1,148 @@
+#include "ConnectionPool.h"
+#include <iostream>
+
+ConnectionPool::ConnectionPool(const std::string& path, size_t size, int busy_timeout_ms,
+                               const SqliteTuning& tuning) {
+    if (size == 0) {
+        size = 1;
+    }
+
+    const int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+
+    for (size_t i = 0; i < size; i++) {
+        auto conn = std::make_unique<Connection>();
+        if (sqlite3_open_v2(path.c_str(), &conn->handle, flags, nullptr) != SQLITE_OK) {
+            std::cerr << "Cannot open database: " << sqlite3_errmsg(conn->handle) << std::endl;
+            sqlite3_close(conn->handle);
+            opened = false;
+            break;
+        }
+
+        sqlite3_busy_timeout(conn->handle, busy_timeout_ms);
+
+        // WAL: readers never block the writer and the writer never blocks readers.
+        // synchronous=NORMAL (the default) is durable across application crashes in
+        // WAL mode and only syncs the WAL on checkpoint instead of on every commit.
+        // foreign_keys is per connection and off by default; the schema relies on it
+        // to cascade note and link deletes.
+        char* errMsg = nullptr;
+        std::string pragmas = "PRAGMA journal_mode=WAL; PRAGMA synchronous=" + tuning.synchronous +
+                              "; PRAGMA foreign_keys=ON; PRAGMA cache_size=-" + std::to_string(tuning.cache_kb) +
+                              "; PRAGMA mmap_size=" + std::to_string(tuning.mmap_bytes) + ";";
+        if (sqlite3_exec(conn->handle, pragmas.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+            std::cerr << "Failed to configure connection: " << errMsg << std::endl;
+            sqlite3_free(errMsg);
+        }
+
+        idle.push_back(conn.get());
+        connections.push_back(std::move(conn));
+    }
+}
+
+ConnectionPool::~ConnectionPool() {
+    for (auto& conn : connections) {
+        for (sqlite3_stmt* stmt : conn->statements) {
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(conn->handle);
+    }
+}
+
+ConnectionPool::Lease ConnectionPool::acquire() {
+    std::unique_lock<std::mutex> lock(mtx);
+    available.wait(lock, [this] { return !idle.empty(); });
+
+    Connection* conn = idle.back();
+    idle.pop_back();
+    return Lease(this, conn);
+}
+
+void ConnectionPool::release(Connection* conn) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        idle.push_back(conn);
+    }
+    available.notify_one();
+}
+
+CachedStatement::CachedStatement(Connection& conn, Stmt id) {
+    sqlite3_stmt*& slot = conn.statements[static_cast<size_t>(id)];
+    if (!slot) {
+        if (sqlite3_prepare_v3(conn.handle, statementSql(id), -1, SQLITE_PREPARE_PERSISTENT, &slot, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed to prepare " << statementName(id) << ": " << sqlite3_errmsg(conn.handle) << std::endl;
+            slot = nullptr;
+        }
+    }
+    stmt = slot;
+}
+
+CachedStatement::~CachedStatement() {
+    if (stmt) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+}
+
+Transaction::Transaction(Connection& conn) : conn(conn) {
+    // IMMEDIATE takes the write lock up front, so a busy database is waited
+    // out by the busy timeout here instead of failing halfway through
+    CachedStatement begin(conn, Stmt::BeginImmediate);
+    active = begin && sqlite3_step(begin) == SQLITE_DONE;
+    if (!active) {
+        std::cerr << "Failed to begin transaction: " << sqlite3_errmsg(conn.handle) << std::endl;
+    }
+}
+
+Transaction::~Transaction() {
+    if (active) {
+        CachedStatement rollback(conn, Stmt::Rollback);
+        if (rollback) {
+            sqlite3_step(rollback);
+        }
+    }
+}
+
+Savepoint::Savepoint(Connection& conn) : conn(conn) {
+    CachedStatement begin(conn, Stmt::Savepoint);
+    active = begin && sqlite3_step(begin) == SQLITE_DONE;
+    if (!active) {
+        std::cerr << "Failed to open savepoint: " << sqlite3_errmsg(conn.handle) << std::endl;
+    }
+}
+
+Savepoint::~Savepoint() {
+    if (active) {
+        // ROLLBACK TO keeps the savepoint open; RELEASE then closes it
+        CachedStatement rollback(conn, Stmt::RollbackToSavepoint);
+        if (rollback) {
+            sqlite3_step(rollback);
+        }
+        release();
+    }
+}
+
+bool Savepoint::release() {
+    if (!active) {
+        return false;
+    }
+    CachedStatement releaseStmt(conn, Stmt::ReleaseSavepoint);
+    if (!releaseStmt || sqlite3_step(releaseStmt) != SQLITE_DONE) {
+        std::cerr << "Failed to release savepoint: " << sqlite3_errmsg(conn.handle) << std::endl;
+        return false;
+    }
+    active = false;
+    return true;
+}
+
+bool Transaction::commit() {
+    if (!active) {
+        return false;
+    }
+    CachedStatement commitStmt(conn, Stmt::Commit);
+    if (!commitStmt || sqlite3_step(commitStmt) != SQLITE_DONE) {
+        std::cerr << "Failed to commit transaction: " << sqlite3_errmsg(conn.handle) << std::endl;
+        return false;
+    }
+    active = false;
+    return true;
+}
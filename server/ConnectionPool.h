@@ -0,0 +1,118 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <sqlite3.h>
+#include "Statements.h"
+
+// One open SQLite connection. A connection is only ever used by the thread
+// that currently holds its lease, so it is opened with SQLITE_OPEN_NOMUTEX.
+struct Connection {
+    sqlite3* handle = nullptr;
+    sqlite3_stmt* statements[STATEMENT_COUNT] = {}; // Compiled lazily, see CachedStatement
+};
+
+// A registered statement borrowed from a connection's cache. It is compiled
+// on first use and reset (releasing its read snapshot) and unbound again when
+// the handle goes out of scope, ready for the next borrower.
+class CachedStatement {
+public:
+    CachedStatement(Connection& conn, Stmt id);
+    ~CachedStatement();
+    CachedStatement(const CachedStatement&) = delete;
+    CachedStatement& operator=(const CachedStatement&) = delete;
+
+    // Converts implicitly so the sqlite3_bind_* / sqlite3_column_* calls read as usual
+    operator sqlite3_stmt*() const { return stmt; }
+
+private:
+    sqlite3_stmt* stmt;
+};
+
+// Write transaction on a leased connection. Rolls back when it goes out of
+// scope without commit(), so early returns leave the database untouched.
+class Transaction {
+public:
+    explicit Transaction(Connection& conn);
+    ~Transaction();
+    Transaction(const Transaction&) = delete;
+    Transaction& operator=(const Transaction&) = delete;
+
+    // False when BEGIN failed; nothing should be written then
+    explicit operator bool() const { return active; }
+    bool commit();
+
+private:
+    Connection& conn;
+    bool active;
+};
+
+// Nested scope inside a Transaction. Rolls back to where it started when it goes
+// out of scope without release(), so one failed step of a batch does not leave
+// half its rows behind while the rest of the transaction still commits.
+class Savepoint {
+public:
+    explicit Savepoint(Connection& conn);
+    ~Savepoint();
+    Savepoint(const Savepoint&) = delete;
+    Savepoint& operator=(const Savepoint&) = delete;
+
+    explicit operator bool() const { return active; }
+    bool release();
+
+private:
+    Connection& conn;
+    bool active;
+};
+
+// Per-connection SQLite settings (server config sqlite_*)
+struct SqliteTuning {
+    int cache_kb = 2000;                 // PRAGMA cache_size, per connection
+    long long mmap_bytes = 0;            // PRAGMA mmap_size; 0 reads through the page cache only
+    std::string synchronous = "NORMAL";  // OFF, NORMAL, FULL or EXTRA
+};
+
+// Fixed-size checkout/return pool of SQLite connections opened in WAL mode.
+// WAL lets readers run concurrently with the single writer, and the busy
+// timeout makes competing writers wait instead of failing with SQLITE_BUSY.
+class ConnectionPool {
+public:
+    // RAII handle: returns the connection to the pool when it goes out of scope
+    class Lease {
+    public:
+        Lease(ConnectionPool* pool, Connection* conn) : pool(pool), conn(conn) {}
+        Lease(Lease&& other) noexcept : pool(other.pool), conn(other.conn) { other.conn = nullptr; }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease() { if (conn) pool->release(conn); }
+
+        Connection* operator->() const { return conn; }
+        Connection& operator*() const { return *conn; }
+
+    private:
+        ConnectionPool* pool;
+        Connection* conn;
+    };
+
+    ConnectionPool(const std::string& path, size_t size, int busy_timeout_ms,
+                   const SqliteTuning& tuning = SqliteTuning());
+    ~ConnectionPool();
+
+    // Blocks until a connection is free
+    Lease acquire();
+
+    size_t size() const { return connections.size(); }
+    bool isOpen() const { return opened; }
+
+private:
+    void release(Connection* conn);
+
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::vector<Connection*> idle;
+    std::mutex mtx;
+    std::condition_variable available;
+    bool opened = true;
+};
@@ -0,0 +1,82 @@
+#include "ContentCompactor.h"
+#include <iostream>
+
+ContentCompactor::ContentCompactor(Storage& db, int interval_seconds, double min_dead_ratio)
+    : db(db), intervalSeconds(interval_seconds), minDeadRatio(min_dead_ratio) {
+}
+
+ContentCompactor::~ContentCompactor() {
+    stop();
+}
+
+void ContentCompactor::start() {
+    if (!worker.joinable()) {
+        worker = std::thread(&ContentCompactor::run, this);
+    }
+}
+
+void ContentCompactor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void ContentCompactor::run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stopping) {
+        // Nothing to compact right after startup, so the first pass waits an interval
+        wake.wait_for(lock, std::chrono::seconds(intervalSeconds), [this] { return stopping; });
+        if (stopping) {
+            break;
+        }
+        lock.unlock();
+        compactOnce();
+        lock.lock();
+    }
+}
+
+ContentStore::Compaction ContentCompactor::compactOnce() {
+    auto start = std::chrono::steady_clock::now();
+    ContentStore::Compaction result = db.compactContent(minDeadRatio);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    ContentStore::Usage usage = db.contentUsage();
+
+    segmentsCompacted += result.segments_compacted;
+    segmentsRemoved += result.segments_removed;
+    bytesMoved += result.bytes_moved;
+    bytesReclaimed += result.bytes_reclaimed;
+    lastPassMs = ms;
+    segments = usage.segments;
+    fileBytes = usage.file_bytes;
+    liveBytes = usage.live_bytes;
+    passes++;
+
+    if (result.segments_compacted + result.segments_removed > 0) {
+        std::cout << "Content compaction: " << result.segments_compacted << " segments compacted ("
+                  << result.bytes_moved << " bytes moved), " << result.segments_removed << " removed ("
+                  << result.bytes_reclaimed << " bytes) in " << ms << " ms" << std::endl;
+    }
+    return result;
+}
+
+ContentCompactor::Stats ContentCompactor::stats() const {
+    Stats s;
+    s.passes = passes;
+    s.segments_compacted = segmentsCompacted;
+    s.segments_removed = segmentsRemoved;
+    s.bytes_moved = bytesMoved;
+    s.bytes_reclaimed = bytesReclaimed;
+    s.last_pass_ms = lastPassMs;
+    s.segments = segments;
+    s.file_bytes = fileBytes;
+    s.live_bytes = liveBytes;
+    s.min_dead_ratio = minDeadRatio;
+    s.interval_seconds = intervalSeconds;
+    return s;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "Storage.h"
+
+// Background thread that gives the space of deleted notes back from the
+// segment files (Database::compactContent). A segment whose share of dead
+// bytes reaches min_dead_ratio has its live notes copied to the active
+// segment and is deleted one pass later. Does nothing with SqliteContentStore
+// or MemoryStorage.
+class ContentCompactor {
+public:
+    // Counters for GET /metrics
+    struct Stats {
+        long long passes;
+        long long segments_compacted;
+        long long segments_removed;
+        long long bytes_moved;
+        long long bytes_reclaimed;
+        double last_pass_ms;
+        int segments;               // As of the last pass
+        long long file_bytes;
+        long long live_bytes;
+        double min_dead_ratio;
+        int interval_seconds;
+    };
+
+    ContentCompactor(Storage& db, int interval_seconds, double min_dead_ratio);
+    ~ContentCompactor();
+    ContentCompactor(const ContentCompactor&) = delete;
+    ContentCompactor& operator=(const ContentCompactor&) = delete;
+
+    void start();
+    void stop();
+
+    // One pass on the calling thread
+    ContentStore::Compaction compactOnce();
+
+    Stats stats() const;
+
+private:
+    void run();
+
+    Storage& db;
+    const int intervalSeconds;
+    const double minDeadRatio;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::atomic<long long> passes{0};
+    std::atomic<long long> segmentsCompacted{0};
+    std::atomic<long long> segmentsRemoved{0};
+    std::atomic<long long> bytesMoved{0};
+    std::atomic<long long> bytesReclaimed{0};
+    std::atomic<double> lastPassMs{0};
+    std::atomic<int> segments{0};
+    std::atomic<long long> fileBytes{0};
+    std::atomic<long long> liveBytes{0};
+};
@@ -0,0 +1,112 @@
+#include "ContentStore.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include "../common/Crypto.h"
+
+ContentStore::ChunkSource ContentStore::base64Source(const std::string& encoded) {
+    return [&encoded, pos = size_t(0)](std::vector<unsigned char>& chunk) mutable {
+        std::string slice = encoded.substr(pos, CHUNK_BASE64);
+        pos += slice.size();
+        chunk = Crypto::base64Decode(slice);
+        return static_cast<long long>(chunk.size()) == Crypto::base64DecodedSize(slice);
+    };
+}
+
+ContentStore::ChunkSource ContentStore::bytesSource(const std::string& bytes) {
+    return [&bytes, pos = size_t(0)](std::vector<unsigned char>& chunk) mutable {
+        size_t length = std::min(bytes.size() - pos, static_cast<size_t>(CHUNK_BYTES));
+        chunk.assign(bytes.begin() + pos, bytes.begin() + pos + length);
+        pos += length;
+        return true;
+    };
+}
+
+bool SqliteContentStore::writeChunks(Connection& conn, sqlite3_int64 note_id, long long size, const ChunkSource& next) {
+    if (size == 0) {
+        return true;
+    }
+
+    sqlite3_blob* blob;
+    if (sqlite3_blob_open(conn.handle, "main", "NoteContents", "encrypted_content", note_id, 1, &blob) != SQLITE_OK) {
+        std::cerr << "Failed to open content blob: " << sqlite3_errmsg(conn.handle) << std::endl;
+        sqlite3_blob_close(blob);
+        return false;
+    }
+
+    // Each chunk goes straight into the zeroblob reserved for it
+    bool ok = true;
+    long long offset = 0;
+    std::vector<unsigned char> chunk;
+    while (ok && offset < size) {
+        ok = next(chunk) && !chunk.empty() && offset + static_cast<long long>(chunk.size()) <= size &&
+             sqlite3_blob_write(blob, chunk.data(), static_cast<int>(chunk.size()), static_cast<int>(offset)) == SQLITE_OK;
+        offset += static_cast<long long>(chunk.size());
+    }
+
+    sqlite3_blob_close(blob);
+    return ok;
+}
+
+bool SqliteContentStore::read(Connection& conn, sqlite3_int64 note_id, std::string& encoded) {
+    sqlite3_blob* blob;
+    if (sqlite3_blob_open(conn.handle, "main", "NoteContents", "encrypted_content", note_id, 0, &blob) != SQLITE_OK) {
+        std::cerr << "Failed to open content blob: " << sqlite3_errmsg(conn.handle) << std::endl;
+        sqlite3_blob_close(blob);
+        return false;
+    }
+
+    // The output is sized once up front, then filled chunk by chunk
+    int size = sqlite3_blob_bytes(blob);
+    encoded.clear();
+    encoded.reserve((static_cast<size_t>(size) + 2) / 3 * 4);
+
+    bool ok = true;
+    std::vector<unsigned char> chunk;
+    for (int offset = 0; ok && offset < size; offset += CHUNK_BYTES) {
+        chunk.resize(std::min(CHUNK_BYTES, size - offset));
+        ok = sqlite3_blob_read(blob, chunk.data(), static_cast<int>(chunk.size()), offset) == SQLITE_OK;
+        encoded += Crypto::base64Encode(chunk);
+    }
+
+    sqlite3_blob_close(blob);
+    return ok;
+}
+
+bool ContentStore::resolveRange(const ByteRange& range, long long total, long long& first, long long& length) {
+    if (range.offset < 0) {
+        length = std::min(-range.offset, total);
+        first = total - length;
+    } else {
+        first = range.offset;
+        length = range.length < 0 ? total - first : std::min(range.length, total - first);
+    }
+    // The whole of an empty note is fine; any other empty range is not
+    return (first < total && length > 0) || (range.offset == 0 && range.length < 0);
+}
+
+bool SqliteContentStore::readRange(Connection& conn, sqlite3_int64 note_id, const ByteRange& range, RangeData& data) {
+    sqlite3_blob* blob;
+    if (sqlite3_blob_open(conn.handle, "main", "NoteContents", "encrypted_content", note_id, 0, &blob) != SQLITE_OK) {
+        std::cerr << "Failed to open content blob: " << sqlite3_errmsg(conn.handle) << std::endl;
+        sqlite3_blob_close(blob);
+        return false;
+    }
+
+    data.total_size = sqlite3_blob_bytes(blob);
+    data.offset = -1;
+    data.bytes.clear();
+
+    long long first;
+    long long length;
+    bool ok = true;
+    if (resolveRange(range, data.total_size, first, length)) {
+        data.offset = first;
+        data.bytes.resize(static_cast<size_t>(length));
+        ok = length == 0 ||
+             sqlite3_blob_read(blob, &data.bytes[0], static_cast<int>(length), static_cast<int>(first)) == SQLITE_OK;
+    }
+
+    sqlite3_blob_close(blob);
+    return ok;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "ConnectionPool.h"
+
+// Where the ciphertext of a note is kept. Database stores the metadata, the
+// wrapped key and the IV itself and hands the ciphertext to one of these,
+// always on the connection (and inside the transaction) of the calling
+// operation. Ciphertext goes in as raw bytes pulled chunk by chunk (or as
+// base64, decoded the same way) and comes out as base64, the wire format.
+class ContentStore {
+public:
+    // Fills `chunk` with the next bytes of a ciphertext; false on a read or decode error
+    using ChunkSource = std::function<bool(std::vector<unsigned char>& chunk)>;
+
+    // Ciphertext is moved in chunks of this many bytes (a multiple of 3, so
+    // every chunk encodes to whole base64 quads)
+    static constexpr int CHUNK_BYTES = 48 * 1024;
+    static constexpr size_t CHUNK_BASE64 = CHUNK_BYTES / 3 * 4;
+
+    // Result of one compaction pass
+    struct Compaction {
+        int segments_compacted = 0;     // Live notes copied out, file queued for removal
+        int segments_removed = 0;       // Files deleted
+        long long bytes_moved = 0;
+        long long bytes_reclaimed = 0;  // Size of the deleted files
+    };
+
+    // Space accounting for GET /metrics
+    struct Usage {
+        int segments = 0;
+        long long file_bytes = 0;
+        long long live_bytes = 0;
+    };
+
+    virtual ~ContentStore() = default;
+
+    // Called once from Database::init, after the schema exists
+    virtual bool open() { return true; }
+
+    // Bytes to reserve in NoteContents.encrypted_content for a new note of
+    // `size` decoded bytes; the row is inserted with a zeroblob of that size
+    // before write() is called
+    virtual long long inlineBytes(long long size) const = 0;
+
+    // Stores the ciphertext of a note whose NoteContents row was just inserted,
+    // pulling exactly `size` bytes from `next`; fails if the source ends early or overruns
+    virtual bool writeChunks(Connection& conn, sqlite3_int64 note_id, long long size, const ChunkSource& next) = 0;
+
+    // Source decoding `encoded` (base64) slice by slice; `encoded` must outlive it
+    static ChunkSource base64Source(const std::string& encoded);
+    // Source slicing raw ciphertext `bytes` into CHUNK_BYTES pieces; `bytes` must outlive it
+    static ChunkSource bytesSource(const std::string& bytes);
+
+    // Base64 ciphertext of a note
+    virtual bool read(Connection& conn, sqlite3_int64 note_id, std::string& encoded) = 0;
+
+    // Part of a note's raw ciphertext, like an HTTP byte range: `length` bytes
+    // from `offset` (length -1 = to the end), or the last -offset bytes when
+    // offset is negative. The default is the whole note.
+    struct ByteRange {
+        long long offset = 0;
+        long long length = -1;
+    };
+    struct RangeData {
+        long long total_size = 0;  // Size of the whole ciphertext
+        long long offset = -1;     // First byte returned; -1 if the range lies past the end
+        std::string bytes;         // Raw, not base64
+    };
+    // Reads only the bytes of `range`. An unsatisfiable range is not an error:
+    // the call succeeds with data.offset = -1 and no bytes.
+    virtual bool readRange(Connection& conn, sqlite3_int64 note_id, const ByteRange& range, RangeData& data) = 0;
+
+    // Clips `range` to a ciphertext of `total` bytes; false if nothing of it is inside
+    static bool resolveRange(const ByteRange& range, long long total, long long& first, long long& length);
+
+    // Makes everything written so far durable. Called before the transaction
+    // that references it commits.
+    virtual bool sync() { return true; }
+
+    // Called once the transaction that wrote through `conn` has committed or
+    // rolled back; whatever writeChunks set aside for it is settled either way
+    virtual void transactionEnded(Connection&) {}
+
+    // Reclaims space held by deleted notes (segment files only)
+    virtual Compaction compact(Connection&, double) { return Compaction(); }
+    virtual Usage usage(Connection&) { return Usage(); }
+
+    // Copies into `destination` (a directory) everything a database snapshot
+    // taken before the call can reference. Nothing to do when all ciphertext is
+    // inside SQLite.
+    virtual bool snapshot(const std::string&) { return true; }
+};
+
+// Ciphertext inside NoteContents.encrypted_content, moved chunk by chunk with
+// SQLite's incremental blob I/O so no decoded copy of a whole note is built
+class SqliteContentStore : public ContentStore {
+public:
+    long long inlineBytes(long long size) const override { return size; }
+    bool writeChunks(Connection& conn, sqlite3_int64 note_id, long long size, const ChunkSource& next) override;
+    bool read(Connection& conn, sqlite3_int64 note_id, std::string& encoded) override;
+    bool readRange(Connection& conn, sqlite3_int64 note_id, const ByteRange& range, RangeData& data) override;
+};
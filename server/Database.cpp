@@ -1,109 +1,716 @@
 #include "Database.h"
 #include <iostream>
 #include <ctime>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <functional>
 #include "../common/Crypto.h"
 
-Database::Database() {
-    if (sqlite3_open("secure_notes.db", &db)) {
-        std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
+namespace {
+
+// Schema version stored in PRAGMA user_version
+//   0: original schema
+//   1: deleting a note cascades to its links and user shares, deleting a link to its access rows
+//   2: ciphertext stored as a raw BLOB instead of base64 TEXT (older rows decoded in the background)
+//   3: ciphertext, wrapped key and IV moved out of Notes into NoteContents
+//   4: ContentSegments indexes ciphertext kept in segment files
+//   5: LinkRoutes and Settings for the directory of a sharded deployment
+//   6: share link tokens stored as 32-byte BLOBs instead of 64 hex characters
+const int SCHEMA_VERSION = 6;
+
+const char* SQL_USERS = R"(
+    CREATE TABLE IF NOT EXISTS Users (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        username TEXT UNIQUE NOT NULL,
+        password_hash TEXT NOT NULL,
+        salt TEXT NOT NULL,
+        receive_public_key_hex TEXT NOT NULL
+    );
+)";
+
+// Notes only holds the small metadata that listings, ownership checks and share
+// joins read, so dozens of rows fit on a page. Everything needed only to download
+// a note lives in NoteContents, one row per note under the same id; the
+// ciphertext is the last column so wrapped_key and iv_hex stay on the row's first page.
+const char* SQL_NOTES = R"(
+    CREATE TABLE IF NOT EXISTS Notes (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        user_id INTEGER NOT NULL,
+        filename TEXT NOT NULL DEFAULT 'note.txt',
+        created_at INTEGER NOT NULL,
+        FOREIGN KEY (user_id) REFERENCES Users(id)
+    );
+)";
+
+const char* SQL_NOTE_CONTENTS = R"(
+    CREATE TABLE IF NOT EXISTS NoteContents (
+        note_id INTEGER PRIMARY KEY,
+        wrapped_key TEXT NOT NULL,
+        iv_hex TEXT NOT NULL,
+        encrypted_content BLOB NOT NULL,
+        FOREIGN KEY (note_id) REFERENCES Notes(id) ON DELETE CASCADE
+    );
+)";
+
+// Location of ciphertext that SegmentContentStore keeps outside the database
+// (the note's NoteContents.encrypted_content is then empty)
+const char* SQL_CONTENT_SEGMENTS = R"(
+    CREATE TABLE IF NOT EXISTS ContentSegments (
+        note_id INTEGER PRIMARY KEY,
+        segment_id INTEGER NOT NULL,
+        segment_offset INTEGER NOT NULL,
+        length INTEGER NOT NULL,
+        FOREIGN KEY (note_id) REFERENCES Notes(id) ON DELETE CASCADE
+    );
+)";
+
+// Only used in the directory database of a sharded deployment (ShardedStorage):
+// which shard holds the link behind a token, and the layout the shards were
+// created with. Empty everywhere else.
+const char* SQL_LINK_ROUTES = R"(
+    CREATE TABLE IF NOT EXISTS LinkRoutes (
+        token BLOB PRIMARY KEY,
+        shard INTEGER NOT NULL,
+        expiration_time INTEGER NOT NULL
+    );
+)";
+
+const char* SQL_SETTINGS = R"(
+    CREATE TABLE IF NOT EXISTS Settings (
+        name TEXT PRIMARY KEY,
+        value TEXT NOT NULL
+    );
+)";
+
+const char* SQL_SHARED_LINKS = R"(
+    CREATE TABLE IF NOT EXISTS SharedLinks (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        token BLOB UNIQUE NOT NULL,
+        note_id INTEGER NOT NULL,
+        owner_id INTEGER NOT NULL,
+        expiration_time INTEGER NOT NULL,
+        FOREIGN KEY (note_id) REFERENCES Notes(id) ON DELETE CASCADE,
+        FOREIGN KEY (owner_id) REFERENCES Users(id)
+    );
+)";
+
+const char* SQL_SHARED_LINK_ACCESS = R"(
+    CREATE TABLE IF NOT EXISTS SharedLinkAccess (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        link_id INTEGER NOT NULL,
+        username TEXT NOT NULL,
+        send_public_key_hex TEXT NOT NULL,
+        wrapped_key TEXT NOT NULL,
+        FOREIGN KEY (link_id) REFERENCES SharedLinks(id) ON DELETE CASCADE
+    );
+)";
+
+const char* SQL_USER_SHARES = R"(
+    CREATE TABLE IF NOT EXISTS UserShares (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        note_id INTEGER NOT NULL,
+        sender_id INTEGER NOT NULL,
+        recipient_id INTEGER NOT NULL,
+        send_public_key_hex TEXT NOT NULL,
+        new_wrapped_key TEXT NOT NULL,
+        expiration_time INTEGER NOT NULL,
+        FOREIGN KEY (note_id) REFERENCES Notes(id) ON DELETE CASCADE,
+        FOREIGN KEY (sender_id) REFERENCES Users(id),
+        FOREIGN KEY (recipient_id) REFERENCES Users(id)
+    );
+)";
+
+// One index per access path; test/db_test.cpp fails if a statement plans a full SCAN.
+// The Notes index covers the keyset listing (id is spelled out so the cursor is a range)
+// and keeps each user's notes clustered by (user_id, created_at).
+// The note_id / link_id indexes also serve the cascading deletes, the expiration_time
+// ones let the expiry sweeper find due rows without scanning. The segment index
+// lets compaction walk one segment file's notes in file order.
+const char* SQL_INDEXES = R"(
+    DROP INDEX IF EXISTS idx_notes_user_created;
+    CREATE INDEX IF NOT EXISTS idx_notes_user_created_id ON Notes(user_id, created_at, id, filename);
+    CREATE INDEX IF NOT EXISTS idx_links_owner_expiration ON SharedLinks(owner_id, expiration_time);
+    CREATE INDEX IF NOT EXISTS idx_links_note ON SharedLinks(note_id);
+    CREATE INDEX IF NOT EXISTS idx_link_access_link_user ON SharedLinkAccess(link_id, username);
+    CREATE INDEX IF NOT EXISTS idx_user_shares_recipient_expiration ON UserShares(recipient_id, expiration_time);
+    CREATE INDEX IF NOT EXISTS idx_user_shares_note ON UserShares(note_id);
+    CREATE INDEX IF NOT EXISTS idx_links_expiration ON SharedLinks(expiration_time);
+    CREATE INDEX IF NOT EXISTS idx_user_shares_expiration ON UserShares(expiration_time);
+    CREATE INDEX IF NOT EXISTS idx_content_segments_segment ON ContentSegments(segment_id, segment_offset, length);
+    CREATE INDEX IF NOT EXISTS idx_link_routes_expiration ON LinkRoutes(expiration_time);
+)";
+
+bool exec(sqlite3* db, const char* sql, const char* what) {
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Failed to " << what << ": " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        return false;
     }
+    return true;
 }
 
-Database::~Database() {
-    sqlite3_close(db);
+int readUserVersion(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    int version = 0;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return version;
 }
 
-bool Database::init() {
-    const char* sqlUsers = R"(
-        CREATE TABLE IF NOT EXISTS Users (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            username TEXT UNIQUE NOT NULL,
-            password_hash TEXT NOT NULL,
-            salt TEXT NOT NULL,
-            receive_public_key_hex TEXT NOT NULL
-        );
-    )";
-
-    const char* sqlNotes = R"(
-        CREATE TABLE IF NOT EXISTS Notes (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            user_id INTEGER NOT NULL,
-            encrypted_content TEXT NOT NULL,
-            wrapped_key TEXT NOT NULL,
-            iv_hex TEXT NOT NULL,
-            filename TEXT NOT NULL DEFAULT 'note.txt',
-            created_at INTEGER NOT NULL,
-            FOREIGN KEY (user_id) REFERENCES Users(id)
-        );
-    )";
-
-    const char* sqlSharedLinks = R"(
-        CREATE TABLE IF NOT EXISTS SharedLinks (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            token TEXT UNIQUE NOT NULL,
-            note_id INTEGER NOT NULL,
-            owner_id INTEGER NOT NULL,
-            expiration_time INTEGER NOT NULL,
-            FOREIGN KEY (note_id) REFERENCES Notes(id),
-            FOREIGN KEY (owner_id) REFERENCES Users(id)
-        );
-    )";
-
-    const char* sqlSharedLinkAccess = R"(
-        CREATE TABLE IF NOT EXISTS SharedLinkAccess (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            link_id INTEGER NOT NULL,
-            username TEXT NOT NULL,
-            send_public_key_hex TEXT NOT NULL,
-            wrapped_key TEXT NOT NULL,
-            FOREIGN KEY (link_id) REFERENCES SharedLinks(id)
-        );
-    )";
-
-    const char* sqlUserShares = R"(
-        CREATE TABLE IF NOT EXISTS UserShares (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            note_id INTEGER NOT NULL,
-            sender_id INTEGER NOT NULL,
-            recipient_id INTEGER NOT NULL,
-            send_public_key_hex TEXT NOT NULL,
-            new_wrapped_key TEXT NOT NULL,
-            expiration_time INTEGER NOT NULL,
-            FOREIGN KEY (note_id) REFERENCES Notes(id),
-            FOREIGN KEY (sender_id) REFERENCES Users(id),
-            FOREIGN KEY (recipient_id) REFERENCES Users(id)
-        );
-    )";
+bool tableExists(sqlite3* db, const char* name) {
+    sqlite3_stmt* stmt;
+    bool exists = false;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        exists = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+    }
+    return exists;
+}
 
-    char* errMsg = nullptr;
-    
-    if (sqlite3_exec(db, sqlUsers, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Failed to create Users table: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
+// Executes a list of {sql, description} steps, stopping at the first failure
+bool execSteps(sqlite3* db, const char* const (*steps)[2], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (!exec(db, steps[i][0], steps[i][1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Version 0 -> 1: SQLite cannot add ON DELETE CASCADE to an existing table, so the
+// three share tables are rebuilt (rename, create, copy, drop).
+// Rows whose note or link was already gone are dropped, they were unreachable anyway.
+bool migrateToCascadingDeletes(sqlite3* db) {
+    const char* const steps[][2] = {
+        {"DELETE FROM SharedLinks WHERE note_id NOT IN (SELECT id FROM Notes);"
+         "DELETE FROM SharedLinkAccess WHERE link_id NOT IN (SELECT id FROM SharedLinks);"
+         "DELETE FROM UserShares WHERE note_id NOT IN (SELECT id FROM Notes);", "remove orphaned shares"},
+        {"ALTER TABLE SharedLinks RENAME TO SharedLinks_old;"
+         "ALTER TABLE SharedLinkAccess RENAME TO SharedLinkAccess_old;"
+         "ALTER TABLE UserShares RENAME TO UserShares_old;", "rename share tables"},
+        {SQL_SHARED_LINKS, "create SharedLinks table"},
+        {SQL_SHARED_LINK_ACCESS, "create SharedLinkAccess table"},
+        {SQL_USER_SHARES, "create UserShares table"},
+        // Same columns in the same order, only the foreign key clauses changed.
+        // The AUTOINCREMENT counters are carried over so ids are never reused.
+        {"INSERT INTO SharedLinks SELECT * FROM SharedLinks_old;"
+         "INSERT INTO SharedLinkAccess SELECT * FROM SharedLinkAccess_old;"
+         "INSERT INTO UserShares SELECT * FROM UserShares_old;"
+         "DELETE FROM sqlite_sequence WHERE name IN ('SharedLinks', 'SharedLinkAccess', 'UserShares');"
+         "UPDATE sqlite_sequence SET name = substr(name, 1, length(name) - 4)"
+         " WHERE name IN ('SharedLinks_old', 'SharedLinkAccess_old', 'UserShares_old');", "copy share rows"},
+        {"DROP TABLE SharedLinkAccess_old; DROP TABLE SharedLinks_old; DROP TABLE UserShares_old;", "drop old share tables"},
+    };
+    return execSteps(db, steps, sizeof(steps) / sizeof(steps[0]));
+}
+
+// Ciphertext rewritten per transaction by the batched content steps below
+const long long MIGRATION_BATCH_BYTES = 8LL * 1024 * 1024;
+
+// Version 1 -> 2: ciphertext goes from base64 TEXT to the raw bytes as a BLOB, ~25%
+// smaller. The rows are decoded after startup by Database::backfillStep, like the
+// version 6 tokens, so neither the decode nor a VACUUM holds up the start. The
+// migration only records the backfill position; Settings is created here already,
+// version 5 would otherwise add it. Version 3 moves the TEXT values into NoteContents
+// as they are, which is where the backfill finds them. Until the key is gone, reads
+// check for a note still holding TEXT (Stmt::SelectLegacyNoteContent).
+const char* CONTENT_BACKFILL_KEY = "content_backfill.NoteContents";
+
+bool scheduleContentBackfill(sqlite3* db) {
+    std::string sql = std::string("INSERT OR REPLACE INTO Settings (name, value) VALUES ('") +
+                      CONTENT_BACKFILL_KEY + "', '0');";
+    return exec(db, SQL_SETTINGS, "create Settings table") &&
+           exec(db, sql.c_str(), "schedule content backfill");
+}
+
+// One batch of the content backfill, inside the caller's transaction: decodes the
+// base64 TEXT ciphertext among the next `limit` notes after last_id, stopping early
+// once MIGRATION_BATCH_BYTES have been rewritten. Only TEXT values are touched and
+// the declared column type is left alone. Returns the number of notes visited and
+// sets `done` once the table is finished, -1 on failure.
+int convertContentBatch(sqlite3* db, sqlite3_int64& last_id, int limit, bool& done) {
+    sqlite3_stmt* select;
+    sqlite3_stmt* update;
+    if (sqlite3_prepare_v2(db, "SELECT note_id, encrypted_content FROM NoteContents WHERE note_id > ?"
+                               " AND typeof(encrypted_content) = 'text' ORDER BY note_id LIMIT ?",
+                           -1, &select, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare content backfill: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    if (sqlite3_prepare_v2(db, "UPDATE NoteContents SET encrypted_content = ? WHERE note_id = ?",
+                           -1, &update, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare content backfill: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(select);
+        return -1;
+    }
+
+    int rows = 0;
+    long long bytes = 0;
+    bool ok = true;
+    done = true;
+    sqlite3_bind_int64(select, 1, last_id);
+    sqlite3_bind_int(select, 2, limit);
+    while (ok && sqlite3_step(select) == SQLITE_ROW) {
+        if (bytes >= MIGRATION_BATCH_BYTES) {
+            // Left for the next batch
+            done = false;
+            break;
+        }
+        rows++;
+        last_id = sqlite3_column_int64(select, 0);
+        std::string encoded(reinterpret_cast<const char*>(sqlite3_column_text(select, 1)),
+                            sqlite3_column_bytes(select, 1));
+        bytes += static_cast<long long>(encoded.size());
+
+        long long size = Crypto::base64DecodedSize(encoded);
+        std::vector<unsigned char> decoded = size > 0 ? Crypto::base64Decode(encoded) : std::vector<unsigned char>();
+        if (size < 0 || static_cast<long long>(decoded.size()) != size) {
+            // Nothing can decrypt it either way; leave the row as it is
+            std::cerr << "Note " << last_id << " does not hold valid base64, left as TEXT" << std::endl;
+            continue;
+        }
+
+        // An empty vector has no data pointer, and binding that would store NULL
+        if (decoded.empty()) {
+            sqlite3_bind_zeroblob(update, 1, 0);
+        } else {
+            sqlite3_bind_blob(update, 1, decoded.data(), static_cast<int>(decoded.size()), SQLITE_STATIC);
+        }
+        sqlite3_bind_int64(update, 2, last_id);
+        ok = sqlite3_step(update) == SQLITE_DONE;
+        sqlite3_reset(update);
+    }
+    done = done && rows < limit;
+
+    sqlite3_finalize(select);
+    sqlite3_finalize(update);
+    return ok ? rows : -1;
+}
+
+// Version 2 -> 3, before the version is recorded: moves each note's ciphertext,
+// wrapped key and IV into NoteContents and empties the ciphertext in Notes, at most
+// MIGRATION_BATCH_BYTES of ciphertext (or 256 notes) per transaction. The pages a
+// batch frees are reused by the next one, so the file grows by about one batch
+// instead of doubling. An interrupted run continues with the notes that have no
+// NoteContents row yet.
+
+bool moveNoteContents(sqlite3* db) {
+    const int rowsPerTransaction = 256;
+    if (!exec(db, SQL_NOTE_CONTENTS, "create NoteContents table")) {
         return false;
     }
-    
-    if (sqlite3_exec(db, sqlNotes, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Failed to create Notes table: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
+
+    sqlite3_stmt* select = nullptr;
+    sqlite3_stmt* copy = nullptr;
+    sqlite3_stmt* empty = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT id, length(encrypted_content) FROM Notes WHERE id > ?"
+                               " AND NOT EXISTS (SELECT 1 FROM NoteContents WHERE note_id = Notes.id)"
+                               " ORDER BY id LIMIT ?", -1, &select, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT INTO NoteContents (note_id, wrapped_key, iv_hex, encrypted_content)"
+                               " SELECT id, wrapped_key, iv_hex, encrypted_content FROM Notes WHERE id = ?",
+                           -1, &copy, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "UPDATE Notes SET encrypted_content = x'' WHERE id = ?", -1, &empty, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare content move: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(select);
+        sqlite3_finalize(copy);
+        sqlite3_finalize(empty);
         return false;
     }
-    
-    if (sqlite3_exec(db, sqlSharedLinks, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Failed to create SharedLinks table: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
+
+    long long moved = 0;
+    sqlite3_int64 lastId = 0;
+    bool ok = true;
+    bool more = true;
+    while (ok && more) {
+        if (!exec(db, "BEGIN IMMEDIATE;", "begin content move")) {
+            ok = false;
+            break;
+        }
+
+        int rows = 0;
+        long long bytes = 0;
+        sqlite3_bind_int64(select, 1, lastId);
+        sqlite3_bind_int(select, 2, rowsPerTransaction);
+        more = false;
+        while (ok && sqlite3_step(select) == SQLITE_ROW) {
+            if (bytes >= MIGRATION_BATCH_BYTES) {
+                // Left for the next transaction
+                more = true;
+                break;
+            }
+            rows++;
+            lastId = sqlite3_column_int64(select, 0);
+            bytes += sqlite3_column_int64(select, 1);
+
+            sqlite3_bind_int64(copy, 1, lastId);
+            sqlite3_bind_int64(empty, 1, lastId);
+            ok = sqlite3_step(copy) == SQLITE_DONE && sqlite3_step(empty) == SQLITE_DONE;
+            if (!ok) {
+                std::cerr << "Failed to move note " << lastId << ": " << sqlite3_errmsg(db) << std::endl;
+            }
+            sqlite3_reset(copy);
+            sqlite3_reset(empty);
+        }
+        sqlite3_reset(select);
+        more = more || rows == rowsPerTransaction;
+        moved += rows;
+
+        if (!ok || !exec(db, "COMMIT;", "commit content move")) {
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+            ok = false;
+        }
+    }
+
+    sqlite3_finalize(select);
+    sqlite3_finalize(copy);
+    sqlite3_finalize(empty);
+    if (ok) {
+        std::cout << moved << " note contents moved to NoteContents" << std::endl;
+    }
+    return ok;
+}
+
+// Version 2 -> 3, once moveNoteContents is done: rebuilds Notes with just the
+// metadata. The ciphertext is already out, so every row is small. Same rebuild
+// steps as version 1.
+bool migrateToSplitNotes(sqlite3* db) {
+    const char* const steps[][2] = {
+        {"ALTER TABLE Notes RENAME TO Notes_old;", "rename Notes table"},
+        {SQL_NOTES, "create Notes table"},
+        {"INSERT INTO Notes (id, user_id, filename, created_at)"
+         " SELECT id, user_id, filename, created_at FROM Notes_old;"
+         "DELETE FROM sqlite_sequence WHERE name = 'Notes';"
+         "UPDATE sqlite_sequence SET name = 'Notes' WHERE name = 'Notes_old';", "copy note metadata"},
+        {"DROP TABLE Notes_old;", "drop old Notes table"},
+    };
+    return execSteps(db, steps, sizeof(steps) / sizeof(steps[0]));
+}
+
+// Version 3 -> 4: existing notes stay inline, only new large ones go to segment files
+bool addContentSegments(sqlite3* db) {
+    return exec(db, SQL_CONTENT_SEGMENTS, "create ContentSegments table");
+}
+
+// Version 4 -> 5
+bool addDirectoryTables(sqlite3* db) {
+    return exec(db, SQL_LINK_ROUTES, "create LinkRoutes table") &&
+           exec(db, SQL_SETTINGS, "create Settings table");
+}
+
+// Version 5 -> 6: share link tokens (SharedLinks, and LinkRoutes in a sharded directory)
+// go from 64 hex characters to the 32 raw bytes, which halves the unique token index.
+// The rows are rewritten after startup by Database::backfillStep, so a large database
+// serves requests right away. The migration only records where each table's backfill
+// starts (Settings: token_backfill.<table> = last rowid done); until the key is gone,
+// token lookups that miss retry with the hex form the remaining rows still hold.
+const char* const TOKEN_BACKFILL_TABLES[] = {"SharedLinks", "LinkRoutes"};
+
+std::string tokenBackfillKey(const char* table) {
+    return std::string("token_backfill.") + table;
+}
+
+bool scheduleTokenBackfill(sqlite3* db) {
+    for (const char* table : TOKEN_BACKFILL_TABLES) {
+        std::string sql = "INSERT OR REPLACE INTO Settings (name, value) VALUES ('" + tokenBackfillKey(table) + "', '0');";
+        if (!exec(db, sql.c_str(), "schedule token backfill")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// One batch of the token backfill, inside the caller's transaction: converts the hex
+// TEXT tokens among the next `limit` rows after last_row and advances last_row.
+// Only TEXT values are touched and the declared column type is left alone.
+// Returns the number of rows visited (fewer than `limit` once the table is done), -1 on failure.
+int convertTokenBatch(sqlite3* db, const char* table, sqlite3_int64& last_row, int limit) {
+    std::string selectSql = std::string("SELECT rowid, token FROM ") + table +
+                            " WHERE rowid > ? AND typeof(token) = 'text' ORDER BY rowid LIMIT ?";
+    std::string updateSql = std::string("UPDATE ") + table + " SET token = ? WHERE rowid = ?";
+    sqlite3_stmt* select;
+    sqlite3_stmt* update;
+    if (sqlite3_prepare_v2(db, selectSql.c_str(), -1, &select, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare token backfill: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    if (sqlite3_prepare_v2(db, updateSql.c_str(), -1, &update, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare token backfill: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(select);
+        return -1;
+    }
+
+    int rows = 0;
+    bool ok = true;
+    sqlite3_bind_int64(select, 1, last_row);
+    sqlite3_bind_int(select, 2, limit);
+    while (ok && sqlite3_step(select) == SQLITE_ROW) {
+        rows++;
+        last_row = sqlite3_column_int64(select, 0);
+        std::string hex(reinterpret_cast<const char*>(sqlite3_column_text(select, 1)),
+                        sqlite3_column_bytes(select, 1));
+
+        if (hex.length() != 2 * Storage::SHARE_TOKEN_BYTES ||
+            hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+            // No URL can name it any more; the link simply expires
+            std::cerr << table << " row " << last_row << " has a token that is not hex, left as TEXT" << std::endl;
+            continue;
+        }
+
+        std::vector<unsigned char> bytes = Crypto::fromHex(hex);
+        sqlite3_bind_blob(update, 1, bytes.data(), static_cast<int>(bytes.size()), SQLITE_STATIC);
+        sqlite3_bind_int64(update, 2, last_row);
+        ok = sqlite3_step(update) == SQLITE_DONE;
+        sqlite3_reset(update);
+    }
+
+    sqlite3_finalize(select);
+    sqlite3_finalize(update);
+    return ok ? rows : -1;
+}
+
+// Converts one batch of rows after a position and advances it; sets `done` once the table is finished
+using ConvertBatch = std::function<int(sqlite3* db, sqlite3_int64& last_row, bool& done)>;
+
+// One batch of a backfill whose position is kept in Settings under `key`. The batch and
+// the new position commit together, a crash resumes from the last batch; the key is
+// deleted once the table is done. Returns the rows visited (0 when the key is already
+// gone), -1 on failure.
+int runBackfillBatch(Connection& conn, const std::string& key, const std::string& what, const ConvertBatch& convert) {
+    sqlite3_int64 lastRow;
+    {
+        CachedStatement stmt(conn, Stmt::SelectSetting);
+        if (!stmt) {
+            return -1;
+        }
+        sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
+            return 0;
+        }
+        lastRow = sqlite3_column_int64(stmt, 0);
+    }
+
+    Transaction txn(conn);
+    if (!txn) {
+        return -1;
+    }
+    bool done = false;
+    int rows = convert(conn.handle, lastRow, done);
+    if (rows < 0) {
+        return -1;
+    }
+
+    CachedStatement stmt(conn, done ? Stmt::DeleteSetting : Stmt::InsertSetting);
+    if (!stmt) {
+        return -1;
+    }
+    std::string position = std::to_string(lastRow);
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    if (!done) {
+        sqlite3_bind_text(stmt, 2, position.c_str(), -1, SQLITE_TRANSIENT);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE || !txn.commit()) {
+        return -1;
+    }
+
+    if (done) {
+        std::cout << what << " finished" << std::endl;
+    }
+    return rows;
+}
+
+// Ordered schema changes: migration N turns a version N-1 database into version N.
+// Database::init runs each missing one in its own transaction together with
+// PRAGMA user_version = N, so a crash leaves the previous version behind and the
+// migration simply runs again on the next start. `prepare` does work too large for
+// one transaction before that (batched, and safe to repeat); `rebuildsTables`
+// turns foreign key checks off around the transaction for rename-and-copy rebuilds.
+struct Migration {
+    int version;
+    const char* description;
+    bool (*prepare)(sqlite3* db);
+    bool (*apply)(sqlite3* db);
+    bool rebuildsTables;
+};
+
+const Migration MIGRATIONS[] = {
+    {1, "cascading deletes", nullptr, migrateToCascadingDeletes, true},
+    {2, "ciphertext as BLOB, backfilled in the background", nullptr, scheduleContentBackfill, false},
+    {3, "note metadata split from contents", moveNoteContents, migrateToSplitNotes, true},
+    {4, "segment file index", nullptr, addContentSegments, false},
+    {5, "sharding directory tables", nullptr, addDirectoryTables, false},
+    {6, "share tokens as BLOB, backfilled in the background", nullptr, scheduleTokenBackfill, false},
+};
+
+static_assert(sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0]) == SCHEMA_VERSION,
+              "Every schema version needs a migration");
+
+bool applyMigration(sqlite3* db, const Migration& migration, bool last) {
+    if (migration.prepare && !migration.prepare(db)) {
         return false;
     }
-    
-    if (sqlite3_exec(db, sqlSharedLinkAccess, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Failed to create SharedLinkAccess table: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
+    // Both pragmas are no-ops inside a transaction. legacy_alter_table keeps a
+    // rename from rewriting the foreign keys of the other tables to the _old names.
+    if (migration.rebuildsTables &&
+        !exec(db, "PRAGMA foreign_keys=OFF; PRAGMA legacy_alter_table=ON;", "prepare migration")) {
         return false;
     }
-    
-    if (sqlite3_exec(db, sqlUserShares, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Failed to create UserShares table: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
+
+    // The last migration also brings the indexes up to date, so a database that
+    // reaches the current version always has all of them
+    std::string setVersion = "PRAGMA user_version = " + std::to_string(migration.version) + ";";
+    bool ok = exec(db, "BEGIN IMMEDIATE;", "begin migration") &&
+              migration.apply(db) &&
+              (!last || exec(db, SQL_INDEXES, "create indexes")) &&
+              exec(db, setVersion.c_str(), "record schema version") &&
+              exec(db, "COMMIT;", "commit migration");
+    if (!ok) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
+
+    if (migration.rebuildsTables) {
+        exec(db, "PRAGMA legacy_alter_table=OFF; PRAGMA foreign_keys=ON;", "finish migration");
+    }
+    return ok;
+}
+
+// A new database gets the current schema in one transaction
+bool createSchema(sqlite3* db) {
+    std::string sql = std::string("BEGIN IMMEDIATE;") + SQL_USERS + SQL_NOTES + SQL_NOTE_CONTENTS +
+                      SQL_CONTENT_SEGMENTS + SQL_SHARED_LINKS + SQL_SHARED_LINK_ACCESS + SQL_USER_SHARES +
+                      SQL_LINK_ROUTES + SQL_SETTINGS + SQL_INDEXES +
+                      "PRAGMA user_version = " + std::to_string(SCHEMA_VERSION) + "; COMMIT;";
+    if (!exec(db, sql.c_str(), "create schema")) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    return true;
+}
+
+bool upgradeSchema(sqlite3* db, int version) {
+    // A database created before user_version was tracked already has the tables
+    if (version == 0 && !tableExists(db, "Notes")) {
+        return createSchema(db);
+    }
+
+    // Tables of the original schema that a version 0 database may still lack
+    if (version == 0 &&
+        !(exec(db, SQL_USERS, "create Users table") &&
+          exec(db, SQL_SHARED_LINKS, "create SharedLinks table") &&
+          exec(db, SQL_SHARED_LINK_ACCESS, "create SharedLinkAccess table") &&
+          exec(db, SQL_USER_SHARES, "create UserShares table"))) {
+        return false;
+    }
+
+    for (const Migration& migration : MIGRATIONS) {
+        if (migration.version <= version) {
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (!applyMigration(db, migration, migration.version == SCHEMA_VERSION)) {
+            std::cerr << "Migration to schema version " << migration.version
+                      << " (" << migration.description << ") failed" << std::endl;
+            return false;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Database migrated to schema version " << migration.version
+                  << " (" << migration.description << ") in " << ms << " ms" << std::endl;
+    }
+    return true;
+}
+
+bool settingExists(sqlite3* db, const std::string& name) {
+    sqlite3_stmt* stmt;
+    bool exists = false;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM Settings WHERE name = ?", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+        exists = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+    }
+    return exists;
+}
+
+// Tells the content store that a writing transaction is over. Declared before the
+// Transaction, so it runs after that has committed or rolled back.
+class ContentWrites {
+public:
+    ContentWrites(ContentStore& store, Connection& conn) : store(store), conn(conn) {}
+    ~ContentWrites() { store.transactionEnded(conn); }
+    ContentWrites(const ContentWrites&) = delete;
+    ContentWrites& operator=(const ContentWrites&) = delete;
+
+private:
+    ContentStore& store;
+    Connection& conn;
+};
+
+// Share tokens are raw bytes: bound and read back as BLOBs. `legacy_hex` binds the
+// hex TEXT form that rows not yet reached by the token backfill still hold.
+void bindToken(sqlite3_stmt* stmt, int index, const std::string& token, bool legacy_hex = false) {
+    if (legacy_hex) {
+        std::vector<unsigned char> bytes(token.begin(), token.end());
+        sqlite3_bind_text(stmt, index, Crypto::toHex(bytes).c_str(), -1, SQLITE_TRANSIENT);
+    } else {
+        sqlite3_bind_blob(stmt, index, token.data(), static_cast<int>(token.size()), SQLITE_TRANSIENT);
+    }
+}
+
+std::string columnToken(sqlite3_stmt* stmt, int column) {
+    if (sqlite3_column_type(stmt, column) == SQLITE_TEXT) {
+        std::vector<unsigned char> bytes = Crypto::fromHex(reinterpret_cast<const char*>(sqlite3_column_text(stmt, column)));
+        return std::string(bytes.begin(), bytes.end());
+    }
+    const char* data = static_cast<const char*>(sqlite3_column_blob(stmt, column));
+    return std::string(data ? data : "", sqlite3_column_bytes(stmt, column));
+}
+}
+
+Database::Database(const std::string& path, size_t pool_size, std::unique_ptr<ContentStore> contents,
+                   const SqliteTuning& tuning)
+    : path(path),
+      pool(path, pool_size, BUSY_TIMEOUT_MS, tuning),
+      contents(contents ? std::move(contents) : std::make_unique<SqliteContentStore>()),
+      userCache(USER_CACHE_CAPACITY),
+      linkCache(LINK_CACHE_CAPACITY) {
+}
+
+bool Database::init() {
+    if (!pool.isOpen()) {
+        return false;
+    }
+
+    {
+        auto conn = pool.acquire();
+        sqlite3* db = conn->handle;
+
+        int version = readUserVersion(db);
+        if (version > SCHEMA_VERSION) {
+            std::cerr << "Database schema version " << version << " is newer than this server ("
+                      << SCHEMA_VERSION << ")" << std::endl;
+            return false;
+        }
+        // Already current: no DDL at all, startup does not depend on the database size
+        if (version < SCHEMA_VERSION && !upgradeSchema(db, version)) {
+            return false;
+        }
+
+        bool pending = false;
+        for (const char* table : TOKEN_BACKFILL_TABLES) {
+            pending = pending || settingExists(db, tokenBackfillKey(table));
+        }
+        legacyTokens = pending;
+        legacyContent = settingExists(db, CONTENT_BACKFILL_KEY);
+    }
+
+    if (!contents->open()) {
         return false;
     }
     
@@ -111,13 +718,44 @@ bool Database::init() {
     return true;
 }
 
+int Database::backfillStep(int batch_size) {
+    if (!legacyContent && !legacyTokens) {
+        return 0;
+    }
+
+    auto conn = pool.acquire();
+    if (legacyContent) {
+        int rows = runBackfillBatch(*conn, CONTENT_BACKFILL_KEY, "Content backfill",
+                                    [batch_size](sqlite3* db, sqlite3_int64& last_row, bool& done) {
+                                        return convertContentBatch(db, last_row, batch_size, done);
+                                    });
+        if (rows != 0) {
+            return rows;
+        }
+        legacyContent = false;
+    }
+
+    for (const char* table : TOKEN_BACKFILL_TABLES) {
+        int rows = runBackfillBatch(*conn, tokenBackfillKey(table), std::string("Token backfill of ") + table,
+                                    [table, batch_size](sqlite3* db, sqlite3_int64& last_row, bool& done) {
+                                        int visited = convertTokenBatch(db, table, last_row, batch_size);
+                                        done = visited < batch_size;
+                                        return visited;
+                                    });
+        if (rows != 0) {
+            return rows;
+        }
+    }
+
+    legacyTokens = false;
+    return 0;
+}
+
 bool Database::createUser(std::string username, std::string pass_hash, 
                           std::string salt, std::string receive_pub_key) {
-    const char* sql = "INSERT INTO Users (username, password_hash, salt, receive_public_key_hex) VALUES (?, ?, ?, ?)";
-    
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare insert user statement" << std::endl;
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::InsertUser);
+    if (!stmt) {
         return false;
     }
     
@@ -127,7 +765,9 @@ bool Database::createUser(std::string username, std::string pass_hash,
     sqlite3_bind_text(stmt, 4, receive_pub_key.c_str(), -1, SQLITE_TRANSIENT);
     
     int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    
+    // Nothing is cached for a name that did not exist, but a racing lookup may be loading it
+    userCache.invalidate(username);
     
     if (rc == SQLITE_CONSTRAINT) {
         std::cerr << "Username already exists" << std::endl;
@@ -140,10 +780,14 @@ bool Database::createUser(std::string username, std::string pass_hash,
 UserRecord Database::getUserByUsername(std::string username) {
     UserRecord record{-1, "", "", "", ""};
     
-    const char* sql = "SELECT id, username, password_hash, salt, receive_public_key_hex FROM Users WHERE username = ?";
+    if (userCache.get(username, record)) {
+        return record;
+    }
+    uint64_t generation = userCache.generation(username);
     
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectUserByUsername);
+    if (!stmt) {
         return record;
     }
     
@@ -155,382 +799,745 @@ UserRecord Database::getUserByUsername(std::string username) {
         record.password_hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
         record.salt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
         record.receive_public_key_hex = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+        // Unknown names are not cached: /register checks one right before creating it
+        userCache.put(username, record, generation);
     }
     
-    sqlite3_finalize(stmt);
     return record;
 }
 
 bool Database::updateUserPublicKey(int user_id, std::string receive_pub_key) {
-    const char* sql = "UPDATE Users SET receive_public_key_hex = ? WHERE id = ?";
+    auto conn = pool.acquire();
+    
+    // The cache is keyed by username
+    std::string username;
+    {
+        CachedStatement stmt(*conn, Stmt::SelectUsernameById);
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_int(stmt, 1, user_id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            username = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        }
+    }
     
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    CachedStatement stmt(*conn, Stmt::UpdateUserPublicKey);
+    if (!stmt) {
         return false;
     }
     
     sqlite3_bind_text(stmt, 1, receive_pub_key.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int(stmt, 2, user_id);
     
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    userCache.invalidate(username);
+    return ok;
+}
+
+CacheStats Database::userCacheStats() {
+    return userCache.stats();
+}
+
+CacheStats Database::linkCacheStats() {
+    return linkCache.stats();
+}
+
+bool Database::createUserStub(int user_id, std::string username) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::InsertUserStub);
+    if (!stmt) {
+        return false;
+    }
     
-    return rc == SQLITE_DONE;
+    sqlite3_bind_int(stmt, 1, user_id);
+    sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
+    
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+bool Database::createUserStubs(const std::vector<std::pair<int, std::string>>& users) {
+    auto conn = pool.acquire();
+    Transaction txn(*conn);
+    if (!txn) {
+        return false;
+    }
+    
+    for (const auto& user : users) {
+        CachedStatement stmt(*conn, Stmt::InsertUserStub);
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_int(stmt, 1, user.first);
+        sqlite3_bind_text(stmt, 2, user.second.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            return false;
+        }
+    }
+    return txn.commit();
+}
+
+std::vector<std::pair<int, std::string>> Database::listUserIds(int after_id, int limit) {
+    std::vector<std::pair<int, std::string>> users;
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectUserIdPage);
+    if (!stmt) {
+        return users;
+    }
+    
+    sqlite3_bind_int(stmt, 1, after_id);
+    sqlite3_bind_int(stmt, 2, limit);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        users.emplace_back(sqlite3_column_int(stmt, 0),
+                           reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+    }
+    return users;
+}
+
+int Database::maxUserId() {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectMaxUserId);
+    if (!stmt || sqlite3_step(stmt) != SQLITE_ROW) {
+        return -1;
+    }
+    return sqlite3_column_int(stmt, 0);
+}
+
+int Database::insertNote(Connection& conn, const NewNote& note, long created_at) {
+    if (note.raw_content) {
+        return insertNote(conn, note, static_cast<long long>(note.encrypted_content.size()),
+                          ContentStore::bytesSource(note.encrypted_content), created_at);
+    }
+    // -1 for invalid base64, rejected by the size check below
+    long long size = Crypto::base64DecodedSize(note.encrypted_content);
+    return insertNote(conn, note, size, ContentStore::base64Source(note.encrypted_content), created_at);
+}
+
+int Database::insertNote(Connection& conn, const NewNote& note, long long size,
+                         const ContentStore::ChunkSource& next, long created_at) {
+    if (size < 0 || size > std::numeric_limits<int>::max()) {
+        return -1;
+    }
+    
+    // Any failure below undoes the Notes row and whatever content got written,
+    // so a batch can commit around a failed note without keeping its metadata
+    Savepoint savepoint(conn);
+    if (!savepoint) {
+        return -1;
+    }
+    
+    sqlite3_int64 noteId;
+    {
+        CachedStatement stmt(conn, Stmt::InsertNote);
+        if (!stmt) {
+            return -1;
+        }
+        
+        sqlite3_bind_int(stmt, 1, note.user_id);
+        sqlite3_bind_text(stmt, 2, note.filename.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 3, created_at);
+        
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            return -1;
+        }
+        noteId = sqlite3_last_insert_rowid(conn.handle);
+    }
+    
+    {
+        CachedStatement stmt(conn, Stmt::InsertNoteContent);
+        if (!stmt) {
+            return -1;
+        }
+        
+        // Reserves the inline part of the ciphertext as a zeroblob; the content
+        // store streams the bytes in afterwards
+        sqlite3_bind_int64(stmt, 1, noteId);
+        sqlite3_bind_text(stmt, 2, note.wrapped_key.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, note.iv_hex.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 4, contents->inlineBytes(size));
+        
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            return -1;
+        }
+    }
+    
+    if (!contents->writeChunks(conn, noteId, size, next) || !savepoint.release()) {
+        return -1;
+    }
+    
+    return static_cast<int>(noteId);
+}
+
+int Database::saveNote(int user_id, std::string encrypted_content, 
+                       std::string wrapped_key, std::string iv_hex, std::string filename) {
+    NewNote note{user_id, std::move(encrypted_content), std::move(wrapped_key),
+                 std::move(iv_hex), std::move(filename)};
+    
+    auto conn = pool.acquire();
+    
+    // The row and its ciphertext are written in two steps; the transaction
+    // keeps a half-written note from ever being visible
+    ContentWrites writes(*contents, *conn);
+    Transaction txn(*conn);
+    if (!txn) {
+        return -1;
+    }
+    
+    int noteId = insertNote(*conn, note, static_cast<long>(std::time(nullptr)));
+    if (noteId == -1 || !contents->sync() || !txn.commit()) {
+        return -1;
+    }
+    return noteId;
+}
+
+int Database::saveNoteStream(int user_id, long long size, const ContentStore::ChunkSource& next,
+                             std::string wrapped_key, std::string iv_hex, std::string filename) {
+    NewNote note{user_id, std::string(), std::move(wrapped_key), std::move(iv_hex), std::move(filename)};
+    
+    auto conn = pool.acquire();
+    ContentWrites writes(*contents, *conn);
+    Transaction txn(*conn);
+    if (!txn) {
+        return -1;
+    }
+    
+    int noteId = insertNote(*conn, note, size, next, static_cast<long>(std::time(nullptr)));
+    if (noteId == -1 || !contents->sync() || !txn.commit()) {
+        return -1;
+    }
+    return noteId;
+}
+
+std::vector<int> Database::saveNotes(const std::vector<NewNote>& notes) {
+    std::vector<int> ids(notes.size(), -1);
+    
+    auto conn = pool.acquire();
+    ContentWrites writes(*contents, *conn);
+    Transaction txn(*conn);
+    if (!txn) {
+        return ids;
+    }
+    
+    long now = static_cast<long>(std::time(nullptr));
+    
+    // A failed note is rolled back to its savepoint; the rest of the batch still commits
+    for (size_t i = 0; i < notes.size(); i++) {
+        ids[i] = insertNote(*conn, notes[i], now);
+    }
+    
+    // One sync of the segment file for the whole batch
+    if (!contents->sync() || !txn.commit()) {
+        std::fill(ids.begin(), ids.end(), -1);
+    }
+    return ids;
+}
+
+NoteData Database::getNoteById(int note_id) {
+    auto conn = pool.acquire();
+    return readNote(*conn, note_id, nullptr);
+}
+
+NoteData Database::readNote(Connection& conn, int note_id, ContentStore::RangeData* raw) {
+    NoteData note;
+    note.note_id = -1;
+    
+    CachedStatement stmt(conn, Stmt::SelectNoteById);
+    if (!stmt) {
+        return note;
+    }
+    
+    sqlite3_bind_int(stmt, 1, note_id);
+    
+    // The content is read while the statement still holds the read snapshot
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        readNoteColumns(stmt, note);
+        if (!readNoteContent(conn, note, raw)) {
+            note.note_id = -1;
+        }
+    }
+    
+    return note;
+}
+
+void Database::readNoteColumns(sqlite3_stmt* stmt, NoteData& note) {
+    note.note_id = sqlite3_column_int(stmt, 0);
+    note.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+    note.created_at = sqlite3_column_int64(stmt, 3);
+}
+
+bool Database::readNoteKeys(Connection& conn, NoteData& note) {
+    CachedStatement stmt(conn, Stmt::SelectNoteContentKeys);
+    if (!stmt) {
+        return false;
+    }
+    
+    sqlite3_bind_int(stmt, 1, note.note_id);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return false;
+    }
+    
+    note.wrapped_key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    note.iv_hex = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    return true;
+}
+
+bool Database::readNoteContent(Connection& conn, NoteData& note, ContentStore::RangeData* raw) {
+    if (!readNoteKeys(conn, note)) {
+        return false;
+    }
+    if (raw) {
+        note.encrypted_content.clear();
+        return readContentRange(conn, note.note_id, ContentStore::ByteRange(), *raw);
+    }
+    return readContent(conn, note.note_id, note.encrypted_content);
+}
+
+bool Database::readLegacyContent(Connection& conn, sqlite3_int64 note_id, std::string& encoded) {
+    if (!legacyContent) {
+        return false;
+    }
+    CachedStatement stmt(conn, Stmt::SelectLegacyNoteContent);
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, note_id);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return false;
+    }
+    encoded.assign(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), sqlite3_column_bytes(stmt, 0));
+    return true;
 }
 
-int Database::saveNote(int user_id, std::string encrypted_content, 
-                       std::string wrapped_key, std::string iv_hex, std::string filename) {
-    const char* sql = "INSERT INTO Notes (user_id, encrypted_content, wrapped_key, iv_hex, filename, created_at) VALUES (?, ?, ?, ?, ?, ?)";
-    
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare save note statement" << std::endl;
-        return -1;
+bool Database::readContent(Connection& conn, sqlite3_int64 note_id, std::string& encoded) {
+    return readLegacyContent(conn, note_id, encoded) || contents->read(conn, note_id, encoded);
+}
+
+bool Database::readContentRange(Connection& conn, sqlite3_int64 note_id, const ContentStore::ByteRange& range,
+                                ContentStore::RangeData& data) {
+    std::string encoded;
+    if (!readLegacyContent(conn, note_id, encoded)) {
+        return contents->readRange(conn, note_id, range, data);
     }
-    
-    long now = static_cast<long>(std::time(nullptr));
-    
-    sqlite3_bind_int(stmt, 1, user_id);
-    sqlite3_bind_text(stmt, 2, encrypted_content.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, wrapped_key.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 4, iv_hex.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 5, filename.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int64(stmt, 6, now);
-    
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    
-    if (rc != SQLITE_DONE) {
-        return -1;
+
+    // Only notes from before version 2 get here: decoded whole, the range is cut from the result
+    std::vector<unsigned char> bytes = Crypto::base64Decode(encoded);
+    data.total_size = static_cast<long long>(bytes.size());
+    data.offset = -1;
+    data.bytes.clear();
+    long long first;
+    long long length;
+    if (ContentStore::resolveRange(range, data.total_size, first, length)) {
+        data.offset = first;
+        data.bytes.assign(bytes.begin() + first, bytes.begin() + first + length);
     }
-    
-    return static_cast<int>(sqlite3_last_insert_rowid(db));
+    return true;
 }
 
-NoteData Database::getNoteById(int note_id) {
-    NoteData note;
-    note.note_id = -1;
+Database::NoteAccess Database::getNoteForOwner(int note_id, int user_id, NoteData& note) {
+    return readOwnedNote(note_id, user_id, note, nullptr, nullptr);
+}
+
+Database::NoteAccess Database::getNoteRangeForOwner(int note_id, int user_id, const ContentStore::ByteRange& range,
+                                                    NoteData& note, ContentStore::RangeData& data) {
+    return readOwnedNote(note_id, user_id, note, &range, &data);
+}
+
+Database::NoteAccess Database::readOwnedNote(int note_id, int user_id, NoteData& note,
+                                             const ContentStore::ByteRange* range, ContentStore::RangeData* data) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectNoteById);
+    if (!stmt) {
+        return NoteAccess::NotFound;
+    }
     
-    const char* sql = "SELECT id, user_id, encrypted_content, wrapped_key, iv_hex, filename, created_at FROM Notes WHERE id = ?";
+    sqlite3_bind_int(stmt, 1, note_id);
     
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        return note;
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return NoteAccess::NotFound;
     }
     
-    sqlite3_bind_int(stmt, 1, note_id);
+    // Owner is checked on the metadata table alone, so a forbidden request
+    // never touches NoteContents
+    if (sqlite3_column_int(stmt, 1) != user_id) {
+        return NoteAccess::Forbidden;
+    }
     
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        note.note_id = sqlite3_column_int(stmt, 0);
-        note.encrypted_content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        note.wrapped_key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        note.iv_hex = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        note.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
-        note.created_at = sqlite3_column_int64(stmt, 6);
+    readNoteColumns(stmt, note);
+    if (!range) {
+        return readNoteContent(*conn, note, nullptr) ? NoteAccess::Ok : NoteAccess::NotFound;
     }
     
-    sqlite3_finalize(stmt);
-    return note;
+    note.encrypted_content.clear();
+    if (!readNoteKeys(*conn, note) || !readContentRange(*conn, note_id, *range, *data)) {
+        return NoteAccess::NotFound;
+    }
+    return NoteAccess::Ok;
 }
 
-std::vector<NoteData> Database::getNotesForUser(int user_id) {
-    std::vector<NoteData> notes;
-    
-    const char* sql = "SELECT id, encrypted_content, wrapped_key, iv_hex, filename, created_at FROM Notes WHERE user_id = ? ORDER BY created_at DESC";
-    
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        return notes;
+Database::NotePage Database::listNotes(int user_id, const NoteCursor& after, int limit) {
+    NotePage page;
+    page.has_more = false;
+    
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectNotePageByUser);
+    if (!stmt) {
+        return page;
     }
     
+    // Fetch one extra row to know whether another page follows
     sqlite3_bind_int(stmt, 1, user_id);
+    sqlite3_bind_int64(stmt, 2, after.created_at);
+    sqlite3_bind_int(stmt, 3, after.note_id);
+    sqlite3_bind_int(stmt, 4, limit + 1);
     
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        NoteData note;
-        note.note_id = sqlite3_column_int(stmt, 0);
-        note.encrypted_content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        note.wrapped_key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        note.iv_hex = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        note.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        note.created_at = sqlite3_column_int64(stmt, 5);
-        notes.push_back(note);
+        if (static_cast<int>(page.notes.size()) == limit) {
+            page.has_more = true;
+            break;
+        }
+        NoteListItem item;
+        item.note_id = sqlite3_column_int(stmt, 0);
+        item.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        item.created_at = sqlite3_column_int64(stmt, 2);
+        page.notes.push_back(item);
     }
     
-    sqlite3_finalize(stmt);
-    return notes;
+    return page;
 }
 
 bool Database::deleteNote(int note_id, int user_id) {
-    // First verify ownership
-    const char* checkSql = "SELECT id FROM Notes WHERE id = ? AND user_id = ?";
-    sqlite3_stmt* checkStmt;
-    if (sqlite3_prepare_v2(db, checkSql, -1, &checkStmt, nullptr) != SQLITE_OK) {
+    auto conn = pool.acquire();
+    
+    // Tokens are read in the same transaction as the delete, so a link created
+    // in between cannot outlive its note in the link cache
+    Transaction txn(*conn);
+    std::vector<std::string> tokens;
+    if (!txn || !selectLinkTokens(*conn, note_id, tokens)) {
         return false;
     }
     
-    sqlite3_bind_int(checkStmt, 1, note_id);
-    sqlite3_bind_int(checkStmt, 2, user_id);
+    CachedStatement stmt(*conn, Stmt::DeleteNoteByOwner);
+    if (!stmt) {
+        return false;
+    }
     
-    bool owned = (sqlite3_step(checkStmt) == SQLITE_ROW);
-    sqlite3_finalize(checkStmt);
+    // Ownership is part of the WHERE clause and the shares cascade
+    sqlite3_bind_int(stmt, 1, note_id);
+    sqlite3_bind_int(stmt, 2, user_id);
     
-    if (!owned) {
+    if (sqlite3_step(stmt) != SQLITE_DONE || sqlite3_changes(conn->handle) != 1 || !txn.commit()) {
         return false;
     }
-    
-    // Delete associated user shares
-    const char* deleteSharesSql = "DELETE FROM UserShares WHERE note_id = ?";
-    sqlite3_stmt* delSharesStmt;
-    if (sqlite3_prepare_v2(db, deleteSharesSql, -1, &delSharesStmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(delSharesStmt, 1, note_id);
-        sqlite3_step(delSharesStmt);
-        sqlite3_finalize(delSharesStmt);
+    for (const auto& token : tokens) {
+        linkCache.invalidate(token);
+    }
+    return true;
+}
+
+std::vector<int> Database::deleteNotes(int user_id, const std::vector<int>& note_ids) {
+    std::vector<int> deleted;
+    std::vector<std::string> tokens;
+    
+    auto conn = pool.acquire();
+    Transaction txn(*conn);
+    CachedStatement stmt(*conn, Stmt::DeleteNoteByOwner);
+    if (!txn || !stmt) {
+        return deleted;
     }
     
-    // Delete associated shared link access entries and links
-    const char* getLinksSql = "SELECT id FROM SharedLinks WHERE note_id = ?";
-    sqlite3_stmt* getLinksStmt;
-    if (sqlite3_prepare_v2(db, getLinksSql, -1, &getLinksStmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(getLinksStmt, 1, note_id);
-        while (sqlite3_step(getLinksStmt) == SQLITE_ROW) {
-            int linkId = sqlite3_column_int(getLinksStmt, 0);
-            
-            const char* delAccessSql = "DELETE FROM SharedLinkAccess WHERE link_id = ?";
-            sqlite3_stmt* delAccessStmt;
-            if (sqlite3_prepare_v2(db, delAccessSql, -1, &delAccessStmt, nullptr) == SQLITE_OK) {
-                sqlite3_bind_int(delAccessStmt, 1, linkId);
-                sqlite3_step(delAccessStmt);
-                sqlite3_finalize(delAccessStmt);
-            }
+    // One write lock and one WAL commit for the whole batch
+    for (int note_id : note_ids) {
+        std::vector<std::string> noteTokens;
+        if (!selectLinkTokens(*conn, note_id, noteTokens)) {
+            return {};
         }
-        sqlite3_finalize(getLinksStmt);
+        
+        sqlite3_bind_int(stmt, 1, note_id);
+        sqlite3_bind_int(stmt, 2, user_id);
+        
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            return {};
+        }
+        if (sqlite3_changes(conn->handle) == 1) {
+            deleted.push_back(note_id);
+            tokens.insert(tokens.end(), noteTokens.begin(), noteTokens.end());
+        }
+        sqlite3_reset(stmt);
     }
     
-    const char* deleteLinksSql = "DELETE FROM SharedLinks WHERE note_id = ?";
-    sqlite3_stmt* delLinksStmt;
-    if (sqlite3_prepare_v2(db, deleteLinksSql, -1, &delLinksStmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(delLinksStmt, 1, note_id);
-        sqlite3_step(delLinksStmt);
-        sqlite3_finalize(delLinksStmt);
+    if (!txn.commit()) {
+        return {};
     }
-    
-    // Finally delete the note itself
-    const char* deleteNoteSql = "DELETE FROM Notes WHERE id = ?";
-    sqlite3_stmt* delNoteStmt;
-    if (sqlite3_prepare_v2(db, deleteNoteSql, -1, &delNoteStmt, nullptr) != SQLITE_OK) {
+    for (const auto& token : tokens) {
+        linkCache.invalidate(token);
+    }
+    return deleted;
+}
+
+bool Database::selectLinkTokens(Connection& conn, int note_id, std::vector<std::string>& tokens) {
+    CachedStatement stmt(conn, Stmt::SelectLinkTokensByNote);
+    if (!stmt) {
         return false;
     }
     
-    sqlite3_bind_int(delNoteStmt, 1, note_id);
-    int rc = sqlite3_step(delNoteStmt);
-    sqlite3_finalize(delNoteStmt);
-    
+    sqlite3_bind_int(stmt, 1, note_id);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        tokens.push_back(columnToken(stmt, 0));
+    }
     return rc == SQLITE_DONE;
 }
 
-std::vector<Database::OutgoingShare> Database::getOutgoingShares(int user_id) {
-    std::vector<OutgoingShare> shares;
-    
-    const char* sql = R"(
-        SELECT sl.note_id, sl.token, sl.expiration_time, sl.id
-        FROM SharedLinks sl
-        WHERE sl.owner_id = ?
-        ORDER BY sl.expiration_time DESC
-    )";
-    
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        return shares;
+Database::OutgoingSharePage Database::listOutgoingShares(int user_id, const ShareCursor& after,
+                                                         int limit, bool active_only) {
+    OutgoingSharePage page;
+    page.has_more = false;
+    
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectLinkPageByOwner);
+    if (!stmt) {
+        return page;
     }
     
+    long now = static_cast<long>(std::time(nullptr));
+    
+    // Fetch one extra row to know whether another page follows
     sqlite3_bind_int(stmt, 1, user_id);
+    sqlite3_bind_int64(stmt, 2, active_only ? now : std::numeric_limits<long>::min());
+    sqlite3_bind_int64(stmt, 3, after.expiration_time);
+    sqlite3_bind_int(stmt, 4, after.link_id);
+    sqlite3_bind_int(stmt, 5, limit + 1);
     
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        OutgoingShare share;
-        share.note_id = sqlite3_column_int(stmt, 0);
-        share.token = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        share.expiration_time = sqlite3_column_int64(stmt, 2);
-        int link_id = sqlite3_column_int(stmt, 3);
-        
-        // Get usernames who have access to this link
-        const char* userSql = "SELECT username FROM SharedLinkAccess WHERE link_id = ?";
-        sqlite3_stmt* userStmt;
-        if (sqlite3_prepare_v2(db, userSql, -1, &userStmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(userStmt, 1, link_id);
-            while (sqlite3_step(userStmt) == SQLITE_ROW) {
-                std::string username = reinterpret_cast<const char*>(sqlite3_column_text(userStmt, 0));
-                share.shared_with.push_back(username);
-            }
-            sqlite3_finalize(userStmt);
+        if (static_cast<int>(page.shares.size()) == limit) {
+            page.has_more = true;
+            break;
         }
-        
-        shares.push_back(share);
+        OutgoingShare share;
+        share.link_id = sqlite3_column_int(stmt, 0);
+        share.note_id = sqlite3_column_int(stmt, 1);
+        share.token = columnToken(stmt, 2);
+        share.expiration_time = sqlite3_column_int64(stmt, 3);
+        share.shared_with = nlohmann::json::parse(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4)))
+                                .get<std::vector<std::string>>();
+        page.shares.push_back(share);
     }
     
-    sqlite3_finalize(stmt);
-    return shares;
+    return page;
 }
 
 std::string Database::createShareLink(int note_id, int user_id,
                                       std::vector<UserAccessEntry> user_access_list,
                                       int duration_seconds) {
     // Generate random token
-    auto tokenBytes = Crypto::generateRandomBytes(32);
-    std::string token = Crypto::toHex(tokenBytes);
+    auto tokenBytes = Crypto::generateRandomBytes(SHARE_TOKEN_BYTES);
+    if (tokenBytes.empty()) {
+        return "";
+    }
+    std::string token(tokenBytes.begin(), tokenBytes.end());
     
     long expirationTime = static_cast<long>(std::time(nullptr)) + duration_seconds;
     
-    // Insert into SharedLinks
-    const char* insertLinkSql = "INSERT INTO SharedLinks (token, note_id, owner_id, expiration_time) VALUES (?, ?, ?, ?)";
-    sqlite3_stmt* linkStmt;
-    if (sqlite3_prepare_v2(db, insertLinkSql, -1, &linkStmt, nullptr) != SQLITE_OK) {
+    auto conn = pool.acquire();
+    
+    // The link and its whole whitelist are one transaction: one commit however
+    // many recipients, and a failure leaves no half-created link behind
+    Transaction txn(*conn);
+    if (!txn) {
         return "";
     }
     
-    sqlite3_bind_text(linkStmt, 1, token.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(linkStmt, 2, note_id);
-    sqlite3_bind_int(linkStmt, 3, user_id);
-    sqlite3_bind_int64(linkStmt, 4, expirationTime);
+    // Insert into SharedLinks
+    {
+        CachedStatement linkStmt(*conn, Stmt::InsertLink);
+        if (!linkStmt) {
+            return "";
+        }
+        
+        bindToken(linkStmt, 1, token);
+        sqlite3_bind_int(linkStmt, 2, note_id);
+        sqlite3_bind_int(linkStmt, 3, user_id);
+        sqlite3_bind_int64(linkStmt, 4, expirationTime);
+        
+        if (sqlite3_step(linkStmt) != SQLITE_DONE) {
+            return "";
+        }
+    }
+    
+    int linkId = static_cast<int>(sqlite3_last_insert_rowid(conn->handle));
     
-    if (sqlite3_step(linkStmt) != SQLITE_DONE) {
-        sqlite3_finalize(linkStmt);
+    // Insert access entries for each user, reusing one statement
+    CachedStatement accessStmt(*conn, Stmt::InsertLinkAccess);
+    if (!accessStmt) {
         return "";
     }
-    sqlite3_finalize(linkStmt);
     
-    int linkId = static_cast<int>(sqlite3_last_insert_rowid(db));
-    
-    // Insert access entries for each user
-    const char* insertAccessSql = "INSERT INTO SharedLinkAccess (link_id, username, send_public_key_hex, wrapped_key) VALUES (?, ?, ?, ?)";
     for (const auto& entry : user_access_list) {
-        sqlite3_stmt* accessStmt;
-        if (sqlite3_prepare_v2(db, insertAccessSql, -1, &accessStmt, nullptr) != SQLITE_OK) {
-            continue;
-        }
-        
         sqlite3_bind_int(accessStmt, 1, linkId);
-        sqlite3_bind_text(accessStmt, 2, entry.username.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(accessStmt, 3, entry.send_public_key_hex.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(accessStmt, 4, entry.wrapped_key.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(accessStmt, 2, entry.username.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(accessStmt, 3, entry.send_public_key_hex.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(accessStmt, 4, entry.wrapped_key.c_str(), -1, SQLITE_STATIC);
         
-        sqlite3_step(accessStmt);
-        sqlite3_finalize(accessStmt);
+        if (sqlite3_step(accessStmt) != SQLITE_DONE) {
+            std::cerr << "Failed to add " << entry.username << " to share link: " << sqlite3_errmsg(conn->handle) << std::endl;
+            return "";
+        }
+        sqlite3_reset(accessStmt);
     }
     
+    if (!txn.commit()) {
+        return "";
+    }
     return token;
 }
 
 Database::ShareLinkData Database::getShareLinkData(std::string token, std::string username) {
+    return readShareLink(token, username, nullptr);
+}
+
+Database::ShareLinkData Database::getShareLinkRaw(std::string token, std::string username,
+                                                  ContentStore::RangeData& data) {
+    return readShareLink(token, username, &data);
+}
+
+Database::ShareLinkData Database::readShareLink(const std::string& token, const std::string& username,
+                                                ContentStore::RangeData* raw) {
     ShareLinkData result{-1, "", "", "", "", "", false};
     
     long now = static_cast<long>(std::time(nullptr));
     
-    // Get link info and check expiration
-    const char* getLinkSql = "SELECT id, note_id, expiration_time FROM SharedLinks WHERE token = ?";
-    sqlite3_stmt* linkStmt;
-    if (sqlite3_prepare_v2(db, getLinkSql, -1, &linkStmt, nullptr) != SQLITE_OK) {
-        return result;
-    }
-    
-    sqlite3_bind_text(linkStmt, 1, token.c_str(), -1, SQLITE_TRANSIENT);
-    
-    if (sqlite3_step(linkStmt) != SQLITE_ROW) {
-        sqlite3_finalize(linkStmt);
-        return result;
-    }
-    
-    int linkId = sqlite3_column_int(linkStmt, 0);
-    int noteId = sqlite3_column_int(linkStmt, 1);
-    long expirationTime = sqlite3_column_int64(linkStmt, 2);
-    sqlite3_finalize(linkStmt);
+    auto conn = pool.acquire();
     
-    // Check if expired
-    if (expirationTime < now) {
-        // Delete expired link
-        const char* delSql = "DELETE FROM SharedLinks WHERE id = ?";
-        sqlite3_stmt* delStmt;
-        if (sqlite3_prepare_v2(db, delSql, -1, &delStmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(delStmt, 1, linkId);
-            sqlite3_step(delStmt);
-            sqlite3_finalize(delStmt);
+    // Hot link: the token is already resolved, only this user's whitelist row and the note are read
+    LinkTarget link;
+    if (linkCache.get(token, link)) {
+        // Cached entries are checked against their expiration on every access, so
+        // links removed by the expiry sweeper are never served from here
+        if (link.expiration_time < now) {
+            dropExpiredLink(*conn, token, link.link_id);
+            return result;
         }
+        
+        {
+            CachedStatement accessStmt(*conn, Stmt::SelectLinkAccess);
+            if (!accessStmt) {
+                return result;
+            }
+            
+            sqlite3_bind_int(accessStmt, 1, link.link_id);
+            sqlite3_bind_text(accessStmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
+            
+            if (sqlite3_step(accessStmt) != SQLITE_ROW) {
+                return result;
+            }
+            
+            result.send_public_key_hex = reinterpret_cast<const char*>(sqlite3_column_text(accessStmt, 0));
+            result.wrapped_key = reinterpret_cast<const char*>(sqlite3_column_text(accessStmt, 1));
+        }
+        
+        // Same connection, the pool is not re-entrant
+        NoteData note = readNote(*conn, link.note_id, raw);
+        if (note.note_id == -1) {
+            return result;
+        }
+        
+        result.note_id = link.note_id;
+        result.encrypted_content = note.encrypted_content;
+        result.iv_hex = note.iv_hex;
+        result.filename = note.filename;
+        result.valid = true;
         return result;
     }
     
-    // Check if user has access
-    const char* getAccessSql = "SELECT send_public_key_hex, wrapped_key FROM SharedLinkAccess WHERE link_id = ? AND username = ?";
-    sqlite3_stmt* accessStmt;
-    if (sqlite3_prepare_v2(db, getAccessSql, -1, &accessStmt, nullptr) != SQLITE_OK) {
-        return result;
-    }
-    
-    sqlite3_bind_int(accessStmt, 1, linkId);
-    sqlite3_bind_text(accessStmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
-    
-    if (sqlite3_step(accessStmt) != SQLITE_ROW) {
-        sqlite3_finalize(accessStmt);
-        return result;
-    }
-    
-    result.send_public_key_hex = reinterpret_cast<const char*>(sqlite3_column_text(accessStmt, 0));
-    result.wrapped_key = reinterpret_cast<const char*>(sqlite3_column_text(accessStmt, 1));
-    sqlite3_finalize(accessStmt);
-    
-    // Get note data
-    NoteData note = getNoteById(noteId);
-    if (note.note_id == -1) {
-        return result;
+    // Cold link: one joined lookup for the link, the whitelist row and the note metadata
+    uint64_t generation = linkCache.generation(token);
+    {
+        CachedStatement stmt(*conn, Stmt::SelectLinkForAccess);
+        if (!stmt) {
+            return result;
+        }
+        
+        sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
+        bindToken(stmt, 2, token);
+        
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_DONE && legacyTokens) {
+            sqlite3_reset(stmt);
+            bindToken(stmt, 2, token, true);
+            rc = sqlite3_step(stmt);
+        }
+        if (rc != SQLITE_ROW) {
+            return result;
+        }
+        
+        link.link_id = sqlite3_column_int(stmt, 0);
+        link.note_id = sqlite3_column_int(stmt, 1);
+        link.expiration_time = sqlite3_column_int64(stmt, 2);
+        
+        if (link.expiration_time >= now) {
+            // Cached even when this user is not on the whitelist: the link is the same for everyone
+            linkCache.put(token, link, generation);
+            
+            if (sqlite3_column_type(stmt, 3) == SQLITE_NULL) {
+                return result;
+            }
+            
+            result.send_public_key_hex = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            result.wrapped_key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+            
+            // The content is read while the statement still holds the read snapshot
+            NoteData note;
+            note.note_id = link.note_id;
+            note.filename = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
+            note.created_at = sqlite3_column_int64(stmt, 6);
+            if (!readNoteContent(*conn, note, raw)) {
+                return result;
+            }
+            
+            result.note_id = link.note_id;
+            result.encrypted_content = note.encrypted_content;
+            result.iv_hex = note.iv_hex;
+            result.filename = note.filename;
+            result.valid = true;
+            return result;
+        }
     }
     
-    result.note_id = noteId;
-    result.encrypted_content = note.encrypted_content;
-    result.iv_hex = note.iv_hex;
-    result.filename = note.filename;
-    result.valid = true;
-    
+    dropExpiredLink(*conn, token, link.link_id);
     return result;
 }
 
-bool Database::deleteShareLink(std::string token, int user_id) {
-    // Verify ownership
-    const char* checkSql = "SELECT id FROM SharedLinks WHERE token = ? AND owner_id = ?";
-    sqlite3_stmt* checkStmt;
-    if (sqlite3_prepare_v2(db, checkSql, -1, &checkStmt, nullptr) != SQLITE_OK) {
-        return false;
+void Database::dropExpiredLink(Connection& conn, const std::string& token, int link_id) {
+    CachedStatement stmt(conn, Stmt::DeleteLink);
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, link_id);
+        sqlite3_step(stmt);
     }
-    
-    sqlite3_bind_text(checkStmt, 1, token.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(checkStmt, 2, user_id);
-    
-    if (sqlite3_step(checkStmt) != SQLITE_ROW) {
-        sqlite3_finalize(checkStmt);
+    linkCache.invalidate(token);
+}
+
+bool Database::deleteShareLink(std::string token, int user_id) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::DeleteLinkByTokenAndOwner);
+    if (!stmt) {
         return false;
     }
     
-    int linkId = sqlite3_column_int(checkStmt, 0);
-    sqlite3_finalize(checkStmt);
+    // Access entries are removed by ON DELETE CASCADE
+    bindToken(stmt, 1, token);
+    sqlite3_bind_int(stmt, 2, user_id);
     
-    // Delete access entries first
-    const char* delAccessSql = "DELETE FROM SharedLinkAccess WHERE link_id = ?";
-    sqlite3_stmt* delAccessStmt;
-    if (sqlite3_prepare_v2(db, delAccessSql, -1, &delAccessStmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(delAccessStmt, 1, linkId);
-        sqlite3_step(delAccessStmt);
-        sqlite3_finalize(delAccessStmt);
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE && sqlite3_changes(conn->handle) == 0 && legacyTokens) {
+        sqlite3_reset(stmt);
+        bindToken(stmt, 1, token, true);
+        rc = sqlite3_step(stmt);
     }
-    
-    // Delete the link
-    const char* delLinkSql = "DELETE FROM SharedLinks WHERE id = ?";
-    sqlite3_stmt* delLinkStmt;
-    if (sqlite3_prepare_v2(db, delLinkSql, -1, &delLinkStmt, nullptr) != SQLITE_OK) {
+    if (rc != SQLITE_DONE || sqlite3_changes(conn->handle) != 1) {
         return false;
     }
-    
-    sqlite3_bind_int(delLinkStmt, 1, linkId);
-    int rc = sqlite3_step(delLinkStmt);
-    sqlite3_finalize(delLinkStmt);
-    
-    return rc == SQLITE_DONE;
+    linkCache.invalidate(token);
+    return true;
 }
 
 bool Database::createUserShare(int note_id, int sender_id, int recipient_id,
@@ -538,10 +1545,9 @@ bool Database::createUserShare(int note_id, int sender_id, int recipient_id,
                                int duration_seconds) {
     long expirationTime = static_cast<long>(std::time(nullptr)) + duration_seconds;
     
-    const char* sql = "INSERT INTO UserShares (note_id, sender_id, recipient_id, send_public_key_hex, new_wrapped_key, expiration_time) VALUES (?, ?, ?, ?, ?, ?)";
-    
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::InsertUserShare);
+    if (!stmt) {
         return false;
     }
     
@@ -552,10 +1558,7 @@ bool Database::createUserShare(int note_id, int sender_id, int recipient_id,
     sqlite3_bind_text(stmt, 5, new_wrapped_key.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int64(stmt, 6, expirationTime);
     
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    
-    return rc == SQLITE_DONE;
+    return sqlite3_step(stmt) == SQLITE_DONE;
 }
 
 std::vector<int> Database::getSharedNotesForUser(int user_id) {
@@ -563,10 +1566,9 @@ std::vector<int> Database::getSharedNotesForUser(int user_id) {
     
     long now = static_cast<long>(std::time(nullptr));
     
-    const char* sql = "SELECT id FROM UserShares WHERE recipient_id = ? AND expiration_time > ?";
-    
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectUserSharesByRecipient);
+    if (!stmt) {
         return shareIds;
     }
     
@@ -577,7 +1579,6 @@ std::vector<int> Database::getSharedNotesForUser(int user_id) {
         shareIds.push_back(sqlite3_column_int(stmt, 0));
     }
     
-    sqlite3_finalize(stmt);
     return shareIds;
 }
 
@@ -587,16 +1588,9 @@ Database::ShareInfo Database::getShareInfo(int share_id, int recipient_id) {
     
     long now = static_cast<long>(std::time(nullptr));
     
-    const char* sql = R"(
-        SELECT us.note_id, us.send_public_key_hex, us.new_wrapped_key, 
-               n.encrypted_content, n.iv_hex
-        FROM UserShares us
-        JOIN Notes n ON us.note_id = n.id
-        WHERE us.id = ? AND us.recipient_id = ? AND us.expiration_time > ?
-    )";
-    
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectShareInfo);
+    if (!stmt) {
         return info;
     }
     
@@ -605,13 +1599,237 @@ Database::ShareInfo Database::getShareInfo(int share_id, int recipient_id) {
     sqlite3_bind_int64(stmt, 3, now);
     
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        info.note_id = sqlite3_column_int(stmt, 0);
+        int noteId = sqlite3_column_int(stmt, 0);
         info.send_public_key_hex = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
         info.new_wrapped_key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        info.encrypted_content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        info.iv_hex = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+        info.iv_hex = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        if (readContent(*conn, noteId, info.encrypted_content)) {
+            info.note_id = noteId;
+        }
     }
     
-    sqlite3_finalize(stmt);
     return info;
 }
+
+int Database::deleteExpired(Stmt id, long now, int batch_size) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, id);
+    if (!stmt) {
+        return -1;
+    }
+    
+    sqlite3_bind_int64(stmt, 1, now);
+    sqlite3_bind_int(stmt, 2, batch_size);
+    
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cerr << "Expiry sweep failed: " << sqlite3_errmsg(conn->handle) << std::endl;
+        return -1;
+    }
+    return sqlite3_changes(conn->handle);
+}
+
+long Database::countExpired(Stmt id, long now) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, id);
+    if (!stmt) {
+        return -1;
+    }
+    
+    sqlite3_bind_int64(stmt, 1, now);
+    
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return -1;
+    }
+    return static_cast<long>(sqlite3_column_int64(stmt, 0));
+}
+
+int Database::deleteExpiredLinks(long now, int batch_size) {
+    return deleteExpired(Stmt::DeleteExpiredLinks, now, batch_size);
+}
+
+int Database::deleteExpiredUserShares(long now, int batch_size) {
+    return deleteExpired(Stmt::DeleteExpiredUserShares, now, batch_size);
+}
+
+long Database::countExpiredLinks(long now) {
+    return countExpired(Stmt::CountExpiredLinks, now);
+}
+
+long Database::countExpiredUserShares(long now) {
+    return countExpired(Stmt::CountExpiredUserShares, now);
+}
+
+std::string Database::segmentDirFor(const std::string& database_path) {
+    size_t ext = database_path.rfind(".db");
+    if (ext != std::string::npos && ext + 3 == database_path.size()) {
+        return database_path.substr(0, ext) + ".segments";
+    }
+    return database_path + ".segments";
+}
+
+bool Database::backup(const std::string& destination, int pages_per_step, int pause_ms,
+                      const BackupProgress& progress) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::string partial = destination + ".partial";
+    fs::remove(partial, ec);
+    fs::remove(partial + "-journal", ec);
+
+    // A connection of its own: a pooled one would be kept from the workers for the whole copy
+    sqlite3* source = nullptr;
+    sqlite3* target = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &source, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK ||
+        sqlite3_open_v2(partial.c_str(), &target, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+        std::cerr << "Cannot open databases for backup to " << destination << std::endl;
+        sqlite3_close(source);
+        sqlite3_close(target);
+        return false;
+    }
+    sqlite3_busy_timeout(source, BUSY_TIMEOUT_MS);
+
+    // Pins the read snapshot: every step below reads the database as of this moment,
+    // so commits from other connections neither show up in the copy nor restart it.
+    // Writers are not blocked (WAL); checkpoints just cannot pass this reader until it ends.
+    bool ok = exec(source, "BEGIN; SELECT COUNT(*) FROM sqlite_master;", "start backup snapshot");
+
+    // Segment files are copied after the pin, so they hold everything the snapshot references
+    std::string segments = segmentDirFor(destination);
+    fs::remove_all(segments, ec);
+    ok = ok && contents->snapshot(segments);
+
+    sqlite3_backup* job = ok ? sqlite3_backup_init(target, "main", source, "main") : nullptr;
+    int rc = job ? SQLITE_OK : SQLITE_ERROR;
+    while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+        rc = sqlite3_backup_step(job, pages_per_step);
+        if (progress) {
+            long long total = sqlite3_backup_pagecount(job);
+            progress(total - sqlite3_backup_remaining(job), total);
+        }
+        if (rc != SQLITE_DONE && pause_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(pause_ms));
+        }
+    }
+    if (job && sqlite3_backup_finish(job) != SQLITE_OK) {
+        rc = SQLITE_ERROR;
+    }
+    if (ok && rc != SQLITE_DONE) {
+        std::cerr << "Backup to " << destination << " failed: " << sqlite3_errmsg(target) << std::endl;
+    }
+    ok = ok && rc == SQLITE_DONE;
+
+    exec(source, "COMMIT;", "end backup snapshot");
+    sqlite3_close(source);
+    sqlite3_close(target);
+
+    // The snapshot only appears under its name once it is complete
+    if (ok) {
+        fs::rename(partial, destination, ec);
+        if (ec) {
+            std::cerr << "Cannot move backup to " << destination << ": " << ec.message() << std::endl;
+            ok = false;
+        }
+    }
+    if (!ok) {
+        fs::remove(partial, ec);
+        fs::remove_all(segments, ec);
+    }
+    return ok;
+}
+
+ContentStore::Compaction Database::compactContent(double min_dead_ratio) {
+    auto conn = pool.acquire();
+    return contents->compact(*conn, min_dead_ratio);
+}
+
+ContentStore::Usage Database::contentUsage() {
+    auto conn = pool.acquire();
+    return contents->usage(*conn);
+}
+
+bool Database::addLinkRoute(const std::string& token, int shard, long expiration_time) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::InsertLinkRoute);
+    if (!stmt) {
+        return false;
+    }
+    
+    bindToken(stmt, 1, token);
+    sqlite3_bind_int(stmt, 2, shard);
+    sqlite3_bind_int64(stmt, 3, expiration_time);
+    
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+int Database::findLinkRoute(const std::string& token) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectLinkRoute);
+    if (!stmt) {
+        return -1;
+    }
+    
+    bindToken(stmt, 1, token);
+    
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE && legacyTokens) {
+        sqlite3_reset(stmt);
+        bindToken(stmt, 1, token, true);
+        rc = sqlite3_step(stmt);
+    }
+    if (rc != SQLITE_ROW) {
+        return -1;
+    }
+    return sqlite3_column_int(stmt, 0);
+}
+
+bool Database::deleteLinkRoute(const std::string& token) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::DeleteLinkRoute);
+    if (!stmt) {
+        return false;
+    }
+    
+    bindToken(stmt, 1, token);
+    
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        return false;
+    }
+    if (sqlite3_changes(conn->handle) == 0 && legacyTokens) {
+        sqlite3_reset(stmt);
+        bindToken(stmt, 1, token, true);
+        return sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    return true;
+}
+
+int Database::deleteExpiredLinkRoutes(long now, int batch_size) {
+    return deleteExpired(Stmt::DeleteExpiredLinkRoutes, now, batch_size);
+}
+
+bool Database::readSetting(const std::string& name, std::string& value) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::SelectSetting);
+    if (!stmt) {
+        return false;
+    }
+    
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+    
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return false;
+    }
+    value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    return true;
+}
+
+bool Database::writeSetting(const std::string& name, const std::string& value) {
+    auto conn = pool.acquire();
+    CachedStatement stmt(*conn, Stmt::InsertSetting);
+    if (!stmt) {
+        return false;
+    }
+    
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_STATIC);
+    
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
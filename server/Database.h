@@ -2,91 +2,164 @@
 #include <string>
 #include <vector>
 #include <sqlite3.h>
-#include "../common/Protocol.h"
-
-// Struct ánh xạ dữ liệu từ bảng Users
-struct UserRecord {
-    int id;
-    std::string username;
-    std::string password_hash; // Đã băm
-    std::string salt;
-    std::string receive_public_key_hex; // Key ECDH công khai (Receive Key)
-};
+#include <memory>
+#include <atomic>
+#include "ConnectionPool.h"
+#include "ContentStore.h"
+#include "Storage.h"
+#include "LruCache.h"
 
+// Storage trên SQLite (file secure_notes.db, WAL, pool kết nối)
+class Database : public Storage {
+private:
+    // Thời gian chờ khi một writer khác đang giữ lock (ms)
+    static const int BUSY_TIMEOUT_MS = 5000;
+    // Số UserRecord giữ trong cache (login, register, pubkey)
+    static const size_t USER_CACHE_CAPACITY = 10000;
+    // Số share link giữ trong cache (link được nhiều người mở)
+    static const size_t LINK_CACHE_CAPACITY = 10000;
 
+    // Những gì của một link không phụ thuộc người mở
+    struct LinkTarget {
+        int link_id;
+        int note_id;
+        long expiration_time;
+    };
 
-class Database {
-private:
-    sqlite3* db; // Con trỏ kết nối DB
+    const std::string path; // File DB, backup mở kết nối riêng tới file này
+    ConnectionPool pool; // Pool kết nối (WAL), mỗi request mượn một kết nối
+    std::unique_ptr<ContentStore> contents; // Nơi lưu ciphertext (SQLite hoặc segment files)
+    LruCache<std::string, UserRecord> userCache; // username -> UserRecord, xóa khi createUser/updateUserPublicKey
+    LruCache<std::string, LinkTarget> linkCache; // token -> LinkTarget, xóa khi deleteShareLink/deleteNote/hết hạn
+    // Còn dòng có token dạng hex TEXT (backfill version 6 chưa xong): tra token trượt thì thử lại dạng hex
+    std::atomic<bool> legacyTokens{false};
+    // Còn ciphertext dạng base64 TEXT (backfill version 2 chưa xong): đọc note thì kiểm tra dạng TEXT trước
+    std::atomic<bool> legacyContent{false};
+
+    // Đọc note trên một kết nối đã mượn sẵn; raw != nullptr: ciphertext thô vào raw thay vì base64 trong note
+    NoteData readNote(Connection& conn, int note_id, ContentStore::RangeData* raw);
+    // Đọc các cột metadata của một dòng Stmt::SelectNoteById (bảng Notes)
+    static void readNoteColumns(sqlite3_stmt* stmt, NoteData& note);
+    // Đọc wrapped_key, iv_hex của note từ bảng NoteContents
+    bool readNoteKeys(Connection& conn, NoteData& note);
+    // Như trên, kèm ciphertext (base64, hoặc thô vào raw nếu raw != nullptr)
+    bool readNoteContent(Connection& conn, NoteData& note, ContentStore::RangeData* raw);
+    // Ciphertext của một note qua contents, hoặc từ dòng TEXT cũ nếu backfill version 2 chưa tới
+    bool readContent(Connection& conn, sqlite3_int64 note_id, std::string& encoded);
+    bool readContentRange(Connection& conn, sqlite3_int64 note_id, const ContentStore::ByteRange& range,
+                          ContentStore::RangeData& data);
+    // true nếu note còn giữ base64 TEXT (khi đó encoded là chuỗi đó)
+    bool readLegacyContent(Connection& conn, sqlite3_int64 note_id, std::string& encoded);
+    // Kiểm tra chủ sở hữu rồi đọc note; range = nullptr: cả ciphertext (base64), ngược lại chỉ đoạn đó vào data
+    NoteAccess readOwnedNote(int note_id, int user_id, NoteData& note,
+                             const ContentStore::ByteRange* range, ContentStore::RangeData* data);
+    // Dùng chung cho link và user share hết hạn
+    int deleteExpired(Stmt id, long now, int batch_size);
+    long countExpired(Stmt id, long now);
+    // Token của mọi link trên note (để xóa khỏi linkCache khi xóa note)
+    bool selectLinkTokens(Connection& conn, int note_id, std::vector<std::string>& tokens);
+    // getShareLinkData / getShareLinkRaw; raw = nullptr: ciphertext base64 trong kết quả
+    ShareLinkData readShareLink(const std::string& token, const std::string& username, ContentStore::RangeData* raw);
+    // Xóa link đã hết hạn mà người mở vừa gặp
+    void dropExpiredLink(Connection& conn, const std::string& token, int link_id);
 
 public:
-    Database();
-    ~Database();
+    // pool_size: số kết nối, nên bằng số worker thread của Crow
+    // contents: nơi lưu ciphertext, mặc định ngay trong SQLite (SqliteContentStore)
+    // tuning: cache, mmap, synchronous của từng kết nối (ServerConfig)
+    Database(const std::string& path = "secure_notes.db", size_t pool_size = 1,
+             std::unique_ptr<ContentStore> contents = nullptr, const SqliteTuning& tuning = SqliteTuning());
 
-    // Khởi tạo bảng (Users, Notes, SharedLinks)
-    bool init();
+    // Tạo schema mới, hoặc chạy các migration còn thiếu theo user_version (mỗi migration một transaction).
+    // Schema đã mới nhất thì không chạy DDL nào. Từ chối DB có version mới hơn server.
+    bool init() override;
+    // Backfill sau migration (ciphertext base64 -> BLOB của version 2, rồi token hex -> BLOB của version 6),
+    // tiếp tục từ vị trí lưu trong Settings
+    int backfillStep(int batch_size) override;
 
     // --- User Operations ---
-    bool createUser(std::string username, std::string pass_hash, std::string salt, std::string receive_pub_key);
-    UserRecord getUserByUsername(std::string username);
-    bool updateUserPublicKey(int user_id, std::string receive_pub_key);
+    bool createUser(std::string username, std::string pass_hash, std::string salt, std::string receive_pub_key) override;
+    UserRecord getUserByUsername(std::string username) override;
+    bool updateUserPublicKey(int user_id, std::string receive_pub_key) override;
+    CacheStats userCacheStats() override;
+    CacheStats linkCacheStats() override;
 
     // --- Note Operations ---
-    // Trả về note_id vừa tạo
-    int saveNote(int user_id, std::string encrypted_content, std::string wrapped_key, std::string iv_hex, std::string filename);
-    NoteData getNoteById(int note_id);
-    
+    int saveNote(int user_id, std::string encrypted_content, std::string wrapped_key, std::string iv_hex, std::string filename) override;
+    std::vector<int> saveNotes(const std::vector<NewNote>& notes) override;
+    // Một transaction riêng, không qua group commit; ciphertext ghi thẳng vào blob/segment theo từng khối
+    int saveNoteStream(int user_id, long long size, const ContentStore::ChunkSource& next,
+                       std::string wrapped_key, std::string iv_hex, std::string filename) override;
+    NoteData getNoteById(int note_id) override;
+    NoteAccess getNoteForOwner(int note_id, int user_id, NoteData& note) override;
+    NoteAccess getNoteRangeForOwner(int note_id, int user_id, const ContentStore::ByteRange& range,
+                                    NoteData& note, ContentStore::RangeData& data) override;
+
     // --- Sharing Operations ---
-    // Tạo link chia sẻ với whitelist username, trả về token chuỗi
-    struct UserAccessEntry {
-        std::string username;
-        std::string send_public_key_hex;
-        std::string wrapped_key;
-    };
-    std::string createShareLink(int note_id, int user_id, 
+    std::string createShareLink(int note_id, int user_id,
                                 std::vector<UserAccessEntry> user_access_list,
-                                int duration_seconds);
-    // Kiểm tra quyền truy cập và lấy dữ liệu
-    struct ShareLinkData {
-        int note_id;
-        std::string encrypted_content;
-        std::string send_public_key_hex;
-        std::string wrapped_key;
-        std::string iv_hex;
-        std::string filename;
-        bool valid;
-    };
-    ShareLinkData getShareLinkData(std::string token, std::string username);
-    // Xóa link chia sẻ
-    bool deleteShareLink(std::string token, int user_id);
-    
-    // Chia sẻ ghi chú với người dùng cụ thể (User-to-User)
-    bool createUserShare(int note_id, int sender_id, int recipient_id, 
-                         std::string send_public_key_hex, std::string new_wrapped_key, 
-                         int duration_seconds);
-    // Lấy danh sách ghi chú được chia sẻ cho user
-    std::vector<int> getSharedNotesForUser(int user_id);
-    // Lấy thông tin chia sẻ cụ thể
-    struct ShareInfo {
-        int note_id;
-        std::string send_public_key_hex;
-        std::string new_wrapped_key;
-        std::string encrypted_content;
-        std::string iv_hex;
-    };
-    ShareInfo getShareInfo(int share_id, int recipient_id);
-    
-    // Lấy danh sách ghi chú của user
-    std::vector<NoteData> getNotesForUser(int user_id);
-    // Xóa ghi chú
-    bool deleteNote(int note_id, int user_id);
-    
-    // Lấy danh sách share links do user tạo (outgoing shares)
-    struct OutgoingShare {
-        int note_id;
-        std::string token;
-        long expiration_time;
-        std::vector<std::string> shared_with; // Danh sách usernames được chia sẻ
-    };
-    std::vector<OutgoingShare> getOutgoingShares(int user_id);
+                                int duration_seconds) override;
+    // Lần đầu: một truy vấn join (link + whitelist + note); các lần sau bỏ qua bảng SharedLinks nhờ linkCache
+    ShareLinkData getShareLinkData(std::string token, std::string username) override;
+    ShareLinkData getShareLinkRaw(std::string token, std::string username, ContentStore::RangeData& data) override;
+    bool deleteShareLink(std::string token, int user_id) override;
+    bool createUserShare(int note_id, int sender_id, int recipient_id,
+                         std::string send_public_key_hex, std::string new_wrapped_key,
+                         int duration_seconds) override;
+    std::vector<int> getSharedNotesForUser(int user_id) override;
+    ShareInfo getShareInfo(int share_id, int recipient_id) override;
+
+    NotePage listNotes(int user_id, const NoteCursor& after, int limit) override;
+    // Link, quyền truy cập và user share bị xóa theo qua ON DELETE CASCADE
+    bool deleteNote(int note_id, int user_id) override;
+    std::vector<int> deleteNotes(int user_id, const std::vector<int>& note_ids) override;
+
+    // Một truy vấn duy nhất cho cả trang, kể cả danh sách người nhận
+    OutgoingSharePage listOutgoingShares(int user_id, const ShareCursor& after, int limit, bool active_only) override;
+
+    // --- Dọn dẹp share hết hạn (ExpirySweeper) ---
+    // Mỗi lần gọi là một transaction ngắn (SharedLinkAccess xóa theo cascade).
+    int deleteExpiredLinks(long now, int batch_size) override;
+    int deleteExpiredUserShares(long now, int batch_size) override;
+    long countExpiredLinks(long now) override;
+    long countExpiredUserShares(long now) override;
+
+    // --- Backup (BackupRunner) ---
+    // Kết nối riêng giữ một read transaction suốt quá trình chép (WAL: writer vẫn chạy),
+    // nên snapshot là đúng thời điểm bắt đầu. Ghi ra file tạm rồi đổi tên khi xong.
+    // Segment files được chép vào thư mục cùng tên với destination, đuôi .segments
+    bool backup(const std::string& destination, int pages_per_step, int pause_ms,
+                const BackupProgress& progress) override;
+    // secure_notes.db -> secure_notes.segments
+    static std::string segmentDirFor(const std::string& database_path);
+
+    // --- Segment files (ContentCompactor) ---
+    // Dọn segment có tỉ lệ dữ liệu chết >= min_dead_ratio; không làm gì nếu ciphertext nằm trong SQLite
+    ContentStore::Compaction compactContent(double min_dead_ratio) override;
+    ContentStore::Usage contentUsage() override;
+
+    // --- Sharding (ShardedStorage) ---
+    // Bản sao user của directory trong một shard, chỉ để thỏa khóa ngoại (id giữ nguyên, bỏ qua nếu đã có)
+    bool createUserStub(int user_id, std::string username);
+    // Nhiều stub trong một transaction (sửa shard thiếu user)
+    bool createUserStubs(const std::vector<std::pair<int, std::string>>& users);
+    // Một trang (id, username) theo id tăng dần, sau after_id
+    std::vector<std::pair<int, std::string>> listUserIds(int after_id, int limit);
+    // id user lớn nhất, 0 nếu chưa có user, -1 nếu lỗi
+    int maxUserId();
+    // Directory: token của link -> shard chứa link. -1 nếu không có.
+    bool addLinkRoute(const std::string& token, int shard, long expiration_time);
+    int findLinkRoute(const std::string& token);
+    bool deleteLinkRoute(const std::string& token);
+    int deleteExpiredLinkRoutes(long now, int batch_size);
+    // Cấu hình lưu trong DB (bảng Settings), false nếu chưa có
+    bool readSetting(const std::string& name, std::string& value);
+    bool writeSetting(const std::string& name, const std::string& value);
+
+private:
+    // Thêm một note trong transaction của caller: ghi dòng với zeroblob rồi giải mã ciphertext vào blob theo từng khối
+    int insertNote(Connection& conn, const NewNote& note, long created_at);
+    // Như trên với ciphertext thô lấy từ `next` (note.encrypted_content bỏ qua)
+    int insertNote(Connection& conn, const NewNote& note, long long size,
+                   const ContentStore::ChunkSource& next, long created_at);
 };
@@ -0,0 +1,96 @@
+#include "ExpirySweeper.h"
+#include <iostream>
+#include <ctime>
+
+ExpirySweeper::ExpirySweeper(Storage& db, int interval_seconds, int batch_size, int max_batches)
+    : db(db), intervalSeconds(interval_seconds), batchSize(batch_size), maxBatches(max_batches) {
+}
+
+ExpirySweeper::~ExpirySweeper() {
+    stop();
+}
+
+void ExpirySweeper::start() {
+    if (!worker.joinable()) {
+        worker = std::thread(&ExpirySweeper::run, this);
+    }
+}
+
+void ExpirySweeper::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void ExpirySweeper::run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stopping) {
+        lock.unlock();
+        sweepOnce();
+        lock.lock();
+        wake.wait_for(lock, std::chrono::seconds(intervalSeconds), [this] { return stopping; });
+    }
+}
+
+long long ExpirySweeper::sweepTable(int (Storage::*deleteBatch)(long, int), long now) {
+    long long deleted = 0;
+    for (int batch = 0; batch < maxBatches; batch++) {
+        // The connection goes back to the pool between batches, so request
+        // handlers interleave with a large sweep instead of queueing behind it
+        int rows = (db.*deleteBatch)(now, batchSize);
+        if (rows <= 0) {
+            break;
+        }
+        deleted += rows;
+        if (rows < batchSize) {
+            break;
+        }
+    }
+    return deleted;
+}
+
+long long ExpirySweeper::sweepOnce() {
+    auto start = std::chrono::steady_clock::now();
+    long now = static_cast<long>(std::time(nullptr));
+
+    long long links = sweepTable(&Storage::deleteExpiredLinks, now);
+    long long shares = sweepTable(&Storage::deleteExpiredUserShares, now);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    linksDeleted += links;
+    userSharesDeleted += shares;
+    lastPassDeleted = links + shares;
+    lastPassMs = ms;
+    lastPassRate = ms > 0 ? (links + shares) * 1000.0 / ms : 0;
+    backlogLinks = db.countExpiredLinks(now);
+    backlogUserShares = db.countExpiredUserShares(now);
+    passes++;
+
+    if (links + shares > 0) {
+        std::cout << "Expiry sweep: removed " << links << " links and " << shares
+                  << " user shares in " << ms << " ms" << std::endl;
+    }
+    return links + shares;
+}
+
+ExpirySweeper::Stats ExpirySweeper::stats() const {
+    Stats s;
+    s.passes = passes;
+    s.links_deleted = linksDeleted;
+    s.user_shares_deleted = userSharesDeleted;
+    s.last_pass_deleted = lastPassDeleted;
+    s.last_pass_ms = lastPassMs;
+    s.last_pass_rows_per_second = lastPassRate;
+    s.backlog_links = backlogLinks;
+    s.backlog_user_shares = backlogUserShares;
+    s.batch_size = batchSize;
+    s.max_batches = maxBatches;
+    s.interval_seconds = intervalSeconds;
+    return s;
+}
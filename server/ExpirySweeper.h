@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "Storage.h"
+
+// Background thread that deletes expired share links (with their access rows)
+// and expired user shares. Each pass walks the expiration_time indexes, so it
+// only touches rows that are actually due, and deletes them in small batches
+// (one short write transaction each) so uploads are never blocked for long.
+class ExpirySweeper {
+public:
+    // Counters for GET /metrics
+    struct Stats {
+        long long passes;
+        long long links_deleted;        // SharedLinkAccess rows go with them (cascade)
+        long long user_shares_deleted;
+        long long last_pass_deleted;
+        double last_pass_ms;
+        double last_pass_rows_per_second;
+        long backlog_links;             // Still expired after the last pass (pass hit max_batches)
+        long backlog_user_shares;
+        int batch_size;
+        int max_batches;
+        int interval_seconds;
+    };
+
+    // Up to max_batches batches of batch_size rows per table and pass
+    ExpirySweeper(Storage& db, int interval_seconds, int batch_size, int max_batches);
+    ~ExpirySweeper();
+    ExpirySweeper(const ExpirySweeper&) = delete;
+    ExpirySweeper& operator=(const ExpirySweeper&) = delete;
+
+    void start();
+    void stop();
+
+    // One pass on the calling thread; returns the number of rows deleted
+    long long sweepOnce();
+
+    Stats stats() const;
+
+private:
+    void run();
+    long long sweepTable(int (Storage::*deleteBatch)(long, int), long now);
+
+    Storage& db;
+    const int intervalSeconds;
+    const int batchSize;
+    const int maxBatches;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::atomic<long long> passes{0};
+    std::atomic<long long> linksDeleted{0};
+    std::atomic<long long> userSharesDeleted{0};
+    std::atomic<long long> lastPassDeleted{0};
+    std::atomic<double> lastPassMs{0};
+    std::atomic<double> lastPassRate{0};
+    std::atomic<long> backlogLinks{0};
+    std::atomic<long> backlogUserShares{0};
+};
@@ -0,0 +1,145 @@
+#include "GroupCommitQueue.h"
+#include <iostream>
+
+GroupCommitQueue::GroupCommitQueue(Storage& db, int window_ms, size_t max_batch)
+    : db(db), window(window_ms), maxBatch(max_batch == 0 ? 1 : max_batch) {
+}
+
+GroupCommitQueue::~GroupCommitQueue() {
+    stop();
+}
+
+void GroupCommitQueue::start() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!running) {
+        running = true;
+        stopping = false;
+        writer = std::thread(&GroupCommitQueue::run, this);
+    }
+}
+
+void GroupCommitQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!running) {
+            return;
+        }
+        stopping = true;
+    }
+    hasWork.notify_all();
+    writer.join();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    running = false;
+}
+
+int GroupCommitQueue::saveNote(int user_id, std::string encrypted_content, std::string wrapped_key,
+                               std::string iv_hex, std::string filename) {
+    return saveNote(Storage::NewNote{user_id, std::move(encrypted_content), std::move(wrapped_key),
+                                     std::move(iv_hex), std::move(filename)});
+}
+
+int GroupCommitQueue::saveNote(Storage::NewNote note) {
+    auto pending = std::make_shared<Pending>();
+    pending->note = std::move(note);
+    std::future<int> result = pending->result.get_future();
+
+    bool direct;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        direct = !running || stopping;
+        if (!direct) {
+            queue.push_back(pending);
+        }
+    }
+    if (direct) {
+        // A batch of one, so raw content takes the same path as in a group commit.
+        // Written outside the lock, which would otherwise hold up start() and stats().
+        return db.saveNotes({std::move(pending->note)})[0];
+    }
+    hasWork.notify_one();
+
+    return result.get();
+}
+
+void GroupCommitQueue::run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        hasWork.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            break; // stopping and drained
+        }
+
+        // Notes that queued up while the previous batch was committing are taken
+        // right away. A non-zero window additionally holds the batch open for
+        // late arrivals, which pays off when each commit is expensive (fsync).
+        if (window.count() > 0 && !stopping && queue.size() < maxBatch) {
+            auto deadline = std::chrono::steady_clock::now() + window;
+            hasWork.wait_until(lock, deadline, [this] { return stopping || queue.size() >= maxBatch; });
+        }
+
+        std::vector<std::shared_ptr<Pending>> batch;
+        while (!queue.empty() && batch.size() < maxBatch) {
+            batch.push_back(queue.front());
+            queue.pop_front();
+        }
+
+        lock.unlock();
+        commitBatch(batch);
+        lock.lock();
+    }
+}
+
+void GroupCommitQueue::commitBatch(std::vector<std::shared_ptr<Pending>>& batch) {
+    std::vector<Storage::NewNote> newNotes;
+    newNotes.reserve(batch.size());
+    for (auto& pending : batch) {
+        newNotes.push_back(std::move(pending->note));
+    }
+
+    std::vector<int> ids;
+    try {
+        ids = db.saveNotes(newNotes);
+    } catch (const std::exception& e) {
+        std::cerr << "Group commit failed: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "Group commit failed" << std::endl;
+    }
+    // Every caller is blocked on its promise: notes without an id get -1
+    ids.resize(batch.size(), -1);
+
+    long long failures = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (ids[i] == -1) {
+            failures++;
+        }
+        batch[i]->result.set_value(ids[i]);
+    }
+
+    batches++;
+    notes += batch.size();
+    failed += failures;
+    lastBatch = batch.size();
+    if (batch.size() > largestBatch) {
+        largestBatch = batch.size();
+    }
+    if (failures > 0) {
+        std::cerr << "Group commit: " << failures << " of " << batch.size() << " notes failed" << std::endl;
+    }
+}
+
+GroupCommitQueue::Stats GroupCommitQueue::stats() const {
+    Stats s;
+    s.batches = batches;
+    s.notes = notes;
+    s.failed = failed;
+    s.last_batch = lastBatch;
+    s.largest_batch = largestBatch;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        s.pending = queue.size();
+    }
+    s.window_ms = static_cast<int>(window.count());
+    s.max_batch = maxBatch;
+    return s;
+}
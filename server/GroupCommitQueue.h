@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "Storage.h"
+
+// Group commit for note uploads. Request handlers enqueue their note and block
+// until it is stored; a single writer thread takes everything that is waiting
+// (plus whatever arrives within the commit window, up to max_batch notes) and
+// writes it with one transaction, then hands every caller its own note_id.
+// Concurrent uploads then share one commit instead of queueing on the write
+// lock one by one. With window_ms = 0 the batch is whatever piled up while
+// the previous commit was running, so an idle server adds no delay.
+class GroupCommitQueue {
+public:
+    // Counters for GET /metrics
+    struct Stats {
+        long long batches;
+        long long notes;
+        long long failed;
+        size_t last_batch;
+        size_t largest_batch;
+        size_t pending;
+        int window_ms;
+        size_t max_batch;
+    };
+
+    GroupCommitQueue(Storage& db, int window_ms, size_t max_batch);
+    ~GroupCommitQueue();
+    GroupCommitQueue(const GroupCommitQueue&) = delete;
+    GroupCommitQueue& operator=(const GroupCommitQueue&) = delete;
+
+    void start();
+    // Commits what is already queued, then stops the writer
+    void stop();
+
+    // Same contract as Storage::saveNote: the new note_id, or -1 on failure.
+    // Falls back to a direct write while the writer is not running.
+    int saveNote(int user_id, std::string encrypted_content, std::string wrapped_key,
+                 std::string iv_hex, std::string filename);
+    // Same, for a note that may carry raw ciphertext (NewNote::raw_content)
+    int saveNote(Storage::NewNote note);
+
+    Stats stats() const;
+
+private:
+    struct Pending {
+        Storage::NewNote note;
+        std::promise<int> result;
+    };
+
+    void run();
+    void commitBatch(std::vector<std::shared_ptr<Pending>>& batch);
+
+    Storage& db;
+    const std::chrono::milliseconds window;
+    const size_t maxBatch;
+
+    std::thread writer;
+    mutable std::mutex mtx;
+    std::condition_variable hasWork;
+    std::deque<std::shared_ptr<Pending>> queue; // Shared so the writer never touches a returned caller's frame
+    bool running = false;
+    bool stopping = false;
+
+    std::atomic<long long> batches{0};
+    std::atomic<long long> notes{0};
+    std::atomic<long long> failed{0};
+    std::atomic<size_t> lastBatch{0};
+    std::atomic<size_t> largestBatch{0};
+};
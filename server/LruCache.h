@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Counters of one cache for GET /metrics
+struct CacheStats {
+    long long hits = 0;
+    long long misses = 0;
+    long long evictions = 0;
+    long long invalidations = 0;
+    size_t entries = 0;
+    size_t capacity = 0;
+
+    // Totals over several caches (one per shard database)
+    CacheStats& operator+=(const CacheStats& other) {
+        hits += other.hits;
+        misses += other.misses;
+        evictions += other.evictions;
+        invalidations += other.invalidations;
+        entries += other.entries;
+        capacity += other.capacity;
+        return *this;
+    }
+};
+
+// Thread-safe LRU cache split into independently locked shards (each with its
+// own recency list and 1/shards of the capacity), so concurrent lookups of
+// different keys rarely share a lock.
+//
+// Loading from the database races with invalidation: a reader may fetch a row,
+// an update then invalidates the key, and the reader inserts the old row. To
+// close that window a loader takes generation(key) before it queries and hands
+// it to put(); the entry is dropped if its shard was invalidated in between.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+    // capacity 0 disables the cache (every get misses, put does nothing)
+    explicit LruCache(size_t capacity, size_t shards = 16)
+        : capacity(capacity), shards(shards == 0 ? 1 : shards) {
+        size_t perShard = (capacity + this->shards.size() - 1) / this->shards.size();
+        for (auto& shard : this->shards) {
+            shard.capacity = perShard;
+        }
+    }
+    LruCache(const LruCache&) = delete;
+    LruCache& operator=(const LruCache&) = delete;
+
+    // Copies the cached value into `value` and marks it most recently used
+    bool get(const Key& key, Value& value) {
+        Shard& shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            misses++;
+            return false;
+        }
+        shard.order.splice(shard.order.begin(), shard.order, it->second);
+        value = it->second->second;
+        hits++;
+        return true;
+    }
+
+    uint64_t generation(const Key& key) {
+        Shard& shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        return shard.generation;
+    }
+
+    // Inserts or replaces a value loaded after generation(key) returned `generation`
+    void put(const Key& key, Value value, uint64_t generation) {
+        Shard& shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        if (shard.capacity == 0 || shard.generation != generation) {
+            return;
+        }
+
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            it->second->second = std::move(value);
+            shard.order.splice(shard.order.begin(), shard.order, it->second);
+            return;
+        }
+
+        shard.order.emplace_front(key, std::move(value));
+        shard.index.emplace(key, shard.order.begin());
+        if (shard.index.size() > shard.capacity) {
+            shard.index.erase(shard.order.back().first);
+            shard.order.pop_back();
+            evictions++;
+        }
+    }
+
+    // Drops the key (if cached) and fails every put() that loaded before this call
+    void invalidate(const Key& key) {
+        Shard& shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        shard.generation++;
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.order.erase(it->second);
+            shard.index.erase(it);
+        }
+        invalidations++;
+    }
+
+    CacheStats stats() {
+        CacheStats s;
+        s.hits = hits;
+        s.misses = misses;
+        s.evictions = evictions;
+        s.invalidations = invalidations;
+        s.capacity = capacity;
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            s.entries += shard.index.size();
+        }
+        return s;
+    }
+
+private:
+    struct Shard {
+        std::mutex mtx;
+        std::list<std::pair<Key, Value>> order;  // Most recently used first
+        std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator, Hash> index;
+        uint64_t generation = 0;
+        size_t capacity = 0;
+    };
+
+    Shard& shardOf(const Key& key) {
+        return shards[Hash()(key) % shards.size()];
+    }
+
+    const size_t capacity;
+    std::vector<Shard> shards;
+
+    std::atomic<long long> hits{0};
+    std::atomic<long long> misses{0};
+    std::atomic<long long> evictions{0};
+    std::atomic<long long> invalidations{0};
+};
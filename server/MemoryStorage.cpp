@@ -0,0 +1,728 @@
+#include "MemoryStorage.h"
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include "../common/Crypto.h"
+
+namespace {
+
+using ReadLock = std::shared_lock<std::shared_mutex>;
+using WriteLock = std::unique_lock<std::shared_mutex>;
+
+long currentTime() {
+    return static_cast<long>(std::time(nullptr));
+}
+
+// Removes one occurrence of `value` (the row lists are short)
+template <typename T>
+void removeValue(std::vector<T>& values, const T& value) {
+    auto it = std::find(values.begin(), values.end(), value);
+    if (it != values.end()) {
+        values.erase(it);
+    }
+}
+
+}
+
+MemoryStorage::MemoryStorage(size_t stripes)
+    : userIds(stripes), users(stripes), notes(stripes), notesByUser(stripes),
+      links(stripes), linksByOwner(stripes), userShares(stripes), sharesByRecipient(stripes) {
+}
+
+bool MemoryStorage::init() {
+    std::cout << "In-memory storage initialized (nothing is persisted)" << std::endl;
+    return true;
+}
+
+bool MemoryStorage::createUser(std::string username, std::string pass_hash,
+                               std::string salt, std::string receive_pub_key) {
+    // The record is stored before the username points to it, so whoever finds
+    // the name also finds the user
+    int id = nextUserId++;
+    {
+        auto& stripe = users.stripe(id);
+        WriteLock lock(stripe.mtx);
+        stripe.rows[id] = UserRecord{id, username, std::move(pass_hash), std::move(salt), std::move(receive_pub_key)};
+    }
+
+    bool taken;
+    {
+        auto& stripe = userIds.stripe(username);
+        WriteLock lock(stripe.mtx);
+        taken = !stripe.rows.emplace(username, id).second;
+    }
+
+    if (taken) {
+        auto& stripe = users.stripe(id);
+        WriteLock lock(stripe.mtx);
+        stripe.rows.erase(id);
+        std::cerr << "Username already exists" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+UserRecord MemoryStorage::getUserByUsername(std::string username) {
+    UserRecord record{-1, "", "", "", ""};
+
+    int id;
+    {
+        auto& stripe = userIds.stripe(username);
+        ReadLock lock(stripe.mtx);
+        auto it = stripe.rows.find(username);
+        if (it == stripe.rows.end()) {
+            return record;
+        }
+        id = it->second;
+    }
+
+    auto& stripe = users.stripe(id);
+    ReadLock lock(stripe.mtx);
+    auto it = stripe.rows.find(id);
+    if (it != stripe.rows.end()) {
+        record = it->second;
+    }
+    return record;
+}
+
+bool MemoryStorage::updateUserPublicKey(int user_id, std::string receive_pub_key) {
+    auto& stripe = users.stripe(user_id);
+    WriteLock lock(stripe.mtx);
+    auto it = stripe.rows.find(user_id);
+    if (it != stripe.rows.end()) {
+        it->second.receive_public_key_hex = std::move(receive_pub_key);
+    }
+    // Same as the UPDATE in Database: an unknown user is not an error
+    return true;
+}
+
+bool MemoryStorage::userExists(int user_id) {
+    auto& stripe = users.stripe(user_id);
+    ReadLock lock(stripe.mtx);
+    return stripe.rows.count(user_id) == 1;
+}
+
+int MemoryStorage::insertNote(const NewNote& note, long created_at) {
+    // Content is kept raw, so only a JSON upload has anything to decode
+    if (note.raw_content) {
+        return storeNote(note, std::vector<unsigned char>(note.encrypted_content.begin(), note.encrypted_content.end()),
+                         created_at);
+    }
+    if (Crypto::base64DecodedSize(note.encrypted_content) < 0) {
+        return -1;
+    }
+    return storeNote(note, Crypto::base64Decode(note.encrypted_content), created_at);
+}
+
+int MemoryStorage::storeNote(const NewNote& note, std::vector<unsigned char> content, long created_at) {
+    // Same validation as Database, so both engines reject the same uploads
+    if (content.size() > static_cast<size_t>(std::numeric_limits<int>::max()) || !userExists(note.user_id)) {
+        return -1;
+    }
+
+    int id = nextNoteId++;
+    {
+        auto& stripe = notes.stripe(id);
+        WriteLock lock(stripe.mtx);
+        NoteRow& row = stripe.rows[id];
+        row.user_id = note.user_id;
+        row.filename = note.filename;
+        row.created_at = created_at;
+        row.wrapped_key = note.wrapped_key;
+        row.iv_hex = note.iv_hex;
+        row.content = std::make_shared<const std::vector<unsigned char>>(std::move(content));
+    }
+    {
+        auto& stripe = notesByUser.stripe(note.user_id);
+        WriteLock lock(stripe.mtx);
+        stripe.rows[note.user_id].emplace(SortKey(created_at, id), note.filename);
+    }
+    return id;
+}
+
+int MemoryStorage::saveNote(int user_id, std::string encrypted_content,
+                            std::string wrapped_key, std::string iv_hex, std::string filename) {
+    NewNote note{user_id, std::move(encrypted_content), std::move(wrapped_key),
+                 std::move(iv_hex), std::move(filename)};
+    return insertNote(note, currentTime());
+}
+
+int MemoryStorage::saveNoteStream(int user_id, long long size, const ContentStore::ChunkSource& next,
+                                  std::string wrapped_key, std::string iv_hex, std::string filename) {
+    if (size < 0 || size > std::numeric_limits<int>::max()) {
+        return -1;
+    }
+
+    std::vector<unsigned char> bytes;
+    bytes.reserve(static_cast<size_t>(size));
+    std::vector<unsigned char> chunk;
+    while (static_cast<long long>(bytes.size()) < size) {
+        if (!next(chunk) || chunk.empty() || static_cast<long long>(bytes.size() + chunk.size()) > size) {
+            return -1;
+        }
+        bytes.insert(bytes.end(), chunk.begin(), chunk.end());
+    }
+
+    NewNote note{user_id, "", std::move(wrapped_key), std::move(iv_hex), std::move(filename)};
+    return storeNote(note, std::move(bytes), currentTime());
+}
+
+std::vector<int> MemoryStorage::saveNotes(const std::vector<NewNote>& notes) {
+    std::vector<int> ids;
+    ids.reserve(notes.size());
+    long now = currentTime();
+    for (const auto& note : notes) {
+        ids.push_back(insertNote(note, now));
+    }
+    return ids;
+}
+
+bool MemoryStorage::readNote(int note_id, NoteRow& row) {
+    auto& stripe = notes.stripe(note_id);
+    ReadLock lock(stripe.mtx);
+    auto it = stripe.rows.find(note_id);
+    if (it == stripe.rows.end()) {
+        return false;
+    }
+    // Only the pointer to the ciphertext is copied under the lock
+    row.user_id = it->second.user_id;
+    row.filename = it->second.filename;
+    row.created_at = it->second.created_at;
+    row.wrapped_key = it->second.wrapped_key;
+    row.iv_hex = it->second.iv_hex;
+    row.content = it->second.content;
+    return true;
+}
+
+NoteData MemoryStorage::getNoteById(int note_id) {
+    NoteData note;
+    note.note_id = -1;
+
+    NoteRow row;
+    if (readNote(note_id, row)) {
+        note.note_id = note_id;
+        note.encrypted_content = Crypto::base64Encode(*row.content);
+        note.wrapped_key = row.wrapped_key;
+        note.iv_hex = row.iv_hex;
+        note.filename = row.filename;
+        note.created_at = row.created_at;
+    }
+    return note;
+}
+
+Storage::NoteAccess MemoryStorage::getNoteForOwner(int note_id, int user_id, NoteData& note) {
+    NoteRow row;
+    if (!readNote(note_id, row)) {
+        return NoteAccess::NotFound;
+    }
+    if (row.user_id != user_id) {
+        return NoteAccess::Forbidden;
+    }
+
+    note.note_id = note_id;
+    note.encrypted_content = Crypto::base64Encode(*row.content);
+    note.wrapped_key = row.wrapped_key;
+    note.iv_hex = row.iv_hex;
+    note.filename = row.filename;
+    note.created_at = row.created_at;
+    return NoteAccess::Ok;
+}
+
+Storage::NoteAccess MemoryStorage::getNoteRangeForOwner(int note_id, int user_id, const ContentStore::ByteRange& range,
+                                                        NoteData& note, ContentStore::RangeData& data) {
+    NoteRow row;
+    if (!readNote(note_id, row)) {
+        return NoteAccess::NotFound;
+    }
+    if (row.user_id != user_id) {
+        return NoteAccess::Forbidden;
+    }
+
+    note.note_id = note_id;
+    note.encrypted_content.clear();
+    note.wrapped_key = row.wrapped_key;
+    note.iv_hex = row.iv_hex;
+    note.filename = row.filename;
+    note.created_at = row.created_at;
+
+    const std::vector<unsigned char>& content = *row.content;
+    data.total_size = static_cast<long long>(content.size());
+    data.offset = -1;
+    data.bytes.clear();
+    long long first;
+    long long length;
+    if (!ContentStore::resolveRange(range, data.total_size, first, length)) {
+        return NoteAccess::Ok;
+    }
+
+    data.bytes.assign(content.begin() + first, content.begin() + first + length);
+    data.offset = first;
+    return NoteAccess::Ok;
+}
+
+Storage::NotePage MemoryStorage::listNotes(int user_id, const NoteCursor& after, int limit) {
+    NotePage page;
+    page.has_more = false;
+
+    auto& stripe = notesByUser.stripe(user_id);
+    ReadLock lock(stripe.mtx);
+    auto owned = stripe.rows.find(user_id);
+    if (owned == stripe.rows.end()) {
+        return page;
+    }
+
+    // Everything before lower_bound(cursor) sorts below the cursor; walk it newest first
+    const auto& index = owned->second;
+    auto it = index.lower_bound(SortKey(after.created_at, after.note_id));
+    while (it != index.begin()) {
+        --it;
+        if (static_cast<int>(page.notes.size()) == limit) {
+            page.has_more = true;
+            break;
+        }
+        NoteListItem item;
+        item.note_id = it->first.second;
+        item.created_at = it->first.first;
+        item.filename = it->second;
+        page.notes.push_back(item);
+    }
+    return page;
+}
+
+bool MemoryStorage::eraseNote(int note_id, int owner_id) {
+    NoteRow row;
+    {
+        auto& stripe = notes.stripe(note_id);
+        WriteLock lock(stripe.mtx);
+        auto it = stripe.rows.find(note_id);
+        if (it == stripe.rows.end() || (owner_id != -1 && it->second.user_id != owner_id)) {
+            return false;
+        }
+        row = std::move(it->second);
+        stripe.rows.erase(it);
+    }
+    {
+        auto& stripe = notesByUser.stripe(row.user_id);
+        WriteLock lock(stripe.mtx);
+        auto owned = stripe.rows.find(row.user_id);
+        if (owned != stripe.rows.end()) {
+            owned->second.erase(SortKey(row.created_at, note_id));
+        }
+    }
+
+    // The cascade Database gets from ON DELETE CASCADE
+    for (const auto& token : row.links) {
+        eraseLink(token, -1);
+    }
+    for (int shareId : row.user_shares) {
+        eraseUserShare(shareId);
+    }
+    return true;
+}
+
+bool MemoryStorage::deleteNote(int note_id, int user_id) {
+    return eraseNote(note_id, user_id);
+}
+
+std::vector<int> MemoryStorage::deleteNotes(int user_id, const std::vector<int>& note_ids) {
+    std::vector<int> deleted;
+    for (int note_id : note_ids) {
+        if (eraseNote(note_id, user_id)) {
+            deleted.push_back(note_id);
+        }
+    }
+    return deleted;
+}
+
+std::string MemoryStorage::createShareLink(int note_id, int user_id,
+                                           std::vector<UserAccessEntry> user_access_list,
+                                           int duration_seconds) {
+    auto tokenBytes = Crypto::generateRandomBytes(SHARE_TOKEN_BYTES);
+    if (tokenBytes.empty()) {
+        return "";
+    }
+    std::string token(tokenBytes.begin(), tokenBytes.end());
+
+    LinkRow link;
+    link.id = nextLinkId++;
+    link.note_id = note_id;
+    link.owner_id = user_id;
+    link.expiration_time = currentTime() + duration_seconds;
+    link.access = std::move(user_access_list);
+
+    // Stored and indexed first, then attached to its note; if the note is gone
+    // by then the link is taken back out, like a failed foreign key
+    SortKey key(link.expiration_time, link.id);
+    {
+        auto& stripe = links.stripe(token);
+        WriteLock lock(stripe.mtx);
+        stripe.rows.emplace(token, std::move(link));
+    }
+    {
+        auto& stripe = linksByOwner.stripe(user_id);
+        WriteLock lock(stripe.mtx);
+        stripe.rows[user_id].emplace(key, token);
+    }
+
+    bool attached = false;
+    {
+        auto& stripe = notes.stripe(note_id);
+        WriteLock lock(stripe.mtx);
+        auto it = stripe.rows.find(note_id);
+        if (it != stripe.rows.end()) {
+            it->second.links.push_back(token);
+            attached = true;
+        }
+    }
+
+    if (!attached) {
+        eraseLink(token, -1);
+        return "";
+    }
+    return token;
+}
+
+Storage::ShareLinkData MemoryStorage::findShareLink(const std::string& token, const std::string& username,
+                                                    NoteRow& row) {
+    ShareLinkData result{-1, "", "", "", "", "", false};
+
+    int noteId;
+    long expirationTime;
+    bool allowed = false;
+    {
+        auto& stripe = links.stripe(token);
+        ReadLock lock(stripe.mtx);
+        auto it = stripe.rows.find(token);
+        if (it == stripe.rows.end()) {
+            return result;
+        }
+        noteId = it->second.note_id;
+        expirationTime = it->second.expiration_time;
+        for (const auto& entry : it->second.access) {
+            if (entry.username == username) {
+                result.send_public_key_hex = entry.send_public_key_hex;
+                result.wrapped_key = entry.wrapped_key;
+                allowed = true;
+                break;
+            }
+        }
+    }
+
+    if (expirationTime < currentTime()) {
+        eraseLink(token, -1);
+        return ShareLinkData{-1, "", "", "", "", "", false};
+    }
+    if (!allowed) {
+        return result;
+    }
+
+    if (!readNote(noteId, row)) {
+        return ShareLinkData{-1, "", "", "", "", "", false};
+    }
+
+    result.note_id = noteId;
+    result.iv_hex = row.iv_hex;
+    result.filename = row.filename;
+    result.valid = true;
+    return result;
+}
+
+Storage::ShareLinkData MemoryStorage::getShareLinkData(std::string token, std::string username) {
+    NoteRow row;
+    ShareLinkData result = findShareLink(token, username, row);
+    if (result.valid) {
+        result.encrypted_content = Crypto::base64Encode(*row.content);
+    }
+    return result;
+}
+
+Storage::ShareLinkData MemoryStorage::getShareLinkRaw(std::string token, std::string username,
+                                                      ContentStore::RangeData& data) {
+    NoteRow row;
+    ShareLinkData result = findShareLink(token, username, row);
+    if (result.valid) {
+        data.bytes.assign(row.content->begin(), row.content->end());
+        data.total_size = static_cast<long long>(data.bytes.size());
+        data.offset = 0;
+    }
+    return result;
+}
+
+bool MemoryStorage::eraseLink(const std::string& token, int owner_id) {
+    LinkRow link;
+    {
+        auto& stripe = links.stripe(token);
+        WriteLock lock(stripe.mtx);
+        auto it = stripe.rows.find(token);
+        if (it == stripe.rows.end() || (owner_id != -1 && it->second.owner_id != owner_id)) {
+            return false;
+        }
+        link = std::move(it->second);
+        stripe.rows.erase(it);
+    }
+    {
+        auto& stripe = linksByOwner.stripe(link.owner_id);
+        WriteLock lock(stripe.mtx);
+        auto owned = stripe.rows.find(link.owner_id);
+        if (owned != stripe.rows.end()) {
+            owned->second.erase(SortKey(link.expiration_time, link.id));
+        }
+    }
+    {
+        auto& stripe = notes.stripe(link.note_id);
+        WriteLock lock(stripe.mtx);
+        auto it = stripe.rows.find(link.note_id);
+        if (it != stripe.rows.end()) {
+            removeValue(it->second.links, token);
+        }
+    }
+    return true;
+}
+
+bool MemoryStorage::deleteShareLink(std::string token, int user_id) {
+    return eraseLink(token, user_id);
+}
+
+bool MemoryStorage::createUserShare(int note_id, int sender_id, int recipient_id,
+                                    std::string send_public_key_hex, std::string new_wrapped_key,
+                                    int duration_seconds) {
+    if (!userExists(sender_id) || !userExists(recipient_id)) {
+        return false;
+    }
+
+    int id = nextShareId++;
+    {
+        auto& stripe = userShares.stripe(id);
+        WriteLock lock(stripe.mtx);
+        stripe.rows[id] = UserShareRow{note_id, sender_id, recipient_id, std::move(send_public_key_hex),
+                                       std::move(new_wrapped_key), currentTime() + duration_seconds};
+    }
+    {
+        auto& stripe = sharesByRecipient.stripe(recipient_id);
+        WriteLock lock(stripe.mtx);
+        stripe.rows[recipient_id].insert(id);
+    }
+
+    // Same order as createShareLink
+    bool attached = false;
+    {
+        auto& stripe = notes.stripe(note_id);
+        WriteLock lock(stripe.mtx);
+        auto it = stripe.rows.find(note_id);
+        if (it != stripe.rows.end()) {
+            it->second.user_shares.push_back(id);
+            attached = true;
+        }
+    }
+
+    if (!attached) {
+        eraseUserShare(id);
+        return false;
+    }
+    return true;
+}
+
+bool MemoryStorage::eraseUserShare(int share_id) {
+    UserShareRow share;
+    {
+        auto& stripe = userShares.stripe(share_id);
+        WriteLock lock(stripe.mtx);
+        auto it = stripe.rows.find(share_id);
+        if (it == stripe.rows.end()) {
+            return false;
+        }
+        share = std::move(it->second);
+        stripe.rows.erase(it);
+    }
+    {
+        auto& stripe = sharesByRecipient.stripe(share.recipient_id);
+        WriteLock lock(stripe.mtx);
+        auto received = stripe.rows.find(share.recipient_id);
+        if (received != stripe.rows.end()) {
+            received->second.erase(share_id);
+        }
+    }
+    {
+        auto& stripe = notes.stripe(share.note_id);
+        WriteLock lock(stripe.mtx);
+        auto it = stripe.rows.find(share.note_id);
+        if (it != stripe.rows.end()) {
+            removeValue(it->second.user_shares, share_id);
+        }
+    }
+    return true;
+}
+
+std::vector<int> MemoryStorage::getSharedNotesForUser(int user_id) {
+    std::vector<int> candidates;
+    {
+        auto& stripe = sharesByRecipient.stripe(user_id);
+        ReadLock lock(stripe.mtx);
+        auto received = stripe.rows.find(user_id);
+        if (received != stripe.rows.end()) {
+            candidates.assign(received->second.begin(), received->second.end());
+        }
+    }
+
+    long now = currentTime();
+    std::vector<int> shareIds;
+    for (int id : candidates) {
+        auto& stripe = userShares.stripe(id);
+        ReadLock lock(stripe.mtx);
+        auto it = stripe.rows.find(id);
+        if (it != stripe.rows.end() && it->second.expiration_time > now) {
+            shareIds.push_back(id);
+        }
+    }
+    return shareIds;
+}
+
+Storage::ShareInfo MemoryStorage::getShareInfo(int share_id, int recipient_id) {
+    ShareInfo info;
+    info.note_id = -1;
+
+    int noteId;
+    {
+        auto& stripe = userShares.stripe(share_id);
+        ReadLock lock(stripe.mtx);
+        auto it = stripe.rows.find(share_id);
+        if (it == stripe.rows.end() || it->second.recipient_id != recipient_id ||
+            it->second.expiration_time <= currentTime()) {
+            return info;
+        }
+        noteId = it->second.note_id;
+        info.send_public_key_hex = it->second.send_public_key_hex;
+        info.new_wrapped_key = it->second.new_wrapped_key;
+    }
+
+    NoteRow row;
+    if (readNote(noteId, row)) {
+        info.note_id = noteId;
+        info.iv_hex = row.iv_hex;
+        info.encrypted_content = Crypto::base64Encode(*row.content);
+    }
+    return info;
+}
+
+Storage::OutgoingSharePage MemoryStorage::listOutgoingShares(int user_id, const ShareCursor& after,
+                                                             int limit, bool active_only) {
+    OutgoingSharePage page;
+    page.has_more = false;
+
+    long now = currentTime();
+
+    // Positions first, under the owner's stripe only; the links are looked up afterwards
+    std::vector<std::pair<SortKey, std::string>> positions;
+    {
+        auto& stripe = linksByOwner.stripe(user_id);
+        ReadLock lock(stripe.mtx);
+        auto owned = stripe.rows.find(user_id);
+        if (owned == stripe.rows.end()) {
+            return page;
+        }
+
+        const auto& index = owned->second;
+        auto it = index.lower_bound(SortKey(after.expiration_time, after.link_id));
+        while (it != index.begin()) {
+            --it;
+            if (active_only && it->first.first <= now) {
+                break;
+            }
+            if (static_cast<int>(positions.size()) == limit) {
+                page.has_more = true;
+                break;
+            }
+            positions.push_back(*it);
+        }
+    }
+
+    for (const auto& position : positions) {
+        OutgoingShare share;
+        {
+            auto& stripe = links.stripe(position.second);
+            ReadLock lock(stripe.mtx);
+            auto it = stripe.rows.find(position.second);
+            if (it == stripe.rows.end()) {
+                continue;
+            }
+            share.note_id = it->second.note_id;
+            for (const auto& entry : it->second.access) {
+                share.shared_with.push_back(entry.username);
+            }
+        }
+        share.link_id = position.first.second;
+        share.token = position.second;
+        share.expiration_time = position.first.first;
+        // Database returns them in (link_id, username) index order
+        std::sort(share.shared_with.begin(), share.shared_with.end());
+        page.shares.push_back(share);
+    }
+    return page;
+}
+
+int MemoryStorage::deleteExpiredLinks(long now, int batch_size) {
+    std::vector<std::pair<long, std::string>> expired;
+    for (auto& stripe : links.all()) {
+        ReadLock lock(stripe.mtx);
+        for (const auto& link : stripe.rows) {
+            if (link.second.expiration_time < now) {
+                expired.emplace_back(link.second.expiration_time, link.first);
+            }
+        }
+    }
+
+    // Oldest first, like Database
+    size_t count = std::min(expired.size(), static_cast<size_t>(std::max(batch_size, 0)));
+    std::partial_sort(expired.begin(), expired.begin() + count, expired.end());
+
+    int deleted = 0;
+    for (size_t i = 0; i < count; i++) {
+        deleted += eraseLink(expired[i].second, -1) ? 1 : 0;
+    }
+    return deleted;
+}
+
+int MemoryStorage::deleteExpiredUserShares(long now, int batch_size) {
+    std::vector<std::pair<long, int>> expired;
+    for (auto& stripe : userShares.all()) {
+        ReadLock lock(stripe.mtx);
+        for (const auto& share : stripe.rows) {
+            if (share.second.expiration_time < now) {
+                expired.emplace_back(share.second.expiration_time, share.first);
+            }
+        }
+    }
+
+    size_t count = std::min(expired.size(), static_cast<size_t>(std::max(batch_size, 0)));
+    std::partial_sort(expired.begin(), expired.begin() + count, expired.end());
+
+    int deleted = 0;
+    for (size_t i = 0; i < count; i++) {
+        deleted += eraseUserShare(expired[i].second) ? 1 : 0;
+    }
+    return deleted;
+}
+
+long MemoryStorage::countExpiredLinks(long now) {
+    long count = 0;
+    for (auto& stripe : links.all()) {
+        ReadLock lock(stripe.mtx);
+        for (const auto& link : stripe.rows) {
+            count += link.second.expiration_time < now ? 1 : 0;
+        }
+    }
+    return count;
+}
+
+long MemoryStorage::countExpiredUserShares(long now) {
+    long count = 0;
+    for (auto& stripe : userShares.all()) {
+        ReadLock lock(stripe.mtx);
+        for (const auto& share : stripe.rows) {
+            count += share.second.expiration_time < now ? 1 : 0;
+        }
+    }
+    return count;
+}
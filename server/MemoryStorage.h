@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Storage.h"
+
+// Storage kept entirely in memory, for benchmarks and load tests that should
+// measure HTTP, JSON and crypto without any disk I/O. Nothing survives a restart.
+//
+// Every table is a hash map split into lock stripes, each behind its own
+// reader/writer lock, so requests on different keys rarely wait for each other.
+// No operation holds two stripe locks at once: a row and its secondary indexes
+// (per-user notes, per-owner links, per-recipient shares, the note's own list of
+// shares for the delete cascade) are updated one after the other, and reads that
+// go through an index look the row up again. A concurrent delete can therefore
+// only make a row disappear slightly early, never leave a half-written one visible.
+class MemoryStorage : public Storage {
+public:
+    // stripes: lock stripes per table
+    explicit MemoryStorage(size_t stripes = 64);
+
+    bool init() override;
+
+    bool createUser(std::string username, std::string pass_hash, std::string salt, std::string receive_pub_key) override;
+    UserRecord getUserByUsername(std::string username) override;
+    bool updateUserPublicKey(int user_id, std::string receive_pub_key) override;
+
+    int saveNote(int user_id, std::string encrypted_content, std::string wrapped_key, std::string iv_hex, std::string filename) override;
+    // Not atomic as a batch: each note becomes visible as soon as it is stored
+    std::vector<int> saveNotes(const std::vector<NewNote>& notes) override;
+    // Collects the raw bytes, which is how every note is kept here
+    int saveNoteStream(int user_id, long long size, const ContentStore::ChunkSource& next,
+                       std::string wrapped_key, std::string iv_hex, std::string filename) override;
+    NoteData getNoteById(int note_id) override;
+    NoteAccess getNoteForOwner(int note_id, int user_id, NoteData& note) override;
+    // Copies only the bytes of the range
+    NoteAccess getNoteRangeForOwner(int note_id, int user_id, const ContentStore::ByteRange& range,
+                                    NoteData& note, ContentStore::RangeData& data) override;
+
+    std::string createShareLink(int note_id, int user_id,
+                                std::vector<UserAccessEntry> user_access_list,
+                                int duration_seconds) override;
+    ShareLinkData getShareLinkData(std::string token, std::string username) override;
+    ShareLinkData getShareLinkRaw(std::string token, std::string username, ContentStore::RangeData& data) override;
+    bool deleteShareLink(std::string token, int user_id) override;
+    bool createUserShare(int note_id, int sender_id, int recipient_id,
+                         std::string send_public_key_hex, std::string new_wrapped_key,
+                         int duration_seconds) override;
+    std::vector<int> getSharedNotesForUser(int user_id) override;
+    ShareInfo getShareInfo(int share_id, int recipient_id) override;
+
+    NotePage listNotes(int user_id, const NoteCursor& after, int limit) override;
+    bool deleteNote(int note_id, int user_id) override;
+    std::vector<int> deleteNotes(int user_id, const std::vector<int>& note_ids) override;
+    OutgoingSharePage listOutgoingShares(int user_id, const ShareCursor& after, int limit, bool active_only) override;
+
+    // There is no expiration index: each call scans every stripe once, which is
+    // fine at the sweeper's pace of a few calls a minute
+    int deleteExpiredLinks(long now, int batch_size) override;
+    int deleteExpiredUserShares(long now, int batch_size) override;
+    long countExpiredLinks(long now) override;
+    long countExpiredUserShares(long now) override;
+
+private:
+    // Hash map split into independently locked stripes
+    template <typename Key, typename Value>
+    class StripedMap {
+    public:
+        struct Stripe {
+            std::shared_mutex mtx;
+            std::unordered_map<Key, Value> rows;
+        };
+
+        explicit StripedMap(size_t count) : stripes(count == 0 ? 1 : count) {}
+        Stripe& stripe(const Key& key) { return stripes[std::hash<Key>()(key) % stripes.size()]; }
+        std::vector<Stripe>& all() { return stripes; }
+
+    private:
+        std::vector<Stripe> stripes;
+    };
+
+    struct NoteRow {
+        int user_id;
+        std::string filename;
+        long created_at;
+        std::string wrapped_key;
+        std::string iv_hex;
+        // Raw ciphertext, base64-encoded only for JSON replies; shared so readers copy it outside the lock
+        std::shared_ptr<const std::vector<unsigned char>> content;
+        std::vector<std::string> links;  // Go with the note when it is deleted
+        std::vector<int> user_shares;
+    };
+
+    struct LinkRow {
+        int id;
+        int note_id;
+        int owner_id;
+        long expiration_time;
+        std::vector<UserAccessEntry> access;
+    };
+
+    struct UserShareRow {
+        int note_id;
+        int sender_id;
+        int recipient_id;
+        std::string send_public_key_hex;
+        std::string new_wrapped_key;
+        long expiration_time;
+    };
+
+    // Keyset position inside the per-user and per-owner indexes
+    using SortKey = std::pair<long, int>;
+
+    int insertNote(const NewNote& note, long created_at);
+    // Stores `content` with the metadata of `note` (whose encrypted_content is ignored)
+    int storeNote(const NewNote& note, std::vector<unsigned char> content, long created_at);
+    bool userExists(int user_id);
+    // Copies a note out of its stripe; false if it does not exist
+    bool readNote(int note_id, NoteRow& row);
+    // Looks the link up for `username`; on success `row` holds the note and the
+    // result everything but encrypted_content
+    ShareLinkData findShareLink(const std::string& token, const std::string& username, NoteRow& row);
+    // Removes a row together with its index entries; owner_id -1 skips the ownership check
+    bool eraseNote(int note_id, int owner_id);
+    bool eraseLink(const std::string& token, int owner_id);
+    bool eraseUserShare(int share_id);
+
+    StripedMap<std::string, int> userIds;  // username -> id
+    StripedMap<int, UserRecord> users;
+    StripedMap<int, NoteRow> notes;
+    StripedMap<int, std::map<SortKey, std::string>> notesByUser;  // (created_at, id) -> filename
+    StripedMap<std::string, LinkRow> links;                       // By token
+    StripedMap<int, std::map<SortKey, std::string>> linksByOwner; // (expiration_time, id) -> token
+    StripedMap<int, UserShareRow> userShares;
+    StripedMap<int, std::set<int>> sharesByRecipient;
+
+    std::atomic<int> nextUserId{1};
+    std::atomic<int> nextNoteId{1};
+    std::atomic<int> nextLinkId{1};
+    std::atomic<int> nextShareId{1};
+};
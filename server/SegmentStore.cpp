@@ -0,0 +1,527 @@
+#include "SegmentStore.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include "../common/Crypto.h"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* SEGMENT_EXTENSION = ".seg";
+
+bool seekFile(std::FILE* file, long long offset) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+bool syncFile(std::FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+}
+
+SegmentContentStore::SegmentContentStore(const std::string& dir, long long inline_max_bytes,
+                                         long long segment_max_bytes, int grace_seconds)
+    : dir(dir), inlineMax(inline_max_bytes), segmentMax(segment_max_bytes), grace(grace_seconds) {
+}
+
+SegmentContentStore::~SegmentContentStore() {
+    std::lock_guard<std::mutex> lock(mtx);
+    sealActive();
+}
+
+std::string SegmentContentStore::segmentPath(int segment) const {
+    std::ostringstream name;
+    name << std::setw(6) << std::setfill('0') << segment << SEGMENT_EXTENSION;
+    return (fs::path(dir) / name.str()).string();
+}
+
+bool SegmentContentStore::open() {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "Cannot create segment directory " << dir << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    // Segments of an earlier run are read-only from now on; one that holds no
+    // live notes any more (e.g. compacted just before a crash) goes at the next compaction
+    std::lock_guard<std::mutex> lock(mtx);
+    int last = 0;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() != SEGMENT_EXTENSION) {
+            continue;
+        }
+        int segment = std::atoi(it->path().stem().string().c_str());
+        if (segment > 0) {
+            sealed[segment] = Clock::time_point();
+            last = std::max(last, segment);
+        }
+    }
+    if (ec) {
+        std::cerr << "Cannot list segment directory " << dir << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    return openActive(last + 1);
+}
+
+bool SegmentContentStore::openActive(int segment) {
+    std::string path = segmentPath(segment);
+    active = std::fopen(path.c_str(), "ab");
+    if (!active) {
+        std::cerr << "Cannot open segment " << path << std::endl;
+        return false;
+    }
+    activeId = segment;
+    std::error_code ec;
+    activeSize = static_cast<long long>(fs::file_size(path, ec));
+    return !ec;
+}
+
+void SegmentContentStore::sealActive() {
+    if (!active) {
+        return;
+    }
+    syncFile(active);
+    std::fclose(active);
+    active = nullptr;
+    dirty = false;
+    sealed[activeId] = Clock::now();
+}
+
+long long SegmentContentStore::inlineBytes(long long size) const {
+    return size < inlineMax ? size : 0;
+}
+
+bool SegmentContentStore::append(Connection& conn, long long length, const ChunkSource& next,
+                                 int& segment, long long& offset) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (active && activeSize > 0 && activeSize + length > segmentMax) {
+            sealActive();
+            openActive(activeId + 1);
+        }
+        if (!active) {
+            return false;
+        }
+
+        segment = activeId;
+        offset = activeSize;
+        activeSize += length;
+        reservations[&conn].push_back(segment);
+    }
+
+    // A handle of its own, so the source (possibly a slow client) is pulled
+    // without holding up other uploads
+    std::FILE* file = std::fopen(segmentPath(segment).c_str(), "r+b");
+    bool ok = file && seekFile(file, offset);
+    long long written = 0;
+    std::vector<unsigned char> chunk;
+    while (ok && written < length) {
+        ok = next(chunk) && !chunk.empty() && written + static_cast<long long>(chunk.size()) <= length &&
+             std::fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size();
+        written += static_cast<long long>(chunk.size());
+    }
+    ok = ok && std::fflush(file) == 0;
+
+    bool sealedMeanwhile;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        sealedMeanwhile = !active || segment != activeId;
+        if (ok && !sealedMeanwhile) {
+            dirty = true;  // The next sync() covers these bytes
+        }
+    }
+    // Sealing synced the file, maybe before these bytes were in it
+    if (ok && sealedMeanwhile) {
+        ok = syncFile(file);
+    }
+    if (file) {
+        std::fclose(file);
+    }
+
+    if (!ok) {
+        // The reserved range is never referenced; compaction reclaims it
+        std::cerr << "Failed to append to segment " << segment << std::endl;
+    }
+    return ok;
+}
+
+bool SegmentContentStore::writeChunks(Connection& conn, sqlite3_int64 note_id, long long size, const ChunkSource& next) {
+    if (size < inlineMax) {
+        return SqliteContentStore::writeChunks(conn, note_id, size, next);
+    }
+
+    int segment;
+    long long offset;
+    if (!append(conn, size, next, segment, offset)) {
+        return false;
+    }
+
+    CachedStatement stmt(conn, Stmt::InsertContentSegment);
+    if (!stmt) {
+        return false;
+    }
+
+    sqlite3_bind_int64(stmt, 1, note_id);
+    sqlite3_bind_int(stmt, 2, segment);
+    sqlite3_bind_int64(stmt, 3, offset);
+    sqlite3_bind_int64(stmt, 4, size);
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+bool SegmentContentStore::read(Connection& conn, sqlite3_int64 note_id, std::string& encoded) {
+    CachedStatement stmt(conn, Stmt::SelectContentSegment);
+    if (!stmt) {
+        return false;
+    }
+
+    sqlite3_bind_int64(stmt, 1, note_id);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return SqliteContentStore::read(conn, note_id, encoded);
+    }
+
+    return readSegment(sqlite3_column_int(stmt, 0), sqlite3_column_int64(stmt, 1),
+                       sqlite3_column_int64(stmt, 2), encoded);
+}
+
+bool SegmentContentStore::readRange(Connection& conn, sqlite3_int64 note_id, const ByteRange& range, RangeData& data) {
+    CachedStatement stmt(conn, Stmt::SelectContentSegment);
+    if (!stmt) {
+        return false;
+    }
+
+    sqlite3_bind_int64(stmt, 1, note_id);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return SqliteContentStore::readRange(conn, note_id, range, data);
+    }
+
+    int segment = sqlite3_column_int(stmt, 0);
+    data.total_size = sqlite3_column_int64(stmt, 2);
+    data.offset = -1;
+    data.bytes.clear();
+
+    long long first;
+    long long length;
+    if (!resolveRange(range, data.total_size, first, length)) {
+        return true;
+    }
+
+    std::ifstream file(segmentPath(segment), std::ios::binary);
+    if (!file.seekg(sqlite3_column_int64(stmt, 1) + first)) {
+        std::cerr << "Cannot open segment " << segment << std::endl;
+        return false;
+    }
+    data.bytes.resize(static_cast<size_t>(length));
+    if (length > 0 && !file.read(&data.bytes[0], static_cast<std::streamsize>(length))) {
+        std::cerr << "Segment " << segment << " is shorter than its index says" << std::endl;
+        return false;
+    }
+    data.offset = first;
+    return true;
+}
+
+bool SegmentContentStore::readSegment(int segment, long long offset, long long length, std::string& encoded) const {
+    std::ifstream file(segmentPath(segment), std::ios::binary);
+    if (!file.seekg(offset)) {
+        std::cerr << "Cannot open segment " << segment << std::endl;
+        return false;
+    }
+
+    encoded.clear();
+    encoded.reserve(static_cast<size_t>((length + 2) / 3 * 4));
+
+    std::vector<unsigned char> chunk;
+    for (long long done = 0; done < length; done += static_cast<long long>(chunk.size())) {
+        chunk.resize(static_cast<size_t>(std::min<long long>(CHUNK_BYTES, length - done)));
+        if (!file.read(reinterpret_cast<char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()))) {
+            std::cerr << "Segment " << segment << " is shorter than its index says" << std::endl;
+            return false;
+        }
+        encoded += Crypto::base64Encode(chunk);
+    }
+    return true;
+}
+
+void SegmentContentStore::transactionEnded(Connection& conn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    reservations.erase(&conn);
+}
+
+bool SegmentContentStore::reserved(int segment) const {
+    for (const auto& entry : reservations) {
+        if (std::find(entry.second.begin(), entry.second.end(), segment) != entry.second.end()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SegmentContentStore::sync() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!dirty || !active) {
+        return true;
+    }
+    if (!syncFile(active)) {
+        std::cerr << "Failed to sync segment " << activeId << std::endl;
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+long long SegmentContentStore::liveBytes(Connection& conn, int segment) {
+    CachedStatement stmt(conn, Stmt::SumSegmentBytes);
+    if (!stmt) {
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, segment);
+    return sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+}
+
+bool SegmentContentStore::moveLiveNotes(Connection& conn, int segment, Compaction& result) {
+    struct Location {
+        sqlite3_int64 note_id;
+        long long offset;
+        long long length;
+        int new_segment;
+        long long new_offset;
+    };
+
+    std::vector<Location> notes;
+    {
+        CachedStatement stmt(conn, Stmt::SelectSegmentNotes);
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_int(stmt, 1, segment);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            notes.push_back({sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1),
+                             sqlite3_column_int64(stmt, 2), 0, 0});
+        }
+    }
+
+    // Copy first, outside any transaction; uploads keep appending in between
+    std::ifstream source(segmentPath(segment), std::ios::binary);
+    long long bytes = 0;
+    for (auto& note : notes) {
+        if (!source.seekg(note.offset)) {
+            return false;
+        }
+        long long remaining = note.length;
+        auto next = [&](std::vector<unsigned char>& chunk) {
+            chunk.resize(static_cast<size_t>(std::min<long long>(CHUNK_BYTES, remaining)));
+            remaining -= static_cast<long long>(chunk.size());
+            return static_cast<bool>(source.read(reinterpret_cast<char*>(chunk.data()),
+                                                 static_cast<std::streamsize>(chunk.size())));
+        };
+        if (!append(conn, note.length, next, note.new_segment, note.new_offset)) {
+            return false;
+        }
+        bytes += note.length;
+    }
+    if (!sync()) {
+        return false;
+    }
+
+    // A note deleted since matches no row; its copy is just dead space in the new segment
+    Transaction txn(conn);
+    if (!txn) {
+        return false;
+    }
+    for (const auto& note : notes) {
+        CachedStatement stmt(conn, Stmt::MoveContentSegment);
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_int(stmt, 1, note.new_segment);
+        sqlite3_bind_int64(stmt, 2, note.new_offset);
+        sqlite3_bind_int64(stmt, 3, note.note_id);
+        sqlite3_bind_int(stmt, 4, segment);
+        sqlite3_bind_int64(stmt, 5, note.offset);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            return false;
+        }
+    }
+    if (!txn.commit()) {
+        return false;
+    }
+
+    result.bytes_moved += bytes;
+    return true;
+}
+
+void SegmentContentStore::removeRetired(Compaction& result) {
+    std::vector<int> due;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (snapshots > 0) {
+            return;
+        }
+        auto now = Clock::now();
+        for (const auto& entry : retired) {
+            if (now - entry.second >= grace) {
+                due.push_back(entry.first);
+            }
+        }
+    }
+
+    for (int segment : due) {
+        std::string path = segmentPath(segment);
+        std::error_code ec;
+        auto size = fs::file_size(path, ec);
+        long long bytes = ec ? 0 : static_cast<long long>(size);
+        fs::remove(path, ec);
+        if (ec) {
+            // Still open in a reader (Windows); tried again next pass
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        retired.erase(segment);
+        result.segments_removed++;
+        result.bytes_reclaimed += bytes;
+    }
+}
+
+ContentStore::Compaction SegmentContentStore::compact(Connection& conn, double min_dead_ratio) {
+    Compaction result;
+    removeRetired(result);
+
+    std::vector<int> candidates;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto now = Clock::now();
+        for (const auto& entry : sealed) {
+            // Bytes of a transaction still open are live whatever the index says,
+            // however long that transaction runs
+            if (now - entry.second >= grace && !reserved(entry.first)) {
+                candidates.push_back(entry.first);
+            }
+        }
+    }
+
+    for (int segment : candidates) {
+        std::error_code ec;
+        auto size = fs::file_size(segmentPath(segment), ec);
+        long long live = liveBytes(conn, segment);
+        if (ec || live < 0) {
+            continue;
+        }
+
+        long long fileBytes = static_cast<long long>(size);
+        double dead = fileBytes > 0 ? 1.0 - static_cast<double>(live) / fileBytes : 1.0;
+        if (live > 0 && dead < min_dead_ratio) {
+            continue;
+        }
+        bool moved = live == 0 || moveLiveNotes(conn, segment, result);
+        transactionEnded(conn);
+        if (!moved) {
+            std::cerr << "Compaction of segment " << segment << " failed, kept as it is" << std::endl;
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        sealed.erase(segment);
+        retired[segment] = Clock::now();
+        result.segments_compacted++;
+    }
+    return result;
+}
+
+ContentStore::Usage SegmentContentStore::usage(Connection& conn) {
+    std::vector<int> segments;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto& entry : sealed) segments.push_back(entry.first);
+        for (const auto& entry : retired) segments.push_back(entry.first);
+        if (active) segments.push_back(activeId);
+    }
+
+    Usage result;
+    for (int segment : segments) {
+        std::error_code ec;
+        auto size = fs::file_size(segmentPath(segment), ec);
+        if (ec) {
+            continue;
+        }
+        result.segments++;
+        result.file_bytes += static_cast<long long>(size);
+        result.live_bytes += std::max(0LL, liveBytes(conn, segment));
+    }
+    return result;
+}
+
+bool SegmentContentStore::snapshot(const std::string& destination) {
+    // Retired segments were compacted at least a grace period before they can be
+    // removed, so a database snapshot taken just now no longer points into one that
+    // is already due; those may vanish before they are copied
+    std::vector<std::pair<int, bool>> segments; // (id, required)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        snapshots++;
+        auto now = Clock::now();
+        for (const auto& entry : sealed) segments.push_back({entry.first, true});
+        for (const auto& entry : retired) segments.push_back({entry.first, now - entry.second < grace});
+        if (active) segments.push_back({activeId, true});
+    }
+
+    std::error_code ec;
+    fs::create_directories(destination, ec);
+    bool ok = !ec;
+    if (ec) {
+        std::cerr << "Cannot create snapshot directory " << destination << ": " << ec.message() << std::endl;
+    }
+
+    std::vector<char> buffer(1024 * 1024);
+    for (size_t i = 0; ok && i < segments.size(); i++) {
+        std::string source = segmentPath(segments[i].first);
+        std::ifstream in(source, std::ios::binary);
+        if (!in) {
+            if (segments[i].second) {
+                std::cerr << "Cannot read segment " << source << " for snapshot" << std::endl;
+                ok = false;
+            }
+            continue;
+        }
+
+        // Bytes appended while copying belong to later commits; copying them too is harmless
+        std::string target = (fs::path(destination) / fs::path(source).filename()).string();
+        std::ofstream out(target, std::ios::binary | std::ios::trunc);
+        while (out && in) {
+            in.read(buffer.data(), buffer.size());
+            out.write(buffer.data(), in.gcount());
+        }
+        out.flush();
+        if (!out || in.bad()) {
+            std::cerr << "Cannot copy segment " << source << " to " << target << std::endl;
+            ok = false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    snapshots--;
+    return ok;
+}
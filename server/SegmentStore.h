@@ -0,0 +1,75 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ContentStore.h"
+
+// Large ciphertexts in append-only segment files next to the database, small
+// ones inline in SQLite like SqliteContentStore. Where each segment-held note
+// lives is indexed in the ContentSegments table, written in the transaction
+// that creates the note, so a rolled-back upload only leaves unreferenced bytes
+// behind. Deleting a note cascades to its index row; compact() later copies the
+// live notes out of mostly dead segments and deletes the files.
+class SegmentContentStore : public SqliteContentStore {
+public:
+    // inline_max_bytes: notes smaller than this stay in SQLite
+    // segment_max_bytes: a new segment is started once the active one would outgrow this
+    // grace_seconds: a sealed segment is only compacted, and a compacted one only
+    //   deleted, after this long, so no in-flight read still uses it. A segment that
+    //   an open transaction has written to is not compacted at all until it ends.
+    SegmentContentStore(const std::string& dir, long long inline_max_bytes,
+                        long long segment_max_bytes, int grace_seconds);
+    ~SegmentContentStore();
+    SegmentContentStore(const SegmentContentStore&) = delete;
+    SegmentContentStore& operator=(const SegmentContentStore&) = delete;
+
+    bool open() override;
+    long long inlineBytes(long long size) const override;
+    bool writeChunks(Connection& conn, sqlite3_int64 note_id, long long size, const ChunkSource& next) override;
+    bool read(Connection& conn, sqlite3_int64 note_id, std::string& encoded) override;
+    // Seeks to the range inside the segment; nothing else of the note is read
+    bool readRange(Connection& conn, sqlite3_int64 note_id, const ByteRange& range, RangeData& data) override;
+    bool sync() override;
+    void transactionEnded(Connection& conn) override;
+    Compaction compact(Connection& conn, double min_dead_ratio) override;
+    Usage usage(Connection& conn) override;
+    // Segments are append-only, so copying each file as it is now covers every
+    // note committed before the call. No segment is deleted while this runs.
+    bool snapshot(const std::string& destination) override;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::string segmentPath(int segment) const;
+    // Appends `length` bytes produced by `next` to the active segment. The space is
+    // reserved under the lock and written after it, so appends run side by side; the
+    // reservation counts as live until conn's transaction ends.
+    bool append(Connection& conn, long long length, const ChunkSource& next, int& segment, long long& offset);
+    bool readSegment(int segment, long long offset, long long length, std::string& encoded) const;
+    bool moveLiveNotes(Connection& conn, int segment, Compaction& result);
+    long long liveBytes(Connection& conn, int segment);
+    void removeRetired(Compaction& result);
+    // All three expect mtx to be held
+    bool openActive(int segment);
+    void sealActive();
+    bool reserved(int segment) const;
+
+    const std::string dir;
+    const long long inlineMax;
+    const long long segmentMax;
+    const std::chrono::seconds grace;
+
+    std::mutex mtx;                            // Guards everything below
+    int activeId = 0;
+    std::FILE* active = nullptr;
+    long long activeSize = 0;
+    bool dirty = false;                        // Appended since the last sync()
+    std::map<int, Clock::time_point> sealed;   // Read-only segments, by the time they were sealed
+    std::map<int, Clock::time_point> retired;  // Compacted segments waiting to be deleted
+    int snapshots = 0;                         // snapshot() calls in progress; retired files are kept meanwhile
+    std::map<const Connection*, std::vector<int>> reservations; // Segments appended to in a transaction still open
+};
@@ -0,0 +1,193 @@
+#include "ServerConfig.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+const char* const KEYS[] = {
+    "bind_address", "port", "public_url", "worker_threads", "max_body_bytes", "max_upload_bytes",
+    "group_commit_window_ms", "group_commit_max_batch", "storage", "shards", "db_path", "sqlite_cache_kb",
+    "sqlite_mmap_mb", "sqlite_synchronous",
+};
+
+// Whole string must be a number in [min, max]
+bool parseNumber(const std::string& text, long long min, long long max, long long& value) {
+    try {
+        size_t used = 0;
+        value = std::stoll(text, &used);
+        return used == text.size() && value >= min && value <= max;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+bool parseInt(const std::string& text, int min, int max, int& value) {
+    long long parsed;
+    if (!parseNumber(text, min, max, parsed)) {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+std::string environmentName(const std::string& key) {
+    std::string name = "SECURE_NOTES_" + key;
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::toupper(c); });
+    return name;
+}
+
+}
+
+bool ServerConfig::set(const std::string& key, const std::string& value) {
+    long long number;
+    if (key == "bind_address") {
+        bind_address = value;
+        return !value.empty();
+    } else if (key == "port") {
+        return parseInt(value, 1, 65535, port);
+    } else if (key == "public_url") {
+        public_url = value;
+        return true;
+    } else if (key == "worker_threads") {
+        // Crow takes the count as uint16_t
+        return parseInt(value, 0, 1024, worker_threads);
+    } else if (key == "max_body_bytes") {
+        if (!parseNumber(value, 1, 1LL << 40, number)) {
+            return false;
+        }
+        max_body_bytes = number;
+        return true;
+    } else if (key == "max_upload_bytes") {
+        // A note is at most INT_MAX bytes in storage
+        if (!parseNumber(value, 1, 0x7fffffffLL, number)) {
+            return false;
+        }
+        max_upload_bytes = number;
+        return true;
+    } else if (key == "group_commit_window_ms") {
+        // Every upload may wait this long, so anything past a second is a typo
+        return parseInt(value, 0, 1000, group_commit_window_ms);
+    } else if (key == "group_commit_max_batch") {
+        return parseInt(value, 1, 100000, group_commit_max_batch);
+    } else if (key == "storage") {
+        storage = value;
+        return value == "sqlite" || value == "memory";
+    } else if (key == "shards") {
+        return parseInt(value, 1, 256, shards);
+    } else if (key == "db_path") {
+        db_path = value;
+        return !value.empty();
+    } else if (key == "sqlite_cache_kb") {
+        return parseInt(value, 0, 64 * 1024 * 1024, sqlite.cache_kb);
+    } else if (key == "sqlite_mmap_mb") {
+        if (!parseNumber(value, 0, 1LL << 20, number)) {
+            return false;
+        }
+        sqlite.mmap_bytes = number * 1024 * 1024;
+        return true;
+    } else if (key == "sqlite_synchronous") {
+        std::string mode = value;
+        std::transform(mode.begin(), mode.end(), mode.begin(), [](unsigned char c) { return std::toupper(c); });
+        sqlite.synchronous = mode;
+        return mode == "OFF" || mode == "NORMAL" || mode == "FULL" || mode == "EXTRA";
+    }
+    return false;
+}
+
+bool ServerConfig::load(int argc, char* argv[], ServerConfig& config) {
+    std::string file = DEFAULT_FILE;
+    bool fileRequired = false;
+    std::string storageOption;
+    std::string shardsOption;
+    for (int i = 1; i + 1 < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--config") {
+            file = argv[i + 1];
+            fileRequired = true;
+        } else if (option == "--storage") {
+            storageOption = argv[i + 1];
+        } else if (option == "--shards") {
+            shardsOption = argv[i + 1];
+        }
+    }
+
+    std::ifstream in(file);
+    if (in) {
+        nlohmann::json values;
+        try {
+            in >> values;
+        } catch (const std::exception& e) {
+            std::cerr << "Cannot parse " << file << ": " << e.what() << std::endl;
+            return false;
+        }
+        if (!values.is_object()) {
+            std::cerr << file << " must hold a JSON object" << std::endl;
+            return false;
+        }
+        for (const auto& item : values.items()) {
+            const nlohmann::json& value = item.value();
+            std::string text = value.is_string() ? value.get<std::string>() : value.dump();
+            if (!config.set(item.key(), text)) {
+                std::cerr << file << ": invalid setting " << item.key() << " = " << text << std::endl;
+                return false;
+            }
+        }
+    } else if (fileRequired) {
+        std::cerr << "Cannot open config file " << file << std::endl;
+        return false;
+    }
+
+    for (const char* key : KEYS) {
+        std::string name = environmentName(key);
+        if (const char* value = std::getenv(name.c_str())) {
+            if (!config.set(key, value)) {
+                std::cerr << "Invalid " << name << "=" << value << std::endl;
+                return false;
+            }
+        }
+    }
+
+    if ((!storageOption.empty() && !config.set("storage", storageOption)) ||
+        (!shardsOption.empty() && !config.set("shards", shardsOption))) {
+        std::cerr << "Invalid --storage or --shards option" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+unsigned int ServerConfig::workerCount() const {
+    // Same count Crow's multithreaded() would pick
+    return worker_threads > 0 ? static_cast<unsigned int>(worker_threads)
+                              : std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::string ServerConfig::publicUrl() const {
+    std::string url = public_url.empty() ? "http://localhost:" + std::to_string(port) : public_url;
+    while (!url.empty() && url.back() == '/') {
+        url.pop_back();
+    }
+    return url;
+}
+
+nlohmann::json ServerConfig::toJson() const {
+    nlohmann::json config;
+    config["bind_address"] = bind_address;
+    config["port"] = port;
+    config["public_url"] = publicUrl();
+    config["worker_threads"] = workerCount();
+    config["max_body_bytes"] = max_body_bytes;
+    config["max_upload_bytes"] = max_upload_bytes;
+    config["group_commit_window_ms"] = group_commit_window_ms;
+    config["group_commit_max_batch"] = group_commit_max_batch;
+    config["storage"] = storage;
+    config["shards"] = shards;
+    config["db_path"] = db_path;
+    config["sqlite_cache_kb"] = sqlite.cache_kb;
+    config["sqlite_mmap_mb"] = sqlite.mmap_bytes / (1024 * 1024);
+    config["sqlite_synchronous"] = sqlite.synchronous;
+    return config;
+}
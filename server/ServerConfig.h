@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include "../vendor/json.hpp"
+#include "ConnectionPool.h"
+
+// Settings the server reads at startup. Every value has a default; a JSON file
+// (flat object, same keys as below) overrides it, an environment variable
+// SECURE_NOTES_<KEY IN UPPER CASE> overrides the file, and the command line
+// options --storage and --shards override everything.
+//
+//   bind_address        listen address                      0.0.0.0
+//   port                listen port                         8080
+//   public_url          prefix of the share links handed out http://localhost:<port>
+//   worker_threads      Crow workers, 0 = one per CPU        0
+//   max_body_bytes      larger request bodies get 413        67108864 (64 MB)
+//   max_upload_bytes    same for POST /upload/raw            536870912 (512 MB)
+//   group_commit_window_ms  extra wait for uploads to batch   0
+//   group_commit_max_batch  most uploads per commit           256
+//   storage             sqlite or memory                    sqlite
+//   shards              SQLite files behind a directory     1
+//   db_path             database file (segments next to it) secure_notes.db
+//   sqlite_cache_kb     page cache per connection           2000
+//   sqlite_mmap_mb      memory-mapped I/O per connection    0
+//   sqlite_synchronous  OFF, NORMAL, FULL or EXTRA          NORMAL
+struct ServerConfig {
+    std::string bind_address = "0.0.0.0";
+    int port = 8080;
+    std::string public_url;
+    int worker_threads = 0;
+    long long max_body_bytes = 64LL * 1024 * 1024;
+    long long max_upload_bytes = 512LL * 1024 * 1024;
+    int group_commit_window_ms = 0;
+    int group_commit_max_batch = 256;
+    std::string storage = "sqlite";
+    int shards = 1;
+    std::string db_path = "secure_notes.db";
+    SqliteTuning sqlite;
+
+    // Config file used when --config is not given; a missing default file is not an error
+    static constexpr const char* DEFAULT_FILE = "server_config.json";
+
+    // Fills `config` from all sources in order; false (with the reason on stderr)
+    // on an unreadable file, an unknown key or a value out of range
+    static bool load(int argc, char* argv[], ServerConfig& config);
+
+    // Applies one setting given as text; false if the key is unknown or the value invalid
+    bool set(const std::string& key, const std::string& value);
+
+    // worker_threads with 0 resolved
+    unsigned int workerCount() const;
+    // public_url with the default resolved, without a trailing slash
+    std::string publicUrl() const;
+
+    // Effective settings, logged at startup
+    nlohmann::json toJson() const;
+};
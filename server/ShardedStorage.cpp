@@ -0,0 +1,573 @@
+#include "ShardedStorage.h"
+#include <algorithm>
+#include <ctime>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <set>
+
+namespace {
+
+// A route outlives its link by this long, so the sweeper never drops the route
+// of a link that can still be opened (both expirations are computed separately)
+const long ROUTE_SLACK_SECONDS = 60;
+
+// Token -> shard routes kept in memory; a route never changes while it exists
+const size_t ROUTE_CACHE_CAPACITY = 10000;
+
+// Directory users read per step of a stub repair
+const int USER_STUB_PAGE = 500;
+
+const char* STUBS_PENDING_SETTING = "user_stubs_pending";
+
+}
+
+ShardedStorage::ShardedStorage(const std::string& directory_path, int shard_count, size_t pool_size,
+                               const ContentFactory& contents, const SqliteTuning& tuning)
+    : directory(directory_path, pool_size, nullptr, tuning), routeCache(ROUTE_CACHE_CAPACITY) {
+    for (int shard = 0; shard < std::max(shard_count, 1); shard++) {
+        shards.push_back(std::make_unique<Database>(shardPath(directory_path, shard), pool_size,
+                                                    contents ? contents(shard) : nullptr, tuning));
+    }
+}
+
+std::string ShardedStorage::shardPath(const std::string& directory_path, int shard) {
+    std::string suffix = ".shard" + std::to_string(shard);
+    size_t ext = directory_path.rfind(".db");
+    if (ext != std::string::npos && ext + 3 == directory_path.size()) {
+        return directory_path.substr(0, ext) + suffix + ".db";
+    }
+    return directory_path + suffix;
+}
+
+int ShardedStorage::shardOfUser(int user_id) const {
+    return static_cast<int>(static_cast<unsigned>(user_id) % shards.size());
+}
+
+int ShardedStorage::toGlobal(int local_id, int shard) const {
+    return local_id * shardCount() + shard;
+}
+
+int ShardedStorage::shardOfId(int global_id) const {
+    return global_id > 0 ? global_id % shardCount() : -1;
+}
+
+int ShardedStorage::toLocal(int global_id) const {
+    return global_id / shardCount();
+}
+
+int ShardedStorage::localBound(int global_id, int shard) const {
+    // Smallest local id whose global id is >= global_id
+    long long bound = (static_cast<long long>(global_id) - shard + shardCount() - 1) / shardCount();
+    return static_cast<int>(std::max<long long>(bound, 0));
+}
+
+bool ShardedStorage::init() {
+    if (!directory.init()) {
+        return false;
+    }
+    for (auto& shard : shards) {
+        if (!shard->init()) {
+            return false;
+        }
+    }
+
+    // Every id and user already placed depends on the shard count
+    std::string stored;
+    std::string configured = std::to_string(shardCount());
+    if (!directory.readSetting("shard_count", stored)) {
+        if (!directory.writeSetting("shard_count", configured)) {
+            return false;
+        }
+    } else if (stored != configured) {
+        std::cerr << "Directory was created with " << stored << " shards, started with "
+                  << configured << " (resharding is not supported)" << std::endl;
+        return false;
+    }
+
+    // Users are added in id order, so a crash during createUser leaves a shard
+    // behind on the newest id; an older failed stub was recorded in the settings
+    std::string pending;
+    bool repair = directory.readSetting(STUBS_PENDING_SETTING, pending) && pending == "1";
+    int newest = directory.maxUserId();
+    for (auto& shard : shards) {
+        repair = repair || shard->maxUserId() < newest;
+    }
+    if (repair) {
+        std::cerr << "Adding missing users to the shards" << std::endl;
+        return repairUserStubs();
+    }
+    return true;
+}
+
+bool ShardedStorage::repairUserStubs() {
+    std::lock_guard<std::mutex> lock(repairMtx);
+    // Cleared before the scan: a stub failing meanwhile marks it again
+    stubsPending = false;
+    int after = 0;
+    while (true) {
+        auto users = directory.listUserIds(after, USER_STUB_PAGE);
+        if (users.empty()) {
+            break;
+        }
+        for (auto& shard : shards) {
+            if (!shard->createUserStubs(users)) {
+                std::cerr << "Failed to repair user stubs" << std::endl;
+                markStubsPending();
+                return false;
+            }
+        }
+        after = users.back().first;
+    }
+    return directory.writeSetting(STUBS_PENDING_SETTING, "0");
+}
+
+void ShardedStorage::markStubsPending() {
+    stubsPending = true;
+    directory.writeSetting(STUBS_PENDING_SETTING, "1");
+}
+
+void ShardedStorage::repairPendingStubs() {
+    if (stubsPending) {
+        repairUserStubs();
+    }
+}
+
+bool ShardedStorage::createUser(std::string username, std::string pass_hash,
+                                std::string salt, std::string receive_pub_key) {
+    if (!directory.createUser(username, pass_hash, salt, receive_pub_key)) {
+        return false;
+    }
+
+    // Every shard gets the user, so notes on any shard can be shared with them.
+    // The account exists once it is in the directory: a stub that fails here is
+    // added by the repair before the next write to the shards.
+    int userId = directory.getUserByUsername(username).id;
+    for (int shard = 0; shard < shardCount(); shard++) {
+        if (userId == -1 || !shards[shard]->createUserStub(userId, username)) {
+            std::cerr << "Failed to add user " << username << " to shard " << shard << std::endl;
+            markStubsPending();
+            break;
+        }
+    }
+    return true;
+}
+
+UserRecord ShardedStorage::getUserByUsername(std::string username) {
+    return directory.getUserByUsername(username);
+}
+
+bool ShardedStorage::updateUserPublicKey(int user_id, std::string receive_pub_key) {
+    // The shard stubs carry no keys
+    return directory.updateUserPublicKey(user_id, receive_pub_key);
+}
+
+CacheStats ShardedStorage::userCacheStats() {
+    return directory.userCacheStats();
+}
+
+CacheStats ShardedStorage::linkCacheStats() {
+    CacheStats total;
+    for (auto& shard : shards) {
+        total += shard->linkCacheStats();
+    }
+    return total;
+}
+
+int ShardedStorage::saveNote(int user_id, std::string encrypted_content,
+                             std::string wrapped_key, std::string iv_hex, std::string filename) {
+    repairPendingStubs();
+    int shard = shardOfUser(user_id);
+    int local = shards[shard]->saveNote(user_id, std::move(encrypted_content), std::move(wrapped_key),
+                                        std::move(iv_hex), std::move(filename));
+    return local == -1 ? -1 : toGlobal(local, shard);
+}
+
+int ShardedStorage::saveNoteStream(int user_id, long long size, const ContentStore::ChunkSource& next,
+                                   std::string wrapped_key, std::string iv_hex, std::string filename) {
+    repairPendingStubs();
+    int shard = shardOfUser(user_id);
+    int local = shards[shard]->saveNoteStream(user_id, size, next, std::move(wrapped_key),
+                                              std::move(iv_hex), std::move(filename));
+    return local == -1 ? -1 : toGlobal(local, shard);
+}
+
+std::vector<int> ShardedStorage::saveNotes(const std::vector<NewNote>& notes) {
+    repairPendingStubs();
+    std::vector<std::vector<size_t>> positions(shards.size());
+    std::vector<std::vector<NewNote>> batches(shards.size());
+    for (size_t i = 0; i < notes.size(); i++) {
+        int shard = shardOfUser(notes[i].user_id);
+        positions[shard].push_back(i);
+        batches[shard].push_back(notes[i]);
+    }
+
+    // Each shard has its own write lock, so the batches commit side by side
+    std::vector<std::future<std::vector<int>>> commits(shards.size());
+    for (size_t shard = 0; shard < shards.size(); shard++) {
+        if (!batches[shard].empty()) {
+            commits[shard] = std::async(std::launch::async, [this, &batches, shard] {
+                return shards[shard]->saveNotes(batches[shard]);
+            });
+        }
+    }
+
+    std::vector<int> ids(notes.size(), -1);
+    for (size_t shard = 0; shard < shards.size(); shard++) {
+        if (!commits[shard].valid()) {
+            continue;
+        }
+        std::vector<int> local = commits[shard].get();
+        for (size_t i = 0; i < local.size(); i++) {
+            ids[positions[shard][i]] = local[i] == -1 ? -1 : toGlobal(local[i], static_cast<int>(shard));
+        }
+    }
+    return ids;
+}
+
+NoteData ShardedStorage::getNoteById(int note_id) {
+    int shard = shardOfId(note_id);
+    if (shard == -1) {
+        NoteData note;
+        note.note_id = -1;
+        return note;
+    }
+
+    NoteData note = shards[shard]->getNoteById(toLocal(note_id));
+    if (note.note_id != -1) {
+        note.note_id = note_id;
+    }
+    return note;
+}
+
+Storage::NoteAccess ShardedStorage::getNoteForOwner(int note_id, int user_id, NoteData& note) {
+    int shard = shardOfId(note_id);
+    if (shard == -1) {
+        return NoteAccess::NotFound;
+    }
+
+    NoteAccess access = shards[shard]->getNoteForOwner(toLocal(note_id), user_id, note);
+    if (access == NoteAccess::Ok) {
+        note.note_id = note_id;
+    }
+    return access;
+}
+
+Storage::NoteAccess ShardedStorage::getNoteRangeForOwner(int note_id, int user_id, const ContentStore::ByteRange& range,
+                                                         NoteData& note, ContentStore::RangeData& data) {
+    int shard = shardOfId(note_id);
+    if (shard == -1) {
+        return NoteAccess::NotFound;
+    }
+
+    NoteAccess access = shards[shard]->getNoteRangeForOwner(toLocal(note_id), user_id, range, note, data);
+    if (access == NoteAccess::Ok) {
+        note.note_id = note_id;
+    }
+    return access;
+}
+
+std::string ShardedStorage::createShareLink(int note_id, int user_id,
+                                            std::vector<UserAccessEntry> user_access_list,
+                                            int duration_seconds) {
+    repairPendingStubs();
+    int shard = shardOfId(note_id);
+    if (shard == -1) {
+        return "";
+    }
+
+    std::string token = shards[shard]->createShareLink(toLocal(note_id), user_id,
+                                                       std::move(user_access_list), duration_seconds);
+    if (token.empty()) {
+        return "";
+    }
+
+    long routeExpiration = static_cast<long>(std::time(nullptr)) + duration_seconds + ROUTE_SLACK_SECONDS;
+    if (!directory.addLinkRoute(token, shard, routeExpiration)) {
+        // Unreachable without its route
+        shards[shard]->deleteShareLink(token, user_id);
+        return "";
+    }
+    return token;
+}
+
+int ShardedStorage::routeOf(const std::string& token) {
+    int shard;
+    if (routeCache.get(token, shard)) {
+        return shard;
+    }
+    uint64_t generation = routeCache.generation(token);
+    shard = directory.findLinkRoute(token);
+    if (shard >= 0 && shard < shardCount()) {
+        routeCache.put(token, shard, generation);
+    }
+    return shard;
+}
+
+Storage::ShareLinkData ShardedStorage::getShareLinkData(std::string token, std::string username) {
+    // A cached route whose link was deleted or swept just leads to a miss in the shard
+    int shard = routeOf(token);
+    if (shard < 0 || shard >= shardCount()) {
+        return ShareLinkData{-1, "", "", "", "", "", false};
+    }
+
+    ShareLinkData data = shards[shard]->getShareLinkData(token, username);
+    if (data.valid) {
+        data.note_id = toGlobal(data.note_id, shard);
+    }
+    return data;
+}
+
+Storage::ShareLinkData ShardedStorage::getShareLinkRaw(std::string token, std::string username,
+                                                       ContentStore::RangeData& data) {
+    int shard = routeOf(token);
+    if (shard < 0 || shard >= shardCount()) {
+        return ShareLinkData{-1, "", "", "", "", "", false};
+    }
+
+    ShareLinkData link = shards[shard]->getShareLinkRaw(token, username, data);
+    if (link.valid) {
+        link.note_id = toGlobal(link.note_id, shard);
+    }
+    return link;
+}
+
+bool ShardedStorage::deleteShareLink(std::string token, int user_id) {
+    int shard = routeOf(token);
+    if (shard < 0 || shard >= shardCount() || !shards[shard]->deleteShareLink(token, user_id)) {
+        return false;
+    }
+    directory.deleteLinkRoute(token);
+    routeCache.invalidate(token);
+    return true;
+}
+
+bool ShardedStorage::createUserShare(int note_id, int sender_id, int recipient_id,
+                                     std::string send_public_key_hex, std::string new_wrapped_key,
+                                     int duration_seconds) {
+    repairPendingStubs();
+    // Stored with the note, whatever shard the recipient is on
+    int shard = shardOfId(note_id);
+    if (shard == -1) {
+        return false;
+    }
+    return shards[shard]->createUserShare(toLocal(note_id), sender_id, recipient_id,
+                                          std::move(send_public_key_hex), std::move(new_wrapped_key),
+                                          duration_seconds);
+}
+
+std::vector<int> ShardedStorage::getSharedNotesForUser(int user_id) {
+    std::vector<int> shareIds;
+    for (int shard = 0; shard < shardCount(); shard++) {
+        for (int local : shards[shard]->getSharedNotesForUser(user_id)) {
+            shareIds.push_back(toGlobal(local, shard));
+        }
+    }
+    return shareIds;
+}
+
+Storage::ShareInfo ShardedStorage::getShareInfo(int share_id, int recipient_id) {
+    int shard = shardOfId(share_id);
+    if (shard == -1) {
+        return ShareInfo{-1, "", "", "", ""};
+    }
+
+    ShareInfo info = shards[shard]->getShareInfo(toLocal(share_id), recipient_id);
+    if (info.note_id != -1) {
+        info.note_id = toGlobal(info.note_id, shard);
+    }
+    return info;
+}
+
+Storage::NotePage ShardedStorage::listNotes(int user_id, const NoteCursor& after, int limit) {
+    int shard = shardOfUser(user_id);
+
+    NoteCursor local;
+    local.created_at = after.created_at;
+    local.note_id = localBound(after.note_id, shard);
+
+    NotePage page = shards[shard]->listNotes(user_id, local, limit);
+    for (auto& note : page.notes) {
+        note.note_id = toGlobal(note.note_id, shard);
+    }
+    return page;
+}
+
+bool ShardedStorage::deleteNote(int note_id, int user_id) {
+    // Routes of links that go with the note are left to expire
+    int shard = shardOfId(note_id);
+    return shard != -1 && shards[shard]->deleteNote(toLocal(note_id), user_id);
+}
+
+std::vector<int> ShardedStorage::deleteNotes(int user_id, const std::vector<int>& note_ids) {
+    std::vector<std::vector<int>> perShard(shards.size());
+    for (int note_id : note_ids) {
+        int shard = shardOfId(note_id);
+        if (shard != -1) {
+            perShard[shard].push_back(toLocal(note_id));
+        }
+    }
+
+    // A user's own notes are all on one shard, so this is one transaction in practice
+    std::set<int> removed;
+    for (int shard = 0; shard < shardCount(); shard++) {
+        if (!perShard[shard].empty()) {
+            for (int local : shards[shard]->deleteNotes(user_id, perShard[shard])) {
+                removed.insert(toGlobal(local, shard));
+            }
+        }
+    }
+
+    // Same order as requested, each id once
+    std::vector<int> deleted;
+    for (int note_id : note_ids) {
+        if (removed.erase(note_id) == 1) {
+            deleted.push_back(note_id);
+        }
+    }
+    return deleted;
+}
+
+Storage::OutgoingSharePage ShardedStorage::listOutgoingShares(int user_id, const ShareCursor& after,
+                                                              int limit, bool active_only) {
+    OutgoingSharePage page;
+    page.has_more = false;
+
+    // Each shard returns its own first page after the cursor; the merged page is
+    // the first `limit` of those in (expiration_time, link_id) order
+    for (int shard = 0; shard < shardCount(); shard++) {
+        ShareCursor local;
+        local.expiration_time = after.expiration_time;
+        local.link_id = localBound(after.link_id, shard);
+
+        OutgoingSharePage part = shards[shard]->listOutgoingShares(user_id, local, limit, active_only);
+        page.has_more = page.has_more || part.has_more;
+        for (auto& share : part.shares) {
+            share.link_id = toGlobal(share.link_id, shard);
+            share.note_id = toGlobal(share.note_id, shard);
+            page.shares.push_back(std::move(share));
+        }
+    }
+
+    std::sort(page.shares.begin(), page.shares.end(), [](const OutgoingShare& a, const OutgoingShare& b) {
+        return a.expiration_time != b.expiration_time ? a.expiration_time > b.expiration_time
+                                                      : a.link_id > b.link_id;
+    });
+    if (static_cast<int>(page.shares.size()) > limit) {
+        page.shares.resize(limit);
+        page.has_more = true;
+    }
+    return page;
+}
+
+int ShardedStorage::deleteExpiredLinks(long now, int batch_size) {
+    int deleted = 0;
+    for (auto& shard : shards) {
+        int rows = shard->deleteExpiredLinks(now, batch_size - deleted);
+        if (rows < 0) {
+            return -1;
+        }
+        deleted += rows;
+        if (deleted == batch_size) {
+            break;
+        }
+    }
+
+    // Routes expire after their links; they are not counted as deleted links
+    if (directory.deleteExpiredLinkRoutes(now, batch_size) < 0) {
+        return -1;
+    }
+    return deleted;
+}
+
+int ShardedStorage::deleteExpiredUserShares(long now, int batch_size) {
+    int deleted = 0;
+    for (auto& shard : shards) {
+        int rows = shard->deleteExpiredUserShares(now, batch_size - deleted);
+        if (rows < 0) {
+            return -1;
+        }
+        deleted += rows;
+        if (deleted == batch_size) {
+            break;
+        }
+    }
+    return deleted;
+}
+
+long ShardedStorage::countExpiredLinks(long now) {
+    long count = 0;
+    for (auto& shard : shards) {
+        long rows = shard->countExpiredLinks(now);
+        if (rows < 0) {
+            return -1;
+        }
+        count += rows;
+    }
+    return count;
+}
+
+long ShardedStorage::countExpiredUserShares(long now) {
+    long count = 0;
+    for (auto& shard : shards) {
+        long rows = shard->countExpiredUserShares(now);
+        if (rows < 0) {
+            return -1;
+        }
+        count += rows;
+    }
+    return count;
+}
+
+bool ShardedStorage::backup(const std::string& destination, int pages_per_step, int pause_ms,
+                            const BackupProgress& progress) {
+    // Progress runs over all files: pages of the finished ones plus the current one
+    long long finished = 0;
+    long long current = 0;
+    auto track = [&](long long copied, long long total) {
+        current = total;
+        if (progress) {
+            progress(finished + copied, finished + total);
+        }
+    };
+
+    for (int shard = 0; shard < shardCount(); shard++) {
+        current = 0;
+        if (!shards[shard]->backup(shardPath(destination, shard), pages_per_step, pause_ms, track)) {
+            return false;
+        }
+        finished += current;
+    }
+    return directory.backup(destination, pages_per_step, pause_ms, track);
+}
+
+int ShardedStorage::backfillStep(int batch_size) {
+    int rows = directory.backfillStep(batch_size);
+    for (size_t i = 0; rows == 0 && i < shards.size(); i++) {
+        rows = shards[i]->backfillStep(batch_size);
+    }
+    return rows;
+}
+
+ContentStore::Compaction ShardedStorage::compactContent(double min_dead_ratio) {
+    ContentStore::Compaction total;
+    for (auto& shard : shards) {
+        ContentStore::Compaction result = shard->compactContent(min_dead_ratio);
+        total.segments_compacted += result.segments_compacted;
+        total.segments_removed += result.segments_removed;
+        total.bytes_moved += result.bytes_moved;
+        total.bytes_reclaimed += result.bytes_reclaimed;
+    }
+    return total;
+}
+
+ContentStore::Usage ShardedStorage::contentUsage() {
+    ContentStore::Usage total;
+    for (auto& shard : shards) {
+        ContentStore::Usage usage = shard->contentUsage();
+        total.segments += usage.segments;
+        total.file_bytes += usage.file_bytes;
+        total.live_bytes += usage.live_bytes;
+    }
+    return total;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Database.h"
+
+// Spreads users over several SQLite files so uploads and share creation are not
+// all queued behind one write lock. A small directory database holds the real
+// Users table and the token -> shard routes of share links; each shard is a
+// full Database holding the Notes, SharedLinks and UserShares of its users
+// (user_id % shard_count), plus a stub of every user so foreign keys hold for
+// cross-shard shares.
+//
+// Note, link and user share ids are global: local_id * shard_count + shard, so
+// the shard of any id is known without a lookup. A link or user share lives
+// with its note, which keeps the delete cascades inside one database;
+// recipient-side listings therefore ask every shard. The shard count is stored
+// in the directory on first start and cannot change afterwards (no resharding).
+//
+// A user is committed to the directory before its stubs are written. A stub
+// that fails is recorded in the directory settings and every shard is repaired
+// before its next write; init() also repairs the shards a crash left behind.
+class ShardedStorage : public Storage {
+public:
+    // Content store of one shard; nullptr keeps ciphertext inline in SQLite
+    using ContentFactory = std::function<std::unique_ptr<ContentStore>(int shard)>;
+
+    // Shards go next to the directory: secure_notes.db -> secure_notes.shard0.db, ...
+    // pool_size connections per database, as every worker may hit the same shard
+    ShardedStorage(const std::string& directory_path, int shard_count, size_t pool_size,
+                   const ContentFactory& contents = nullptr, const SqliteTuning& tuning = SqliteTuning());
+
+    static std::string shardPath(const std::string& directory_path, int shard);
+    int shardCount() const { return static_cast<int>(shards.size()); }
+    // Shard holding a user's notes
+    int shardOfUser(int user_id) const;
+
+    bool init() override;
+
+    bool createUser(std::string username, std::string pass_hash, std::string salt, std::string receive_pub_key) override;
+    UserRecord getUserByUsername(std::string username) override;
+    bool updateUserPublicKey(int user_id, std::string receive_pub_key) override;
+    // Users live in the directory, and so does their cache
+    CacheStats userCacheStats() override;
+    // Summed over the shards, where the links live
+    CacheStats linkCacheStats() override;
+
+    int saveNote(int user_id, std::string encrypted_content, std::string wrapped_key, std::string iv_hex, std::string filename) override;
+    // One transaction per shard involved, committed in parallel
+    std::vector<int> saveNotes(const std::vector<NewNote>& notes) override;
+    int saveNoteStream(int user_id, long long size, const ContentStore::ChunkSource& next,
+                       std::string wrapped_key, std::string iv_hex, std::string filename) override;
+    NoteData getNoteById(int note_id) override;
+    NoteAccess getNoteForOwner(int note_id, int user_id, NoteData& note) override;
+    NoteAccess getNoteRangeForOwner(int note_id, int user_id, const ContentStore::ByteRange& range,
+                                    NoteData& note, ContentStore::RangeData& data) override;
+
+    std::string createShareLink(int note_id, int user_id,
+                                std::vector<UserAccessEntry> user_access_list,
+                                int duration_seconds) override;
+    ShareLinkData getShareLinkData(std::string token, std::string username) override;
+    ShareLinkData getShareLinkRaw(std::string token, std::string username, ContentStore::RangeData& data) override;
+    bool deleteShareLink(std::string token, int user_id) override;
+    bool createUserShare(int note_id, int sender_id, int recipient_id,
+                         std::string send_public_key_hex, std::string new_wrapped_key,
+                         int duration_seconds) override;
+    std::vector<int> getSharedNotesForUser(int user_id) override;
+    ShareInfo getShareInfo(int share_id, int recipient_id) override;
+
+    NotePage listNotes(int user_id, const NoteCursor& after, int limit) override;
+    bool deleteNote(int note_id, int user_id) override;
+    std::vector<int> deleteNotes(int user_id, const std::vector<int>& note_ids) override;
+    // Links on someone else's note live in that note's shard, so every shard is asked
+    OutgoingSharePage listOutgoingShares(int user_id, const ShareCursor& after, int limit, bool active_only) override;
+
+    int deleteExpiredLinks(long now, int batch_size) override;
+    int deleteExpiredUserShares(long now, int batch_size) override;
+    long countExpiredLinks(long now) override;
+    long countExpiredUserShares(long now) override;
+
+    // destination is the directory file; shards go next to it like the live ones.
+    // Each file is its own point-in-time snapshot. The shards are copied first, so
+    // every user stub, note and link in them has its user and route in the directory copy.
+    bool backup(const std::string& destination, int pages_per_step, int pause_ms,
+                const BackupProgress& progress) override;
+
+    // The directory first, then one shard after the other
+    int backfillStep(int batch_size) override;
+
+    ContentStore::Compaction compactContent(double min_dead_ratio) override;
+    ContentStore::Usage contentUsage() override;
+
+private:
+    int toGlobal(int local_id, int shard) const;
+    // Shard of a global id, -1 if it cannot be one
+    int shardOfId(int global_id) const;
+    int toLocal(int global_id) const;
+    // Keyset bound inside one shard: local ids below it are exactly the global ids below `global_id`
+    int localBound(int global_id, int shard) const;
+    // Shard of a link token, -1 if unknown; cached, as a route never changes
+    int routeOf(const std::string& token);
+
+    // Adds every directory user missing from a shard (INSERT OR IGNORE, page by page)
+    bool repairUserStubs();
+    void markStubsPending();
+    // Called before any write to a shard that needs the user rows
+    void repairPendingStubs();
+
+    Database directory;
+    std::vector<std::unique_ptr<Database>> shards;
+    LruCache<std::string, int> routeCache; // token -> shard
+    std::atomic<bool> stubsPending{false};
+    std::mutex repairMtx;
+};
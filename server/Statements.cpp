@@ -0,0 +1,166 @@
+#include "Statements.h"
+
+namespace {
+
+struct StatementDef {
+    Stmt id;
+    const char* name;
+    const char* sql;
+};
+
+// Must stay in the same order as the Stmt enum
+const StatementDef STATEMENTS[] = {
+    {Stmt::BeginImmediate, "BeginImmediate", "BEGIN IMMEDIATE"},
+    {Stmt::Commit, "Commit", "COMMIT"},
+    {Stmt::Rollback, "Rollback", "ROLLBACK"},
+    {Stmt::Savepoint, "Savepoint", "SAVEPOINT nested"},
+    {Stmt::RollbackToSavepoint, "RollbackToSavepoint", "ROLLBACK TO nested"},
+    {Stmt::ReleaseSavepoint, "ReleaseSavepoint", "RELEASE nested"},
+
+    {Stmt::InsertUser, "InsertUser",
+     "INSERT INTO Users (username, password_hash, salt, receive_public_key_hex) VALUES (?, ?, ?, ?)"},
+    {Stmt::SelectUserByUsername, "SelectUserByUsername",
+     "SELECT id, username, password_hash, salt, receive_public_key_hex FROM Users WHERE username = ?"},
+    {Stmt::UpdateUserPublicKey, "UpdateUserPublicKey",
+     "UPDATE Users SET receive_public_key_hex = ? WHERE id = ?"},
+    {Stmt::SelectUsernameById, "SelectUsernameById",
+     "SELECT username FROM Users WHERE id = ?"},
+    // A shard's copy of a directory user, only there for the foreign keys
+    {Stmt::InsertUserStub, "InsertUserStub",
+     "INSERT OR IGNORE INTO Users (id, username, password_hash, salt, receive_public_key_hex) VALUES (?, ?, '', '', '')"},
+    {Stmt::SelectUserIdPage, "SelectUserIdPage",
+     "SELECT id, username FROM Users WHERE id > ? ORDER BY id LIMIT ?"},
+    {Stmt::SelectMaxUserId, "SelectMaxUserId",
+     "SELECT COALESCE(MAX(id), 0) FROM Users"},
+
+    {Stmt::InsertNote, "InsertNote",
+     "INSERT INTO Notes (user_id, filename, created_at) VALUES (?, ?, ?)"},
+    {Stmt::InsertNoteContent, "InsertNoteContent",
+     "INSERT INTO NoteContents (note_id, wrapped_key, iv_hex, encrypted_content) VALUES (?, ?, ?, zeroblob(?))"},
+    {Stmt::SelectNoteById, "SelectNoteById",
+     "SELECT id, user_id, filename, created_at FROM Notes WHERE id = ?"},
+    {Stmt::SelectNoteContentKeys, "SelectNoteContentKeys",
+     "SELECT wrapped_key, iv_hex FROM NoteContents WHERE note_id = ?"},
+    // Base64 TEXT left by a version 1 database until the content backfill reaches it
+    {Stmt::SelectLegacyNoteContent, "SelectLegacyNoteContent",
+     "SELECT encrypted_content FROM NoteContents WHERE note_id = ? AND typeof(encrypted_content) = 'text'"},
+
+    // Segment file index (SegmentContentStore)
+    {Stmt::InsertContentSegment, "InsertContentSegment",
+     "INSERT INTO ContentSegments (note_id, segment_id, segment_offset, length) VALUES (?, ?, ?, ?)"},
+    {Stmt::SelectContentSegment, "SelectContentSegment",
+     "SELECT segment_id, segment_offset, length FROM ContentSegments WHERE note_id = ?"},
+    {Stmt::SelectSegmentNotes, "SelectSegmentNotes",
+     "SELECT note_id, segment_offset, length FROM ContentSegments WHERE segment_id = ? ORDER BY segment_offset"},
+    {Stmt::SumSegmentBytes, "SumSegmentBytes",
+     "SELECT COALESCE(SUM(length), 0) FROM ContentSegments WHERE segment_id = ?"},
+    // Only moves the note if compaction still saw it where it was copied from
+    {Stmt::MoveContentSegment, "MoveContentSegment",
+     "UPDATE ContentSegments SET segment_id = ?, segment_offset = ? WHERE note_id = ? AND segment_id = ? AND segment_offset = ?"},
+    {Stmt::SelectNotePageByUser, "SelectNotePageByUser", R"(
+        SELECT id, filename, created_at FROM Notes
+        WHERE user_id = ? AND (created_at, id) < (?, ?)
+        ORDER BY created_at DESC, id DESC
+        LIMIT ?
+    )"},
+    // Contents, links, their access rows and user shares go with the note (ON DELETE CASCADE)
+    {Stmt::DeleteNoteByOwner, "DeleteNoteByOwner",
+     "DELETE FROM Notes WHERE id = ? AND user_id = ?"},
+
+    // Recipients are aggregated per link by a correlated subquery on the covering
+    // (link_id, username) index, so rows still come out in index order (no sort, no N+1).
+    // Usernames come back as a JSON array so no separator can clash with a username.
+    {Stmt::SelectLinkPageByOwner, "SelectLinkPageByOwner", R"(
+        SELECT sl.id, sl.note_id, sl.token, sl.expiration_time,
+               (SELECT json_group_array(sla.username)
+                FROM SharedLinkAccess sla WHERE sla.link_id = sl.id)
+        FROM SharedLinks sl
+        WHERE sl.owner_id = ? AND sl.expiration_time > ?
+          AND (sl.expiration_time, sl.id) < (?, ?)
+        ORDER BY sl.expiration_time DESC, sl.id DESC
+        LIMIT ?
+    )"},
+    {Stmt::InsertLink, "InsertLink",
+     "INSERT INTO SharedLinks (token, note_id, owner_id, expiration_time) VALUES (?, ?, ?, ?)"},
+    {Stmt::InsertLinkAccess, "InsertLinkAccess",
+     "INSERT INTO SharedLinkAccess (link_id, username, send_public_key_hex, wrapped_key) VALUES (?, ?, ?, ?)"},
+    // Link, the caller's whitelist row and the note metadata in one lookup. The access
+    // columns are NULL when the link exists but the username is not on its whitelist.
+    {Stmt::SelectLinkForAccess, "SelectLinkForAccess", R"(
+        SELECT sl.id, sl.note_id, sl.expiration_time, sla.send_public_key_hex, sla.wrapped_key,
+               n.filename, n.created_at
+        FROM SharedLinks sl
+        JOIN Notes n ON n.id = sl.note_id
+        LEFT JOIN SharedLinkAccess sla ON sla.link_id = sl.id AND sla.username = ?
+        WHERE sl.token = ?
+    )"},
+    // Tokens dropped from the link cache when their note is deleted
+    {Stmt::SelectLinkTokensByNote, "SelectLinkTokensByNote",
+     "SELECT token FROM SharedLinks WHERE note_id = ?"},
+    {Stmt::DeleteLink, "DeleteLink",
+     "DELETE FROM SharedLinks WHERE id = ?"},
+    {Stmt::SelectLinkAccess, "SelectLinkAccess",
+     "SELECT send_public_key_hex, wrapped_key FROM SharedLinkAccess WHERE link_id = ? AND username = ?"},
+    {Stmt::DeleteLinkByTokenAndOwner, "DeleteLinkByTokenAndOwner",
+     "DELETE FROM SharedLinks WHERE token = ? AND owner_id = ?"},
+
+    {Stmt::InsertUserShare, "InsertUserShare",
+     "INSERT INTO UserShares (note_id, sender_id, recipient_id, send_public_key_hex, new_wrapped_key, expiration_time) VALUES (?, ?, ?, ?, ?, ?)"},
+    {Stmt::SelectUserSharesByRecipient, "SelectUserSharesByRecipient",
+     "SELECT id FROM UserShares WHERE recipient_id = ? AND expiration_time > ?"},
+    {Stmt::SelectShareInfo, "SelectShareInfo", R"(
+        SELECT us.note_id, us.send_public_key_hex, us.new_wrapped_key, nc.iv_hex
+        FROM UserShares us
+        JOIN NoteContents nc ON nc.note_id = us.note_id
+        WHERE us.id = ? AND us.recipient_id = ? AND us.expiration_time > ?
+    )"},
+
+    // Expiry sweeper: oldest expired rows first, one bounded batch per statement.
+    // Access rows of a deleted link go with it (ON DELETE CASCADE).
+    {Stmt::DeleteExpiredLinks, "DeleteExpiredLinks", R"(
+        DELETE FROM SharedLinks WHERE id IN (
+            SELECT id FROM SharedLinks WHERE expiration_time < ?
+            ORDER BY expiration_time LIMIT ?)
+    )"},
+    {Stmt::DeleteExpiredUserShares, "DeleteExpiredUserShares", R"(
+        DELETE FROM UserShares WHERE id IN (
+            SELECT id FROM UserShares WHERE expiration_time < ?
+            ORDER BY expiration_time LIMIT ?)
+    )"},
+    {Stmt::CountExpiredLinks, "CountExpiredLinks",
+     "SELECT COUNT(*) FROM SharedLinks WHERE expiration_time < ?"},
+    {Stmt::CountExpiredUserShares, "CountExpiredUserShares",
+     "SELECT COUNT(*) FROM UserShares WHERE expiration_time < ?"},
+
+    // Directory of a sharded deployment (ShardedStorage)
+    {Stmt::InsertLinkRoute, "InsertLinkRoute",
+     "INSERT INTO LinkRoutes (token, shard, expiration_time) VALUES (?, ?, ?)"},
+    {Stmt::SelectLinkRoute, "SelectLinkRoute",
+     "SELECT shard FROM LinkRoutes WHERE token = ?"},
+    {Stmt::DeleteLinkRoute, "DeleteLinkRoute",
+     "DELETE FROM LinkRoutes WHERE token = ?"},
+    {Stmt::DeleteExpiredLinkRoutes, "DeleteExpiredLinkRoutes", R"(
+        DELETE FROM LinkRoutes WHERE token IN (
+            SELECT token FROM LinkRoutes WHERE expiration_time < ?
+            ORDER BY expiration_time LIMIT ?)
+    )"},
+    {Stmt::SelectSetting, "SelectSetting",
+     "SELECT value FROM Settings WHERE name = ?"},
+    {Stmt::InsertSetting, "InsertSetting",
+     "INSERT OR REPLACE INTO Settings (name, value) VALUES (?, ?)"},
+    {Stmt::DeleteSetting, "DeleteSetting",
+     "DELETE FROM Settings WHERE name = ?"},
+};
+
+static_assert(sizeof(STATEMENTS) / sizeof(STATEMENTS[0]) == STATEMENT_COUNT,
+              "Every Stmt needs an entry in STATEMENTS");
+
+}
+
+const char* statementSql(Stmt id) {
+    return STATEMENTS[static_cast<size_t>(id)].sql;
+}
+
+const char* statementName(Stmt id) {
+    return STATEMENTS[static_cast<size_t>(id)].name;
+}
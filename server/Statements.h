@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+
+// Registry of every SQL statement the server runs against the database.
+// Each pooled connection compiles a statement the first time it is used
+// and keeps it until the connection is closed.
+enum class Stmt {
+    BeginImmediate,
+    Commit,
+    Rollback,
+    Savepoint,
+    RollbackToSavepoint,
+    ReleaseSavepoint,
+    InsertUser,
+    SelectUserByUsername,
+    UpdateUserPublicKey,
+    SelectUsernameById,
+    InsertUserStub,
+    SelectUserIdPage,
+    SelectMaxUserId,
+    InsertNote,
+    InsertNoteContent,
+    SelectNoteById,
+    SelectNoteContentKeys,
+    SelectLegacyNoteContent,
+    InsertContentSegment,
+    SelectContentSegment,
+    SelectSegmentNotes,
+    SumSegmentBytes,
+    MoveContentSegment,
+    SelectNotePageByUser,
+    DeleteNoteByOwner,
+    SelectLinkPageByOwner,
+    InsertLink,
+    InsertLinkAccess,
+    SelectLinkForAccess,
+    SelectLinkTokensByNote,
+    DeleteLink,
+    SelectLinkAccess,
+    DeleteLinkByTokenAndOwner,
+    InsertUserShare,
+    SelectUserSharesByRecipient,
+    SelectShareInfo,
+    DeleteExpiredLinks,
+    DeleteExpiredUserShares,
+    CountExpiredLinks,
+    CountExpiredUserShares,
+    InsertLinkRoute,
+    SelectLinkRoute,
+    DeleteLinkRoute,
+    DeleteExpiredLinkRoutes,
+    SelectSetting,
+    InsertSetting,
+    DeleteSetting,
+    Count
+};
+
+const size_t STATEMENT_COUNT = static_cast<size_t>(Stmt::Count);
+
+// SQL text of a registered statement
+const char* statementSql(Stmt id);
+
+// Readable name of a registered statement (for logs and tests)
+const char* statementName(Stmt id);
@@ -0,0 +1,183 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <limits>
+#include "../common/Protocol.h"
+#include "ContentStore.h"
+#include "LruCache.h"
+
+// Struct ánh xạ dữ liệu từ bảng Users
+struct UserRecord {
+    int id;
+    std::string username;
+    std::string password_hash; // Đã băm
+    std::string salt;
+    std::string receive_public_key_hex; // Key ECDH công khai (Receive Key)
+};
+
+// Mọi thao tác lưu trữ mà server cần. Các cài đặt:
+//   - Database (SQLite, WAL, pool kết nối): dùng thật
+//   - ShardedStorage (nhiều file SQLite + directory): nhiều writer song song
+//   - MemoryStorage (hash map chia stripe, không đụng đĩa): đo riêng tầng HTTP/crypto, load test
+// Server chọn một trong hai lúc khởi động. Mọi hàm phải an toàn khi gọi từ nhiều thread.
+class Storage {
+public:
+    virtual ~Storage() = default;
+
+    // Khởi tạo (tạo bảng, nâng cấp schema...), gọi một lần trước mọi thao tác khác
+    virtual bool init() = 0;
+
+    // --- User Operations ---
+    virtual bool createUser(std::string username, std::string pass_hash, std::string salt, std::string receive_pub_key) = 0;
+    // id = -1 nếu không tồn tại
+    virtual UserRecord getUserByUsername(std::string username) = 0;
+    virtual bool updateUserPublicKey(int user_id, std::string receive_pub_key) = 0;
+
+    // --- Note Operations ---
+    // Trả về note_id vừa tạo, -1 nếu lỗi (kể cả ciphertext không phải base64 hợp lệ)
+    virtual int saveNote(int user_id, std::string encrypted_content, std::string wrapped_key, std::string iv_hex, std::string filename) = 0;
+    // Ghi nhiều note trong một transaction (group commit, xem GroupCommitQueue).
+    // Trả về note_id theo đúng thứ tự, -1 cho note ghi lỗi.
+    struct NewNote {
+        int user_id;
+        std::string encrypted_content;
+        std::string wrapped_key;
+        std::string iv_hex;
+        std::string filename;
+        // true: encrypted_content là ciphertext thô (upload CBOR/MessagePack), không phải base64
+        bool raw_content = false;
+    };
+    virtual std::vector<int> saveNotes(const std::vector<NewNote>& notes) = 0;
+    // Upload lớn (POST /upload/raw): ciphertext thô `size` byte, lấy từng khối từ `next`
+    // thay vì một chuỗi base64 trong bộ nhớ. Trả về note_id, -1 nếu lỗi hoặc nguồn không đủ/thừa byte.
+    virtual int saveNoteStream(int user_id, long long size, const ContentStore::ChunkSource& next,
+                               std::string wrapped_key, std::string iv_hex, std::string filename) = 0;
+    // note_id = -1 nếu không tồn tại
+    virtual NoteData getNoteById(int note_id) = 0;
+
+    // Đọc note và kiểm tra chủ sở hữu trong cùng một truy vấn theo khóa chính.
+    // Chỉ ghi vào `note` khi kết quả là Ok.
+    enum class NoteAccess { Ok, NotFound, Forbidden };
+    virtual NoteAccess getNoteForOwner(int note_id, int user_id, NoteData& note) = 0;
+    // Như trên nhưng chỉ đọc một đoạn ciphertext thô (GET /note/<id>/raw, Range).
+    // `note` nhận metadata, wrapped_key, iv_hex; encrypted_content để trống.
+    virtual NoteAccess getNoteRangeForOwner(int note_id, int user_id, const ContentStore::ByteRange& range,
+                                            NoteData& note, ContentStore::RangeData& data) = 0;
+
+    // --- Sharing Operations ---
+    // Token link = SHARE_TOKEN_BYTES byte ngẫu nhiên, đi qua Storage dưới dạng byte thô trong std::string.
+    // Chuyển sang/từ base64url (URL) chỉ ở handler /share.
+    static const int SHARE_TOKEN_BYTES = 32;
+
+    // Tạo link chia sẻ với whitelist username, trả về token (rỗng nếu lỗi).
+    // Link và toàn bộ whitelist được ghi trong một transaction.
+    struct UserAccessEntry {
+        std::string username;
+        std::string send_public_key_hex;
+        std::string wrapped_key;
+    };
+    virtual std::string createShareLink(int note_id, int user_id,
+                                        std::vector<UserAccessEntry> user_access_list,
+                                        int duration_seconds) = 0;
+    // Kiểm tra quyền truy cập và lấy dữ liệu
+    struct ShareLinkData {
+        int note_id;
+        std::string encrypted_content;
+        std::string send_public_key_hex;
+        std::string wrapped_key;
+        std::string iv_hex;
+        std::string filename;
+        bool valid;
+    };
+    virtual ShareLinkData getShareLinkData(std::string token, std::string username) = 0;
+    // Như trên nhưng ciphertext thô nằm trong `data` (trả về CBOR/MessagePack), encrypted_content để trống
+    virtual ShareLinkData getShareLinkRaw(std::string token, std::string username, ContentStore::RangeData& data) = 0;
+    // Xóa link chia sẻ
+    virtual bool deleteShareLink(std::string token, int user_id) = 0;
+
+    // Chia sẻ ghi chú với người dùng cụ thể (User-to-User)
+    virtual bool createUserShare(int note_id, int sender_id, int recipient_id,
+                                 std::string send_public_key_hex, std::string new_wrapped_key,
+                                 int duration_seconds) = 0;
+    // Lấy danh sách ghi chú được chia sẻ cho user
+    virtual std::vector<int> getSharedNotesForUser(int user_id) = 0;
+    // Lấy thông tin chia sẻ cụ thể
+    struct ShareInfo {
+        int note_id;
+        std::string send_public_key_hex;
+        std::string new_wrapped_key;
+        std::string encrypted_content;
+        std::string iv_hex;
+    };
+    virtual ShareInfo getShareInfo(int share_id, int recipient_id) = 0;
+
+    // Liệt kê metadata ghi chú theo trang (keyset), mới nhất trước.
+    // Con trỏ mặc định = trang đầu tiên; trang sau dùng (created_at, note_id) của phần tử cuối.
+    struct NoteCursor {
+        long created_at = std::numeric_limits<long>::max();
+        int note_id = std::numeric_limits<int>::max();
+    };
+    struct NotePage {
+        std::vector<NoteListItem> notes;
+        bool has_more;
+    };
+    virtual NotePage listNotes(int user_id, const NoteCursor& after, int limit) = 0;
+    // Xóa ghi chú (link, quyền truy cập và user share bị xóa theo)
+    virtual bool deleteNote(int note_id, int user_id) = 0;
+    // Xóa nhiều ghi chú trong một transaction, trả về các id đã xóa thật sự
+    virtual std::vector<int> deleteNotes(int user_id, const std::vector<int>& note_ids) = 0;
+
+    // Liệt kê share links do user tạo (outgoing shares) theo trang, hết hạn muộn nhất trước.
+    // Mỗi link kèm danh sách người nhận.
+    struct OutgoingShare {
+        int link_id;
+        int note_id;
+        std::string token; // Byte thô
+        long expiration_time;
+        std::vector<std::string> shared_with; // Danh sách usernames được chia sẻ
+    };
+    struct ShareCursor {
+        long expiration_time = std::numeric_limits<long>::max();
+        int link_id = std::numeric_limits<int>::max();
+    };
+    struct OutgoingSharePage {
+        std::vector<OutgoingShare> shares;
+        bool has_more;
+    };
+    // active_only: bỏ qua link đã hết hạn
+    virtual OutgoingSharePage listOutgoingShares(int user_id, const ShareCursor& after, int limit, bool active_only) = 0;
+
+    // --- Dọn dẹp share hết hạn (ExpirySweeper) ---
+    // Xóa tối đa batch_size bản ghi hết hạn trước `now`, cũ nhất trước; trả về số dòng đã xóa, -1 nếu lỗi.
+    virtual int deleteExpiredLinks(long now, int batch_size) = 0;
+    virtual int deleteExpiredUserShares(long now, int batch_size) = 0;
+    // Số bản ghi đã hết hạn nhưng chưa được dọn
+    virtual long countExpiredLinks(long now) = 0;
+    virtual long countExpiredUserShares(long now) = 0;
+
+    // --- Cache (GET /metrics) ---
+    // Cache UserRecord theo username; mặc định không có cache
+    virtual CacheStats userCacheStats() { return CacheStats(); }
+    // Cache share link theo token
+    virtual CacheStats linkCacheStats() { return CacheStats(); }
+
+    // --- Backup (BackupRunner) ---
+    // Ghi snapshot nhất quán tại thời điểm gọi vào file `destination` (và thư mục segment cạnh nó),
+    // không chặn writer. Mỗi bước chép pages_per_step page rồi nghỉ pause_ms;
+    // progress(page đã chép, tổng số page) được gọi sau mỗi bước.
+    // Mặc định không hỗ trợ (MemoryStorage không có gì trên đĩa).
+    using BackupProgress = std::function<void(long long pages_copied, long long pages_total)>;
+    virtual bool backup(const std::string&, int, int, const BackupProgress&) { return false; }
+
+    // --- Backfill sau migration (BackfillRunner) ---
+    // Migration dài (viết lại từng dòng) chạy nền sau khi server đã phục vụ request.
+    // Mỗi lần gọi xử lý tối đa batch_size dòng trong một transaction; trả về số dòng đã xử lý,
+    // 0 khi không còn gì, -1 nếu lỗi. Mặc định không có gì để làm.
+    virtual int backfillStep(int) { return 0; }
+
+    // --- Segment files (ContentCompactor) ---
+    // Mặc định không có gì để dọn
+    virtual ContentStore::Compaction compactContent(double) { return ContentStore::Compaction(); }
+    virtual ContentStore::Usage contentUsage() { return ContentStore::Usage(); }
+};
@@ -1,25 +1,353 @@
 #include "../vendor/json.hpp"
 #include "../vendor/crow_all.h"
 #include "Database.h"
+#include "MemoryStorage.h"
+#include "ShardedStorage.h"
+#include "ExpirySweeper.h"
+#include "GroupCommitQueue.h"
+#include "ContentCompactor.h"
+#include "BackupRunner.h"
+#include "BackfillRunner.h"
+#include "SegmentStore.h"
+#include "ServerConfig.h"
 #include "Auth.h"
 #include "../common/Protocol.h"
 #include "../common/Crypto.h"
+#include "../common/WireFormat.h"
+#include <cctype>
 #include <ctime>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include <iterator>
 
 using json = nlohmann::json;
 
-int main() {
-    Database db;
+// Page sizes for the paginated listing endpoints (?limit=N)
+static const int PAGE_SIZE_DEFAULT = 100;
+static const int PAGE_SIZE_MAX = 500;
+
+// Most note ids accepted by one DELETE /notes request (one transaction)
+static const size_t BULK_DELETE_MAX = 1000;
+
+// Expiry sweeper: a pass every minute, at most 20 x 500 rows per table and pass
+static const int SWEEP_INTERVAL_SECONDS = 60;
+static const int SWEEP_BATCH_SIZE = 500;
+static const int SWEEP_MAX_BATCHES = 20;
+
+// Ciphertexts of 64 KB and more go to append-only segment files of up to 64 MB next to
+// the database (secure_notes.db -> secure_notes.segments). Every 5 minutes, segments that
+// are at least half dead are compacted; nothing is compacted or deleted until it has been
+// untouched for a minute.
+static const long long SEGMENT_INLINE_MAX_BYTES = 64 * 1024;
+static const long long SEGMENT_MAX_BYTES = 64LL * 1024 * 1024;
+static const int SEGMENT_GRACE_SECONDS = 60;
+static const int COMPACT_INTERVAL_SECONDS = 300;
+static const double COMPACT_MIN_DEAD_RATIO = 0.5;
+
+// Online backups (POST /admin/backup) go to backups/; 64 pages (256 KB) per step and a
+// 10 ms pause in between keep the copy from competing with requests for the disk
+static const char* BACKUP_DIR = "backups";
+static const int BACKUP_PAGES_PER_STEP = 64;
+static const int BACKUP_PAUSE_MS = 10;
+
+// Rows left for after startup by a schema migration (share tokens of schema version 6)
+// are rewritten 1000 per transaction, 20 ms apart, so writes from requests interleave
+static const int BACKFILL_BATCH_SIZE = 1000;
+static const int BACKFILL_PAUSE_MS = 20;
+
+// Parses the ?limit= and ?after=<sort_key>,<id> query parameters of a paginated listing.
+// Leaves the defaults untouched when a parameter is absent; returns false if malformed.
+static bool parsePageParams(const crow::request& req, int& limit, long& afterKey, int& afterId) {
+    try {
+        if (const char* limitParam = req.url_params.get("limit")) {
+            limit = std::stoi(limitParam);
+        }
+        if (const char* afterParam = req.url_params.get("after")) {
+            std::string cursor = afterParam;
+            size_t comma = cursor.find(',');
+            if (comma == std::string::npos) {
+                return false;
+            }
+            afterKey = std::stol(cursor.substr(0, comma));
+            afterId = std::stoi(cursor.substr(comma + 1));
+        }
+    } catch (const std::exception& e) {
+        return false;
+    }
+    return limit >= 1 && limit <= PAGE_SIZE_MAX;
+}
+
+// Serializes a note response (meta must be a non-empty object) with the base64
+// ciphertext appended as raw text, so the content is not copied into a json value and escaped again
+static std::string jsonWithContent(const json& meta, const std::string& encryptedContent) {
+    std::string body = meta.dump();
+    body.pop_back(); // closing '}'
+    body.reserve(body.size() + encryptedContent.size() + 24);
+    body += ",\"encrypted_content\":\"";
+    body += encryptedContent; // base64 never needs escaping
+    body += "\"}";
+    return body;
+}
+
+// Request body in the format named by its Content-Type (JSON by default).
+// Throws on a malformed body, like json::parse, so handlers answer 400.
+// A binary `rawField` of a CBOR/MessagePack body is left as json::binary.
+static json parseBody(const crow::request& req, const std::string& rawField = std::string()) {
+    return WireFormat::decode(req.body, WireFormat::fromContentType(req.get_header_value("Content-Type")), rawField);
+}
+
+// Response in the format the client lists first in Accept (JSON by default).
+// Error bodies stay JSON text whatever the client accepts.
+static crow::response reply(const crow::request& req, int code, const json& body) {
+    WireFormat::Format format = WireFormat::fromAccept(req.get_header_value("Accept"));
+    crow::response res(code, WireFormat::encode(body, format));
+    res.set_header("Content-Type", WireFormat::contentType(format));
+    return res;
+}
+
+// reply() for a note or share payload. JSON keeps the no-copy jsonWithContent path;
+// for the binary formats `raw` is the ciphertext read raw from storage, sent as a
+// byte string without passing through base64.
+static crow::response replyWithContent(const crow::request& req, WireFormat::Format format, json meta,
+                                       const std::string& encryptedContent, const std::string& raw) {
+    if (format != WireFormat::Format::Json) {
+        meta["encrypted_content"] = json::binary(std::vector<std::uint8_t>(raw.begin(), raw.end()));
+        return reply(req, 200, meta);
+    }
+    crow::response res(200, jsonWithContent(meta, encryptedContent));
+    res.set_header("Content-Type", WireFormat::contentType(WireFormat::Format::Json));
+    return res;
+}
+
+// X-Filename of a raw upload is percent-encoded UTF-8, as headers are ASCII only.
+// False on a truncated or non-hex escape.
+static bool percentDecode(const std::string& text, std::string& decoded) {
+    decoded.clear();
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '%') {
+            decoded += text[i];
+            continue;
+        }
+        if (i + 2 >= text.size()) {
+            return false;
+        }
+        std::string hex = text.substr(i + 1, 2);
+        if (hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+            return false;
+        }
+        decoded += static_cast<char>(std::stoi(hex, nullptr, 16));
+        i += 2;
+    }
+    return true;
+}
+
+static std::string percentEncode(const std::string& text) {
+    static const char* HEX = "0123456789ABCDEF";
+    std::string encoded;
+    for (unsigned char c : text) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += static_cast<char>(c);
+        } else {
+            encoded += '%';
+            encoded += HEX[c >> 4];
+            encoded += HEX[c & 15];
+        }
+    }
+    return encoded;
+}
+
+// Single byte range of a Range header: "bytes=first-last", "bytes=first-" or
+// "bytes=-suffix". False when there is no usable range (absent, malformed or
+// several ranges), in which case the whole content is served, as RFC 9110 allows.
+static bool parseByteRange(const std::string& header, ContentStore::ByteRange& range) {
+    const std::string prefix = "bytes=";
+    if (header.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    std::string spec = header.substr(prefix.size());
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos || spec.find_first_not_of("0123456789-") != std::string::npos ||
+        spec.find('-', dash + 1) != std::string::npos) {
+        return false;
+    }
+    std::string first = spec.substr(0, dash);
+    std::string last = spec.substr(dash + 1);
+    try {
+        if (first.empty()) {
+            // Suffix: the last N bytes
+            if (last.empty() || std::stoll(last) == 0) {
+                return false;
+            }
+            range.offset = -std::stoll(last);
+            range.length = -1;
+            return true;
+        }
+        range.offset = std::stoll(first);
+        if (last.empty()) {
+            range.length = -1;
+            return true;
+        }
+        long long end = std::stoll(last);
+        if (end < range.offset) {
+            return false;
+        }
+        range.length = end - range.offset + 1;
+        return true;
+    } catch (const std::exception&) {
+        return false; // Out of range for long long
+    }
+}
+
+// Share tokens are raw bytes inside the server and 43 base64url characters in URLs.
+// Links created before schema version 6 carry 64 hex characters; both decode to the
+// same bytes, so old links keep working. False for anything else.
+static bool decodeShareToken(const std::string& text, std::string& token) {
+    std::vector<unsigned char> bytes;
+    if (text.length() == 2 * Storage::SHARE_TOKEN_BYTES) {
+        if (text.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+            return false;
+        }
+        bytes = Crypto::fromHex(text);
+    } else {
+        bytes = Crypto::base64UrlDecode(text);
+    }
+    if (bytes.size() != static_cast<size_t>(Storage::SHARE_TOKEN_BYTES)) {
+        return false;
+    }
+    token.assign(bytes.begin(), bytes.end());
+    return true;
+}
+
+static std::string encodeShareToken(const std::string& token) {
+    return Crypto::base64UrlEncode(std::vector<unsigned char>(token.begin(), token.end()));
+}
+
+// Answers 413 for request bodies above max_body_bytes (max_upload_bytes for raw
+// uploads) before a handler parses them. Crow has buffered the body by then; the
+// limit bounds what gets decoded and stored.
+struct BodyLimit {
+    struct context {};
+    size_t maxBytes = 0;
+    size_t maxUploadBytes = 0;
+
+    void before_handle(crow::request& req, crow::response& res, context&) {
+        if (req.body.size() > (req.url == "/upload/raw" ? maxUploadBytes : maxBytes)) {
+            res.code = 413;
+            res.body = R"({"error": "Request body too large"})";
+            res.end();
+        }
+    }
+    void after_handle(crow::request&, crow::response&, context&) {}
+};
+
+// Authenticates once per request, before the handler, for the routes marked
+// with CROW_MIDDLEWARES(app, RequireAuth): no valid bearer token -> 401, else the
+// handler reads the payload from app.get_context<RequireAuth>(req).auth.
+// Tokens verified before come from Auth's cache, so the usual cost is one lookup.
+struct RequireAuth : crow::ILocalMiddleware {
+    struct context {
+        TokenPayload auth{-1, "", false, -1};
+    };
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx) {
+        ctx.auth = Auth::verifyTokenCached(Auth::extractToken(req.get_header_value("Authorization")));
+        if (!ctx.auth.valid) {
+            res.code = 401;
+            res.body = R"({"error": "Unauthorized"})";
+            res.end();
+        }
+    }
+    void after_handle(crow::request&, crow::response&, context&) {}
+};
+
+// Counters of one in-process cache for GET /metrics
+static json cacheJson(const CacheStats& stats) {
+    json cache;
+    cache["hits"] = stats.hits;
+    cache["misses"] = stats.misses;
+    cache["hit_rate"] = stats.hits + stats.misses > 0
+        ? static_cast<double>(stats.hits) / (stats.hits + stats.misses) : 0.0;
+    cache["evictions"] = stats.evictions;
+    cache["invalidations"] = stats.invalidations;
+    cache["entries"] = stats.entries;
+    cache["capacity"] = stats.capacity;
+    return cache;
+}
+
+int main(int argc, char* argv[]) {
+    // Defaults < server_config.json (or --config <file>) < SECURE_NOTES_* variables < --storage / --shards.
+    // --storage memory keeps everything in RAM, so benchmarks and load tests measure
+    // HTTP, JSON and crypto without disk I/O; the default is the SQLite database.
+    // --shards N (N > 1) spreads users over N SQLite files behind a directory database.
+    ServerConfig config;
+    if (!ServerConfig::load(argc, argv, config)) {
+        return 1;
+    }
+    std::cout << "Configuration: " << config.toJson().dump() << std::endl;
+
+    // Every worker gets its own pooled connection
+    const unsigned int workerThreads = config.workerCount();
+    const std::string shareUrlPrefix = config.publicUrl() + "/share/";
+    std::string storageKind = config.storage;
+
+    std::unique_ptr<Storage> storage;
+    // Extra connections for the expiry sweeper, the upload writer, the compactor and the backfill so they never take a worker's
+    const size_t poolSize = workerThreads + 4;
+    if (storageKind == "sqlite" && config.shards == 1) {
+        storage = std::make_unique<Database>(config.db_path, poolSize,
+            std::make_unique<SegmentContentStore>(Database::segmentDirFor(config.db_path), SEGMENT_INLINE_MAX_BYTES,
+                                                  SEGMENT_MAX_BYTES, SEGMENT_GRACE_SECONDS),
+            config.sqlite);
+    } else if (storageKind == "sqlite") {
+        // Every shard keeps its own segment files: secure_notes.shard0.segments, ...
+        const std::string dbPath = config.db_path;
+        storage = std::make_unique<ShardedStorage>(dbPath, config.shards, poolSize, [dbPath](int shard) {
+            return std::make_unique<SegmentContentStore>(
+                Database::segmentDirFor(ShardedStorage::shardPath(dbPath, shard)),
+                SEGMENT_INLINE_MAX_BYTES, SEGMENT_MAX_BYTES, SEGMENT_GRACE_SECONDS);
+        }, config.sqlite);
+        storageKind += " (" + std::to_string(config.shards) + " shards)";
+    } else {
+        storage = std::make_unique<MemoryStorage>();
+    }
+
+    Storage& db = *storage;
+    auto initStart = std::chrono::steady_clock::now();
     if (!db.init()) {
-        std::cerr << "Failed to initialize database" << std::endl;
+        std::cerr << "Failed to initialize storage" << std::endl;
         return 1;
     }
+    std::cout << "Storage ready in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initStart).count()
+              << " ms" << std::endl;
+
+    ExpirySweeper sweeper(db, SWEEP_INTERVAL_SECONDS, SWEEP_BATCH_SIZE, SWEEP_MAX_BATCHES);
+    sweeper.start();
 
-    crow::SimpleApp app;
+    // Upload group commit: uploads queued while a commit runs share the next one (at most
+    // group_commit_max_batch). A window > 0 also waits that long for more uploads; worth it
+    // with synchronous=FULL or slow disks.
+    GroupCommitQueue uploads(db, config.group_commit_window_ms,
+                             static_cast<size_t>(config.group_commit_max_batch));
+    uploads.start();
+
+    ContentCompactor compactor(db, COMPACT_INTERVAL_SECONDS, COMPACT_MIN_DEAD_RATIO);
+    compactor.start();
+
+    BackupRunner backups(db, BACKUP_DIR, BACKUP_PAGES_PER_STEP, BACKUP_PAUSE_MS);
+
+    BackfillRunner backfill(db, BACKFILL_BATCH_SIZE, BACKFILL_PAUSE_MS);
+    backfill.start();
+
+    crow::App<BodyLimit, RequireAuth> app;
+    app.get_middleware<BodyLimit>().maxBytes = static_cast<size_t>(config.max_body_bytes);
+    app.get_middleware<BodyLimit>().maxUploadBytes = static_cast<size_t>(config.max_upload_bytes);
 
     // Root endpoint - API information
     CROW_ROUTE(app, "/")
-    ([]() {
+    ([](const crow::request& req) {
         json info;
         info["message"] = "Secure Note Sharing API Server";
         info["version"] = "1.0";
@@ -27,25 +355,30 @@ int main() {
             "POST /register - Register new user",
             "POST /login - User login",
             "POST /upload - Upload encrypted note (auth required)",
-            "GET /notes - List user's notes (auth required)",
+            "POST /upload/raw - Upload raw ciphertext body, key/IV/filename in X-Wrapped-Key, X-IV-Hex, X-Filename headers (auth required)",
+            "GET /notes?limit=&after= - List user's notes, paginated (auth required)",
             "GET /note/<id> - Get note by ID (auth required)",
+            "GET /note/<id>/raw - Download raw ciphertext, supports Range (auth required)",
             "DELETE /note/<id> - Delete note (auth required)",
+            "DELETE /notes - Delete several notes, body {\"note_ids\": [...]} (auth required)",
             "POST /share/link - Create share link (auth required)",
             "GET /share/<token> - Access note via share link (auth required)",
             "DELETE /share/<token> - Revoke share link (auth required)",
             "GET /shared - List notes shared with user (auth required)",
             "GET /shared/<id> - Get shared note data (auth required)",
             "GET /user/<username>/pubkey - Get user's public key",
-            "GET /myshares - List notes current user has shared with others (auth required)"
+            "GET /myshares?limit=&after=&active_only= - List share links current user created, paginated (auth required)",
+            "GET /metrics - Server counters (expiry sweeper, upload group commit, content segments, caches, backup)",
+            "POST /admin/backup - Start an online snapshot of the database (localhost only)"
         });
-        return crow::response(200, info.dump());
+        return reply(req, 200, info);
     });
 
     // API 1: Register new user
     CROW_ROUTE(app, "/register").methods(crow::HTTPMethod::Post)
     ([&db](const crow::request& req) {
         try {
-            auto body = json::parse(req.body);
+            auto body = parseBody(req);
             
             std::string username = body["username"].get<std::string>();
             std::string password = body["password"].get<std::string>();
@@ -75,7 +408,7 @@ int main() {
             json response;
             response["success"] = true;
             response["message"] = "User registered successfully";
-            return crow::response(200, response.dump());
+            return reply(req, 200, response);
             
         } catch (const std::exception& e) {
             return crow::response(400, R"({"error": "Invalid request body"})");
@@ -86,7 +419,7 @@ int main() {
     CROW_ROUTE(app, "/login").methods(crow::HTTPMethod::Post)
     ([&db](const crow::request& req) {
         try {
-            auto body = json::parse(req.body);
+            auto body = parseBody(req);
             
             std::string username = body["username"].get<std::string>();
             std::string password = body["password"].get<std::string>();
@@ -109,7 +442,7 @@ int main() {
             response["success"] = true;
             response["token"] = token;
             response["salt"] = user.salt;
-            return crow::response(200, response.dump());
+            return reply(req, 200, response);
             
         } catch (const std::exception& e) {
             return crow::response(400, R"({"error": "Invalid request body"})");
@@ -117,26 +450,35 @@ int main() {
     });
 
     // API 3: Upload note (requires auth)
-    CROW_ROUTE(app, "/upload").methods(crow::HTTPMethod::Post)
-    ([&db](const crow::request& req) {
-        // Verify token
-        std::string authHeader = req.get_header_value("Authorization");
-        std::string tokenStr = Auth::extractToken(authHeader);
-        TokenPayload auth = Auth::verifyToken(tokenStr);
-        
-        if (!auth.valid) {
-            return crow::response(401, R"({"error": "Unauthorized"})");
-        }
+    CROW_ROUTE(app, "/upload").methods(crow::HTTPMethod::Post).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &uploads](const crow::request& req) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
         
         try {
-            auto body = json::parse(req.body);
+            // CBOR/MessagePack ciphertext stays raw bytes all the way to storage
+            auto body = parseBody(req, "encrypted_content");
             
-            std::string encryptedContent = body["encrypted_content"].get<std::string>();
-            std::string wrappedKey = body["wrapped_key"].get<std::string>();
-            std::string ivHex = body["iv_hex"].get<std::string>();
-            std::string filename = body.value("filename", "note.txt"); // Default to note.txt if not provided
+            Storage::NewNote note;
+            note.user_id = auth.user_id;
+            note.wrapped_key = body["wrapped_key"].get<std::string>();
+            note.iv_hex = body["iv_hex"].get<std::string>();
+            note.filename = body.value("filename", "note.txt"); // Default to note.txt if not provided
+            
+            const json& content = body["encrypted_content"];
+            if (content.is_binary()) {
+                const auto& bytes = content.get_binary();
+                note.encrypted_content.assign(bytes.begin(), bytes.end());
+                note.raw_content = true;
+            } else {
+                note.encrypted_content = content.get<std::string>();
+                // Stored decoded as a BLOB, so it must be plain padded base64
+                if (Crypto::base64DecodedSize(note.encrypted_content) < 0) {
+                    return crow::response(400, R"({"error": "encrypted_content must be base64"})");
+                }
+            }
             
-            int noteId = db.saveNote(auth.user_id, encryptedContent, wrappedKey, ivHex, filename);
+            // Waits for the group commit that includes this note
+            int noteId = uploads.saveNote(std::move(note));
             if (noteId == -1) {
                 return crow::response(500, R"({"error": "Failed to save note"})");
             }
@@ -144,16 +486,52 @@ int main() {
             json response;
             response["success"] = true;
             response["note_id"] = noteId;
-            return crow::response(200, response.dump());
+            return reply(req, 200, response);
             
         } catch (const std::exception& e) {
             return crow::response(400, R"({"error": "Invalid request body"})");
         }
     });
 
+    // API 3b: Upload note as raw ciphertext (requires auth)
+    // Body: the ciphertext bytes (application/octet-stream, chunked transfer allowed).
+    // Headers: X-Wrapped-Key, X-IV-Hex, optional X-Filename (percent-encoded). No JSON and no base64,
+    // so a large note costs the buffered body only: it is handed to storage in
+    // ContentStore::CHUNK_BYTES slices, straight into its blob or segment file.
+    // Bypasses the group commit; one big note is its own transaction.
+    CROW_ROUTE(app, "/upload/raw").methods(crow::HTTPMethod::Post).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db](const crow::request& req) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
+        
+        std::string wrappedKey = req.get_header_value("X-Wrapped-Key");
+        std::string ivHex = req.get_header_value("X-IV-Hex");
+        std::string filename;
+        if (wrappedKey.empty() || ivHex.empty()) {
+            return crow::response(400, R"({"error": "X-Wrapped-Key and X-IV-Hex headers are required"})");
+        }
+        if (!percentDecode(req.get_header_value("X-Filename"), filename)) {
+            return crow::response(400, R"({"error": "X-Filename must be percent-encoded"})");
+        }
+        if (filename.empty()) {
+            filename = "note.txt";
+        }
+        
+        int noteId = db.saveNoteStream(auth.user_id, static_cast<long long>(req.body.size()),
+                                       ContentStore::bytesSource(req.body),
+                                       std::move(wrappedKey), std::move(ivHex), std::move(filename));
+        if (noteId == -1) {
+            return crow::response(500, R"({"error": "Failed to save note"})");
+        }
+        
+        json response;
+        response["success"] = true;
+        response["note_id"] = noteId;
+        return reply(req, 200, response);
+    });
+
     // API 4: Get user's public key (for sharing)
     CROW_ROUTE(app, "/user/<string>/pubkey").methods(crow::HTTPMethod::Get)
-    ([&db](std::string username) {
+    ([&db](const crow::request& req, std::string username) {
         UserRecord user = db.getUserByUsername(username);
         if (user.id == -1) {
             return crow::response(404, R"({"error": "User not found"})");
@@ -162,85 +540,123 @@ int main() {
         json response;
         response["username"] = user.username;
         response["receive_public_key_hex"] = user.receive_public_key_hex;
-        return crow::response(200, response.dump());
+        return reply(req, 200, response);
     });
 
-    // API 5: List user's notes
-    CROW_ROUTE(app, "/notes").methods(crow::HTTPMethod::Get)
-    ([&db](const crow::request& req) {
-        std::string authHeader = req.get_header_value("Authorization");
-        std::string tokenStr = Auth::extractToken(authHeader);
-        TokenPayload auth = Auth::verifyToken(tokenStr);
+    // API 5: List user's notes (metadata only, newest first)
+    // Query: ?limit=N&after=<created_at>,<note_id> where "after" is the next_cursor of the previous page
+    CROW_ROUTE(app, "/notes").methods(crow::HTTPMethod::Get).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db](const crow::request& req) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
         
-        if (!auth.valid) {
-            return crow::response(401, R"({"error": "Unauthorized"})");
+        int limit = PAGE_SIZE_DEFAULT;
+        Storage::NoteCursor after;
+        if (!parsePageParams(req, limit, after.created_at, after.note_id)) {
+            return crow::response(400, R"({"error": "Invalid limit or cursor"})");
         }
         
-        auto notes = db.getNotesForUser(auth.user_id);
+        auto page = db.listNotes(auth.user_id, after, limit);
         
-        json response = json::array();
-        for (const auto& note : notes) {
+        json notes = json::array();
+        for (const auto& note : page.notes) {
             json item;
             item["note_id"] = note.note_id;
             item["created_at"] = note.created_at;
             item["filename"] = note.filename;
-            response.push_back(item);
+            notes.push_back(item);
         }
         
-        return crow::response(200, response.dump());
+        json response;
+        response["notes"] = notes;
+        response["next_cursor"] = nullptr;
+        if (page.has_more) {
+            const auto& last = page.notes.back();
+            response["next_cursor"] = std::to_string(last.created_at) + "," + std::to_string(last.note_id);
+        }
+        return reply(req, 200, response);
     });
 
     // API 6: Get note by ID
-    CROW_ROUTE(app, "/note/<int>").methods(crow::HTTPMethod::Get)
-    ([&db](const crow::request& req, int note_id) {
-        std::string authHeader = req.get_header_value("Authorization");
-        std::string tokenStr = Auth::extractToken(authHeader);
-        TokenPayload auth = Auth::verifyToken(tokenStr);
+    CROW_ROUTE(app, "/note/<int>").methods(crow::HTTPMethod::Get).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db](const crow::request& req, int note_id) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
         
-        if (!auth.valid) {
-            return crow::response(401, R"({"error": "Unauthorized"})");
-        }
-        
-        NoteData note = db.getNoteById(note_id);
-        if (note.note_id == -1) {
+        // Fetch and ownership check in one primary-key lookup. CBOR and MessagePack
+        // carry the ciphertext as raw bytes, so it is read raw and never base64-encoded.
+        WireFormat::Format format = WireFormat::fromAccept(req.get_header_value("Accept"));
+        NoteData note;
+        ContentStore::RangeData raw;
+        auto access = format == WireFormat::Format::Json
+            ? db.getNoteForOwner(note_id, auth.user_id, note)
+            : db.getNoteRangeForOwner(note_id, auth.user_id, ContentStore::ByteRange(), note, raw);
+        if (access == Storage::NoteAccess::NotFound) {
             return crow::response(404, R"({"error": "Note not found"})");
         }
-        
-        // Verify ownership by checking if note exists in user's notes
-        auto userNotes = db.getNotesForUser(auth.user_id);
-        bool owned = false;
-        for (const auto& n : userNotes) {
-            if (n.note_id == note_id) {
-                owned = true;
-                break;
-            }
-        }
-        
-        if (!owned) {
+        if (access == Storage::NoteAccess::Forbidden) {
             return crow::response(403, R"({"error": "Access denied"})");
         }
         
         json response;
         response["note_id"] = note.note_id;
-        response["encrypted_content"] = note.encrypted_content;
         response["wrapped_key"] = note.wrapped_key;
         response["iv_hex"] = note.iv_hex;
         response["filename"] = note.filename;
         response["created_at"] = note.created_at;
-        return crow::response(200, response.dump());
+        return replyWithContent(req, format, response, note.encrypted_content, raw.bytes);
     });
 
-    // API 7: Delete note
-    CROW_ROUTE(app, "/note/<int>").methods(crow::HTTPMethod::Delete)
-    ([&db](const crow::request& req, int note_id) {
-        std::string authHeader = req.get_header_value("Authorization");
-        std::string tokenStr = Auth::extractToken(authHeader);
-        TokenPayload auth = Auth::verifyToken(tokenStr);
+    // API 6b: Download a note's ciphertext as raw bytes (requires auth)
+    // Supports a single Range (bytes=a-b, a-, -n): clients resume a dropped download
+    // or fetch pieces in parallel, and only the requested bytes are read from the
+    // blob or segment file. Key, IV and filename come back in X-Wrapped-Key,
+    // X-IV-Hex and X-Filename (percent-encoded), as for POST /upload/raw.
+    // Notes never change after upload, so a range always matches earlier pieces.
+    CROW_ROUTE(app, "/note/<int>/raw").methods(crow::HTTPMethod::Get).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db](const crow::request& req, int note_id) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
+        
+        ContentStore::ByteRange range;
+        bool ranged = parseByteRange(req.get_header_value("Range"), range);
+        
+        NoteData note;
+        ContentStore::RangeData data;
+        auto access = db.getNoteRangeForOwner(note_id, auth.user_id, range, note, data);
+        if (access == Storage::NoteAccess::NotFound) {
+            return crow::response(404, R"({"error": "Note not found"})");
+        }
+        if (access == Storage::NoteAccess::Forbidden) {
+            return crow::response(403, R"({"error": "Access denied"})");
+        }
         
-        if (!auth.valid) {
-            return crow::response(401, R"({"error": "Unauthorized"})");
+        crow::response res;
+        res.set_header("Accept-Ranges", "bytes");
+        // Nothing to send for a range: it starts past the end, or the note is empty
+        if (data.offset < 0 || (ranged && data.bytes.empty())) {
+            res.code = 416;
+            res.set_header("Content-Range", "bytes */" + std::to_string(data.total_size));
+            return res;
         }
         
+        res.code = ranged ? 206 : 200;
+        if (ranged) {
+            res.set_header("Content-Range", "bytes " + std::to_string(data.offset) + "-" +
+                           std::to_string(data.offset + static_cast<long long>(data.bytes.size()) - 1) + "/" +
+                           std::to_string(data.total_size));
+        }
+        res.set_header("Content-Type", "application/octet-stream");
+        res.set_header("X-Wrapped-Key", note.wrapped_key);
+        res.set_header("X-IV-Hex", note.iv_hex);
+        res.set_header("X-Filename", percentEncode(note.filename));
+        res.set_header("X-Created-At", std::to_string(note.created_at));
+        res.body = std::move(data.bytes);
+        return res;
+    });
+
+    // API 7: Delete note
+    CROW_ROUTE(app, "/note/<int>").methods(crow::HTTPMethod::Delete).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db](const crow::request& req, int note_id) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
+        
         if (!db.deleteNote(note_id, auth.user_id)) {
             return crow::response(404, R"({"error": "Note not found or access denied"})");
         }
@@ -248,30 +664,58 @@ int main() {
         json response;
         response["success"] = true;
         response["message"] = "Note deleted";
-        return crow::response(200, response.dump());
+        return reply(req, 200, response);
     });
 
-    // API 8: Create share link with username whitelist
-    CROW_ROUTE(app, "/share/link").methods(crow::HTTPMethod::Post)
-    ([&db](const crow::request& req) {
-        std::string authHeader = req.get_header_value("Authorization");
-        std::string tokenStr = Auth::extractToken(authHeader);
-        TokenPayload auth = Auth::verifyToken(tokenStr);
+    // API 7b: Delete several notes in one transaction
+    // Body: {"note_ids": [1, 2, 3]}; ids that are missing or not owned are reported in "not_found"
+    CROW_ROUTE(app, "/notes").methods(crow::HTTPMethod::Delete).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db](const crow::request& req) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
+        
+        std::vector<int> noteIds;
+        try {
+            auto body = parseBody(req);
+            noteIds = body.at("note_ids").get<std::vector<int>>();
+        } catch (const std::exception& e) {
+            return crow::response(400, R"({"error": "Invalid request body"})");
+        }
         
-        if (!auth.valid) {
-            return crow::response(401, R"({"error": "Unauthorized"})");
+        if (noteIds.empty() || noteIds.size() > BULK_DELETE_MAX) {
+            return crow::response(400, R"({"error": "note_ids must contain 1 to 1000 ids"})");
         }
         
+        std::sort(noteIds.begin(), noteIds.end());
+        noteIds.erase(std::unique(noteIds.begin(), noteIds.end()), noteIds.end());
+        
+        std::vector<int> deleted = db.deleteNotes(auth.user_id, noteIds);
+        
+        std::vector<int> notFound;
+        std::set_difference(noteIds.begin(), noteIds.end(), deleted.begin(), deleted.end(),
+                            std::back_inserter(notFound));
+        
+        json response;
+        response["success"] = true;
+        response["deleted"] = deleted;
+        response["not_found"] = notFound;
+        return reply(req, 200, response);
+    });
+
+    // API 8: Create share link with username whitelist
+    CROW_ROUTE(app, "/share/link").methods(crow::HTTPMethod::Post).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db, &shareUrlPrefix](const crow::request& req) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
+        
         try {
-            auto body = json::parse(req.body);
+            auto body = parseBody(req);
             
             int noteId = body["note_id"].get<int>();
             int duration = body["duration_seconds"].get<int>();
             auto userAccessList = body["user_access_list"];
             
-            std::vector<Database::UserAccessEntry> accessList;
+            std::vector<Storage::UserAccessEntry> accessList;
             for (const auto& item : userAccessList) {
-                Database::UserAccessEntry entry;
+                Storage::UserAccessEntry entry;
                 entry.username = item["username"].get<std::string>();
                 entry.send_public_key_hex = item["send_public_key_hex"].get<std::string>();
                 entry.wrapped_key = item["wrapped_key"].get<std::string>();
@@ -284,13 +728,14 @@ int main() {
             }
             
             long expirationAt = static_cast<long>(std::time(nullptr)) + duration;
+            std::string tokenText = encodeShareToken(token);
             
             json response;
             response["success"] = true;
-            response["share_link"] = "http://localhost:8080/share/" + token;
-            response["token"] = token;
+            response["share_link"] = shareUrlPrefix + tokenText;
+            response["token"] = tokenText;
             response["expiration_at"] = expirationAt;
-            return crow::response(200, response.dump());
+            return reply(req, 200, response);
             
         } catch (const std::exception& e) {
             return crow::response(400, R"({"error": "Invalid request body"})");
@@ -298,82 +743,198 @@ int main() {
     });
 
     // API 10: Access note via share link (requires login)
-    CROW_ROUTE(app, "/share/<string>").methods(crow::HTTPMethod::Get)
-    ([&db](const crow::request& req, std::string shareToken) {
-        std::string authHeader = req.get_header_value("Authorization");
-        std::string tokenStr = Auth::extractToken(authHeader);
-        TokenPayload auth = Auth::verifyToken(tokenStr);
+    CROW_ROUTE(app, "/share/<string>").methods(crow::HTTPMethod::Get).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db](const crow::request& req, std::string shareToken) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
         
-        if (!auth.valid) {
-            return crow::response(401, R"({"error": "Must be logged in to access shared notes"})");
+        // A token that cannot decode names no link
+        std::string token;
+        if (!decodeShareToken(shareToken, token)) {
+            return crow::response(403, R"({"error": "Link expired or access denied"})");
         }
         
-        auto data = db.getShareLinkData(shareToken, auth.username);
+        // Read raw for CBOR and MessagePack, like GET /note/<id>
+        WireFormat::Format format = WireFormat::fromAccept(req.get_header_value("Accept"));
+        ContentStore::RangeData raw;
+        auto data = format == WireFormat::Format::Json
+            ? db.getShareLinkData(token, auth.username)
+            : db.getShareLinkRaw(token, auth.username, raw);
         if (!data.valid) {
             return crow::response(403, R"({"error": "Link expired or access denied"})");
         }
         
         json response;
-        response["encrypted_content"] = data.encrypted_content;
         response["send_public_key_hex"] = data.send_public_key_hex;
         response["wrapped_key"] = data.wrapped_key;
         response["iv_hex"] = data.iv_hex;
         response["filename"] = data.filename;
-        return crow::response(200, response.dump());
+        return replyWithContent(req, format, response, data.encrypted_content, raw.bytes);
     });
 
     // API 11: Revoke share link
-    CROW_ROUTE(app, "/share/<string>").methods(crow::HTTPMethod::Delete)
-    ([&db](const crow::request& req, std::string shareToken) {
-        std::string authHeader = req.get_header_value("Authorization");
-        std::string tokenStr = Auth::extractToken(authHeader);
-        TokenPayload auth = Auth::verifyToken(tokenStr);
+    CROW_ROUTE(app, "/share/<string>").methods(crow::HTTPMethod::Delete).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db](const crow::request& req, std::string shareToken) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
         
-        if (!auth.valid) {
-            return crow::response(401, R"({"error": "Unauthorized"})");
-        }
-        
-        if (!db.deleteShareLink(shareToken, auth.user_id)) {
+        std::string token;
+        if (!decodeShareToken(shareToken, token) || !db.deleteShareLink(token, auth.user_id)) {
             return crow::response(403, R"({"error": "Not owner or link not found"})");
         }
         
         json response;
         response["success"] = true;
         response["message"] = "Share link revoked";
-        return crow::response(200, response.dump());
+        return reply(req, 200, response);
     });
 
 
     // API 12: List notes current user has shared with others (outgoing shares)
-    CROW_ROUTE(app, "/myshares").methods(crow::HTTPMethod::Get)
-    ([&db](const crow::request& req) {
-        std::string authHeader = req.get_header_value("Authorization");
-        std::string tokenStr = Auth::extractToken(authHeader);
-        TokenPayload auth = Auth::verifyToken(tokenStr);
+    // Query: ?limit=N&after=<expiration_time>,<link_id>&active_only=1 (skip expired links)
+    CROW_ROUTE(app, "/myshares").methods(crow::HTTPMethod::Get).CROW_MIDDLEWARES(app, RequireAuth)
+    ([&app, &db, &shareUrlPrefix](const crow::request& req) {
+        const TokenPayload& auth = app.get_context<RequireAuth>(req).auth;
         
-        if (!auth.valid) {
-            return crow::response(401, R"({"error": "Unauthorized"})");
+        int limit = PAGE_SIZE_DEFAULT;
+        Storage::ShareCursor after;
+        if (!parsePageParams(req, limit, after.expiration_time, after.link_id)) {
+            return crow::response(400, R"({"error": "Invalid limit or cursor"})");
         }
+        const char* activeParam = req.url_params.get("active_only");
+        bool activeOnly = activeParam && (std::string(activeParam) == "1" || std::string(activeParam) == "true");
         
-        auto shares = db.getOutgoingShares(auth.user_id);
+        auto page = db.listOutgoingShares(auth.user_id, after, limit, activeOnly);
         
-        json response = json::array();
+        json shares = json::array();
         long currentTime = static_cast<long>(std::time(nullptr));
         
-        for (const auto& share : shares) {
+        for (const auto& share : page.shares) {
             json item;
             item["note_id"] = share.note_id;
-            item["share_link"] = "http://localhost:8080/share/" + share.token;
+            item["share_link"] = shareUrlPrefix + encodeShareToken(share.token);
             item["expiration_time"] = share.expiration_time;
             item["is_expired"] = (share.expiration_time < currentTime);
             item["shared_with"] = share.shared_with;
-            response.push_back(item);
+            shares.push_back(item);
+        }
+        
+        json response;
+        response["shares"] = shares;
+        response["next_cursor"] = nullptr;
+        if (page.has_more) {
+            const auto& last = page.shares.back();
+            response["next_cursor"] = std::to_string(last.expiration_time) + "," + std::to_string(last.link_id);
+        }
+        return reply(req, 200, response);
+    });
+
+    // API 13: Server metrics (no auth, counters only)
+    CROW_ROUTE(app, "/metrics").methods(crow::HTTPMethod::Get)
+    ([&db, &sweeper, &uploads, &compactor, &backups, &backfill, &storageKind](const crow::request& req) {
+        auto stats = sweeper.stats();
+        
+        json sweep;
+        sweep["passes"] = stats.passes;
+        sweep["links_deleted"] = stats.links_deleted;
+        sweep["user_shares_deleted"] = stats.user_shares_deleted;
+        sweep["last_pass_deleted"] = stats.last_pass_deleted;
+        sweep["last_pass_ms"] = stats.last_pass_ms;
+        sweep["last_pass_rows_per_second"] = stats.last_pass_rows_per_second;
+        sweep["backlog_links"] = stats.backlog_links;
+        sweep["backlog_user_shares"] = stats.backlog_user_shares;
+        sweep["batch_size"] = stats.batch_size;
+        sweep["max_batches"] = stats.max_batches;
+        sweep["interval_seconds"] = stats.interval_seconds;
+        
+        auto uploadStats = uploads.stats();
+        json upload;
+        upload["batches"] = uploadStats.batches;
+        upload["notes"] = uploadStats.notes;
+        upload["failed"] = uploadStats.failed;
+        upload["avg_batch"] = uploadStats.batches > 0 ? static_cast<double>(uploadStats.notes) / uploadStats.batches : 0.0;
+        upload["last_batch"] = uploadStats.last_batch;
+        upload["largest_batch"] = uploadStats.largest_batch;
+        upload["pending"] = uploadStats.pending;
+        upload["window_ms"] = uploadStats.window_ms;
+        upload["max_batch"] = uploadStats.max_batch;
+        
+        auto compactStats = compactor.stats();
+        json segments;
+        segments["passes"] = compactStats.passes;
+        segments["segments"] = compactStats.segments;
+        segments["file_bytes"] = compactStats.file_bytes;
+        segments["live_bytes"] = compactStats.live_bytes;
+        segments["segments_compacted"] = compactStats.segments_compacted;
+        segments["segments_removed"] = compactStats.segments_removed;
+        segments["bytes_moved"] = compactStats.bytes_moved;
+        segments["bytes_reclaimed"] = compactStats.bytes_reclaimed;
+        segments["last_pass_ms"] = compactStats.last_pass_ms;
+        segments["min_dead_ratio"] = compactStats.min_dead_ratio;
+        segments["interval_seconds"] = compactStats.interval_seconds;
+        
+        auto backupStats = backups.stats();
+        json backup;
+        backup["running"] = backupStats.running;
+        backup["completed"] = backupStats.backups_completed;
+        backup["failed"] = backupStats.backups_failed;
+        backup["pages_copied"] = backupStats.pages_copied;
+        backup["pages_total"] = backupStats.pages_total;
+        backup["progress"] = backupStats.pages_total > 0
+            ? static_cast<double>(backupStats.pages_copied) / backupStats.pages_total : 0.0;
+        backup["last_duration_ms"] = backupStats.last_duration_ms;
+        backup["last_finished_at"] = backupStats.last_finished_at;
+        backup["last_destination"] = backupStats.last_destination;
+        backup["pages_per_step"] = backupStats.pages_per_step;
+        backup["pause_ms"] = backupStats.pause_ms;
+        
+        auto backfillStats = backfill.stats();
+        json migration;
+        migration["running"] = backfillStats.running;
+        migration["finished"] = backfillStats.finished;
+        migration["batches"] = backfillStats.batches;
+        migration["rows"] = backfillStats.rows;
+        migration["errors"] = backfillStats.errors;
+        migration["last_batch_ms"] = backfillStats.last_batch_ms;
+        migration["elapsed_ms"] = backfillStats.elapsed_ms;
+        migration["batch_size"] = backfillStats.batch_size;
+        migration["pause_ms"] = backfillStats.pause_ms;
+        
+        json response;
+        response["storage"] = storageKind;
+        response["expiry_sweeper"] = sweep;
+        response["upload_group_commit"] = upload;
+        response["content_segments"] = segments;
+        response["user_cache"] = cacheJson(db.userCacheStats());
+        response["link_cache"] = cacheJson(db.linkCacheStats());
+        response["token_cache"] = cacheJson(Auth::tokenCacheStats());
+        response["backup"] = backup;
+        response["migration_backfill"] = migration;
+        return reply(req, 200, response);
+    });
+
+    // API 14: Start an online backup. There are no admin accounts, so only requests
+    // from the machine itself are accepted; progress shows up under "backup" in /metrics.
+    CROW_ROUTE(app, "/admin/backup").methods(crow::HTTPMethod::Post)
+    ([&backups](const crow::request& req) {
+        if (req.remote_ip_address != "127.0.0.1" && req.remote_ip_address != "::1") {
+            return crow::response(403, R"({"error": "Backups can only be started from localhost"})");
         }
         
-        return crow::response(200, response.dump());
+        std::string destination;
+        if (!backups.start(destination)) {
+            return crow::response(409, R"({"error": "A backup is already running"})");
+        }
+        
+        json response;
+        response["success"] = true;
+        response["destination"] = destination;
+        return reply(req, 202, response);
     });
 
-    std::cout << "Server starting on port 8080..." << std::endl;
-    app.port(8080).multithreaded().run();
+    std::cout << "Server starting on " << config.bind_address << ":" << config.port << " with "
+              << workerThreads << " worker threads, " << storageKind << " storage..." << std::endl;
+    app.bindaddr(config.bind_address)
+        .port(static_cast<std::uint16_t>(config.port))
+        .concurrency(static_cast<std::uint16_t>(workerThreads))
+        .run();
     return 0;
 }
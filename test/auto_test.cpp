@@ -9,6 +9,7 @@
 #include <chrono>
 #include <thread>
 #include <cstdlib>
+#include <cstdint>
 #include <fstream>
 #include "../vendor/httplib.h"
 #include "../vendor/json.hpp"
@@ -169,8 +170,7 @@ public:
         client.set_read_timeout(10, 0);
     }
 
-    httplib::Result get(const std::string& path, const std::string& token = "") {
-        httplib::Headers headers;
+    httplib::Result get(const std::string& path, const std::string& token = "", httplib::Headers headers = {}) {
         if (!token.empty()) {
             headers.emplace("Authorization", "Bearer " + token);
         }
@@ -186,6 +186,26 @@ public:
         return client.Post(path.c_str(), headers, body.dump(), "application/json");
     }
 
+    // Body nhi phan (POST /upload/raw), metadata trong header
+    httplib::Result postRaw(const std::string& path, const std::string& body, httplib::Headers headers,
+                            const std::string& token = "") {
+        if (!token.empty()) {
+            headers.emplace("Authorization", "Bearer " + token);
+        }
+        return client.Post(path.c_str(), headers, body, "application/octet-stream");
+    }
+
+    // Body CBOR/MessagePack da encode san; phan hoi xin cung dinh dang
+    httplib::Result postEncoded(const std::string& path, const std::string& body, const std::string& contentType,
+                                const std::string& token = "") {
+        httplib::Headers headers;
+        headers.emplace("Accept", contentType);
+        if (!token.empty()) {
+            headers.emplace("Authorization", "Bearer " + token);
+        }
+        return client.Post(path.c_str(), headers, body, contentType.c_str());
+    }
+
     httplib::Result del(const std::string& path, const std::string& token = "") {
         httplib::Headers headers;
         if (!token.empty()) {
@@ -193,6 +213,14 @@ public:
         }
         return client.Delete(path.c_str(), headers);
     }
+
+    httplib::Result del(const std::string& path, const json& body, const std::string& token = "") {
+        httplib::Headers headers;
+        if (!token.empty()) {
+            headers.emplace("Authorization", "Bearer " + token);
+        }
+        return client.Delete(path.c_str(), headers, body.dump(), "application/json");
+    }
 };
 
 // ============================================
@@ -423,8 +451,8 @@ TestResult testBasicOperations(TestClient& client) {
         
         if (res && res->status == 200) {
             auto j = json::parse(res->body);
-            if (j.is_array()) {
-                    printPass("Tim thay " + std::to_string(j.size()) + " chia se");
+            if (j.contains("notes") && j["notes"].is_array() && j.contains("next_cursor")) {
+                printPass("Tim thay " + std::to_string(j["notes"].size()) + " ghi chu");
                 result.passed++;
             } else {
                 printFail();
@@ -448,7 +476,7 @@ TestResult testBasicOperations(TestClient& client) {
             
             if (res && res->status == 200) {
                 auto j = json::parse(res->body);
-                if (j.contains("encrypted_content") && j.contains("filename")) {
+                if (j.value("encrypted_content", "") == "VGhpcyBpcyBhIHRlc3QgbWVzc2FnZQ==" && j.contains("filename")) {
                     printPass("Filename: " + j["filename"].get<std::string>());
                     result.passed++;
                 } else {
@@ -464,6 +492,230 @@ TestResult testBasicOperations(TestClient& client) {
         printFail(std::string("Exception: ") + e.what());
     }
 
+    // Test 2.4: Paginate notes with a cursor
+    result.total++;
+    printTest("2.4 - Phan trang danh sach notes (limit + after)");
+    try {
+        json body = {
+            {"encrypted_content", "VGhpcyBpcyBhIHRlc3QgbWVzc2FnZQ=="},
+            {"wrapped_key", std::string(80, '0')},
+            {"iv_hex", std::string(32, '0')},
+            {"filename", "page.txt"}
+        };
+        client.post("/upload", body, token);
+        client.post("/upload", body, token);
+
+        auto first = client.get("/notes?limit=1", token);
+        printResponse(first ? first->status : 0, first ? first->body : "");
+
+        if (first && first->status == 200) {
+            auto j1 = json::parse(first->body);
+            if (j1["notes"].size() == 1 && j1["next_cursor"].is_string()) {
+                auto second = client.get("/notes?limit=1&after=" + j1["next_cursor"].get<std::string>(), token);
+                auto j2 = json::parse(second->body);
+                if (second->status == 200 && j2["notes"].size() == 1 &&
+                    j2["notes"][0]["note_id"] != j1["notes"][0]["note_id"] &&
+                    j2["notes"][0]["created_at"].get<long>() <= j1["notes"][0]["created_at"].get<long>()) {
+                    auto bad = client.get("/notes?after=abc", token);
+                    if (bad && bad->status == 400) {
+                        printPass("Trang 2 tiep noi trang 1, cursor sai bi tu choi");
+                        result.passed++;
+                    } else {
+                        printFail("Cursor sai khong bi tu choi");
+                    }
+                } else {
+                    printFail("Trang 2 khong dung");
+                }
+            } else {
+                printFail("Thieu next_cursor");
+            }
+        } else {
+            printFail();
+        }
+    } catch (const std::exception& e) {
+        printFail(std::string("Exception: ") + e.what());
+    }
+
+    // Test 2.5: Bulk delete reports deleted and unknown ids
+    result.total++;
+    printTest("2.5 - Xoa nhieu notes (DELETE /notes)");
+    try {
+        json body = {
+            {"encrypted_content", "VGhpcyBpcyBhIHRlc3QgbWVzc2FnZQ=="},
+            {"wrapped_key", std::string(80, '0')},
+            {"iv_hex", std::string(32, '0')},
+            {"filename", "bulk.txt"}
+        };
+        std::vector<int> ids;
+        for (int i = 0; i < 2; i++) {
+            auto up = client.post("/upload", body, token);
+            if (up && up->status == 200) {
+                ids.push_back(json::parse(up->body)["note_id"].get<int>());
+            }
+        }
+
+        json delBody = {{"note_ids", {ids.size() > 0 ? ids[0] : -1, ids.size() > 1 ? ids[1] : -1, 999999}}};
+        auto res = client.del("/notes", delBody, token);
+        printResponse(res ? res->status : 0, res ? res->body : "");
+
+        if (res && res->status == 200 && ids.size() == 2) {
+            auto j = json::parse(res->body);
+            auto gone = client.get("/note/" + std::to_string(ids[0]), token);
+            auto empty = client.del("/notes", json{{"note_ids", json::array()}}, token);
+            if (j["deleted"].size() == 2 && j["not_found"] == json::array({999999}) &&
+                gone && gone->status == 404 && empty && empty->status == 400) {
+                printPass("Da xoa 2 notes, id la nam trong not_found");
+                result.passed++;
+            } else {
+                printFail("Ket qua xoa khong dung");
+            }
+        } else {
+            printFail();
+        }
+    } catch (const std::exception& e) {
+        printFail(std::string("Exception: ") + e.what());
+    }
+
+    // Test 2.6: Content is stored decoded, so it must be valid base64
+    result.total++;
+    printTest("2.6 - Upload noi dung khong phai base64");
+    try {
+        json body = {
+            {"encrypted_content", "day khong phai base64"},
+            {"wrapped_key", std::string(80, '0')},
+            {"iv_hex", std::string(32, '0')},
+            {"filename", "bad.txt"}
+        };
+        auto res = client.post("/upload", body, token);
+        printResponse(res ? res->status : 0, res ? res->body : "");
+
+        if (res && res->status == 400) {
+            printPass("Bi tu choi voi 400");
+            result.passed++;
+        } else {
+            printFail();
+        }
+    } catch (const std::exception& e) {
+        printFail(std::string("Exception: ") + e.what());
+    }
+
+    // Test 2.7: Raw upload keeps the bytes and the percent-decoded filename
+    int rawNoteId = -1;
+    result.total++;
+    printTest("2.7 - Upload ciphertext tho (POST /upload/raw)");
+    try {
+        // "abc" lap lai: base64 la "YWJj" lap lai, khong can ham base64 o day
+        std::string raw;
+        std::string expected;
+        for (int i = 0; i < 70000; i++) {
+            raw += "abc";
+            expected += "YWJj";
+        }
+        httplib::Headers headers = {
+            {"X-Wrapped-Key", std::string(80, '0')},
+            {"X-IV-Hex", std::string(32, '0')},
+            {"X-Filename", "ghi%20chu%C3%A9.bin"}
+        };
+        auto res = client.postRaw("/upload/raw", raw, headers, token);
+        printResponse(res ? res->status : 0, res ? res->body.substr(0, 200) : "");
+
+        bool ok = false;
+        if (res && res->status == 200) {
+            int noteId = json::parse(res->body)["note_id"].get<int>();
+            rawNoteId = noteId;
+            auto get = client.get("/note/" + std::to_string(noteId), token);
+            if (get && get->status == 200) {
+                auto j = json::parse(get->body);
+                ok = j["encrypted_content"] == expected &&
+                     j["filename"] == "ghi chu\xC3\xA9.bin";
+            }
+        }
+        // Thieu header wrapped key / IV, hoac khong co token
+        auto missing = client.postRaw("/upload/raw", raw, {}, token);
+        auto unauthorized = client.postRaw("/upload/raw", raw, headers);
+
+        if (ok && missing && missing->status == 400 && unauthorized && unauthorized->status == 401) {
+            printPass("Noi dung va ten file dung, thieu header -> 400, khong token -> 401");
+            result.passed++;
+        } else {
+            printFail();
+        }
+    } catch (const std::exception& e) {
+        printFail(std::string("Exception: ") + e.what());
+    }
+
+    // Test 2.8: Raw download with Range (resume / tai song song)
+    result.total++;
+    printTest("2.8 - Tai ciphertext tho theo Range (GET /note/<id>/raw)");
+    try {
+        std::string path = "/note/" + std::to_string(rawNoteId) + "/raw";
+        auto whole = client.get(path, token);
+        auto middle = client.get(path, token, {{"Range", "bytes=3-8"}});
+        auto suffix = client.get(path, token, {{"Range", "bytes=-4"}});
+        auto past = client.get(path, token, {{"Range", "bytes=999999-"}});
+        printResponse(middle ? middle->status : 0, middle ? middle->body : "");
+
+        bool ok = whole && whole->status == 200 && whole->body.size() == 210000 &&
+                  whole->get_header_value("Accept-Ranges") == "bytes" &&
+                  whole->get_header_value("X-Filename") == "ghi%20chu%C3%A9.bin" &&
+                  middle && middle->status == 206 && middle->body == "abcabc" &&
+                  middle->get_header_value("Content-Range") == "bytes 3-8/210000" &&
+                  suffix && suffix->status == 206 && suffix->body == "cabc" &&
+                  past && past->status == 416 && past->get_header_value("Content-Range") == "bytes */210000";
+        if (ok) {
+            printPass("200 / 206 / 416 va Content-Range dung");
+            result.passed++;
+        } else {
+            printFail();
+        }
+    } catch (const std::exception& e) {
+        printFail(std::string("Exception: ") + e.what());
+    }
+
+    // Test 2.9: CBOR/MessagePack thay cho JSON, ciphertext la byte string
+    result.total++;
+    printTest("2.9 - Upload bang CBOR, tai lai bang MessagePack (Accept/Content-Type)");
+    try {
+        std::string message = "This is a test message";
+        std::vector<std::uint8_t> bytes(message.begin(), message.end());
+        json body = {
+            {"encrypted_content", json::binary(bytes)},
+            {"wrapped_key", std::string(80, '0')},
+            {"iv_hex", std::string(32, '0')},
+            {"filename", "cbor.txt"}
+        };
+        std::vector<std::uint8_t> cbor = json::to_cbor(body);
+        auto upload = client.postEncoded("/upload", std::string(cbor.begin(), cbor.end()), "application/cbor", token);
+        int noteId = -1;
+        if (upload && upload->status == 200 && upload->get_header_value("Content-Type") == "application/cbor") {
+            noteId = json::from_cbor(upload->body).value("note_id", -1);
+        }
+
+        std::string path = "/note/" + std::to_string(noteId);
+        auto packed = client.get(path, token, {{"Accept", "application/msgpack"}});
+        auto plain = client.get(path, token);
+        printResponse(packed ? packed->status : 0, packed ? packed->get_header_value("Content-Type") : "");
+
+        bool ok = noteId != -1 && packed && packed->status == 200 &&
+                  packed->get_header_value("Content-Type") == "application/msgpack" && plain && plain->status == 200;
+        if (ok) {
+            json note = json::from_msgpack(packed->body);
+            ok = note["encrypted_content"].is_binary() && note["encrypted_content"] == json::binary(bytes) &&
+                 note["filename"] == "cbor.txt" &&
+                 json::parse(plain->body)["encrypted_content"] == "VGhpcyBpcyBhIHRlc3QgbWVzc2FnZQ==";
+        }
+        auto broken = client.postEncoded("/upload", std::string(cbor.begin(), cbor.begin() + 10), "application/cbor", token);
+        ok = ok && broken && broken->status == 400;
+        if (ok) {
+            printPass("Byte string tren day, base64 khi client xin JSON");
+            result.passed++;
+        } else {
+            printFail();
+        }
+    } catch (const std::exception& e) {
+        printFail(std::string("Exception: ") + e.what());
+    }
+
     std::cout << "\nBasic Operations: " << result.passed << "/" << result.total << " tests passed\n\n";
     return result;
 }
@@ -662,8 +914,9 @@ TestResult testMySharesAPI(TestClient& client) {
         printResponse(res ? res->status : 0, res ? res->body : "");
         
         if (res && res->status == 200) {
-            auto j = json::parse(res->body);
-            if (j.is_array()) {
+            auto body = json::parse(res->body);
+            auto j = body["shares"];
+            if (j.is_array() && body.contains("next_cursor")) {
                 printPass("Tim thay " + std::to_string(j.size()) + " shares");
                 
                 if (j.size() > 0) {
@@ -696,7 +949,55 @@ TestResult testMySharesAPI(TestClient& client) {
                     result.passed++;
                 }
             } else {
-                printFail("Response khong phai array");
+                printFail("Thieu shares / next_cursor");
+            }
+        } else {
+            printFail();
+        }
+    } catch (const std::exception& e) {
+        printFail(std::string("Exception: ") + e.what());
+    }
+
+    // Test 4.2: Paginate my shares and skip expired links
+    result.total++;
+    printTest("4.2 - Phan trang /myshares va active_only");
+    try {
+        // One live and one already expired link
+        for (int duration : {600, -60}) {
+            json body = {
+                {"note_id", TEST_USERS["alice"].note_id},
+                {"duration_seconds", duration},
+                {"user_access_list", json::array()}
+            };
+            client.post("/share/link", body, aliceToken);
+        }
+
+        auto first = client.get("/myshares?limit=1", aliceToken);
+        printResponse(first ? first->status : 0, first ? first->body : "");
+
+        if (first && first->status == 200) {
+            auto j1 = json::parse(first->body);
+            if (j1["shares"].size() == 1 && j1["next_cursor"].is_string()) {
+                auto second = client.get("/myshares?limit=1&after=" + j1["next_cursor"].get<std::string>(), aliceToken);
+                auto j2 = json::parse(second->body);
+
+                auto active = client.get("/myshares?active_only=1", aliceToken);
+                auto ja = json::parse(active->body);
+                bool anyExpired = false;
+                for (const auto& share : ja["shares"]) {
+                    anyExpired = anyExpired || share["is_expired"].get<bool>();
+                }
+
+                if (second->status == 200 && j2["shares"].size() == 1 &&
+                    j2["shares"][0]["expiration_time"].get<long>() <= j1["shares"][0]["expiration_time"].get<long>() &&
+                    active->status == 200 && !ja["shares"].empty() && !anyExpired) {
+                    printPass("Trang 2 tiep noi trang 1, active_only bo qua link het han");
+                    result.passed++;
+                } else {
+                    printFail("Trang 2 hoac active_only khong dung");
+                }
+            } else {
+                printFail("Thieu next_cursor");
             }
         } else {
             printFail();
@@ -0,0 +1,1644 @@
+// bench.cpp - In-process benchmarks for the server storage layer
+// Compile: g++ test/bench.cpp server/Database.cpp server/ConnectionPool.cpp server/Statements.cpp server/GroupCommitQueue.cpp server/ContentStore.cpp server/SegmentStore.cpp server/MemoryStorage.cpp server/ShardedStorage.cpp server/BackfillRunner.cpp server/Auth.cpp common/Crypto.cpp common/WireFormat.cpp sqlite3.o -o bench.exe -std=c++17 -I vendor -lcrypto
+// Run: .\bench.exe   (creates and removes bench_notes*.db and bench_notes.segments in the current directory;
+//                     benchmark 15 needs about 10 GB of free disk)
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include "../server/Database.h"
+#include "../server/Statements.h"
+#include "../server/GroupCommitQueue.h"
+#include "../server/SegmentStore.h"
+#include "../server/MemoryStorage.h"
+#include "../server/ShardedStorage.h"
+#include "../server/BackfillRunner.h"
+#include "../server/Auth.h"
+#include "../common/Crypto.h"
+#include "../common/WireFormat.h"
+
+// ============================================
+// CONFIGURATION
+// ============================================
+
+const std::string BENCH_DB_PATH = "bench_notes.db";
+const int SEED_NOTES = 200;
+const int NOTE_SIZE = 1024;
+const int RUN_SECONDS = 2;
+const int LOOKUP_ITERATIONS = 20000;
+
+// ============================================
+// BENCH UTILITIES
+// ============================================
+
+using Clock = std::chrono::steady_clock;
+
+double microsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+void printHeader(const std::string& text) {
+    std::cout << "\n" << std::string(60, '=') << "\n";
+    std::cout << text << "\n";
+    std::cout << std::string(60, '=') << "\n\n";
+}
+
+void removeDatabase(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+std::vector<unsigned> threadCounts() {
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> counts = {1, 2, 4, 8};
+    counts.push_back(hw);
+    std::sort(counts.begin(), counts.end());
+    counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+    counts.erase(std::remove_if(counts.begin(), counts.end(),
+                                [hw](unsigned c) { return c > std::max(hw, 4u); }),
+                 counts.end());
+    return counts;
+}
+
+// Seeded dataset shared by the benchmarks
+struct Seed {
+    int owner_id = -1;
+    std::string share_token;
+    std::string reader = "bench_reader";
+};
+
+Seed seedDatabase(Storage& db) {
+    Seed seed;
+    db.createUser("bench_owner", "hash", "salt", "04" + std::string(128, '0'));
+    db.createUser(seed.reader, "hash", "salt", "04" + std::string(128, '1'));
+    seed.owner_id = db.getUserByUsername("bench_owner").id;
+
+    std::string content(NOTE_SIZE, 'A');
+    int lastNote = -1;
+    for (int i = 0; i < SEED_NOTES; i++) {
+        lastNote = db.saveNote(seed.owner_id, content, std::string(80, '0'), std::string(32, '0'), "bench.txt");
+    }
+
+    std::vector<Storage::UserAccessEntry> access = {
+        {seed.reader, "04" + std::string(128, '2'), std::string(80, '0')}
+    };
+    seed.share_token = db.createShareLink(lastNote, seed.owner_id, access, 3600);
+    return seed;
+}
+
+// ============================================
+// BENCHMARK 1: CONCURRENT READS (CONNECTION POOL)
+// ============================================
+
+// Readers alternate between /notes and /share/<token> lookups while one
+// writer keeps uploading. With one connection everything is serialized;
+// with one connection per thread reads should scale with cores.
+double runReadMix(Storage& db, unsigned readers) {
+    Seed seed = seedDatabase(db);
+
+    std::atomic<bool> stop{false};
+    std::atomic<long long> reads{0};
+    std::string content(NOTE_SIZE, 'B');
+
+    std::thread writer([&] {
+        while (!stop.load()) {
+            db.saveNote(seed.owner_id, content, std::string(80, '0'), std::string(32, '0'), "w.txt");
+        }
+    });
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < readers; t++) {
+        workers.emplace_back([&, t] {
+            long long local = 0;
+            while (!stop.load()) {
+                if ((local + t) % 2 == 0) {
+                    db.listNotes(seed.owner_id, Storage::NoteCursor(), 100);
+                } else {
+                    db.getShareLinkData(seed.share_token, seed.reader);
+                }
+                local++;
+            }
+            reads += local;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(RUN_SECONDS));
+    stop = true;
+    for (auto& w : workers) w.join();
+    writer.join();
+
+    return static_cast<double>(reads.load()) / RUN_SECONDS;
+}
+
+double runConcurrentReads(size_t poolSize, unsigned readers) {
+    removeDatabase(BENCH_DB_PATH);
+    Database db(BENCH_DB_PATH, poolSize);
+    db.init();
+    return runReadMix(db, readers);
+}
+
+void benchConcurrentReads() {
+    printHeader("BENCHMARK 1: CONCURRENT READS WITH ONE WRITER");
+
+    std::cout << std::left << std::setw(10) << "Readers"
+              << std::setw(22) << "1 connection (ops/s)"
+              << std::setw(22) << "Pooled (ops/s)" << "\n";
+
+    for (unsigned readers : threadCounts()) {
+        double single = runConcurrentReads(1, readers);
+        double pooled = runConcurrentReads(readers + 1, readers);
+        std::cout << std::left << std::setw(10) << readers
+                  << std::setw(22) << std::fixed << std::setprecision(0) << single
+                  << std::setw(22) << pooled << "\n";
+    }
+}
+
+// ============================================
+// BENCHMARK 2: PREPARED STATEMENT CACHE
+// ============================================
+
+// The pre-cache code path: compile, bind, step and finalize on every call
+void uncachedLookup(sqlite3* raw, Stmt id, const std::string& textKey, int intKey) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(raw, statementSql(id), -1, &stmt, nullptr) != SQLITE_OK) {
+        return;
+    }
+    if (textKey.empty()) {
+        sqlite3_bind_int(stmt, 1, intKey);
+    } else {
+        sqlite3_bind_text(stmt, 1, textKey.c_str(), -1, SQLITE_TRANSIENT);
+    }
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+}
+
+void benchStatementCache() {
+    printHeader("BENCHMARK 2: PREPARE PER CALL VS CACHED STATEMENTS");
+
+    removeDatabase(BENCH_DB_PATH);
+    Database db(BENCH_DB_PATH, 1);
+    db.init();
+    Seed seed = seedDatabase(db);
+    int noteId = db.listNotes(seed.owner_id, Database::NoteCursor(), 1).notes.front().note_id;
+
+    sqlite3* raw;
+    sqlite3_open(BENCH_DB_PATH.c_str(), &raw);
+
+    auto start = Clock::now();
+    for (int i = 0; i < LOOKUP_ITERATIONS; i++) uncachedLookup(raw, Stmt::SelectUserByUsername, seed.reader, 0);
+    double userBefore = microsSince(start) / LOOKUP_ITERATIONS;
+
+    start = Clock::now();
+    for (int i = 0; i < LOOKUP_ITERATIONS; i++) db.getUserByUsername(seed.reader);
+    double userAfter = microsSince(start) / LOOKUP_ITERATIONS;
+
+    start = Clock::now();
+    for (int i = 0; i < LOOKUP_ITERATIONS; i++) uncachedLookup(raw, Stmt::SelectNoteById, "", noteId);
+    double noteBefore = microsSince(start) / LOOKUP_ITERATIONS;
+
+    start = Clock::now();
+    for (int i = 0; i < LOOKUP_ITERATIONS; i++) db.getNoteById(noteId);
+    double noteAfter = microsSince(start) / LOOKUP_ITERATIONS;
+
+    sqlite3_close(raw);
+
+    std::cout << std::left << std::setw(22) << "Operation"
+              << std::setw(20) << "Prepare/call (us)"
+              << std::setw(20) << "Cached (us)" << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::left << std::setw(22) << "getUserByUsername"
+              << std::setw(20) << userBefore << std::setw(20) << userAfter << "\n";
+    std::cout << std::left << std::setw(22) << "getNoteById"
+              << std::setw(20) << noteBefore << std::setw(20) << noteAfter << "\n";
+}
+
+// ============================================
+// BENCHMARK 3: NOTE DOWNLOAD VS LIBRARY SIZE
+// ============================================
+
+// Bulk-loads notes for one owner inside a single transaction.
+// noteSize is the base64 size; the stored BLOB is the matching zero-filled ciphertext.
+void seedNotesFast(const std::string& path, int ownerId, int count, int noteSize) {
+    sqlite3* raw;
+    sqlite3_open(path.c_str(), &raw);
+    sqlite3_exec(raw, "BEGIN", nullptr, nullptr, nullptr);
+
+    sqlite3_stmt* note;
+    sqlite3_stmt* content;
+    sqlite3_prepare_v2(raw, statementSql(Stmt::InsertNote), -1, &note, nullptr);
+    sqlite3_prepare_v2(raw, statementSql(Stmt::InsertNoteContent), -1, &content, nullptr);
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_int(note, 1, ownerId);
+        sqlite3_bind_text(note, 2, "seed.txt", -1, SQLITE_STATIC);
+        sqlite3_bind_int64(note, 3, i);
+        sqlite3_step(note);
+        sqlite3_reset(note);
+
+        sqlite3_bind_int64(content, 1, sqlite3_last_insert_rowid(raw));
+        sqlite3_bind_text(content, 2, "key", -1, SQLITE_STATIC);
+        sqlite3_bind_text(content, 3, "iv", -1, SQLITE_STATIC);
+        sqlite3_bind_int(content, 4, noteSize / 4 * 3);
+        sqlite3_step(content);
+        sqlite3_reset(content);
+    }
+    sqlite3_finalize(note);
+    sqlite3_finalize(content);
+
+    sqlite3_exec(raw, "COMMIT", nullptr, nullptr, nullptr);
+    sqlite3_close(raw);
+}
+
+// The former GET /note/<id> ownership check: load every note of the owner and scan
+bool ownedByFullLibraryScan(sqlite3* raw, int noteId, int ownerId) {
+    const char* sql = "SELECT n.id, nc.encrypted_content, nc.wrapped_key, nc.iv_hex, n.filename, n.created_at "
+                      "FROM Notes n JOIN NoteContents nc ON nc.note_id = n.id WHERE n.user_id = ? ORDER BY n.created_at DESC";
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v2(raw, sql, -1, &stmt, nullptr);
+    sqlite3_bind_int(stmt, 1, ownerId);
+
+    std::vector<NoteData> notes;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        NoteData note;
+        note.note_id = sqlite3_column_int(stmt, 0);
+        note.encrypted_content.assign(static_cast<const char*>(sqlite3_column_blob(stmt, 1)),
+                                      sqlite3_column_bytes(stmt, 1));
+        notes.push_back(note);
+    }
+    sqlite3_finalize(stmt);
+
+    for (const auto& note : notes) {
+        if (note.note_id == noteId) return true;
+    }
+    return false;
+}
+
+void benchNoteDownload() {
+    printHeader("BENCHMARK 3: GET /note/<id> LATENCY VS OWNER LIBRARY SIZE");
+
+    const int noteSize = 4096;
+    const int iterations = 50;
+
+    std::cout << std::left << std::setw(12) << "Notes"
+              << std::setw(24) << "getNoteById+scan (us)"
+              << std::setw(24) << "getNoteForOwner (us)" << "\n";
+
+    for (int libraryNotes : {10, 100, 1000, 10000}) {
+        removeDatabase(BENCH_DB_PATH);
+        Database db(BENCH_DB_PATH, 1);
+        db.init();
+        db.createUser("bench_owner", "hash", "salt", "04");
+        int ownerId = db.getUserByUsername("bench_owner").id;
+        seedNotesFast(BENCH_DB_PATH, ownerId, libraryNotes, noteSize);
+        int noteId = libraryNotes / 2;
+
+        sqlite3* raw;
+        sqlite3_open(BENCH_DB_PATH.c_str(), &raw);
+        auto start = Clock::now();
+        for (int i = 0; i < iterations; i++) {
+            NoteData note = db.getNoteById(noteId);
+            ownedByFullLibraryScan(raw, note.note_id, ownerId);
+        }
+        double before = microsSince(start) / iterations;
+        sqlite3_close(raw);
+
+        start = Clock::now();
+        for (int i = 0; i < iterations; i++) {
+            NoteData note;
+            db.getNoteForOwner(noteId, ownerId, note);
+        }
+        double after = microsSince(start) / iterations;
+
+        std::cout << std::left << std::setw(12) << libraryNotes
+                  << std::setw(24) << std::fixed << std::setprecision(1) << before
+                  << std::setw(24) << after << "\n";
+    }
+}
+
+// ============================================
+// BENCHMARK 4: GET /myshares VS NUMBER OF LINKS
+// ============================================
+
+// Bulk-loads share links for one note, each with `recipients` access rows
+void seedLinksFast(const std::string& path, int noteId, int ownerId, int count, int recipients) {
+    sqlite3* raw;
+    sqlite3_open(path.c_str(), &raw);
+    sqlite3_exec(raw, "BEGIN", nullptr, nullptr, nullptr);
+
+    sqlite3_stmt* link;
+    sqlite3_stmt* access;
+    sqlite3_prepare_v2(raw, statementSql(Stmt::InsertLink), -1, &link, nullptr);
+    sqlite3_prepare_v2(raw, statementSql(Stmt::InsertLinkAccess), -1, &access, nullptr);
+    long now = static_cast<long>(std::time(nullptr));
+    for (int i = 0; i < count; i++) {
+        std::string token = "bench_link_" + std::to_string(i);
+        sqlite3_bind_text(link, 1, token.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(link, 2, noteId);
+        sqlite3_bind_int(link, 3, ownerId);
+        // Half of the links are already expired
+        sqlite3_bind_int64(link, 4, now + (i % 2 == 0 ? 3600 : -3600) + i);
+        sqlite3_step(link);
+        sqlite3_reset(link);
+
+        int linkId = static_cast<int>(sqlite3_last_insert_rowid(raw));
+        for (int r = 0; r < recipients; r++) {
+            std::string username = "recipient_" + std::to_string(r);
+            sqlite3_bind_int(access, 1, linkId);
+            sqlite3_bind_text(access, 2, username.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(access, 3, "04", -1, SQLITE_STATIC);
+            sqlite3_bind_text(access, 4, "wk", -1, SQLITE_STATIC);
+            sqlite3_step(access);
+            sqlite3_reset(access);
+        }
+    }
+    sqlite3_finalize(link);
+    sqlite3_finalize(access);
+
+    sqlite3_exec(raw, "COMMIT", nullptr, nullptr, nullptr);
+    sqlite3_close(raw);
+}
+
+// The former getOutgoingShares: one query for the links, then one prepared query per link
+size_t outgoingSharesNPlusOne(sqlite3* raw, int ownerId) {
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v2(raw, "SELECT note_id, token, expiration_time, id FROM SharedLinks WHERE owner_id = ? ORDER BY expiration_time DESC", -1, &stmt, nullptr);
+    sqlite3_bind_int(stmt, 1, ownerId);
+
+    std::vector<Database::OutgoingShare> shares;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Database::OutgoingShare share;
+        share.note_id = sqlite3_column_int(stmt, 0);
+        share.token = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        share.expiration_time = sqlite3_column_int64(stmt, 2);
+
+        sqlite3_stmt* userStmt;
+        sqlite3_prepare_v2(raw, "SELECT username FROM SharedLinkAccess WHERE link_id = ?", -1, &userStmt, nullptr);
+        sqlite3_bind_int(userStmt, 1, sqlite3_column_int(stmt, 3));
+        while (sqlite3_step(userStmt) == SQLITE_ROW) {
+            share.shared_with.push_back(reinterpret_cast<const char*>(sqlite3_column_text(userStmt, 0)));
+        }
+        sqlite3_finalize(userStmt);
+        shares.push_back(share);
+    }
+    sqlite3_finalize(stmt);
+    return shares.size();
+}
+
+// Every page of the new listing, as a client following next_cursor would fetch them
+size_t outgoingSharesAllPages(Database& db, int ownerId, int pageSize, bool activeOnly) {
+    size_t total = 0;
+    Database::ShareCursor cursor;
+    while (true) {
+        auto page = db.listOutgoingShares(ownerId, cursor, pageSize, activeOnly);
+        total += page.shares.size();
+        if (!page.has_more) break;
+        cursor.expiration_time = page.shares.back().expiration_time;
+        cursor.link_id = page.shares.back().link_id;
+    }
+    return total;
+}
+
+void benchOutgoingShares() {
+    printHeader("BENCHMARK 4: GET /myshares LATENCY VS NUMBER OF LINKS");
+
+    const int recipients = 3;
+    const int iterations = 20;
+
+    std::cout << std::left << std::setw(10) << "Links"
+              << std::setw(18) << "N+1 all (us)"
+              << std::setw(18) << "joined all (us)"
+              << std::setw(20) << "active only (us)"
+              << std::setw(18) << "first page (us)" << "\n";
+
+    for (int links : {10, 100, 2000}) {
+        removeDatabase(BENCH_DB_PATH);
+        Database db(BENCH_DB_PATH, 1);
+        db.init();
+        db.createUser("bench_owner", "hash", "salt", "04");
+        int ownerId = db.getUserByUsername("bench_owner").id;
+        int noteId = db.saveNote(ownerId, "Y29udGVudA==", "key", "iv", "shared.txt");
+        seedLinksFast(BENCH_DB_PATH, noteId, ownerId, links, recipients);
+
+        sqlite3* raw;
+        sqlite3_open(BENCH_DB_PATH.c_str(), &raw);
+        auto start = Clock::now();
+        for (int i = 0; i < iterations; i++) {
+            outgoingSharesNPlusOne(raw, ownerId);
+        }
+        double nPlusOne = microsSince(start) / iterations;
+        sqlite3_close(raw);
+
+        start = Clock::now();
+        for (int i = 0; i < iterations; i++) {
+            outgoingSharesAllPages(db, ownerId, 500, false);
+        }
+        double joined = microsSince(start) / iterations;
+
+        start = Clock::now();
+        for (int i = 0; i < iterations; i++) {
+            outgoingSharesAllPages(db, ownerId, 500, true);
+        }
+        double active = microsSince(start) / iterations;
+
+        start = Clock::now();
+        for (int i = 0; i < iterations; i++) {
+            db.listOutgoingShares(ownerId, Database::ShareCursor(), 100, true);
+        }
+        double firstPage = microsSince(start) / iterations;
+
+        std::cout << std::left << std::setw(10) << links
+                  << std::setw(18) << std::fixed << std::setprecision(1) << nPlusOne
+                  << std::setw(18) << joined
+                  << std::setw(20) << active
+                  << std::setw(18) << firstPage << "\n";
+    }
+}
+
+// ============================================
+// BENCHMARK 5: CREATE SHARE LINK VS WHITELIST SIZE
+// ============================================
+
+// The former createShareLink: the link and every access row commit on their own
+void createLinkAutocommit(sqlite3* raw, int noteId, int ownerId, const std::string& token,
+                          const std::vector<Database::UserAccessEntry>& whitelist) {
+    sqlite3_stmt* link;
+    sqlite3_prepare_v2(raw, statementSql(Stmt::InsertLink), -1, &link, nullptr);
+    sqlite3_bind_text(link, 1, token.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(link, 2, noteId);
+    sqlite3_bind_int(link, 3, ownerId);
+    sqlite3_bind_int64(link, 4, static_cast<long>(std::time(nullptr)) + 3600);
+    sqlite3_step(link);
+    sqlite3_finalize(link);
+    int linkId = static_cast<int>(sqlite3_last_insert_rowid(raw));
+
+    for (const auto& entry : whitelist) {
+        sqlite3_stmt* access;
+        sqlite3_prepare_v2(raw, statementSql(Stmt::InsertLinkAccess), -1, &access, nullptr);
+        sqlite3_bind_int(access, 1, linkId);
+        sqlite3_bind_text(access, 2, entry.username.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(access, 3, entry.send_public_key_hex.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(access, 4, entry.wrapped_key.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(access);
+        sqlite3_finalize(access);
+    }
+}
+
+void benchCreateShareLink() {
+    printHeader("BENCHMARK 5: POST /share/link LATENCY VS WHITELIST SIZE");
+
+    std::cout << std::left << std::setw(12) << "Recipients"
+              << std::setw(24) << "autocommit rows (ms)"
+              << std::setw(24) << "one transaction (ms)" << "\n";
+
+    for (int recipients : {10, 500, 5000}) {
+        removeDatabase(BENCH_DB_PATH);
+        Database db(BENCH_DB_PATH, 1);
+        db.init();
+        db.createUser("bench_owner", "hash", "salt", "04");
+        int ownerId = db.getUserByUsername("bench_owner").id;
+        int noteId = db.saveNote(ownerId, "Y29udGVudA==", "key", "iv", "shared.txt");
+
+        std::vector<Database::UserAccessEntry> whitelist;
+        for (int i = 0; i < recipients; i++) {
+            whitelist.push_back({"recipient_" + std::to_string(i), "04" + std::string(128, 'a'), std::string(80, '0')});
+        }
+
+        // Same connection settings as the pool (WAL, synchronous=NORMAL)
+        sqlite3* raw;
+        sqlite3_open(BENCH_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", nullptr, nullptr, nullptr);
+        auto start = Clock::now();
+        createLinkAutocommit(raw, noteId, ownerId, "bench_autocommit", whitelist);
+        double before = microsSince(start) / 1000.0;
+        sqlite3_close(raw);
+
+        start = Clock::now();
+        db.createShareLink(noteId, ownerId, whitelist, 3600);
+        double after = microsSince(start) / 1000.0;
+
+        std::cout << std::left << std::setw(12) << recipients
+                  << std::setw(24) << std::fixed << std::setprecision(2) << before
+                  << std::setw(24) << after << "\n";
+    }
+}
+
+// ============================================
+// BENCHMARK 6: CONCURRENT UPLOADS (GROUP COMMIT)
+// ============================================
+
+// `uploaders` threads upload small notes as fast as they can, each through its
+// own pooled connection (one commit per note) or through the group commit queue
+double runConcurrentUploads(unsigned uploaders, bool groupCommit) {
+    removeDatabase(BENCH_DB_PATH);
+    Database db(BENCH_DB_PATH, uploaders + 1);
+    db.init();
+    db.createUser("bench_owner", "hash", "salt", "04");
+    int ownerId = db.getUserByUsername("bench_owner").id;
+
+    GroupCommitQueue queue(db, 0, 256); // Server defaults
+    if (groupCommit) {
+        queue.start();
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<long long> uploads{0};
+    std::string content(256, 'U');
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < uploaders; t++) {
+        workers.emplace_back([&] {
+            long long local = 0;
+            while (!stop.load()) {
+                int id = groupCommit
+                    ? queue.saveNote(ownerId, content, std::string(80, '0'), std::string(32, '0'), "u.txt")
+                    : db.saveNote(ownerId, content, std::string(80, '0'), std::string(32, '0'), "u.txt");
+                if (id != -1) local++;
+            }
+            uploads += local;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(RUN_SECONDS));
+    stop = true;
+    for (auto& w : workers) w.join();
+    queue.stop();
+
+    return static_cast<double>(uploads.load()) / RUN_SECONDS;
+}
+
+void benchConcurrentUploads() {
+    printHeader("BENCHMARK 6: POST /upload THROUGHPUT UNDER CONCURRENCY");
+
+    std::cout << std::left << std::setw(12) << "Uploaders"
+              << std::setw(24) << "commit per note (/s)"
+              << std::setw(24) << "group commit (/s)" << "\n";
+
+    for (unsigned uploaders : {1u, 4u, 16u, 64u}) {
+        double direct = runConcurrentUploads(uploaders, false);
+        double grouped = runConcurrentUploads(uploaders, true);
+        std::cout << std::left << std::setw(12) << uploaders
+                  << std::setw(24) << std::fixed << std::setprecision(0) << direct
+                  << std::setw(24) << grouped << "\n";
+    }
+}
+
+// ============================================
+// BENCHMARK 7: PAGE CACHE, HOT/COLD NOTE TABLES
+// ============================================
+
+// Notes as they were before schema version 3: metadata and ciphertext in one row
+const char* COMBINED_NOTES_SCHEMA = R"(
+    CREATE TABLE Notes (id INTEGER PRIMARY KEY AUTOINCREMENT, user_id INTEGER NOT NULL,
+        encrypted_content BLOB NOT NULL, wrapped_key TEXT NOT NULL, iv_hex TEXT NOT NULL,
+        filename TEXT NOT NULL DEFAULT 'note.txt', created_at INTEGER NOT NULL);
+    CREATE INDEX idx_notes_user_created_id ON Notes(user_id, created_at, id, filename);
+)";
+
+// Uploads of many users interleave, so each user's notes are spread over the table
+void seedNoteLayout(const std::string& path, bool split, int users, int notesPerUser, int contentBytes) {
+    removeDatabase(path);
+    if (split) {
+        Database db(path, 1);
+        db.init();
+    }
+
+    sqlite3* raw;
+    sqlite3_open(path.c_str(), &raw);
+    if (!split) {
+        sqlite3_exec(raw, COMBINED_NOTES_SCHEMA, nullptr, nullptr, nullptr);
+    }
+    sqlite3_exec(raw, "BEGIN", nullptr, nullptr, nullptr);
+
+    sqlite3_stmt* note;
+    sqlite3_stmt* content = nullptr;
+    if (split) {
+        sqlite3_prepare_v2(raw, statementSql(Stmt::InsertNote), -1, &note, nullptr);
+        sqlite3_prepare_v2(raw, statementSql(Stmt::InsertNoteContent), -1, &content, nullptr);
+    } else {
+        sqlite3_prepare_v2(raw, "INSERT INTO Notes (user_id, encrypted_content, wrapped_key, iv_hex, filename, created_at) "
+                                "VALUES (?, zeroblob(?), ?, ?, ?, ?)", -1, &note, nullptr);
+    }
+
+    std::string wrappedKey(80, '0');
+    std::string ivHex(32, '0');
+    for (int i = 0; i < users * notesPerUser; i++) {
+        int userId = i % users + 1;
+        if (split) {
+            sqlite3_bind_int(note, 1, userId);
+            sqlite3_bind_text(note, 2, "note.txt", -1, SQLITE_STATIC);
+            sqlite3_bind_int64(note, 3, i);
+            sqlite3_step(note);
+            sqlite3_reset(note);
+
+            sqlite3_bind_int64(content, 1, sqlite3_last_insert_rowid(raw));
+            sqlite3_bind_text(content, 2, wrappedKey.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(content, 3, ivHex.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int(content, 4, contentBytes);
+            sqlite3_step(content);
+            sqlite3_reset(content);
+        } else {
+            sqlite3_bind_int(note, 1, userId);
+            sqlite3_bind_int(note, 2, contentBytes);
+            sqlite3_bind_text(note, 3, wrappedKey.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(note, 4, ivHex.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(note, 5, "note.txt", -1, SQLITE_STATIC);
+            sqlite3_bind_int64(note, 6, i);
+            sqlite3_step(note);
+            sqlite3_reset(note);
+        }
+    }
+    sqlite3_finalize(note);
+    sqlite3_finalize(content);
+
+    sqlite3_exec(raw, "COMMIT", nullptr, nullptr, nullptr);
+    sqlite3_close(raw);
+}
+
+struct CacheRun {
+    double hit_rate;
+    double misses_per_op;
+    double micros_per_op;
+};
+
+// Runs the ownership check of GET /note/<id> (Stmt::SelectNoteById, same text for
+// both layouts) for random ids on a fresh connection with a bounded page cache
+CacheRun measureOwnershipChecks(const std::string& path, int cacheKb, int noteCount, int iterations) {
+    sqlite3* raw;
+    sqlite3_open(path.c_str(), &raw);
+    std::string cachePragma = "PRAGMA cache_size = -" + std::to_string(cacheKb) + ";";
+    sqlite3_exec(raw, cachePragma.c_str(), nullptr, nullptr, nullptr);
+
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v2(raw, statementSql(Stmt::SelectNoteById), -1, &stmt, nullptr);
+
+    unsigned int seed = 42;
+    auto runChecks = [&](int count) {
+        for (int i = 0; i < count; i++) {
+            seed = seed * 1103515245 + 12345;
+            sqlite3_bind_int(stmt, 1, static_cast<int>((seed >> 8) % noteCount) + 1);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                sqlite3_column_int(stmt, 1);
+                sqlite3_column_text(stmt, 2);
+            }
+            sqlite3_reset(stmt);
+        }
+    };
+
+    // Warm the cache first so only steady-state misses are counted
+    runChecks(iterations);
+    int current;
+    int highwater;
+    sqlite3_db_status(raw, SQLITE_DBSTATUS_CACHE_HIT, &current, &highwater, 1);
+    sqlite3_db_status(raw, SQLITE_DBSTATUS_CACHE_MISS, &current, &highwater, 1);
+
+    auto start = Clock::now();
+    runChecks(iterations);
+    double elapsed = microsSince(start);
+
+    int hits;
+    int misses;
+    sqlite3_db_status(raw, SQLITE_DBSTATUS_CACHE_HIT, &hits, &highwater, 0);
+    sqlite3_db_status(raw, SQLITE_DBSTATUS_CACHE_MISS, &misses, &highwater, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(raw);
+
+    CacheRun run;
+    run.hit_rate = hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0;
+    run.misses_per_op = static_cast<double>(misses) / iterations;
+    run.micros_per_op = elapsed / iterations;
+    return run;
+}
+
+void benchNoteLayoutCache() {
+    printHeader("BENCHMARK 7: PAGE CACHE HITS, COMBINED VS SPLIT NOTE TABLES");
+
+    const int users = 200;
+    const int notesPerUser = 50;
+    const int contentBytes = 4096;
+    const int iterations = 20000;
+    const std::string combinedPath = "bench_combined.db";
+
+    seedNoteLayout(combinedPath, false, users, notesPerUser, contentBytes);
+    seedNoteLayout(BENCH_DB_PATH, true, users, notesPerUser, contentBytes);
+
+    std::cout << users * notesPerUser << " notes of " << contentBytes << " bytes, "
+              << iterations << " ownership checks on random ids\n\n";
+    std::cout << std::left << std::setw(12) << "Layout"
+              << std::setw(12) << "Cache"
+              << std::setw(14) << "Hit rate (%)"
+              << std::setw(16) << "Misses/check"
+              << std::setw(14) << "us/check" << "\n";
+
+    for (int cacheKb : {1024, 8192}) {
+        for (bool split : {false, true}) {
+            auto run = measureOwnershipChecks(split ? BENCH_DB_PATH : combinedPath, cacheKb,
+                                              users * notesPerUser, iterations);
+            std::cout << std::left << std::setw(12) << (split ? "split" : "combined")
+                      << std::setw(12) << (std::to_string(cacheKb / 1024) + " MB")
+                      << std::setw(14) << std::fixed << std::setprecision(1) << run.hit_rate
+                      << std::setw(16) << std::setprecision(2) << run.misses_per_op
+                      << std::setw(14) << std::setprecision(2) << run.micros_per_op << "\n";
+        }
+    }
+
+    removeDatabase(combinedPath);
+}
+
+// ============================================
+// BENCHMARK 8: LARGE NOTE DOWNLOADS, INLINE VS SEGMENT FILES
+// ============================================
+
+const std::string BENCH_SEGMENT_DIR = "bench_notes.segments";
+
+struct LargeNoteRun {
+    double upload_ms;
+    double micros_per_read;
+    double mb_per_second;
+};
+
+// Uploads `notes` notes of `noteBytes` decoded bytes, then reads random ones back
+// through Database::getNoteById (the GET /note/<id> path) with a small page cache
+LargeNoteRun measureLargeNotes(bool segments, int notes, int noteBytes, int reads) {
+    removeDatabase(BENCH_DB_PATH);
+    std::filesystem::remove_all(BENCH_SEGMENT_DIR);
+
+    std::unique_ptr<ContentStore> store;
+    if (segments) {
+        store = std::make_unique<SegmentContentStore>(BENCH_SEGMENT_DIR, 64 * 1024, 64LL * 1024 * 1024, 60);
+    }
+    Database db(BENCH_DB_PATH, 1, std::move(store));
+    db.init();
+    db.createUser("bench", "hash", "salt", "04");
+    int userId = db.getUserByUsername("bench").id;
+
+    std::string content = Crypto::base64Encode(std::vector<unsigned char>(noteBytes, 0x5a));
+    std::vector<int> ids;
+    auto uploadStart = Clock::now();
+    for (int i = 0; i < notes; i++) {
+        ids.push_back(db.saveNote(userId, content, "key", "iv", "large.bin"));
+    }
+    double uploadMs = microsSince(uploadStart) / 1000.0;
+
+    unsigned int seed = 7;
+    size_t total = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < reads; i++) {
+        seed = seed * 1103515245 + 12345;
+        total += db.getNoteById(ids[(seed >> 8) % ids.size()]).encrypted_content.size();
+    }
+    double elapsed = microsSince(start);
+
+    LargeNoteRun run;
+    run.upload_ms = uploadMs;
+    run.micros_per_read = elapsed / reads;
+    run.mb_per_second = total / 4.0 * 3.0 / elapsed;
+    return run;
+}
+
+void benchLargeNotes() {
+    printHeader("BENCHMARK 8: LARGE NOTES, INLINE BLOB VS SEGMENT FILES");
+
+    const int notes = 64;
+    const int reads = 200;
+
+    std::cout << notes << " notes per size, " << reads << " random downloads\n\n";
+    std::cout << std::left << std::setw(12) << "Store"
+              << std::setw(12) << "Note size"
+              << std::setw(14) << "Upload (ms)"
+              << std::setw(14) << "us/download"
+              << std::setw(14) << "MB/s" << "\n";
+
+    for (int noteKb : {256, 1024}) {
+        for (bool segments : {false, true}) {
+            auto run = measureLargeNotes(segments, notes, noteKb * 1024, reads);
+            std::cout << std::left << std::setw(12) << (segments ? "segment" : "inline")
+                      << std::setw(12) << (std::to_string(noteKb) + " KB")
+                      << std::setw(14) << std::fixed << std::setprecision(1) << run.upload_ms
+                      << std::setw(14) << std::setprecision(1) << run.micros_per_read
+                      << std::setw(14) << std::setprecision(1) << run.mb_per_second << "\n";
+        }
+    }
+
+    std::filesystem::remove_all(BENCH_SEGMENT_DIR);
+}
+
+// ============================================
+// BENCHMARK 9: STORAGE ENGINES
+// ============================================
+
+// Benchmark 1's workload on the SQLite engine (one connection per thread) and on
+// the in-memory engine: the gap is what storage costs a request
+void benchStorageEngines() {
+    printHeader("BENCHMARK 9: SQLITE VS IN-MEMORY STORAGE");
+
+    std::cout << std::left << std::setw(10) << "Readers"
+              << std::setw(18) << "SQLite (ops/s)"
+              << std::setw(20) << "In-memory (ops/s)"
+              << std::setw(10) << "Ratio" << "\n";
+
+    for (unsigned readers : threadCounts()) {
+        double sqlite = runConcurrentReads(readers + 1, readers);
+
+        MemoryStorage memory;
+        memory.init();
+        double inMemory = runReadMix(memory, readers);
+
+        std::cout << std::left << std::setw(10) << readers
+                  << std::setw(18) << std::fixed << std::setprecision(0) << sqlite
+                  << std::setw(20) << inMemory
+                  << std::setw(10) << std::setprecision(1) << (sqlite > 0 ? inMemory / sqlite : 0.0) << "\n";
+    }
+}
+
+// ============================================
+// BENCHMARK 10: WRITE THROUGHPUT VS SHARD COUNT
+// ============================================
+
+void removeShards(int shards) {
+    removeDatabase(BENCH_DB_PATH);
+    for (int shard = 0; shard < shards; shard++) {
+        removeDatabase(ShardedStorage::shardPath(BENCH_DB_PATH, shard));
+    }
+}
+
+// `writers` threads, each its own user, upload notes (one commit each) and share
+// every fourth one; returns writes per second
+double runShardedWrites(int shards, unsigned writers) {
+    removeShards(shards);
+    double rate;
+    {
+        ShardedStorage storage(BENCH_DB_PATH, shards, writers + 1);
+        storage.init();
+        std::vector<int> userIds;
+        for (unsigned t = 0; t < writers; t++) {
+            std::string name = "writer" + std::to_string(t);
+            storage.createUser(name, "hash", "salt", "04");
+            userIds.push_back(storage.getUserByUsername(name).id);
+        }
+
+        std::atomic<bool> stop{false};
+        std::atomic<long long> writes{0};
+        std::string content(NOTE_SIZE, 'C');
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < writers; t++) {
+            workers.emplace_back([&, t] {
+                long long local = 0;
+                while (!stop.load()) {
+                    int noteId = storage.saveNote(userIds[t], content, std::string(80, '0'), std::string(32, '0'), "w.txt");
+                    local++;
+                    if (local % 4 == 0) {
+                        storage.createShareLink(noteId, userIds[t], {{"writer0", "04", std::string(80, '0')}}, 3600);
+                        local++;
+                    }
+                }
+                writes += local;
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(RUN_SECONDS));
+        stop = true;
+        for (auto& w : workers) w.join();
+        rate = static_cast<double>(writes.load()) / RUN_SECONDS;
+    }
+    removeShards(shards);
+    return rate;
+}
+
+void benchShardedWrites() {
+    printHeader("BENCHMARK 10: WRITE THROUGHPUT VS SHARD COUNT");
+
+    const unsigned writers = 8;
+    std::cout << writers << " writers, each its own user; uploads plus a share link every 4th note\n\n";
+    std::cout << std::left << std::setw(10) << "Shards"
+              << std::setw(16) << "Writes/s"
+              << std::setw(10) << "Speedup" << "\n";
+
+    double baseline = 0;
+    for (int shards : {1, 2, 4, 8}) {
+        double rate = runShardedWrites(shards, writers);
+        if (shards == 1) {
+            baseline = rate;
+        }
+        std::cout << std::left << std::setw(10) << shards
+                  << std::setw(16) << std::fixed << std::setprecision(0) << rate
+                  << std::setw(10) << std::setprecision(2) << (baseline > 0 ? rate / baseline : 0.0) << "\n";
+    }
+}
+
+// ============================================
+// BENCHMARK 11: USER CACHE
+// ============================================
+
+// Sharing a note with N recipients looks up N public keys by username before
+// anything is written. A freshly opened Database has an empty cache, so its first
+// pass goes to SQLite; later passes are served from the LRU.
+void benchUserCache() {
+    printHeader("BENCHMARK 11: RECIPIENT PUBLIC KEY LOOKUPS, COLD VS CACHED");
+
+    const int recipients = 200;
+    const int rounds = 20;
+
+    removeDatabase(BENCH_DB_PATH);
+    {
+        Database db(BENCH_DB_PATH, 1);
+        db.init();
+        for (int u = 0; u < recipients; u++) {
+            db.createUser("recipient" + std::to_string(u), "hash", "salt", "04" + std::string(128, 'a'));
+        }
+    }
+
+    std::vector<std::string> names;
+    for (int u = 0; u < recipients; u++) {
+        names.push_back("recipient" + std::to_string(u));
+    }
+
+    double coldMicros = 0;
+    double warmMicros = 0;
+    CacheStats stats;
+    for (int round = 0; round < rounds; round++) {
+        Database db(BENCH_DB_PATH, 1);
+        db.init();
+
+        auto start = Clock::now();
+        for (const auto& name : names) {
+            db.getUserByUsername(name);
+        }
+        coldMicros += microsSince(start);
+
+        start = Clock::now();
+        for (const auto& name : names) {
+            db.getUserByUsername(name);
+        }
+        warmMicros += microsSince(start);
+        stats = db.userCacheStats();
+    }
+
+    double lookups = static_cast<double>(recipients) * rounds;
+    std::cout << rounds << " shares to " << recipients << " recipients each\n\n";
+    std::cout << std::left << std::setw(12) << "Cache"
+              << std::setw(14) << "us/lookup"
+              << std::setw(14) << "us/share" << "\n";
+    std::cout << std::left << std::setw(12) << "cold"
+              << std::setw(14) << std::fixed << std::setprecision(2) << coldMicros / lookups
+              << std::setw(14) << std::setprecision(1) << coldMicros / rounds << "\n";
+    std::cout << std::left << std::setw(12) << "cached"
+              << std::setw(14) << std::fixed << std::setprecision(2) << warmMicros / lookups
+              << std::setw(14) << std::setprecision(1) << warmMicros / rounds << "\n";
+    std::cout << "\nSpeedup: " << std::setprecision(1) << coldMicros / warmMicros
+              << "x  (last round: " << stats.hits << " hits, " << stats.misses << " misses)\n";
+}
+
+// ============================================
+// BENCHMARK 12: SHARE LINK CACHE
+// ============================================
+
+// Popular links opened by many whitelisted users. A freshly opened Database
+// resolves each token with the joined lookup; once cached, an access only reads
+// the user's whitelist row and the note.
+void benchLinkCache() {
+    printHeader("BENCHMARK 12: SHARE LINK ACCESS, COLD VS CACHED LINK");
+
+    const int links = 200;
+    const int readersPerLink = 20;
+    const int rounds = 10;
+
+    removeDatabase(BENCH_DB_PATH);
+    std::vector<std::string> tokens;
+    {
+        Database db(BENCH_DB_PATH, 1);
+        db.init();
+        db.createUser("owner", "hash", "salt", "04");
+        int ownerId = db.getUserByUsername("owner").id;
+        std::string content = Crypto::base64Encode(std::vector<unsigned char>(NOTE_SIZE, 0x5a));
+        std::vector<Database::UserAccessEntry> whitelist;
+        for (int r = 0; r < readersPerLink; r++) {
+            whitelist.push_back({"reader" + std::to_string(r), "04", "wrapped"});
+        }
+        for (int i = 0; i < links; i++) {
+            int noteId = db.saveNote(ownerId, content, "key", "iv", "popular.txt");
+            tokens.push_back(db.createShareLink(noteId, ownerId, whitelist, 3600));
+        }
+    }
+
+    double coldMicros = 0;
+    double warmMicros = 0;
+    long warmAccesses = 0;
+    for (int round = 0; round < rounds; round++) {
+        Database db(BENCH_DB_PATH, 1);
+        db.init();
+
+        auto start = Clock::now();
+        for (const auto& token : tokens) {
+            db.getShareLinkData(token, "reader0");
+        }
+        coldMicros += microsSince(start);
+
+        start = Clock::now();
+        for (int r = 1; r < readersPerLink; r++) {
+            for (const auto& token : tokens) {
+                db.getShareLinkData(token, "reader" + std::to_string(r));
+                warmAccesses++;
+            }
+        }
+        warmMicros += microsSince(start);
+    }
+
+    std::cout << links << " links of " << NOTE_SIZE << " bytes, " << readersPerLink
+              << " readers each, " << rounds << " rounds\n\n";
+    std::cout << std::left << std::setw(12) << "Link"
+              << std::setw(14) << "us/access" << "\n";
+    double cold = coldMicros / (static_cast<double>(links) * rounds);
+    double warm = warmMicros / warmAccesses;
+    std::cout << std::left << std::setw(12) << "cold"
+              << std::setw(14) << std::fixed << std::setprecision(2) << cold << "\n";
+    std::cout << std::left << std::setw(12) << "cached"
+              << std::setw(14) << std::fixed << std::setprecision(2) << warm << "\n";
+    std::cout << "\nSpeedup: " << std::setprecision(2) << cold / warm << "x\n";
+}
+
+// ============================================
+// BENCHMARK 13: SHARE TOKEN INDEX, HEX TEXT VS BLOB
+// ============================================
+
+struct TokenIndexRun {
+    long long index_bytes;   // -1 when this SQLite build has no dbstat table
+    double micros_per_lookup;
+};
+
+// Builds SharedLinks with `links` random tokens stored either as 64 hex characters
+// (schema version 5) or as 32 raw bytes (version 6), then looks up random tokens
+// through the unique token index with a small page cache
+TokenIndexRun measureTokenIndex(bool binary, const std::vector<std::vector<unsigned char>>& tokens, int lookups) {
+    removeDatabase(BENCH_DB_PATH);
+    sqlite3* raw;
+    sqlite3_open(BENCH_DB_PATH.c_str(), &raw);
+    sqlite3_exec(raw, "CREATE TABLE SharedLinks (id INTEGER PRIMARY KEY AUTOINCREMENT, token BLOB UNIQUE NOT NULL,"
+                      " note_id INTEGER NOT NULL, owner_id INTEGER NOT NULL, expiration_time INTEGER NOT NULL);"
+                      "BEGIN;", nullptr, nullptr, nullptr);
+
+    auto bind = [binary](sqlite3_stmt* stmt, const std::vector<unsigned char>& token) {
+        if (binary) {
+            sqlite3_bind_blob(stmt, 1, token.data(), static_cast<int>(token.size()), SQLITE_TRANSIENT);
+        } else {
+            sqlite3_bind_text(stmt, 1, Crypto::toHex(token).c_str(), -1, SQLITE_TRANSIENT);
+        }
+    };
+
+    sqlite3_stmt* insert;
+    sqlite3_prepare_v2(raw, "INSERT INTO SharedLinks (token, note_id, owner_id, expiration_time) VALUES (?, 1, 1, 9999999999)",
+                       -1, &insert, nullptr);
+    for (const auto& token : tokens) {
+        bind(insert, token);
+        sqlite3_step(insert);
+        sqlite3_reset(insert);
+    }
+    sqlite3_finalize(insert);
+    sqlite3_exec(raw, "COMMIT; VACUUM;", nullptr, nullptr, nullptr);
+
+    TokenIndexRun run;
+    run.index_bytes = -1;
+    sqlite3_stmt* size;
+    if (sqlite3_prepare_v2(raw, "SELECT SUM(pgsize) FROM dbstat WHERE name = 'sqlite_autoindex_SharedLinks_1'",
+                           -1, &size, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(size) == SQLITE_ROW) {
+            run.index_bytes = sqlite3_column_int64(size, 0);
+        }
+        sqlite3_finalize(size);
+    }
+
+    sqlite3_exec(raw, "PRAGMA cache_size = -2048;", nullptr, nullptr, nullptr);
+    sqlite3_stmt* lookup;
+    sqlite3_prepare_v2(raw, "SELECT id, note_id, expiration_time FROM SharedLinks WHERE token = ?", -1, &lookup, nullptr);
+    unsigned int seed = 11;
+    int found = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < lookups; i++) {
+        seed = seed * 1103515245 + 12345;
+        bind(lookup, tokens[(seed >> 8) % tokens.size()]);
+        found += sqlite3_step(lookup) == SQLITE_ROW;
+        sqlite3_reset(lookup);
+    }
+    run.micros_per_lookup = microsSince(start) / lookups;
+    sqlite3_finalize(lookup);
+    sqlite3_close(raw);
+
+    if (found != lookups) {
+        std::cerr << "Token lookups missed: " << lookups - found << "\n";
+    }
+    return run;
+}
+
+void benchShareTokens() {
+    printHeader("BENCHMARK 13: SHARE TOKEN INDEX, HEX TEXT VS 32-BYTE BLOB");
+
+    const int links = 200000;
+    const int lookups = 100000;
+
+    std::vector<std::vector<unsigned char>> tokens;
+    for (int i = 0; i < links; i++) {
+        tokens.push_back(Crypto::generateRandomBytes(32));
+    }
+
+    std::cout << links << " links, " << lookups << " random token lookups, 2 MB page cache\n\n";
+    std::cout << std::left << std::setw(12) << "Token"
+              << std::setw(16) << "Index (KB)"
+              << std::setw(14) << "us/lookup" << "\n";
+
+    for (bool binary : {false, true}) {
+        auto run = measureTokenIndex(binary, tokens, lookups);
+        std::cout << std::left << std::setw(12) << (binary ? "blob" : "hex text")
+                  << std::setw(16) << (run.index_bytes < 0 ? std::string("n/a") : std::to_string(run.index_bytes / 1024))
+                  << std::setw(14) << std::fixed << std::setprecision(2) << run.micros_per_lookup << "\n";
+    }
+}
+
+// ============================================
+// BENCHMARK 14: UPLOAD LATENCY DURING A BACKUP
+// ============================================
+
+double percentile(std::vector<double> samples, double fraction) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t index = static_cast<size_t>(fraction * (samples.size() - 1));
+    return samples[index];
+}
+
+struct UploadLatency {
+    double p50;
+    double p99;
+    double backup_ms;
+};
+
+// Uploads 1 KB notes one by one while (optionally) a backup of the seeded database
+// runs on another thread. Uploads are timed only while the backup is in progress.
+UploadLatency measureUploadsDuringBackup(int pages_per_step, int pause_ms, bool with_backup) {
+    const int seedNotes = 20000;
+    const std::string destination = "bench_notes.backup.db";
+
+    removeDatabase(BENCH_DB_PATH);
+    removeDatabase(destination);
+    Database db(BENCH_DB_PATH, 2);
+    db.init();
+    db.createUser("bench", "hash", "salt", "04");
+    int userId = db.getUserByUsername("bench").id;
+    std::string content = Crypto::base64Encode(std::vector<unsigned char>(NOTE_SIZE, 0x5a));
+    std::vector<Storage::NewNote> seed(seedNotes, {userId, content, "key", "iv", "seed.bin"});
+    db.saveNotes(seed);
+
+    std::atomic<bool> done{!with_backup};
+    double backupMillis = 0;
+    std::thread backup;
+    if (with_backup) {
+        backup = std::thread([&] {
+            auto start = Clock::now();
+            db.backup(destination, pages_per_step, pause_ms, nullptr);
+            backupMillis = microsSince(start) / 1000;
+            done = true;
+        });
+    }
+
+    std::vector<double> samples;
+    auto start = Clock::now();
+    while (with_backup ? !done.load() : microsSince(start) < 1e6) {
+        auto t = Clock::now();
+        db.saveNote(userId, content, "key", "iv", "upload.bin");
+        samples.push_back(microsSince(t));
+    }
+    if (backup.joinable()) {
+        backup.join();
+    }
+
+    removeDatabase(destination);
+    std::filesystem::remove_all(Database::segmentDirFor(destination));
+    return {percentile(samples, 0.50), percentile(samples, 0.99), backupMillis};
+}
+
+void benchBackup() {
+    printHeader("BENCHMARK 14: UPLOAD LATENCY DURING AN ONLINE BACKUP");
+
+    std::cout << "20000 seeded 1 KB notes, single-note uploads timed while the backup runs\n\n";
+    std::cout << std::left << std::setw(24) << "Backup"
+              << std::setw(12) << "p50 (us)"
+              << std::setw(12) << "p99 (us)"
+              << std::setw(14) << "Backup (ms)" << "\n";
+
+    struct Mode {
+        const char* name;
+        int pages_per_step;
+        int pause_ms;
+        bool with_backup;
+    };
+    for (const Mode& mode : {Mode{"none", 0, 0, false},
+                             Mode{"64 pages / 10 ms", 64, 10, true},
+                             Mode{"unthrottled", -1, 0, true}}) {
+        auto run = measureUploadsDuringBackup(mode.pages_per_step, mode.pause_ms, mode.with_backup);
+        std::cout << std::left << std::setw(24) << mode.name
+                  << std::setw(12) << std::fixed << std::setprecision(1) << run.p50
+                  << std::setw(12) << run.p99
+                  << std::setw(14) << std::setprecision(0) << run.backup_ms << "\n";
+    }
+}
+
+// ============================================
+// BENCHMARK 15: STARTUP TIME ON A LARGE DATABASE
+// ============================================
+
+const long long STARTUP_DB_BYTES = 10LL * 1024 * 1024 * 1024;
+const int STARTUP_LEGACY_LINKS = 200000;
+
+double millisSince(Clock::time_point start) {
+    return microsSince(start) / 1000;
+}
+
+// Construction plus init(), what the server waits for before it listens
+double timedOpen(std::unique_ptr<Database>& db) {
+    auto start = Clock::now();
+    db = std::make_unique<Database>(BENCH_DB_PATH, 2);
+    db->init();
+    return millisSince(start);
+}
+
+void benchStartup() {
+    printHeader("BENCHMARK 15: STARTUP ON A 10 GB DATABASE, CURRENT SCHEMA VS MIGRATION");
+
+    // 1 MB notes until the file reaches the target size
+    removeDatabase(BENCH_DB_PATH);
+    auto fillStart = Clock::now();
+    {
+        Database db(BENCH_DB_PATH, 1);
+        db.init();
+        db.createUser("bench", "hash", "salt", "04");
+        int userId = db.getUserByUsername("bench").id;
+        std::string content = Crypto::base64Encode(std::vector<unsigned char>(1024 * 1024, 0x33));
+        std::vector<Storage::NewNote> batch(16, {userId, content, "key", "iv", "large.bin"});
+        while (static_cast<long long>(std::filesystem::file_size(BENCH_DB_PATH)) < STARTUP_DB_BYTES) {
+            db.saveNotes(batch);
+        }
+    }
+    std::cout << "Built " << std::filesystem::file_size(BENCH_DB_PATH) / (1024 * 1024) << " MB in "
+              << std::fixed << std::setprecision(1) << millisSince(fillStart) / 1000 << " s\n\n";
+
+    std::cout << std::left << std::setw(44) << "Start" << std::setw(14) << "ms" << "\n";
+
+    std::unique_ptr<Database> db;
+    double total = 0;
+    const int opens = 5;
+    for (int i = 0; i < opens; i++) {
+        db.reset();
+        total += timedOpen(db);
+    }
+    std::cout << std::left << std::setw(44) << "current schema (no DDL), avg of 5"
+              << std::setw(14) << std::setprecision(2) << total / opens << "\n";
+    db.reset();
+
+    // The same file as a version 5 database whose share links still have hex tokens
+    {
+        sqlite3* raw;
+        sqlite3_open(BENCH_DB_PATH.c_str(), &raw);
+        sqlite3_stmt* insert;
+        sqlite3_prepare_v2(raw, "INSERT INTO SharedLinks (token, note_id, owner_id, expiration_time) VALUES (?, 1, 1, 9999999999)",
+                           -1, &insert, nullptr);
+        sqlite3_exec(raw, "BEGIN;", nullptr, nullptr, nullptr);
+        for (int i = 0; i < STARTUP_LEGACY_LINKS; i++) {
+            std::string hex = Crypto::toHex(Crypto::generateRandomBytes(32));
+            sqlite3_bind_text(insert, 1, hex.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_step(insert);
+            sqlite3_reset(insert);
+        }
+        sqlite3_finalize(insert);
+        sqlite3_exec(raw, "COMMIT; PRAGMA user_version = 5;", nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+    }
+
+    double migrateMs = timedOpen(db);
+    std::cout << std::left << std::setw(44) << "version 5 -> 6 (200000 hex tokens)"
+              << std::setw(14) << std::setprecision(2) << migrateMs << "\n";
+
+    // What the server then does in the background while it already serves requests
+    BackfillRunner runner(*db, 1000, 20);
+    runner.start();
+    while (!runner.stats().finished) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    runner.stop();
+    auto stats = runner.stats();
+    std::cout << "\nBackground backfill: " << stats.rows << " tokens in " << stats.batches << " batches, "
+              << std::setprecision(0) << stats.elapsed_ms << " ms (20 ms pause between batches)\n";
+
+    db.reset();
+    removeDatabase(BENCH_DB_PATH);
+}
+
+// ============================================
+// BENCHMARK 16: LARGE FILE DOWNLOAD, WHOLE VS RANGES
+// ============================================
+
+const long long DOWNLOAD_NOTE_BYTES = 256LL * 1024 * 1024;
+const long long DOWNLOAD_PIECE_BYTES = 8LL * 1024 * 1024;
+
+struct DownloadRun {
+    double mb_per_second;
+    double held_mb;  // Largest buffer one request holds
+};
+
+// Fetches the whole note in DOWNLOAD_PIECE_BYTES ranges (GET /note/<id>/raw with Range),
+// `fetchers` pieces in flight at a time, the way a download manager would
+DownloadRun downloadInRanges(Storage& db, int noteId, int userId, unsigned fetchers) {
+    const long long pieces = (DOWNLOAD_NOTE_BYTES + DOWNLOAD_PIECE_BYTES - 1) / DOWNLOAD_PIECE_BYTES;
+    std::atomic<long long> next(0);
+    std::atomic<long long> received(0);
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < fetchers; t++) {
+        threads.emplace_back([&] {
+            for (long long piece = next++; piece < pieces; piece = next++) {
+                ContentStore::ByteRange range;
+                range.offset = piece * DOWNLOAD_PIECE_BYTES;
+                range.length = DOWNLOAD_PIECE_BYTES;
+                NoteData note;
+                ContentStore::RangeData data;
+                db.getNoteRangeForOwner(noteId, userId, range, note, data);
+                received += static_cast<long long>(data.bytes.size());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = microsSince(start);
+    return {received / elapsed, DOWNLOAD_PIECE_BYTES / (1024.0 * 1024.0)};
+}
+
+void benchRangeDownloads() {
+    printHeader("BENCHMARK 16: 256 MB DOWNLOAD, JSON VS RAW VS PARALLEL RANGES");
+
+    std::cout << "One 256 MB note, 8 MB ranges; best of 3 runs (the file is in the OS cache after the first)\n\n";
+    std::cout << std::left << std::setw(10) << "Store"
+              << std::setw(34) << "Download"
+              << std::setw(12) << "MB/s"
+              << std::setw(16) << "Held (MB)" << "\n";
+
+    std::vector<unsigned char> bytes(static_cast<size_t>(DOWNLOAD_NOTE_BYTES));
+    for (size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<unsigned char>(i * 2654435761u >> 24);
+    }
+
+    for (bool segments : {false, true}) {
+        removeDatabase(BENCH_DB_PATH);
+        std::filesystem::remove_all(BENCH_SEGMENT_DIR);
+        std::unique_ptr<ContentStore> store;
+        if (segments) {
+            store = std::make_unique<SegmentContentStore>(BENCH_SEGMENT_DIR, 64 * 1024, 64LL * 1024 * 1024, 60);
+        }
+        Database db(BENCH_DB_PATH, 8, std::move(store));
+        db.init();
+        db.createUser("bench", "hash", "salt", "04");
+        int userId = db.getUserByUsername("bench").id;
+
+        size_t pos = 0;
+        int noteId = db.saveNoteStream(userId, DOWNLOAD_NOTE_BYTES, [&](std::vector<unsigned char>& chunk) {
+            size_t length = std::min(bytes.size() - pos, static_cast<size_t>(ContentStore::CHUNK_BYTES));
+            chunk.assign(bytes.begin() + pos, bytes.begin() + pos + length);
+            pos += length;
+            return true;
+        }, "key", "iv", "large.bin");
+
+        auto print = [segments](const std::string& mode, const DownloadRun& run) {
+            std::cout << std::left << std::setw(10) << (segments ? "segment" : "inline")
+                      << std::setw(34) << mode
+                      << std::setw(12) << std::fixed << std::setprecision(0) << run.mb_per_second
+                      << std::setw(16) << std::setprecision(0) << run.held_mb << "\n";
+        };
+
+        // GET /note/<id>: the whole note as base64 (JSON body), 4/3 of the size
+        DownloadRun json{0, 0};
+        for (int i = 0; i < 3; i++) {
+            NoteData note;
+            auto start = Clock::now();
+            db.getNoteForOwner(noteId, userId, note);
+            double elapsed = microsSince(start);
+            json.mb_per_second = std::max(json.mb_per_second, DOWNLOAD_NOTE_BYTES / elapsed);
+            json.held_mb = note.encrypted_content.size() / (1024.0 * 1024.0);
+        }
+        print("whole note, base64 (GET /note)", json);
+
+        // GET /note/<id>/raw without Range
+        DownloadRun raw{0, 0};
+        for (int i = 0; i < 3; i++) {
+            NoteData note;
+            ContentStore::RangeData data;
+            auto start = Clock::now();
+            db.getNoteRangeForOwner(noteId, userId, ContentStore::ByteRange(), note, data);
+            double elapsed = microsSince(start);
+            raw.mb_per_second = std::max(raw.mb_per_second, data.bytes.size() / elapsed);
+            raw.held_mb = data.bytes.size() / (1024.0 * 1024.0);
+        }
+        print("whole note, raw", raw);
+
+        for (unsigned fetchers : {1u, 2u, 4u, 8u}) {
+            DownloadRun best{0, 0};
+            for (int i = 0; i < 3; i++) {
+                DownloadRun run = downloadInRanges(db, noteId, userId, fetchers);
+                best = run.mb_per_second > best.mb_per_second ? run : best;
+            }
+            print("8 MB ranges, " + std::to_string(fetchers) + " in parallel", best);
+        }
+    }
+
+    removeDatabase(BENCH_DB_PATH);
+    std::filesystem::remove_all(BENCH_SEGMENT_DIR);
+}
+
+// ============================================
+// BENCHMARK 17: JSON VS CBOR VS MESSAGEPACK BODIES
+// ============================================
+
+// Best time of `runs` calls, in microseconds
+template <typename F>
+double bestMicros(int runs, F&& call) {
+    double best = 1e18;
+    for (int i = 0; i < runs; i++) {
+        auto start = Clock::now();
+        call();
+        best = std::min(best, microsSince(start));
+    }
+    return best;
+}
+
+NoteData wireNote(size_t bytes) {
+    std::vector<unsigned char> ciphertext(bytes);
+    for (size_t i = 0; i < ciphertext.size(); i++) {
+        ciphertext[i] = static_cast<unsigned char>(i * 2654435761u >> 24);
+    }
+    NoteData note;
+    note.note_id = 123456;
+    note.encrypted_content = Crypto::base64Encode(ciphertext);
+    note.wrapped_key = Crypto::base64Encode(std::vector<unsigned char>(60, 0x42));
+    note.iv_hex = Crypto::base64Encode(std::vector<unsigned char>(12, 0x17));
+    note.filename = "quarterly report.pdf";
+    note.created_at = 1700000000;
+    return note;
+}
+
+void benchWireFormats() {
+    printHeader("BENCHMARK 17: JSON VS CBOR VS MESSAGEPACK BODIES");
+
+    // The bodies the API exchanges most, built from the Protocol.h structs like the handlers do
+    std::vector<std::pair<std::string, nlohmann::json>> payloads;
+    payloads.emplace_back("note, 1 KB (GET /note)", wireNote(1024));
+    payloads.emplace_back("note, 1 MB (GET /note)", wireNote(1024 * 1024));
+
+    CreateShareLinkRequest share;
+    share.note_id = 123456;
+    share.duration_seconds = 3600;
+    for (int i = 0; i < 5; i++) {
+        ShareLinkUserAccess access;
+        access.username = "recipient" + std::to_string(i);
+        access.send_public_key_hex = "04" + Crypto::toHex(std::vector<unsigned char>(64, static_cast<unsigned char>(i)));
+        access.wrapped_key = Crypto::base64Encode(std::vector<unsigned char>(60, static_cast<unsigned char>(i)));
+        share.user_access_list.push_back(access);
+    }
+    payloads.emplace_back("share link, 5 users (POST /share)", share);
+
+    std::vector<NoteListItem> items;
+    for (int i = 0; i < 100; i++) {
+        items.push_back({1000 + i, 1700000000L + i, "note_" + std::to_string(i) + ".txt"});
+    }
+    payloads.emplace_back("100 notes (GET /notes)", nlohmann::json{{"notes", items}, {"next_cursor", 1099}});
+
+    std::cout << "Encode: json -> body, decode: body -> json (base64/hex restored); best of 20 runs\n\n";
+    std::cout << std::left << std::setw(36) << "Payload"
+              << std::setw(10) << "Format"
+              << std::setw(14) << "Bytes"
+              << std::setw(14) << "Encode (us)"
+              << std::setw(14) << "Decode (us)" << "\n";
+
+    const std::pair<const char*, WireFormat::Format> formats[] = {{"json", WireFormat::Format::Json},
+                                                                  {"cbor", WireFormat::Format::Cbor},
+                                                                  {"msgpack", WireFormat::Format::MsgPack}};
+    for (const auto& payload : payloads) {
+        for (const auto& format : formats) {
+            std::string body = WireFormat::encode(payload.second, format.second);
+            double encode = bestMicros(20, [&] { WireFormat::encode(payload.second, format.second); });
+            double decode = bestMicros(20, [&] { WireFormat::decode(body, format.second); });
+            std::cout << std::left << std::setw(36) << payload.first
+                      << std::setw(10) << format.first
+                      << std::setw(14) << body.size()
+                      << std::setw(14) << std::fixed << std::setprecision(1) << encode
+                      << std::setw(14) << decode << "\n";
+        }
+    }
+
+    // GET /note with Accept: application/cbor reads the ciphertext raw, so the
+    // server never base64-encodes it; the client still converts on decode
+    NoteData note = wireNote(1024 * 1024);
+    nlohmann::json raw = note;
+    raw["encrypted_content"] = nlohmann::json::binary(Crypto::base64Decode(note.encrypted_content));
+    std::string body = WireFormat::encode(raw, WireFormat::Format::Cbor);
+    double encode = bestMicros(20, [&] { WireFormat::encode(raw, WireFormat::Format::Cbor); });
+    std::cout << std::left << std::setw(36) << "note, 1 MB, ciphertext read raw"
+              << std::setw(10) << "cbor"
+              << std::setw(14) << body.size()
+              << std::setw(14) << std::fixed << std::setprecision(1) << encode << "\n";
+}
+
+// ============================================
+// BENCHMARK 18: TOKEN VERIFICATION PER REQUEST
+// ============================================
+
+const int AUTH_TOKENS = 1000;
+const int AUTH_CALLS_PER_THREAD = 200000;
+
+// Nanoseconds per call of `verify` over a rotating set of logged-in users
+template <typename Verify>
+double authNanos(const std::vector<std::string>& headers, unsigned threads, Verify&& verify) {
+    std::atomic<int> invalid(0);
+    auto start = Clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < AUTH_CALLS_PER_THREAD; i++) {
+                if (!verify(headers[(i + t * 97) % headers.size()]).valid) {
+                    invalid++;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (invalid > 0) {
+        std::cout << "  (" << invalid << " tokens rejected)\n";
+    }
+    return microsSince(start) * 1000.0 / (static_cast<double>(AUTH_CALLS_PER_THREAD) * threads);
+}
+
+void benchTokenVerification() {
+    printHeader("BENCHMARK 18: TOKEN VERIFICATION, EVERY REQUEST VS CACHED");
+
+    std::vector<std::string> headers;
+    for (int i = 0; i < AUTH_TOKENS; i++) {
+        headers.push_back("Bearer " + Auth::generateToken(i + 1, "user" + std::to_string(i)));
+    }
+
+    std::cout << AUTH_TOKENS << " active tokens, " << AUTH_CALLS_PER_THREAD << " requests per thread\n\n";
+    std::cout << std::left << std::setw(10) << "Threads"
+              << std::setw(26) << "verifyToken (ns/req)"
+              << std::setw(26) << "verifyTokenCached (ns/req)" << "\n";
+    for (unsigned threads : {1u, 4u, 8u}) {
+        double full = authNanos(headers, threads, [](const std::string& header) {
+            return Auth::verifyToken(Auth::extractToken(header));
+        });
+        double cached = authNanos(headers, threads, [](const std::string& header) {
+            return Auth::verifyTokenCached(Auth::extractToken(header));
+        });
+        std::cout << std::left << std::setw(10) << threads
+                  << std::setw(26) << std::fixed << std::setprecision(0) << full
+                  << std::setw(26) << cached << "\n";
+    }
+
+    CacheStats stats = Auth::tokenCacheStats();
+    std::cout << "\nCache: " << stats.entries << " entries, " << stats.hits << " hits, " << stats.misses << " misses\n";
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+int main() {
+    std::cout << "Secure Note - storage benchmarks\n";
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << "\n";
+
+    benchConcurrentReads();
+    benchStatementCache();
+    benchNoteDownload();
+    benchOutgoingShares();
+    benchCreateShareLink();
+    benchConcurrentUploads();
+    benchNoteLayoutCache();
+    benchLargeNotes();
+    benchStorageEngines();
+    benchShardedWrites();
+    benchUserCache();
+    benchLinkCache();
+    benchShareTokens();
+    benchBackup();
+    benchStartup();
+    benchRangeDownloads();
+    benchWireFormats();
+    benchTokenVerification();
+
+    removeDatabase(BENCH_DB_PATH);
+    return 0;
+}
@@ -0,0 +1,3023 @@
+// db_test.cpp - Storage layer regression tests (no server needed)
+// Compile: g++ test/db_test.cpp server/Database.cpp server/ConnectionPool.cpp server/Statements.cpp server/ExpirySweeper.cpp server/GroupCommitQueue.cpp server/ContentStore.cpp server/SegmentStore.cpp server/ContentCompactor.cpp server/MemoryStorage.cpp server/ShardedStorage.cpp server/BackupRunner.cpp server/BackfillRunner.cpp server/ServerConfig.cpp server/Auth.cpp common/Crypto.cpp common/WireFormat.cpp sqlite3.o -o db_test.exe -std=c++17 -I vendor -lcrypto
+// Run: .\db_test.exe   (creates and removes db_test*.db and db_test.segments in the current directory, backups in db_test_backup)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <filesystem>
+#include <chrono>
+#include <fstream>
+#include <cstdlib>
+#include <future>
+#include <stdexcept>
+#include "../server/Database.h"
+#include "../server/Statements.h"
+#include "../server/ExpirySweeper.h"
+#include "../server/GroupCommitQueue.h"
+#include "../server/SegmentStore.h"
+#include "../server/MemoryStorage.h"
+#include "../server/ShardedStorage.h"
+#include "../server/BackupRunner.h"
+#include "../server/BackfillRunner.h"
+#include "../server/ServerConfig.h"
+#include "../server/Auth.h"
+#include "../common/Crypto.h"
+#include "../common/WireFormat.h"
+
+// ============================================
+// CONFIGURATION
+// ============================================
+
+const std::string TEST_DB_PATH = "db_test.db";
+const std::string NOTE_CONTENT = "Y29udGVudA=="; // base64("content")
+
+// ============================================
+// TEST UTILITIES
+// ============================================
+
+struct TestResult {
+    int passed = 0;
+    int total = 0;
+};
+
+void printHeader(const std::string& text) {
+    std::cout << "\n" << std::string(60, '=') << "\n";
+    std::cout << text << "\n";
+    std::cout << std::string(60, '=') << "\n\n";
+}
+
+void printTest(const std::string& testName) {
+    std::cout << "[TEST] " << testName << "\n";
+}
+
+void printPass(const std::string& message = "PASSED") {
+    std::cout << "\033[32m [PASS] " << message << "\033[0m\n";
+}
+
+void printFail(const std::string& message = "FAILED") {
+    std::cout << "\033[31m [FAIL] " << message << "\033[0m\n";
+}
+
+void printInfo(const std::string& message) {
+    std::cout << "\033[33m [INFO] " << message << "\033[0m\n";
+}
+
+void removeDatabase(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+// ============================================
+// TEST CATEGORY 1: QUERY PLANS
+// ============================================
+
+// Returns the detail column of EXPLAIN QUERY PLAN for a statement
+std::vector<std::string> explainQueryPlan(sqlite3* raw, const std::string& sql) {
+    std::vector<std::string> details;
+    std::string explain = "EXPLAIN QUERY PLAN " + sql;
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(raw, explain.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        details.push_back(std::string("PREPARE FAILED: ") + sqlite3_errmsg(raw));
+        return details;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        details.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)));
+    }
+    sqlite3_finalize(stmt);
+    return details;
+}
+
+// Every table of the schema grows with the user base, so any full SCAN fails.
+// A temp B-tree sort fails too: paginated listings must read rows in index order.
+TestResult testQueryPlans() {
+    printHeader("CATEGORY 1: QUERY PLANS");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    {
+        Database db(TEST_DB_PATH, 1);
+        db.init();
+    }
+
+    sqlite3* raw;
+    sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+
+    for (size_t i = 0; i < STATEMENT_COUNT; i++) {
+        Stmt id = static_cast<Stmt>(i);
+        result.total++;
+        printTest(std::string("1.") + std::to_string(i + 1) + " - " + statementName(id));
+
+        auto plan = explainQueryPlan(raw, statementSql(id));
+        std::string badStep;
+        for (const auto& step : plan) {
+            bool scan = step.rfind("SCAN ", 0) == 0 && step != "SCAN CONSTANT ROW";
+            bool sort = step.rfind("USE TEMP B-TREE", 0) == 0;
+            if (scan || sort || step.rfind("PREPARE FAILED", 0) == 0) {
+                badStep = step;
+                break;
+            }
+        }
+
+        if (badStep.empty()) {
+            printPass(plan.empty() ? "No table access" : plan.back());
+            result.passed++;
+        } else {
+            printFail(badStep);
+            for (const auto& step : plan) {
+                printInfo(step);
+            }
+        }
+    }
+
+    sqlite3_close(raw);
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nQuery Plans: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 2: NOTES
+// ============================================
+
+TestResult testNotes() {
+    printHeader("CATEGORY 2: NOTES");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    Database db(TEST_DB_PATH, 1);
+    db.init();
+    db.createUser("owner", "hash", "salt", "04");
+    int ownerId = db.getUserByUsername("owner").id;
+
+    // Same created_at for every note: the id has to break the tie
+    std::vector<int> noteIds;
+    for (int i = 0; i < 5; i++) {
+        noteIds.push_back(db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "n" + std::to_string(i) + ".txt"));
+    }
+
+    // Test 2.1: Keyset pages cover every note exactly once, newest first
+    result.total++;
+    printTest("2.1 - Pages of 2 return 2, 2, 1 notes without duplicates");
+    {
+        std::vector<int> seen;
+        std::vector<size_t> pageSizes;
+        Database::NoteCursor cursor;
+        bool more = true;
+        while (more) {
+            auto page = db.listNotes(ownerId, cursor, 2);
+            pageSizes.push_back(page.notes.size());
+            for (const auto& note : page.notes) {
+                seen.push_back(note.note_id);
+            }
+            more = page.has_more;
+            if (more) {
+                cursor.created_at = page.notes.back().created_at;
+                cursor.note_id = page.notes.back().note_id;
+            }
+        }
+
+        std::vector<int> expected(noteIds.rbegin(), noteIds.rend());
+        if (seen == expected && pageSizes == std::vector<size_t>{2, 2, 1}) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("Got " + std::to_string(seen.size()) + " notes in " + std::to_string(pageSizes.size()) + " pages");
+        }
+    }
+
+    // Test 2.2: Another user's notes never show up
+    db.createUser("other", "hash", "salt", "04");
+    int otherId = db.getUserByUsername("other").id;
+
+    result.total++;
+    printTest("2.2 - Listing is scoped to the owner");
+    {
+        auto page = db.listNotes(otherId, Database::NoteCursor(), 10);
+        if (page.notes.empty() && !page.has_more) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail();
+        }
+    }
+
+    // Test 2.3: Owner lookup tells found, missing and foreign notes apart
+    result.total++;
+    printTest("2.3 - getNoteForOwner returns Ok / NotFound / Forbidden");
+    {
+        NoteData note;
+        note.note_id = -1;
+        auto ok = db.getNoteForOwner(noteIds[0], ownerId, note);
+        bool okFilled = note.note_id == noteIds[0] && note.encrypted_content == NOTE_CONTENT;
+
+        NoteData untouched;
+        untouched.note_id = -1;
+        auto missing = db.getNoteForOwner(999999, ownerId, untouched);
+        auto forbidden = db.getNoteForOwner(noteIds[0], otherId, untouched);
+
+        if (ok == Database::NoteAccess::Ok && okFilled &&
+            missing == Database::NoteAccess::NotFound &&
+            forbidden == Database::NoteAccess::Forbidden && untouched.note_id == -1) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail();
+        }
+    }
+
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nNotes: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 3: DELETION
+// ============================================
+
+// Runs a single-value query on a separate connection
+long long queryInt(const std::string& path, const std::string& sql) {
+    sqlite3* raw;
+    sqlite3_open(path.c_str(), &raw);
+    long long value = -1;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(raw, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            value = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(raw);
+    return value;
+}
+
+// Runs a statement on a separate connection (test setup outside the Database API)
+void execSql(const std::string& path, const std::string& sql) {
+    sqlite3* raw;
+    sqlite3_open(path.c_str(), &raw);
+    sqlite3_exec(raw, sql.c_str(), nullptr, nullptr, nullptr);
+    sqlite3_close(raw);
+}
+
+long long countShareRows(const std::string& path) {
+    return queryInt(path, "SELECT (SELECT COUNT(*) FROM SharedLinks) + (SELECT COUNT(*) FROM SharedLinkAccess) + (SELECT COUNT(*) FROM UserShares)");
+}
+
+// Schema as it was before user_version 1: no ON DELETE CASCADE
+const char* LEGACY_SCHEMA = R"(
+    CREATE TABLE Users (id INTEGER PRIMARY KEY AUTOINCREMENT, username TEXT UNIQUE NOT NULL,
+        password_hash TEXT NOT NULL, salt TEXT NOT NULL, receive_public_key_hex TEXT NOT NULL);
+    CREATE TABLE Notes (id INTEGER PRIMARY KEY AUTOINCREMENT, user_id INTEGER NOT NULL,
+        encrypted_content TEXT NOT NULL, wrapped_key TEXT NOT NULL, iv_hex TEXT NOT NULL,
+        filename TEXT NOT NULL DEFAULT 'note.txt', created_at INTEGER NOT NULL,
+        FOREIGN KEY (user_id) REFERENCES Users(id));
+    CREATE TABLE SharedLinks (id INTEGER PRIMARY KEY AUTOINCREMENT, token TEXT UNIQUE NOT NULL,
+        note_id INTEGER NOT NULL, owner_id INTEGER NOT NULL, expiration_time INTEGER NOT NULL,
+        FOREIGN KEY (note_id) REFERENCES Notes(id), FOREIGN KEY (owner_id) REFERENCES Users(id));
+    CREATE TABLE SharedLinkAccess (id INTEGER PRIMARY KEY AUTOINCREMENT, link_id INTEGER NOT NULL,
+        username TEXT NOT NULL, send_public_key_hex TEXT NOT NULL, wrapped_key TEXT NOT NULL,
+        FOREIGN KEY (link_id) REFERENCES SharedLinks(id));
+    CREATE TABLE UserShares (id INTEGER PRIMARY KEY AUTOINCREMENT, note_id INTEGER NOT NULL,
+        sender_id INTEGER NOT NULL, recipient_id INTEGER NOT NULL, send_public_key_hex TEXT NOT NULL,
+        new_wrapped_key TEXT NOT NULL, expiration_time INTEGER NOT NULL,
+        FOREIGN KEY (note_id) REFERENCES Notes(id), FOREIGN KEY (sender_id) REFERENCES Users(id),
+        FOREIGN KEY (recipient_id) REFERENCES Users(id));
+
+    INSERT INTO Users VALUES (1, 'owner', 'hash', 'salt', '04');
+    INSERT INTO Users VALUES (2, 'friend', 'hash', 'salt', '04');
+    INSERT INTO Notes VALUES (1, 1, 'Y29udGVudA==', 'key', 'iv', 'kept.txt', 100);
+    INSERT INTO SharedLinks VALUES (1, 'tok1', 1, 1, 9999999999);
+    INSERT INTO SharedLinkAccess VALUES (1, 1, 'friend', '04', 'wk');
+    INSERT INTO UserShares VALUES (1, 1, 1, 2, '04', 'wk', 9999999999);
+    -- Left behind by a delete that failed halfway under the old multi-statement code
+    INSERT INTO SharedLinks VALUES (7, 'orphan', 42, 1, 9999999999);
+    INSERT INTO SharedLinkAccess VALUES (9, 7, 'friend', '04', 'wk');
+    INSERT INTO UserShares VALUES (5, 42, 1, 2, '04', 'wk', 9999999999);
+)";
+
+TestResult testDeletion() {
+    printHeader("CATEGORY 3: DELETION");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    {
+        Database db(TEST_DB_PATH, 1);
+        db.init();
+        db.createUser("owner", "hash", "salt", "04");
+        db.createUser("friend", "hash", "salt", "04");
+        int ownerId = db.getUserByUsername("owner").id;
+        int friendId = db.getUserByUsername("friend").id;
+
+        auto share = [&](int noteId) {
+            db.createShareLink(noteId, ownerId, {{"friend", "04", "wk"}}, 3600);
+            db.createUserShare(noteId, ownerId, friendId, "04", "wk", 3600);
+        };
+
+        // Test 3.1: Deleting a note takes its links, access rows and user shares along
+        result.total++;
+        printTest("3.1 - deleteNote cascades to shares");
+        {
+            int noteId = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "a.txt");
+            share(noteId);
+            long long before = countShareRows(TEST_DB_PATH);
+            bool otherUser = db.deleteNote(noteId, friendId);
+            bool owner = db.deleteNote(noteId, ownerId);
+            bool again = db.deleteNote(noteId, ownerId);
+            long long after = countShareRows(TEST_DB_PATH);
+
+            if (before == 3 && !otherUser && owner && !again && after == 0) {
+                printPass();
+                result.passed++;
+            } else {
+                printFail("Share rows before/after: " + std::to_string(before) + "/" + std::to_string(after));
+            }
+        }
+
+        // Test 3.2: Revoking a link removes its access rows
+        result.total++;
+        printTest("3.2 - deleteShareLink cascades to access rows");
+        {
+            int noteId = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "b.txt");
+            std::string token = db.createShareLink(noteId, ownerId, {{"friend", "04", "wk"}}, 3600);
+            bool otherUser = db.deleteShareLink(token, friendId);
+            bool owner = db.deleteShareLink(token, ownerId);
+            long long access = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinkAccess");
+
+            if (!otherUser && owner && access == 0) {
+                printPass();
+                result.passed++;
+            } else {
+                printFail();
+            }
+            db.deleteNote(noteId, ownerId);
+        }
+
+        // Test 3.3: Bulk delete only removes the caller's notes
+        result.total++;
+        printTest("3.3 - deleteNotes returns the ids it deleted");
+        {
+            int a = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "c.txt");
+            int b = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "d.txt");
+            int foreign = db.saveNote(friendId, NOTE_CONTENT, "key", "iv", "e.txt");
+            share(a);
+            share(b);
+
+            auto deleted = db.deleteNotes(ownerId, {a, foreign, b, 999999});
+            NoteData untouched;
+            bool foreignKept = db.getNoteForOwner(foreign, friendId, untouched) == Database::NoteAccess::Ok;
+
+            if (deleted == std::vector<int>{a, b} && foreignKept && countShareRows(TEST_DB_PATH) == 0) {
+                printPass();
+                result.passed++;
+            } else {
+                printFail("Deleted " + std::to_string(deleted.size()) + " notes");
+            }
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    // Test 3.4: A database from before user_version 1 is rebuilt with cascades
+    result.total++;
+    printTest("3.4 - Legacy schema migrates to cascading deletes");
+    {
+        sqlite3* raw;
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, LEGACY_SCHEMA, nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+
+        Database db(TEST_DB_PATH, 1);
+        bool initOk = db.init();
+        long long version = queryInt(TEST_DB_PATH, "PRAGMA user_version");
+        long long orphans = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks WHERE note_id = 42");
+        long long kept = countShareRows(TEST_DB_PATH);
+
+        // The link counter survives the rebuild: the next link gets an id after the dropped orphan
+        std::string token = db.createShareLink(1, 1, {}, 3600);
+        std::vector<unsigned char> tokenBytes(token.begin(), token.end());
+        long long newLinkId = queryInt(TEST_DB_PATH, "SELECT id FROM SharedLinks WHERE token = x'" + Crypto::toHex(tokenBytes) + "'");
+
+        bool deleted = db.deleteNote(1, 1);
+        long long after = countShareRows(TEST_DB_PATH);
+
+        if (initOk && version == 6 && orphans == 0 && kept == 3 && newLinkId == 8 && deleted && after == 0) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("version=" + std::to_string(version) + " kept=" + std::to_string(kept) +
+                      " new link id=" + std::to_string(newLinkId) + " after delete=" + std::to_string(after));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nDeletion: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 4: OUTGOING SHARES
+// ============================================
+
+TestResult testOutgoingShares() {
+    printHeader("CATEGORY 4: OUTGOING SHARES");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    Database db(TEST_DB_PATH, 1);
+    db.init();
+    db.createUser("owner", "hash", "salt", "04");
+    int ownerId = db.getUserByUsername("owner").id;
+    int noteId = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "shared.txt");
+
+    // Two live links with recipients, one live link without, one expired link
+    db.createShareLink(noteId, ownerId, {{"bob", "04", "wk"}, {"carol", "04", "wk"}}, 300);
+    db.createShareLink(noteId, ownerId, {{"dave", "04", "wk"}}, 200);
+    db.createShareLink(noteId, ownerId, {}, 100);
+    db.createShareLink(noteId, ownerId, {{"erin", "04", "wk"}}, -100);
+
+    // Test 4.1: Pages follow expiration order and carry each link's recipients
+    result.total++;
+    printTest("4.1 - Pages of 3 return 3, 1 links with their recipients");
+    {
+        auto first = db.listOutgoingShares(ownerId, Database::ShareCursor(), 3, false);
+        Database::ShareCursor cursor;
+        if (!first.shares.empty()) {
+            cursor.expiration_time = first.shares.back().expiration_time;
+            cursor.link_id = first.shares.back().link_id;
+        }
+        auto second = db.listOutgoingShares(ownerId, cursor, 3, false);
+
+        bool ok = first.shares.size() == 3 && first.has_more &&
+                  second.shares.size() == 1 && !second.has_more &&
+                  first.shares[0].shared_with == std::vector<std::string>{"bob", "carol"} &&
+                  first.shares[1].shared_with == std::vector<std::string>{"dave"} &&
+                  first.shares[2].shared_with.empty() &&
+                  second.shares[0].shared_with == std::vector<std::string>{"erin"};
+        if (ok) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("Got " + std::to_string(first.shares.size()) + " + " + std::to_string(second.shares.size()) + " links");
+        }
+    }
+
+    // Test 4.2: active_only leaves expired links out of the query
+    result.total++;
+    printTest("4.2 - active_only skips expired links");
+    {
+        auto page = db.listOutgoingShares(ownerId, Database::ShareCursor(), 10, true);
+        if (page.shares.size() == 3 && !page.has_more) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("Got " + std::to_string(page.shares.size()) + " links");
+        }
+    }
+
+    // Test 4.3: The whitelist is written with the link, or not at all
+    result.total++;
+    printTest("4.3 - createShareLink is atomic");
+    {
+        std::vector<Database::UserAccessEntry> whitelist;
+        for (int i = 0; i < 1000; i++) {
+            whitelist.push_back({"user" + std::to_string(i), "04", "wk"});
+        }
+        long long accessBefore = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinkAccess");
+        std::string token = db.createShareLink(noteId, ownerId, whitelist, 300);
+        long long added = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinkAccess") - accessBefore;
+
+        // Unknown note: the foreign key rejects the link and nothing is kept
+        long long linksBefore = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks");
+        std::string failed = db.createShareLink(999999, ownerId, whitelist, 300);
+        long long linksAfter = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks");
+        long long accessAfter = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinkAccess");
+
+        if (!token.empty() && added == 1000 && failed.empty() &&
+            linksAfter == linksBefore && accessAfter == accessBefore + 1000) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("added=" + std::to_string(added) + " links " + std::to_string(linksBefore) + "->" + std::to_string(linksAfter));
+        }
+    }
+
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nOutgoing Shares: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 5: EXPIRY SWEEP
+// ============================================
+
+TestResult testExpirySweep() {
+    printHeader("CATEGORY 5: EXPIRY SWEEP");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    Database db(TEST_DB_PATH, 1);
+    db.init();
+    db.createUser("owner", "hash", "salt", "04");
+    db.createUser("friend", "hash", "salt", "04");
+    int ownerId = db.getUserByUsername("owner").id;
+    int friendId = db.getUserByUsername("friend").id;
+    int noteId = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "shared.txt");
+
+    // 5 expired and 2 live of each kind
+    for (int i = 0; i < 7; i++) {
+        int duration = i < 5 ? -100 - i : 3600;
+        db.createShareLink(noteId, ownerId, {{"friend", "04", "wk"}}, duration);
+        db.createUserShare(noteId, ownerId, friendId, "04", "wk", duration);
+    }
+    long now = static_cast<long>(std::time(nullptr));
+
+    // Test 5.1: A batch never deletes more than batch_size rows
+    result.total++;
+    printTest("5.1 - Batches are bounded and only hit expired rows");
+    {
+        int first = db.deleteExpiredLinks(now, 2);
+        long backlog = db.countExpiredLinks(now);
+        int shares = db.deleteExpiredUserShares(now, 10);
+
+        if (first == 2 && backlog == 3 && shares == 5 && db.countExpiredUserShares(now) == 0 &&
+            queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM UserShares") == 2) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("first=" + std::to_string(first) + " backlog=" + std::to_string(backlog) +
+                      " shares=" + std::to_string(shares));
+        }
+    }
+
+    // Test 5.2: A capped pass reports the rest as backlog, the next pass clears it
+    result.total++;
+    printTest("5.2 - Sweeper pass respects max_batches and reports backlog");
+    {
+        ExpirySweeper sweeper(db, 60, 1, 2);
+        long long firstPass = sweeper.sweepOnce();
+        auto afterFirst = sweeper.stats();
+        sweeper.sweepOnce();
+        auto afterSecond = sweeper.stats();
+
+        // Access rows of the swept links are gone too; the 2 live links keep theirs
+        long long access = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinkAccess");
+        long long links = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks");
+
+        if (firstPass == 2 && afterFirst.backlog_links == 1 &&
+            afterSecond.backlog_links == 0 && afterSecond.links_deleted == 3 && afterSecond.passes == 2 &&
+            links == 2 && access == 2) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("links=" + std::to_string(links) + " access=" + std::to_string(access));
+        }
+    }
+
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nExpiry Sweep: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 6: GROUP COMMIT
+// ============================================
+
+TestResult testGroupCommit() {
+    printHeader("CATEGORY 6: GROUP COMMIT");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    Database db(TEST_DB_PATH, 2);
+    db.init();
+    db.createUser("owner", "hash", "salt", "04");
+    int ownerId = db.getUserByUsername("owner").id;
+
+    // Test 6.1: Concurrent uploads share commits and each caller gets its own note back
+    result.total++;
+    printTest("6.1 - 16 threads x 20 uploads through the queue");
+    {
+        GroupCommitQueue queue(db, 20, 64);
+        queue.start();
+
+        std::mutex idsMtx;
+        std::vector<std::pair<int, std::string>> saved;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 16; t++) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < 20; i++) {
+                    std::string filename = "t" + std::to_string(t) + "_" + std::to_string(i) + ".txt";
+                    int id = queue.saveNote(ownerId, NOTE_CONTENT, "key", "iv", filename);
+                    std::lock_guard<std::mutex> lock(idsMtx);
+                    saved.push_back({id, filename});
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        queue.stop();
+        auto stats = queue.stats();
+
+        std::set<int> unique;
+        bool matches = true;
+        for (const auto& entry : saved) {
+            unique.insert(entry.first);
+            NoteData note = db.getNoteById(entry.first);
+            matches = matches && note.note_id == entry.first && note.filename == entry.second;
+        }
+
+        if (saved.size() == 320 && unique.size() == 320 && !unique.count(-1) && matches &&
+            stats.notes == 320 && stats.batches < 320 && stats.largest_batch > 1 && stats.largest_batch <= 64) {
+            printPass(std::to_string(stats.batches) + " commits for 320 notes");
+            result.passed++;
+        } else {
+            printFail("unique=" + std::to_string(unique.size()) + " batches=" + std::to_string(stats.batches));
+        }
+    }
+
+    // Test 6.2: A stopped queue writes directly
+    result.total++;
+    printTest("6.2 - saveNote falls back to a direct write when stopped");
+    {
+        GroupCommitQueue queue(db, 0, 64);
+        int id = queue.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "direct.txt");
+        if (id != -1 && db.getNoteById(id).filename == "direct.txt" && queue.stats().batches == 0) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail();
+        }
+    }
+
+    // Test 6.3: A note whose content row fails leaves no metadata behind in the committed batch
+    result.total++;
+    printTest("6.3 - Content insert failing mid-batch: the rest commits, no orphan Notes row");
+    {
+        sqlite3* raw;
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, "CREATE TRIGGER fail_content BEFORE INSERT ON NoteContents "
+                          "WHEN NEW.wrapped_key = 'fail' BEGIN SELECT RAISE(ABORT, 'forced'); END",
+                     nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+
+        std::vector<Database::NewNote> batch = {{ownerId, NOTE_CONTENT, "key", "iv", "batch_a.txt"},
+                                                {ownerId, NOTE_CONTENT, "fail", "iv", "batch_b.txt"},
+                                                {ownerId, NOTE_CONTENT, "key", "iv", "batch_c.txt"}};
+        std::vector<int> ids = db.saveNotes(batch);
+        long long saved = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM Notes WHERE filename LIKE 'batch_%'");
+        long long orphans = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM Notes WHERE id NOT IN (SELECT note_id FROM NoteContents)");
+
+        if (ids.size() == 3 && ids[0] != -1 && ids[1] == -1 && ids[2] != -1 && saved == 2 && orphans == 0 &&
+            db.getNoteById(ids[2]).filename == "batch_c.txt") {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("saved=" + std::to_string(saved) + " orphans=" + std::to_string(orphans));
+        }
+    }
+
+    // Test 6.4: A batch whose write throws still answers every caller
+    result.total++;
+    printTest("6.4 - saveNotes throwing fails the batch instead of leaving callers waiting");
+    {
+        struct ThrowingStorage : MemoryStorage {
+            std::vector<int> saveNotes(const std::vector<NewNote>&) override {
+                throw std::runtime_error("forced");
+            }
+        };
+        ThrowingStorage storage;
+        GroupCommitQueue queue(storage, 5, 64);
+        queue.start();
+
+        std::vector<std::future<int>> results;
+        for (int i = 0; i < 4; i++) {
+            results.push_back(std::async(std::launch::async, [&queue] {
+                return queue.saveNote(1, NOTE_CONTENT, "key", "iv", "thrown.txt");
+            }));
+        }
+        int failed = 0;
+        for (auto& pending : results) {
+            if (pending.wait_for(std::chrono::seconds(5)) == std::future_status::ready && pending.get() == -1) {
+                failed++;
+            }
+        }
+        queue.stop();
+
+        if (failed == 4 && queue.stats().failed == 4) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("callers answered with -1: " + std::to_string(failed));
+        }
+    }
+
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nGroup Commit: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 7: CONTENT STORAGE
+// ============================================
+
+TestResult testContentStorage() {
+    printHeader("CATEGORY 7: CONTENT STORAGE");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    Database db(TEST_DB_PATH, 2);
+    db.init();
+    db.createUser("owner", "hash", "salt", "04");
+    int ownerId = db.getUserByUsername("owner").id;
+
+    // Test 7.1: Ciphertext round-trips as a BLOB of its decoded size, across chunk boundaries
+    result.total++;
+    printTest("7.1 - Content of 0 B .. 1 MB round-trips through blob I/O");
+    {
+        const int chunk = 48 * 1024;
+        std::vector<int> sizes = {0, 1, 2, 3, chunk - 1, chunk, chunk + 1, 3 * chunk + 2, 1024 * 1024 + 7};
+        std::string failures;
+        unsigned int seed = 12345;
+        for (int size : sizes) {
+            std::vector<unsigned char> bytes(size);
+            for (auto& b : bytes) {
+                seed = seed * 1103515245 + 12345;
+                b = static_cast<unsigned char>(seed >> 16);
+            }
+            std::string encoded = Crypto::base64Encode(bytes);
+
+            int id = db.saveNote(ownerId, encoded, "key", "iv", "blob.txt");
+            NoteData note = db.getNoteById(id);
+            std::string where = " WHERE note_id = " + std::to_string(id);
+            long long isBlob = queryInt(TEST_DB_PATH, "SELECT typeof(encrypted_content) = 'blob' FROM NoteContents" + where);
+            long long stored = queryInt(TEST_DB_PATH, "SELECT length(encrypted_content) FROM NoteContents" + where);
+
+            if (id == -1 || note.encrypted_content != encoded || isBlob != 1 || stored != size) {
+                failures += " " + std::to_string(size);
+            }
+        }
+        if (failures.empty()) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("sizes:" + failures);
+        }
+    }
+
+    // Test 7.2: Content that is not padded base64 is rejected without leaving a row behind
+    result.total++;
+    printTest("7.2 - Invalid base64 is rejected, the rest of a batch still commits");
+    {
+        long long before = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM Notes");
+        bool rejected = db.saveNote(ownerId, "content", "key", "iv", "bad.txt") == -1 &&
+                        db.saveNote(ownerId, "Y29udA=a", "key", "iv", "bad.txt") == -1 &&
+                        db.saveNote(ownerId, "Y29u\nZGVu", "key", "iv", "bad.txt") == -1;
+        auto ids = db.saveNotes({{ownerId, NOTE_CONTENT, "key", "iv", "ok1.txt"},
+                                 {ownerId, "not base64", "key", "iv", "bad.txt"},
+                                 {ownerId, NOTE_CONTENT, "key", "iv", "ok2.txt"}});
+        long long after = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM Notes");
+
+        if (rejected && ids.size() == 3 && ids[0] != -1 && ids[1] == -1 && ids[2] != -1 && after == before + 2 &&
+            db.getNoteById(ids[2]).encrypted_content == NOTE_CONTENT) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("rows added=" + std::to_string(after - before));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    // Test 7.3: Version 1 databases keep base64 TEXT inside Notes; it stays readable until the
+    // background backfill has turned it into BLOBs in NoteContents
+    result.total++;
+    printTest("7.3 - Schema version 1 TEXT content is readable at once and backfilled to BLOB");
+    {
+        std::string big = Crypto::base64Encode(std::vector<unsigned char>(100000, 0xAB));
+        sqlite3* raw;
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, LEGACY_SCHEMA, nullptr, nullptr, nullptr);
+        sqlite3_exec(raw, "PRAGMA user_version = 1;", nullptr, nullptr, nullptr);
+        sqlite3_stmt* insert;
+        sqlite3_prepare_v2(raw, "INSERT INTO Notes (user_id, encrypted_content, wrapped_key, iv_hex, created_at) "
+                                "VALUES (1, ?, 'key', 'iv', 100)", -1, &insert, nullptr);
+        for (int i = 0; i < 601; i++) {
+            const std::string& text = i == 0 ? big : (i == 1 ? std::string("not base64") : NOTE_CONTENT);
+            sqlite3_bind_text(insert, 1, text.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_step(insert);
+            sqlite3_reset(insert);
+        }
+        sqlite3_finalize(insert);
+        // The last id was handed out once, it must not come back after the rebuild
+        sqlite3_exec(raw, "DELETE FROM Notes WHERE id = 602;", nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+
+        Database db(TEST_DB_PATH, 1);
+        bool initOk = db.init();
+        long long version = queryInt(TEST_DB_PATH, "PRAGMA user_version");
+        long long textsAtStart = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM NoteContents WHERE typeof(encrypted_content) = 'text'");
+        long long hotColumns = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM pragma_table_info('Notes')");
+        long long listIndex = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'idx_notes_user_created_id'");
+        auto readsBack = [&] {
+            NoteData first = db.getNoteById(2);
+            NoteData note;
+            ContentStore::RangeData data;
+            ContentStore::ByteRange range;
+            range.offset = 1000;
+            range.length = 5000;
+            bool ranged = db.getNoteRangeForOwner(2, 1, range, note, data) == Storage::NoteAccess::Ok &&
+                          data.total_size == 100000 && data.offset == 1000 &&
+                          data.bytes == std::string(5000, static_cast<char>(0xAB));
+            return first.encrypted_content == big && first.wrapped_key == "key" && first.iv_hex == "iv" &&
+                   db.getNoteById(601).encrypted_content == NOTE_CONTENT && ranged;
+        };
+        bool readableAtStart = readsBack();
+
+        // 601 notes in batches of 256, then the one link token of the version 6 backfill
+        int steps = 0;
+        int rows;
+        while ((rows = db.backfillStep(256)) > 0) {
+            steps++;
+        }
+        long long blobs = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM NoteContents WHERE typeof(encrypted_content) = 'blob'");
+        long long texts = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM NoteContents WHERE typeof(encrypted_content) = 'text'");
+        long long keys = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM Settings WHERE name LIKE 'content_backfill%'");
+        int newId = db.saveNote(1, NOTE_CONTENT, "key", "iv", "new.txt");
+
+        if (initOk && version == 6 && textsAtStart == 601 && hotColumns == 4 && listIndex == 1 && readableAtStart &&
+            rows == 0 && steps == 4 && blobs == 600 && texts == 1 && keys == 0 && readsBack() && newId == 603) {
+            printPass(std::to_string(steps) + " backfill batches");
+            result.passed++;
+        } else {
+            printFail("version=" + std::to_string(version) + " texts at start=" + std::to_string(textsAtStart) +
+                      " steps=" + std::to_string(steps) + " blobs=" + std::to_string(blobs) +
+                      " texts=" + std::to_string(texts) + " columns=" + std::to_string(hotColumns) +
+                      " new id=" + std::to_string(newId));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    // Test 7.4: The contents row lives and dies with its note
+    result.total++;
+    printTest("7.4 - Deleting a note removes its NoteContents row");
+    {
+        Database db(TEST_DB_PATH, 1);
+        db.init();
+        db.createUser("owner", "hash", "salt", "04");
+        int ownerId = db.getUserByUsername("owner").id;
+        int kept = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "kept.txt");
+        int gone = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "gone.txt");
+        db.deleteNote(gone, ownerId);
+
+        std::string count = "SELECT COUNT(*) FROM NoteContents WHERE note_id = ";
+        if (queryInt(TEST_DB_PATH, count + std::to_string(kept)) == 1 &&
+            queryInt(TEST_DB_PATH, count + std::to_string(gone)) == 0) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail();
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nContent Storage: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 8: SEGMENT FILES
+// ============================================
+
+const std::string TEST_SEGMENT_DIR = "db_test.segments";
+
+// Base64 of `size` bytes that differ per note, so a mixed-up location shows
+std::string segmentTestContent(int note, int size) {
+    std::vector<unsigned char> bytes(size);
+    for (int i = 0; i < size; i++) {
+        bytes[i] = static_cast<unsigned char>(note * 31 + i);
+    }
+    return Crypto::base64Encode(bytes);
+}
+
+int countSegmentFiles() {
+    int files = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(TEST_SEGMENT_DIR, ec)) {
+        files += entry.path().extension() == ".seg" ? 1 : 0;
+    }
+    return files;
+}
+
+TestResult testSegmentFiles() {
+    printHeader("CATEGORY 8: SEGMENT FILES");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    std::filesystem::remove_all(TEST_SEGMENT_DIR);
+
+    // 1 KB inline limit, 64 KB segments, no grace period
+    auto openDatabase = [] {
+        return std::make_unique<Database>(TEST_DB_PATH, 2,
+            std::make_unique<SegmentContentStore>(TEST_SEGMENT_DIR, 1024, 64 * 1024, 0));
+    };
+
+    std::vector<std::pair<int, std::string>> notes;
+    int small = -1;
+    int ownerId = -1;
+
+    // Test 8.1: Large notes are appended to segment files, small ones stay in SQLite
+    result.total++;
+    printTest("8.1 - Notes from 1 KB go to segment files, smaller ones stay inline");
+    {
+        auto db = openDatabase();
+        db->init();
+        db->createUser("owner", "hash", "salt", "04");
+        ownerId = db->getUserByUsername("owner").id;
+
+        small = db->saveNote(ownerId, NOTE_CONTENT, "key", "iv", "small.txt");
+        for (int i = 0; i < 10; i++) {
+            std::string content = segmentTestContent(i, 10000);
+            notes.push_back({db->saveNote(ownerId, content, "key", "iv", "large.txt"), content});
+        }
+
+        bool roundTrip = db->getNoteById(small).encrypted_content == NOTE_CONTENT;
+        for (const auto& note : notes) {
+            NoteData read = db->getNoteById(note.first);
+            roundTrip = roundTrip && read.encrypted_content == note.second && read.wrapped_key == "key";
+        }
+        long long indexed = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM ContentSegments");
+        long long inlineBytes = queryInt(TEST_DB_PATH, "SELECT SUM(length(encrypted_content)) FROM NoteContents");
+        int files = countSegmentFiles();
+
+        if (roundTrip && indexed == 10 && inlineBytes == 7 && files == 2) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("indexed=" + std::to_string(indexed) + " inline bytes=" + std::to_string(inlineBytes) +
+                      " files=" + std::to_string(files));
+        }
+    }
+
+    // Test 8.2: Compaction moves the live notes out of a mostly dead segment and deletes it
+    result.total++;
+    printTest("8.2 - Compaction reclaims deleted notes and keeps the live ones");
+    {
+        auto db = openDatabase();
+        db->init();
+
+        // The first segment held notes 0-5; keep only note 1
+        std::vector<int> doomed;
+        for (int i : {0, 2, 3, 4, 5, 7}) {
+            doomed.push_back(notes[i].first);
+        }
+        db->deleteNotes(ownerId, doomed);
+        auto before = db->contentUsage();
+
+        auto first = db->compactContent(0.5);
+        auto second = db->compactContent(0.5);
+        auto after = db->contentUsage();
+
+        bool intact = true;
+        for (int i : {1, 6, 8, 9}) {
+            intact = intact && db->getNoteById(notes[i].first).encrypted_content == notes[i].second;
+        }
+
+        // The reopen sealed segments 1 and 2; only segment 1 is at least half dead,
+        // so note 1 moves to the new active segment and segment 2 stays as is
+        if (intact && first.segments_compacted == 1 && second.segments_removed == 1 &&
+            after.live_bytes == 40000 && after.file_bytes == 50000 && before.file_bytes == 100000) {
+            printPass(std::to_string(second.bytes_reclaimed) + " bytes reclaimed");
+            result.passed++;
+        } else {
+            printFail("compacted=" + std::to_string(first.segments_compacted) +
+                      " removed=" + std::to_string(second.segments_removed) +
+                      " file bytes " + std::to_string(before.file_bytes) + " -> " + std::to_string(after.file_bytes));
+        }
+    }
+
+    // Test 8.3: A reopened store keeps reading old segments and appends to a new one
+    result.total++;
+    printTest("8.3 - Reopened store reads existing segments, appends to a new one");
+    {
+        auto db = openDatabase();
+        db->init();
+        std::string content = segmentTestContent(42, 5000);
+        int id = db->saveNote(ownerId, content, "key", "iv", "late.txt");
+        long long segment = queryInt(TEST_DB_PATH, "SELECT segment_id FROM ContentSegments WHERE note_id = " + std::to_string(id));
+        long long newest = queryInt(TEST_DB_PATH, "SELECT MAX(segment_id) FROM ContentSegments WHERE note_id <> " + std::to_string(id));
+
+        if (db->getNoteById(notes[9].first).encrypted_content == notes[9].second &&
+            db->getNoteById(id).encrypted_content == content && segment > newest) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("segment=" + std::to_string(segment) + " previous=" + std::to_string(newest));
+        }
+    }
+
+    // Test 8.4: An append pulling a slow source does not hold up other appends, and the
+    // segment it writes to is not compacted while its transaction is open
+    result.total++;
+    printTest("8.4 - Appends run side by side; a segment with open writes is not compacted");
+    {
+        int slowNote;
+        int fastNote;
+        {
+            auto db = openDatabase();
+            db->init();
+            slowNote = db->saveNote(ownerId, NOTE_CONTENT, "key", "iv", "slow.bin");
+            fastNote = db->saveNote(ownerId, NOTE_CONTENT, "key", "iv", "fast.bin");
+        }
+        std::string dir = TEST_SEGMENT_DIR + ".direct";
+        std::filesystem::remove_all(dir);
+        SegmentContentStore store(dir, 1024, 64 * 1024, 0);
+        store.open();
+        ConnectionPool pool(TEST_DB_PATH, 2, 5000);
+        auto slowConn = pool.acquire();
+        auto fastConn = pool.acquire();
+
+        // Two chunks; the second one waits until the test lets it go
+        std::string slowBytes(2 * ContentStore::CHUNK_BYTES, 's');
+        std::promise<void> firstChunk;
+        std::promise<void> release;
+        std::future<void> released = release.get_future();
+        int pulled = 0;
+        ContentStore::ChunkSource slowSource = [&](std::vector<unsigned char>& chunk) {
+            if (pulled++ == 0) {
+                firstChunk.set_value();
+            } else {
+                released.wait();
+            }
+            chunk.assign(ContentStore::CHUNK_BYTES, 's');
+            return true;
+        };
+        auto slow = std::async(std::launch::async, [&] {
+            return store.writeChunks(*slowConn, slowNote, static_cast<long long>(slowBytes.size()), slowSource);
+        });
+        firstChunk.get_future().wait();
+
+        // The first segment is full, so this seals it and goes to the next one
+        std::string fastBytes(ContentStore::CHUNK_BYTES, 'f');
+        auto fast = std::async(std::launch::async, [&] {
+            return store.writeChunks(*fastConn, fastNote, static_cast<long long>(fastBytes.size()),
+                                     ContentStore::bytesSource(fastBytes));
+        });
+        bool fastDone = fast.wait_for(std::chrono::seconds(5)) == std::future_status::ready && fast.get();
+        store.transactionEnded(*fastConn);
+        auto whileOpen = store.compact(*fastConn, 0.5);
+
+        release.set_value();
+        bool slowDone = slow.get();
+        store.transactionEnded(*slowConn);
+        auto afterwards = store.compact(*fastConn, 0.5);
+
+        std::string slowRead;
+        std::string fastRead;
+        bool intact = store.read(*fastConn, slowNote, slowRead) && store.read(*fastConn, fastNote, fastRead) &&
+                      slowRead == Crypto::base64Encode(std::vector<unsigned char>(slowBytes.begin(), slowBytes.end())) &&
+                      fastRead == Crypto::base64Encode(std::vector<unsigned char>(fastBytes.begin(), fastBytes.end()));
+
+        if (fastDone && slowDone && whileOpen.segments_compacted == 0 && afterwards.segments_removed == 0 && intact) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail(std::string("fast append ") + (fastDone ? "finished" : "waited") +
+                      ", compacted while open=" + std::to_string(whileOpen.segments_compacted) +
+                      (intact ? "" : ", contents lost"));
+        }
+        std::filesystem::remove_all(dir);
+    }
+
+    removeDatabase(TEST_DB_PATH);
+    std::filesystem::remove_all(TEST_SEGMENT_DIR);
+
+    std::cout << "\nSegment Files: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 9: STORAGE ENGINES
+// ============================================
+
+// The behaviour the server relies on, run against any Storage. Returns what went
+// wrong, or an empty string.
+std::string checkStorageContract(Storage& storage) {
+    if (!storage.init()) {
+        return "init failed";
+    }
+
+    if (!storage.createUser("alice", "hash", "salt", "04a") || !storage.createUser("bob", "hash", "salt", "04b") ||
+        storage.createUser("alice", "hash", "salt", "04c")) {
+        return "createUser did not reject exactly the duplicate";
+    }
+    int alice = storage.getUserByUsername("alice").id;
+    int bob = storage.getUserByUsername("bob").id;
+    storage.updateUserPublicKey(bob, "04bb");
+    if (alice == -1 || bob == -1 || storage.getUserByUsername("bob").receive_public_key_hex != "04bb" ||
+        storage.getUserByUsername("carol").id != -1) {
+        return "user lookup";
+    }
+
+    int first = storage.saveNote(alice, NOTE_CONTENT, "key1", "iv1", "a.txt");
+    auto batch = storage.saveNotes({{alice, NOTE_CONTENT, "key2", "iv2", "b.txt"},
+                                    {alice, "not base64!", "key", "iv", "bad.txt"},
+                                    {alice, NOTE_CONTENT, "key3", "iv3", "c.txt"}});
+    if (first == -1 || batch.size() != 3 || batch[0] == -1 || batch[1] != -1 || batch[2] == -1 ||
+        storage.saveNote(alice, "%%%", "key", "iv", "bad.txt") != -1) {
+        return "saveNote/saveNotes did not reject exactly the invalid base64";
+    }
+    int second = batch[0];
+    int third = batch[2];
+
+    NoteData note;
+    if (storage.getNoteForOwner(first, alice, note) != Storage::NoteAccess::Ok ||
+        note.encrypted_content != NOTE_CONTENT || note.wrapped_key != "key1" || note.filename != "a.txt" ||
+        storage.getNoteForOwner(first, bob, note) != Storage::NoteAccess::Forbidden ||
+        storage.getNoteForOwner(third + 100, alice, note) != Storage::NoteAccess::NotFound ||
+        storage.getNoteById(second).iv_hex != "iv2") {
+        return "note reads";
+    }
+
+    auto page = storage.listNotes(alice, Storage::NoteCursor(), 2);
+    if (page.notes.size() != 2 || !page.has_more || page.notes[0].note_id != third) {
+        return "first page of listNotes";
+    }
+    Storage::NoteCursor cursor;
+    cursor.created_at = page.notes.back().created_at;
+    cursor.note_id = page.notes.back().note_id;
+    page = storage.listNotes(alice, cursor, 2);
+    if (page.notes.size() != 1 || page.has_more || page.notes[0].note_id != first) {
+        return "second page of listNotes";
+    }
+
+    std::string token = storage.createShareLink(first, alice, {{"bob", "send", "wrapped"}}, 3600);
+    auto linkData = storage.getShareLinkData(token, "bob");
+    if (token.empty() || !linkData.valid || linkData.encrypted_content != NOTE_CONTENT ||
+        linkData.wrapped_key != "wrapped" || linkData.iv_hex != "iv1" ||
+        storage.getShareLinkData(token, "alice").valid || storage.deleteShareLink(token, bob)) {
+        return "share link access";
+    }
+
+    if (!storage.createUserShare(second, alice, bob, "send", "rewrapped", 3600)) {
+        return "createUserShare";
+    }
+    auto shared = storage.getSharedNotesForUser(bob);
+    auto info = shared.size() == 1 ? storage.getShareInfo(shared[0], bob) : Storage::ShareInfo{-1, "", "", "", ""};
+    if (info.note_id != second || info.new_wrapped_key != "rewrapped" || info.iv_hex != "iv2" ||
+        info.encrypted_content != NOTE_CONTENT || storage.getShareInfo(shared[0], alice).note_id != -1) {
+        return "user share access";
+    }
+
+    storage.createShareLink(third, alice, {{"bob", "send", "w"}, {"ann", "send", "w"}}, -10);
+    auto outgoing = storage.listOutgoingShares(alice, Storage::ShareCursor(), 10, false);
+    auto active = storage.listOutgoingShares(alice, Storage::ShareCursor(), 10, true);
+    if (outgoing.shares.size() != 2 || outgoing.shares[0].token != token ||
+        outgoing.shares[1].shared_with != std::vector<std::string>{"ann", "bob"} || active.shares.size() != 1) {
+        return "listOutgoingShares";
+    }
+
+    long now = static_cast<long>(std::time(nullptr));
+    if (storage.countExpiredLinks(now) != 1 || storage.deleteExpiredLinks(now, 10) != 1 ||
+        storage.countExpiredLinks(now) != 0 || storage.countExpiredUserShares(now) != 0) {
+        return "expiry sweep";
+    }
+
+    // Deleting the notes takes their link and user share with them
+    if (storage.deleteNote(first, bob) || !storage.deleteNote(first, alice) ||
+        storage.getShareLinkData(token, "bob").valid ||
+        !storage.listOutgoingShares(alice, Storage::ShareCursor(), 10, false).shares.empty()) {
+        return "deleteNote cascade";
+    }
+    auto deleted = storage.deleteNotes(alice, {second, third, third + 100});
+    if (deleted != std::vector<int>{second, third} || !storage.getSharedNotesForUser(bob).empty() ||
+        !storage.listNotes(alice, Storage::NoteCursor(), 10).notes.empty()) {
+        return "deleteNotes cascade";
+    }
+    return "";
+}
+
+TestResult testStorageEngines() {
+    printHeader("CATEGORY 9: STORAGE ENGINES");
+    TestResult result;
+
+    // Test 9.1 / 9.2: Both engines behave the same
+    removeDatabase(TEST_DB_PATH);
+    {
+        Database sqlite(TEST_DB_PATH, 2);
+        MemoryStorage memory;
+        std::pair<const char*, Storage*> engines[] = {{"9.1 - SQLite engine", &sqlite},
+                                                      {"9.2 - In-memory engine", &memory}};
+        for (const auto& engine : engines) {
+            result.total++;
+            printTest(std::string(engine.first) + " passes the storage contract");
+            std::string failure = checkStorageContract(*engine.second);
+            if (failure.empty()) {
+                printPass();
+                result.passed++;
+            } else {
+                printFail(failure);
+            }
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    // Test 9.3: Concurrent writers on the in-memory engine
+    result.total++;
+    printTest("9.3 - In-memory engine under 8 concurrent users");
+    {
+        MemoryStorage memory(4);  // Few stripes, so threads share them
+        memory.init();
+
+        const int threads = 8;
+        const int notesPerThread = 300;
+        std::vector<std::vector<int>> ids(threads);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&memory, &ids, t] {
+                std::string name = "user" + std::to_string(t);
+                memory.createUser(name, "hash", "salt", "04");
+                int userId = memory.getUserByUsername(name).id;
+                for (int i = 0; i < notesPerThread; i++) {
+                    int id = memory.saveNote(userId, NOTE_CONTENT, "key", "iv", "n.txt");
+                    ids[t].push_back(id);
+                    memory.createShareLink(id, userId, {{"user0", "send", "w"}}, 3600);
+                    if (i % 2 == 0) {
+                        memory.deleteNote(id, userId);
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        std::set<int> unique;
+        size_t listed = 0;
+        size_t links = 0;
+        for (int t = 0; t < threads; t++) {
+            unique.insert(ids[t].begin(), ids[t].end());
+            int userId = memory.getUserByUsername("user" + std::to_string(t)).id;
+            listed += memory.listNotes(userId, Storage::NoteCursor(), notesPerThread).notes.size();
+            links += memory.listOutgoingShares(userId, Storage::ShareCursor(), notesPerThread, false).shares.size();
+        }
+
+        size_t expected = threads * notesPerThread / 2;
+        if (unique.size() == static_cast<size_t>(threads * notesPerThread) && !unique.count(-1) &&
+            listed == expected && links == expected) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("unique ids=" + std::to_string(unique.size()) + " listed=" + std::to_string(listed) +
+                      " links=" + std::to_string(links));
+        }
+    }
+
+    std::cout << "\nStorage Engines: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 10: SHARDED STORAGE
+// ============================================
+
+void removeShardedDatabase(int shards) {
+    removeDatabase(TEST_DB_PATH);
+    for (int shard = 0; shard < shards; shard++) {
+        removeDatabase(ShardedStorage::shardPath(TEST_DB_PATH, shard));
+    }
+}
+
+TestResult testShardedStorage() {
+    printHeader("CATEGORY 10: SHARDED STORAGE");
+    TestResult result;
+
+    const int shards = 4;
+    removeShardedDatabase(shards);
+
+    // Test 10.1: Same contract as the single-file engines
+    result.total++;
+    printTest("10.1 - Sharded engine (4 shards) passes the storage contract");
+    {
+        ShardedStorage storage(TEST_DB_PATH, shards, 2);
+        std::string failure = checkStorageContract(storage);
+        if (failure.empty()) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail(failure);
+        }
+    }
+    removeShardedDatabase(shards);
+
+    // Test 10.2: Shares across shards
+    result.total++;
+    printTest("10.2 - Links and user shares reach a recipient on another shard");
+    {
+        ShardedStorage storage(TEST_DB_PATH, shards, 2);
+        storage.init();
+        storage.createUser("owner", "hash", "salt", "04");
+        storage.createUser("reader", "hash", "salt", "04");
+        int owner = storage.getUserByUsername("owner").id;
+        int reader = storage.getUserByUsername("reader").id;
+
+        int noteId = storage.saveNote(owner, NOTE_CONTENT, "key", "iv", "shared.txt");
+        std::string token = storage.createShareLink(noteId, owner, {{"reader", "send", "wrapped"}}, 3600);
+        bool userShare = storage.createUserShare(noteId, owner, reader, "send", "rewrapped", 3600);
+
+        auto link = storage.getShareLinkData(token, "reader");
+        auto received = storage.getSharedNotesForUser(reader);
+        auto info = received.size() == 1 ? storage.getShareInfo(received[0], reader) : Storage::ShareInfo{-1, "", "", "", ""};
+        bool apart = storage.shardOfUser(owner) != storage.shardOfUser(reader) &&
+                     noteId % shards == storage.shardOfUser(owner);
+
+        storage.deleteNote(noteId, owner);
+        bool cascaded = !storage.getShareLinkData(token, "reader").valid && storage.getSharedNotesForUser(reader).empty();
+
+        if (apart && userShare && link.valid && link.note_id == noteId && link.encrypted_content == NOTE_CONTENT &&
+            info.note_id == noteId && info.encrypted_content == NOTE_CONTENT && cascaded) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("apart=" + std::to_string(apart) + " link=" + std::to_string(link.valid) +
+                      " share note=" + std::to_string(info.note_id) + " cascaded=" + std::to_string(cascaded));
+        }
+    }
+    removeShardedDatabase(shards);
+
+    // Test 10.3: A group commit batch is split by shard and the ids still line up
+    result.total++;
+    printTest("10.3 - saveNotes batch over 8 users returns the right global ids");
+    {
+        ShardedStorage storage(TEST_DB_PATH, shards, 2);
+        storage.init();
+        std::vector<Storage::NewNote> batch;
+        for (int u = 0; u < 8; u++) {
+            std::string name = "user" + std::to_string(u);
+            storage.createUser(name, "hash", "salt", "04");
+            int userId = storage.getUserByUsername(name).id;
+            for (int i = 0; i < 5; i++) {
+                batch.push_back({userId, NOTE_CONTENT, "key", "iv", name + "-" + std::to_string(i) + ".txt"});
+            }
+        }
+        auto ids = storage.saveNotes(batch);
+
+        bool matches = ids.size() == batch.size();
+        for (size_t i = 0; matches && i < ids.size(); i++) {
+            NoteData note;
+            matches = storage.getNoteForOwner(ids[i], batch[i].user_id, note) == Storage::NoteAccess::Ok &&
+                      note.filename == batch[i].filename && note.note_id == ids[i];
+        }
+        std::set<int> unique(ids.begin(), ids.end());
+
+        if (matches && unique.size() == batch.size()) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("batch ids do not match their notes");
+        }
+    }
+
+    // Test 10.4: The shard layout is fixed once created
+    result.total++;
+    printTest("10.4 - Reopening with another shard count is refused");
+    {
+        ShardedStorage other(TEST_DB_PATH, shards + 1, 1);
+        ShardedStorage same(TEST_DB_PATH, shards, 1);
+        bool refused = !other.init();
+        bool reopened = same.init() && same.getUserByUsername("user3").id != -1;
+        removeDatabase(ShardedStorage::shardPath(TEST_DB_PATH, shards));
+
+        if (refused && reopened) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("refused=" + std::to_string(refused) + " reopened=" + std::to_string(reopened));
+        }
+    }
+    removeShardedDatabase(shards);
+
+    // Test 10.5: A stub that fails during register is added before the next write
+    result.total++;
+    printTest("10.5 - Failed shard stub at register is repaired before the next upload");
+    {
+        ShardedStorage storage(TEST_DB_PATH, shards, 2);
+        storage.init();
+        storage.createUser("first", "hash", "salt", "04");
+        int first = storage.getUserByUsername("first").id;
+        // The next user id lands on this shard
+        std::string shardFile = ShardedStorage::shardPath(TEST_DB_PATH, storage.shardOfUser(first + 1));
+        execSql(shardFile, "CREATE TRIGGER fail_stub BEFORE INSERT ON Users "
+                           "WHEN NEW.username = 'carol' BEGIN SELECT RAISE(ABORT, 'forced'); END");
+
+        bool registered = storage.createUser("carol", "hash", "salt", "04");
+        int carol = storage.getUserByUsername("carol").id;
+        bool blocked = storage.saveNote(carol, NOTE_CONTENT, "key", "iv", "blocked.txt") == -1;
+        execSql(shardFile, "DROP TRIGGER fail_stub");
+        int noteId = storage.saveNote(carol, NOTE_CONTENT, "key", "iv", "repaired.txt");
+        long long stubs = queryInt(shardFile, "SELECT COUNT(*) FROM Users WHERE username = 'carol'");
+
+        if (registered && carol == first + 1 && blocked && noteId != -1 && stubs == 1) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("registered=" + std::to_string(registered) + " blocked=" + std::to_string(blocked) +
+                      " note=" + std::to_string(noteId) + " stubs=" + std::to_string(stubs));
+        }
+    }
+    removeShardedDatabase(shards);
+
+    // Test 10.6: A crash between the directory row and the stubs is repaired at start
+    result.total++;
+    printTest("10.6 - Users missing from a shard after a crash are added by init()");
+    {
+        int dave = -1;
+        {
+            ShardedStorage storage(TEST_DB_PATH, shards, 1);
+            storage.init();
+            storage.createUser("dave", "hash", "salt", "04");
+            dave = storage.getUserByUsername("dave").id;
+        }
+        for (int shard = 1; shard < shards; shard++) {
+            execSql(ShardedStorage::shardPath(TEST_DB_PATH, shard), "DELETE FROM Users");
+        }
+
+        ShardedStorage reopened(TEST_DB_PATH, shards, 1);
+        bool started = reopened.init();
+        long long missing = 0;
+        for (int shard = 0; shard < shards; shard++) {
+            missing += 1 - queryInt(ShardedStorage::shardPath(TEST_DB_PATH, shard),
+                                    "SELECT COUNT(*) FROM Users WHERE id = " + std::to_string(dave));
+        }
+        int noteId = reopened.saveNote(dave, NOTE_CONTENT, "key", "iv", "after_crash.txt");
+
+        if (started && missing == 0 && noteId != -1) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("started=" + std::to_string(started) + " missing=" + std::to_string(missing));
+        }
+    }
+    removeShardedDatabase(shards);
+
+    std::cout << "\nSharded Storage: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 11: USER CACHE
+// ============================================
+
+TestResult testUserCache() {
+    printHeader("CATEGORY 11: USER CACHE");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    Database db(TEST_DB_PATH, 2);
+    db.init();
+    db.createUser("alice", "hash", "salt", "04aa");
+
+    // Test 11.1: Repeated lookups are served from the cache
+    result.total++;
+    printTest("11.1 - Repeated getUserByUsername hits the cache");
+    {
+        CacheStats before = db.userCacheStats();
+        UserRecord first = db.getUserByUsername("alice");
+        bool same = true;
+        for (int i = 0; i < 100; i++) {
+            UserRecord again = db.getUserByUsername("alice");
+            same = same && again.id == first.id && again.password_hash == "hash" && again.receive_public_key_hex == "04aa";
+        }
+        db.getUserByUsername("nobody");
+        db.getUserByUsername("nobody");
+        CacheStats after = db.userCacheStats();
+
+        // Unknown names are never cached
+        if (same && after.hits - before.hits == 100 && after.misses - before.misses == 3 && after.entries == 1) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("hits=" + std::to_string(after.hits - before.hits) +
+                      " misses=" + std::to_string(after.misses - before.misses));
+        }
+    }
+
+    // Test 11.2: Writes invalidate
+    result.total++;
+    printTest("11.2 - updateUserPublicKey and createUser invalidate the cached record");
+    {
+        int aliceId = db.getUserByUsername("alice").id;
+        db.updateUserPublicKey(aliceId, "04bb");
+        bool updated = db.getUserByUsername("alice").receive_public_key_hex == "04bb";
+
+        bool missing = db.getUserByUsername("bob").id == -1;
+        db.createUser("bob", "hash", "salt", "04cc");
+        bool created = db.getUserByUsername("bob").receive_public_key_hex == "04cc";
+
+        if (updated && missing && created) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("updated=" + std::to_string(updated) + " created=" + std::to_string(created));
+        }
+    }
+
+    // Test 11.3: LRU order, capacity and the load/invalidate race
+    result.total++;
+    printTest("11.3 - LruCache evicts the least recently used, drops stale loads");
+    {
+        LruCache<int, std::string> cache(3, 1);
+        for (int key = 1; key <= 3; key++) {
+            cache.put(key, "v" + std::to_string(key), cache.generation(key));
+        }
+        std::string value;
+        cache.get(1, value);                        // 2 is now the oldest
+        cache.put(4, "v4", cache.generation(4));    // Evicts 2
+        bool lru = cache.get(1, value) && !cache.get(2, value) && cache.get(3, value) && cache.get(4, value);
+
+        uint64_t loadedAt = cache.generation(5);
+        cache.invalidate(5);                        // A write lands while 5 is being loaded
+        cache.put(5, "stale", loadedAt);
+        bool dropped = !cache.get(5, value);
+
+        CacheStats stats = cache.stats();
+        if (lru && dropped && stats.evictions == 1 && stats.entries == 3) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("lru=" + std::to_string(lru) + " dropped=" + std::to_string(dropped) +
+                      " evictions=" + std::to_string(stats.evictions));
+        }
+    }
+
+    // Test 11.4: Concurrent readers and a writer
+    result.total++;
+    printTest("11.4 - 8 readers see only whole records while the key changes");
+    {
+        for (int u = 0; u < 50; u++) {
+            db.createUser("user" + std::to_string(u), "hash", "salt", "04");
+        }
+        int aliceId = db.getUserByUsername("alice").id;
+
+        std::atomic<bool> stop{false};
+        std::atomic<int> bad{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 8; t++) {
+            readers.emplace_back([&db, &stop, &bad, t] {
+                for (int i = 0; !stop.load(); i++) {
+                    UserRecord user = db.getUserByUsername("user" + std::to_string((i + t) % 50));
+                    UserRecord alice = db.getUserByUsername("alice");
+                    if (user.id == -1 || alice.receive_public_key_hex.rfind("04", 0) != 0) {
+                        bad++;
+                    }
+                }
+            });
+        }
+        for (int k = 0; k < 200; k++) {
+            db.updateUserPublicKey(aliceId, "04" + std::to_string(k));
+        }
+        stop = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        // After the last update every lookup sees the final key
+        if (bad == 0 && db.getUserByUsername("alice").receive_public_key_hex == "04199") {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("bad reads=" + std::to_string(bad.load()) + " final=" +
+                      db.getUserByUsername("alice").receive_public_key_hex);
+        }
+    }
+
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nUser Cache: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 12: SHARE LINK CACHE
+// ============================================
+
+TestResult testLinkCache() {
+    printHeader("CATEGORY 12: SHARE LINK CACHE");
+    TestResult result;
+
+    removeDatabase(TEST_DB_PATH);
+    Database db(TEST_DB_PATH, 2);
+    db.init();
+    db.createUser("owner", "hash", "salt", "04");
+    int ownerId = db.getUserByUsername("owner").id;
+
+    // Test 12.1: A popular link is resolved once
+    result.total++;
+    printTest("12.1 - Repeated accesses hit the cache, each user gets their own key");
+    {
+        int noteId = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "popular.txt");
+        std::vector<Database::UserAccessEntry> whitelist;
+        for (int u = 0; u < 20; u++) {
+            whitelist.push_back({"reader" + std::to_string(u), "send", "wrapped" + std::to_string(u)});
+        }
+        std::string token = db.createShareLink(noteId, ownerId, whitelist, 3600);
+
+        CacheStats before = db.linkCacheStats();
+        bool ok = true;
+        for (int round = 0; round < 5; round++) {
+            for (int u = 0; u < 20; u++) {
+                auto data = db.getShareLinkData(token, "reader" + std::to_string(u));
+                ok = ok && data.valid && data.note_id == noteId && data.encrypted_content == NOTE_CONTENT &&
+                     data.wrapped_key == "wrapped" + std::to_string(u) && data.iv_hex == "iv" &&
+                     data.filename == "popular.txt";
+            }
+        }
+        // The whitelist still applies on a cache hit
+        bool denied = !db.getShareLinkData(token, "stranger").valid;
+        CacheStats after = db.linkCacheStats();
+
+        if (ok && denied && after.misses - before.misses == 1 && after.hits - before.hits == 100) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("ok=" + std::to_string(ok) + " denied=" + std::to_string(denied) +
+                      " hits=" + std::to_string(after.hits - before.hits) +
+                      " misses=" + std::to_string(after.misses - before.misses));
+        }
+    }
+
+    // Test 12.2: Deleting the link
+    result.total++;
+    printTest("12.2 - deleteShareLink drops the cached link");
+    {
+        int noteId = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "revoked.txt");
+        std::string token = db.createShareLink(noteId, ownerId, {{"reader", "send", "wrapped"}}, 3600);
+        bool before = db.getShareLinkData(token, "reader").valid;
+        bool deleted = db.deleteShareLink(token, ownerId);
+        bool after = db.getShareLinkData(token, "reader").valid;
+
+        if (before && deleted && !after) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("before=" + std::to_string(before) + " after=" + std::to_string(after));
+        }
+    }
+
+    // Test 12.3: Deleting the note (links go by cascade)
+    result.total++;
+    printTest("12.3 - deleteNote and deleteNotes drop the links of the note");
+    {
+        int single = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "single.txt");
+        int batched = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "batched.txt");
+        std::string first = db.createShareLink(single, ownerId, {{"reader", "send", "wrapped"}}, 3600);
+        std::string second = db.createShareLink(single, ownerId, {{"reader", "send", "wrapped"}}, 3600);
+        std::string third = db.createShareLink(batched, ownerId, {{"reader", "send", "wrapped"}}, 3600);
+        bool warm = db.getShareLinkData(first, "reader").valid && db.getShareLinkData(second, "reader").valid &&
+                    db.getShareLinkData(third, "reader").valid;
+
+        CacheStats before = db.linkCacheStats();
+        db.deleteNote(single, ownerId);
+        db.deleteNotes(ownerId, {batched});
+        CacheStats after = db.linkCacheStats();
+
+        bool gone = !db.getShareLinkData(first, "reader").valid && !db.getShareLinkData(second, "reader").valid &&
+                    !db.getShareLinkData(third, "reader").valid;
+        if (warm && gone && after.invalidations - before.invalidations == 3 && after.entries + 3 == before.entries) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("warm=" + std::to_string(warm) + " gone=" + std::to_string(gone) +
+                      " invalidations=" + std::to_string(after.invalidations - before.invalidations));
+        }
+    }
+
+    // Test 12.4: Expiry, whether or not the link is cached
+    result.total++;
+    printTest("12.4 - Expired links are refused and deleted, cached or not");
+    {
+        int noteId = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "expiring.txt");
+        std::string stale = db.createShareLink(noteId, ownerId, {{"reader", "send", "wrapped"}}, -10);
+        bool staleRefused = !db.getShareLinkData(stale, "reader").valid;
+
+        std::string shortLived = db.createShareLink(noteId, ownerId, {{"reader", "send", "wrapped"}}, 1);
+        bool openBefore = db.getShareLinkData(shortLived, "reader").valid;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+        bool refusedAfter = !db.getShareLinkData(shortLived, "reader").valid;
+
+        long long remaining = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks WHERE note_id = " +
+                                                     std::to_string(noteId));
+        if (staleRefused && openBefore && refusedAfter && remaining == 0) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("stale=" + std::to_string(staleRefused) + " open=" + std::to_string(openBefore) +
+                      " refused=" + std::to_string(refusedAfter) + " remaining=" + std::to_string(remaining));
+        }
+    }
+
+    removeDatabase(TEST_DB_PATH);
+
+    // Test 12.5: Sharded engine (cached routes, per-shard link caches)
+    result.total++;
+    printTest("12.5 - Sharded engine serves and revokes cached links");
+    {
+        const int shards = 2;
+        removeShardedDatabase(shards);
+        ShardedStorage storage(TEST_DB_PATH, shards, 2);
+        storage.init();
+        storage.createUser("owner", "hash", "salt", "04");
+        int owner = storage.getUserByUsername("owner").id;
+        int noteId = storage.saveNote(owner, NOTE_CONTENT, "key", "iv", "sharded.txt");
+        std::string token = storage.createShareLink(noteId, owner, {{"reader", "send", "wrapped"}}, 3600);
+
+        bool served = true;
+        for (int i = 0; i < 10; i++) {
+            auto data = storage.getShareLinkData(token, "reader");
+            served = served && data.valid && data.note_id == noteId;
+        }
+        CacheStats stats = storage.linkCacheStats();
+        bool revoked = storage.deleteShareLink(token, owner) && !storage.getShareLinkData(token, "reader").valid;
+
+        if (served && revoked && stats.hits == 9 && stats.misses == 1) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("served=" + std::to_string(served) + " revoked=" + std::to_string(revoked) +
+                      " hits=" + std::to_string(stats.hits));
+        }
+    }
+    removeShardedDatabase(2);
+
+    std::cout << "\nShare Link Cache: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 13: BINARY SHARE TOKENS
+// ============================================
+
+TestResult testShareTokens() {
+    printHeader("CATEGORY 13: BINARY SHARE TOKENS");
+    TestResult result;
+
+    // Test 13.1: Tokens are 32 raw bytes, stored as BLOBs, 43 URL-safe characters in links
+    result.total++;
+    printTest("13.1 - New tokens are 32-byte BLOBs with a 43-character base64url form");
+    {
+        removeDatabase(TEST_DB_PATH);
+        Database db(TEST_DB_PATH, 1);
+        db.init();
+        db.createUser("owner", "hash", "salt", "04");
+        int ownerId = db.getUserByUsername("owner").id;
+        int noteId = db.saveNote(ownerId, NOTE_CONTENT, "key", "iv", "a.txt");
+
+        bool encodingOk = true;
+        for (int i = 0; i < 200; i++) {
+            std::string token = db.createShareLink(noteId, ownerId, {{"reader", "send", "wrapped"}}, 3600);
+            std::vector<unsigned char> bytes(token.begin(), token.end());
+            std::string text = Crypto::base64UrlEncode(bytes);
+            encodingOk = encodingOk && token.size() == 32 && text.size() == 43 &&
+                         text.find_first_of("+/=") == std::string::npos &&
+                         Crypto::base64UrlDecode(text) == bytes;
+        }
+        // Malformed input decodes to nothing
+        bool rejects = Crypto::base64UrlDecode("").empty() && Crypto::base64UrlDecode("abcde").empty() &&
+                       Crypto::base64UrlDecode("ab+/").empty() && Crypto::base64UrlDecode("a=bc").empty();
+        long long blobs = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks WHERE typeof(token) = 'blob' AND length(token) = 32");
+
+        if (encodingOk && rejects && blobs == 200) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("encoding=" + std::to_string(encodingOk) + " rejects=" + std::to_string(rejects) +
+                      " blobs=" + std::to_string(blobs));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    // Test 13.2: Version 5 hex tokens are converted after startup and old links open throughout
+    result.total++;
+    printTest("13.2 - Schema version 5 hex tokens are backfilled to BLOB, old links resolve meanwhile");
+    {
+        std::string hex = std::string(32, 'a') + std::string(32, 'f');
+        {
+            Database db(TEST_DB_PATH, 1);
+            db.init();
+            db.createUser("owner", "hash", "salt", "04");
+            db.saveNote(1, NOTE_CONTENT, "key", "iv", "old.txt");
+        }
+        sqlite3* raw;
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        std::string legacy =
+            "INSERT INTO SharedLinks (token, note_id, owner_id, expiration_time) VALUES ('" + hex + "', 1, 1, 9999999999);"
+            "INSERT INTO SharedLinkAccess (link_id, username, send_public_key_hex, wrapped_key) VALUES (1, 'reader', 'send', 'wrapped');"
+            "INSERT INTO SharedLinks (token, note_id, owner_id, expiration_time) VALUES ('not-hex', 1, 1, 9999999999);"
+            "INSERT INTO LinkRoutes (token, shard, expiration_time) VALUES ('" + hex + "', 3, 9999999999);"
+            "PRAGMA user_version = 5;";
+        sqlite3_exec(raw, legacy.c_str(), nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+
+        Database db(TEST_DB_PATH, 1);
+        bool initOk = db.init();
+        long long version = queryInt(TEST_DB_PATH, "PRAGMA user_version");
+        long long blobsAtStart = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks WHERE typeof(token) = 'blob'");
+
+        std::vector<unsigned char> bytes = Crypto::fromHex(hex);
+        std::string token(bytes.begin(), bytes.end());
+        bool opensBefore = db.getShareLinkData(token, "reader").valid && db.findLinkRoute(token) == 3;
+
+        int batches = 0;
+        while (db.backfillStep(1) > 0) {
+            batches++;
+        }
+        long long blobs = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks WHERE typeof(token) = 'blob'");
+        long long texts = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks WHERE typeof(token) = 'text'");
+        long long routeBlobs = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM LinkRoutes WHERE typeof(token) = 'blob'");
+        long long markers = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM Settings WHERE name LIKE 'token_backfill.%'");
+        bool opensAfter = db.getShareLinkData(token, "reader").valid && db.findLinkRoute(token) == 3;
+
+        if (initOk && version == 6 && blobsAtStart == 0 && opensBefore && batches == 3 && blobs == 1 && texts == 1 &&
+            routeBlobs == 1 && markers == 0 && opensAfter && db.backfillStep(1) == 0) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("version=" + std::to_string(version) + " batches=" + std::to_string(batches) +
+                      " blobs=" + std::to_string(blobs) + " opens before=" + std::to_string(opensBefore) +
+                      " after=" + std::to_string(opensAfter));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nShare Tokens: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 14: ONLINE BACKUP
+// ============================================
+
+const std::string TEST_BACKUP_DIR = "db_test_backup";
+
+std::string integrityCheck(const std::string& path) {
+    sqlite3* raw;
+    sqlite3_stmt* stmt;
+    std::string result = "cannot open";
+    if (sqlite3_open_v2(path.c_str(), &raw, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(raw, "PRAGMA integrity_check", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            result = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(raw);
+    return result;
+}
+
+// Uploads notes on another thread until stopped; `committed` counts the finished ones
+class BackgroundWriter {
+public:
+    BackgroundWriter(Storage& storage, int user_id, const std::string& content)
+        : worker([this, &storage, user_id, content] {
+              while (!stop) {
+                  if (storage.saveNote(user_id, content, "key", "iv", "during.txt") != -1) {
+                      committed++;
+                  }
+              }
+          }) {}
+    ~BackgroundWriter() { finish(); }
+    void finish() {
+        stop = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    std::atomic<long long> committed{0};
+
+private:
+    std::atomic<bool> stop{false};
+    std::thread worker;
+};
+
+TestResult testBackup() {
+    printHeader("CATEGORY 14: ONLINE BACKUP");
+    TestResult result;
+
+    std::filesystem::remove_all(TEST_BACKUP_DIR);
+    std::filesystem::create_directories(TEST_BACKUP_DIR);
+    const std::string snapshotPath = TEST_BACKUP_DIR + "/snapshot.db";
+    const std::string content = Crypto::base64Encode(std::vector<unsigned char>(1500, 0x42));
+
+    // Test 14.1: Point-in-time copy while uploads keep committing
+    result.total++;
+    printTest("14.1 - Writes during a backup land after the snapshot, the copy stays intact");
+    {
+        removeDatabase(TEST_DB_PATH);
+        Database db(TEST_DB_PATH, 2);
+        db.init();
+        db.createUser("owner", "hash", "salt", "04");
+        int ownerId = db.getUserByUsername("owner").id;
+        std::vector<Storage::NewNote> seed(1500, {ownerId, content, "key", "iv", "seed.txt"});
+        db.saveNotes(seed);
+
+        BackgroundWriter writer(db, ownerId, content);
+        while (writer.committed < 20) {
+            std::this_thread::yield();
+        }
+        long long before = 1500 + writer.committed;
+        long long steps = 0;
+        long long copied = 0;
+        long long total = 0;
+        bool ok = db.backup(snapshotPath, 16, 2, [&](long long c, long long t) {
+            steps++;
+            copied = c;
+            total = t;
+        });
+        long long after = 1500 + writer.committed;
+        writer.finish();
+        long long live = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM Notes");
+
+        // The copy is a prefix of the note ids: nothing half-applied, nothing from after the start
+        std::string integrity = integrityCheck(snapshotPath);
+        long long count = queryInt(snapshotPath, "SELECT COUNT(*) FROM Notes");
+        long long maxId = queryInt(snapshotPath, "SELECT MAX(id) FROM Notes");
+        bool readable = true;
+        {
+            Database copy(snapshotPath, 1);
+            copy.init();
+            for (int id = 1; id <= count; id += 97) {
+                readable = readable && copy.getNoteById(id).encrypted_content == content;
+            }
+        }
+
+        if (ok && integrity == "ok" && steps > 10 && copied == total && count >= before && count <= after &&
+            maxId == count && readable && live > count && !std::filesystem::exists(snapshotPath + ".partial")) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("ok=" + std::to_string(ok) + " integrity=" + integrity + " steps=" + std::to_string(steps) +
+                      " snapshot=" + std::to_string(count) + " before=" + std::to_string(before) +
+                      " after=" + std::to_string(after) + " live=" + std::to_string(live));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+    removeDatabase(snapshotPath);
+
+    // Test 14.2: Notes kept in segment files come along
+    result.total++;
+    printTest("14.2 - Backup copies the segment files the snapshot references");
+    {
+        std::filesystem::remove_all(TEST_SEGMENT_DIR);
+        std::string large = Crypto::base64Encode(std::vector<unsigned char>(8000, 0x17));
+        bool ok;
+        long long count;
+        {
+            Database db(TEST_DB_PATH, 2, std::make_unique<SegmentContentStore>(TEST_SEGMENT_DIR, 1024, 64 * 1024, 0));
+            db.init();
+            db.createUser("owner", "hash", "salt", "04");
+            int ownerId = db.getUserByUsername("owner").id;
+            for (int i = 0; i < 40; i++) {
+                db.saveNote(ownerId, large, "key", "iv", "large.bin");
+            }
+
+            BackgroundWriter writer(db, ownerId, large);
+            ok = db.backup(snapshotPath, 4, 1, nullptr);
+            writer.finish();
+            count = queryInt(snapshotPath, "SELECT COUNT(*) FROM Notes");
+        }
+
+        bool readable = true;
+        {
+            std::string segments = Database::segmentDirFor(snapshotPath);
+            Database copy(snapshotPath, 1, std::make_unique<SegmentContentStore>(segments, 1024, 64 * 1024, 0));
+            copy.init();
+            for (int id = 1; id <= count; id++) {
+                readable = readable && copy.getNoteById(id).encrypted_content == large;
+            }
+        }
+
+        if (ok && count >= 40 && readable && integrityCheck(snapshotPath) == "ok") {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("ok=" + std::to_string(ok) + " notes=" + std::to_string(count) +
+                      " readable=" + std::to_string(readable));
+        }
+        std::filesystem::remove_all(TEST_SEGMENT_DIR);
+    }
+    removeDatabase(TEST_DB_PATH);
+    std::filesystem::remove_all(TEST_BACKUP_DIR);
+
+    // Test 14.3: Runner, sharded copies and engines without a file
+    result.total++;
+    printTest("14.3 - BackupRunner runs one backup at a time; sharded copies open again");
+    {
+        const int shards = 2;
+        removeShardedDatabase(shards);
+        std::string destination;
+        bool started;
+        bool rejected;
+        BackupRunner::Stats stats;
+        std::string token;
+        int noteId;
+        {
+            ShardedStorage storage(TEST_DB_PATH, shards, 2);
+            storage.init();
+            storage.createUser("owner", "hash", "salt", "04");
+            int owner = storage.getUserByUsername("owner").id;
+            noteId = storage.saveNote(owner, NOTE_CONTENT, "key", "iv", "sharded.txt");
+            token = storage.createShareLink(noteId, owner, {{"reader", "send", "wrapped"}}, 3600);
+
+            BackupRunner runner(storage, TEST_BACKUP_DIR, 1, 20);
+            started = runner.start(destination);
+            std::string second;
+            rejected = !runner.start(second);
+            runner.wait();
+            stats = runner.stats();
+        }
+
+        bool restored;
+        {
+            ShardedStorage copy(destination, shards, 1);
+            copy.init();
+            restored = copy.getNoteById(noteId).encrypted_content == NOTE_CONTENT &&
+                       copy.getShareLinkData(token, "reader").valid;
+        }
+
+        MemoryStorage memory;
+        memory.init();
+        BackupRunner memoryRunner(memory, TEST_BACKUP_DIR, 64, 0);
+        bool memoryFails = !memoryRunner.backupOnce(TEST_BACKUP_DIR + "/memory.db") &&
+                           memoryRunner.stats().backups_failed == 1;
+
+        if (started && rejected && stats.backups_completed == 1 && stats.last_destination == destination &&
+            stats.pages_copied == stats.pages_total && !stats.running && restored && memoryFails) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("started=" + std::to_string(started) + " rejected=" + std::to_string(rejected) +
+                      " completed=" + std::to_string(stats.backups_completed) +
+                      " restored=" + std::to_string(restored));
+        }
+        removeShardedDatabase(shards);
+    }
+    std::filesystem::remove_all(TEST_BACKUP_DIR);
+
+    std::cout << "\nOnline Backup: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 15: SCHEMA MIGRATIONS
+// ============================================
+
+TestResult testMigrations() {
+    printHeader("CATEGORY 15: SCHEMA MIGRATIONS");
+    TestResult result;
+
+    // Test 15.1: Current schema -> no DDL; newer schema -> refused
+    result.total++;
+    printTest("15.1 - A current database starts without DDL, a newer one is refused");
+    {
+        removeDatabase(TEST_DB_PATH);
+        {
+            Database db(TEST_DB_PATH, 1);
+            db.init();
+        }
+        // Would come back if init still ran CREATE INDEX IF NOT EXISTS on every start
+        sqlite3* raw;
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, "DROP INDEX idx_links_expiration;", nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+        long long schemaBefore = queryInt(TEST_DB_PATH, "PRAGMA schema_version");
+
+        bool currentOk;
+        {
+            Database db(TEST_DB_PATH, 1);
+            currentOk = db.init();
+        }
+        long long schemaAfter = queryInt(TEST_DB_PATH, "PRAGMA schema_version");
+        long long index = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'idx_links_expiration'");
+
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, "PRAGMA user_version = 7;", nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+        bool newerOk;
+        {
+            Database db(TEST_DB_PATH, 1);
+            newerOk = db.init();
+        }
+        long long version = queryInt(TEST_DB_PATH, "PRAGMA user_version");
+
+        if (currentOk && schemaAfter == schemaBefore && index == 0 && !newerOk && version == 7) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("schema " + std::to_string(schemaBefore) + " -> " + std::to_string(schemaAfter) +
+                      " index=" + std::to_string(index) + " newer accepted=" + std::to_string(newerOk));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    // Test 15.2: A migration is all or nothing and runs again on the next start
+    result.total++;
+    printTest("15.2 - A failed migration leaves the previous version intact and reruns");
+    {
+        sqlite3* raw;
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, LEGACY_SCHEMA, nullptr, nullptr, nullptr);
+        // Version 3 moves every note into NoteContents; a trigger refusing the row makes it fail
+        sqlite3_exec(raw, "PRAGMA user_version = 2;"
+                          "UPDATE Notes SET encrypted_content = CAST('content' AS BLOB);"
+                          "CREATE TABLE NoteContents (note_id INTEGER PRIMARY KEY, wrapped_key TEXT NOT NULL,"
+                          " iv_hex TEXT NOT NULL, encrypted_content BLOB NOT NULL);"
+                          "CREATE TRIGGER refuse_move BEFORE INSERT ON NoteContents"
+                          " BEGIN SELECT RAISE(ABORT, 'forced'); END;", nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+
+        bool firstOk;
+        {
+            Database db(TEST_DB_PATH, 1);
+            firstOk = db.init();
+        }
+        long long versionAfterFailure = queryInt(TEST_DB_PATH, "PRAGMA user_version");
+        long long oldColumns = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM pragma_table_info('Notes')");
+        long long leftovers = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM sqlite_master WHERE name LIKE '%_old'");
+
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, "DROP TRIGGER refuse_move;", nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+
+        bool secondOk;
+        std::string content;
+        {
+            Database db(TEST_DB_PATH, 1);
+            secondOk = db.init();
+            content = db.getNoteById(1).encrypted_content;
+        }
+        long long version = queryInt(TEST_DB_PATH, "PRAGMA user_version");
+        long long indexes = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'index' AND name LIKE 'idx_%'");
+
+        if (!firstOk && versionAfterFailure == 2 && oldColumns == 7 && leftovers == 0 &&
+            secondOk && version == 6 && content == NOTE_CONTENT && indexes == 10) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("first=" + std::to_string(firstOk) + " version=" + std::to_string(versionAfterFailure) +
+                      " columns=" + std::to_string(oldColumns) + " second=" + std::to_string(secondOk) +
+                      " indexes=" + std::to_string(indexes));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    // Test 15.3: Backfill position survives a restart; links keep opening while it runs
+    result.total++;
+    printTest("15.3 - Token backfill resumes after a restart and runs in the background");
+    {
+        const int links = 2500;
+        std::vector<std::string> tokens;
+        {
+            Database db(TEST_DB_PATH, 1);
+            db.init();
+            db.createUser("owner", "hash", "salt", "04");
+            db.saveNote(1, NOTE_CONTENT, "key", "iv", "old.txt");
+        }
+        sqlite3* raw;
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, "BEGIN;", nullptr, nullptr, nullptr);
+        for (int i = 0; i < links; i++) {
+            std::vector<unsigned char> bytes = Crypto::generateRandomBytes(32);
+            tokens.emplace_back(bytes.begin(), bytes.end());
+            std::string sql = "INSERT INTO SharedLinks (token, note_id, owner_id, expiration_time) VALUES ('" +
+                              Crypto::toHex(bytes) + "', 1, 1, 9999999999);"
+                              "INSERT INTO SharedLinkAccess (link_id, username, send_public_key_hex, wrapped_key)"
+                              " VALUES (last_insert_rowid(), 'reader', 'send', 'wrapped');";
+            sqlite3_exec(raw, sql.c_str(), nullptr, nullptr, nullptr);
+        }
+        sqlite3_exec(raw, "COMMIT; PRAGMA user_version = 5;", nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+
+        // First run: one batch, then the server goes away
+        {
+            Database db(TEST_DB_PATH, 1);
+            db.init();
+            db.backfillStep(1000);
+        }
+        long long position = queryInt(TEST_DB_PATH, "SELECT value FROM Settings WHERE name = 'token_backfill.SharedLinks'");
+
+        Database db(TEST_DB_PATH, 2);
+        db.init();
+        BackfillRunner runner(db, 500, 1);
+        runner.start();
+        int opened = 0;
+        int checked = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (!runner.stats().finished && std::chrono::steady_clock::now() < deadline) {
+            opened += db.getShareLinkData(tokens[checked % links], "reader").valid ? 1 : 0;
+            checked++;
+        }
+        runner.stop();
+        BackfillRunner::Stats stats = runner.stats();
+
+        long long blobs = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM SharedLinks WHERE typeof(token) = 'blob'");
+        long long markers = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM Settings WHERE name LIKE 'token_backfill.%'");
+        bool allOpen = true;
+        for (int i = 0; i < links; i += 50) {
+            allOpen = allOpen && db.getShareLinkData(tokens[i], "reader").valid;
+        }
+
+        if (position == 1000 && stats.finished && !stats.running && stats.rows == links - 1000 &&
+            stats.batches == 3 && stats.errors == 0 && opened == checked && blobs == links && markers == 0 && allOpen) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("position=" + std::to_string(position) + " rows=" + std::to_string(stats.rows) +
+                      " batches=" + std::to_string(stats.batches) + " opened=" + std::to_string(opened) + "/" +
+                      std::to_string(checked) + " blobs=" + std::to_string(blobs));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    // Test 15.4: The version 3 content move reuses the pages it frees
+    result.total++;
+    printTest("15.4 - Splitting 32 MB of notes moves them in batches without doubling the file");
+    {
+        const int notes = 32;
+        sqlite3* raw;
+        sqlite3_open(TEST_DB_PATH.c_str(), &raw);
+        sqlite3_exec(raw, LEGACY_SCHEMA, nullptr, nullptr, nullptr);
+        sqlite3_exec(raw, "DELETE FROM SharedLinks WHERE note_id = 42; DELETE FROM UserShares WHERE note_id = 42;"
+                          "PRAGMA user_version = 2;", nullptr, nullptr, nullptr);
+        for (int i = 0; i < notes; i++) {
+            std::string sql = "INSERT INTO Notes (user_id, encrypted_content, wrapped_key, iv_hex, filename, created_at)"
+                              " VALUES (1, randomblob(1048576), 'key', 'iv', 'big" + std::to_string(i) + ".bin', 200);";
+            sqlite3_exec(raw, sql.c_str(), nullptr, nullptr, nullptr);
+        }
+        sqlite3_exec(raw, "PRAGMA wal_checkpoint(TRUNCATE);", nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+        const std::string pages = "SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size()";
+        long long before = queryInt(TEST_DB_PATH, pages);
+
+        bool initOk;
+        {
+            Database db(TEST_DB_PATH, 1);
+            initOk = db.init();
+        }
+        long long after = queryInt(TEST_DB_PATH, pages);
+        long long moved = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM NoteContents WHERE length(encrypted_content) = 1048576");
+        long long columns = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM pragma_table_info('Notes')");
+
+        if (initOk && moved == notes && columns == 4 && after < before * 13 / 10) {
+            printPass(std::to_string(before / (1024 * 1024)) + " MB -> " + std::to_string(after / (1024 * 1024)) + " MB");
+            result.passed++;
+        } else {
+            printFail("init=" + std::to_string(initOk) + " moved=" + std::to_string(moved) +
+                      " size " + std::to_string(before) + " -> " + std::to_string(after));
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nSchema Migrations: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 16: SERVER CONFIGURATION
+// ============================================
+
+void setEnvironment(const std::string& name, const std::string& value) {
+#ifdef _WIN32
+    _putenv_s(name.c_str(), value.c_str());
+#else
+    setenv(name.c_str(), value.c_str(), 1);
+#endif
+}
+
+void clearEnvironment(const std::string& name) {
+#ifdef _WIN32
+    _putenv_s(name.c_str(), "");
+#else
+    unsetenv(name.c_str());
+#endif
+}
+
+TestResult testServerConfig() {
+    printHeader("CATEGORY 16: SERVER CONFIGURATION");
+    TestResult result;
+    const std::string configPath = "db_test_config.json";
+
+    // Test 16.1: defaults < file < environment < command line
+    result.total++;
+    printTest("16.1 - Config file, environment and command line override in order");
+    {
+        std::ofstream(configPath) << R"({"port": 9000, "worker_threads": 3, "db_path": "file.db",
+            "sqlite_synchronous": "full", "sqlite_mmap_mb": 256, "public_url": "https://notes.example/",
+            "group_commit_window_ms": 5, "group_commit_max_batch": 32})";
+        setEnvironment("SECURE_NOTES_PORT", "9100");
+        setEnvironment("SECURE_NOTES_SQLITE_CACHE_KB", "8192");
+        setEnvironment("SECURE_NOTES_GROUP_COMMIT_MAX_BATCH", "64");
+
+        std::string program = "server_app";
+        std::string configOption = "--config";
+        std::string storageOption = "--storage";
+        std::string storageValue = "memory";
+        char* argv[] = {&program[0], &configOption[0], const_cast<char*>(configPath.c_str()),
+                        &storageOption[0], &storageValue[0]};
+        ServerConfig config;
+        bool loaded = ServerConfig::load(5, argv, config);
+
+        ServerConfig invalid;
+        bool rejects = !invalid.set("port", "70000") && !invalid.set("worker_threads", "four") &&
+                       !invalid.set("sqlite_synchronous", "sometimes") && !invalid.set("no_such_key", "1") &&
+                       !invalid.set("group_commit_window_ms", "5000") && !invalid.set("group_commit_max_batch", "0");
+        setEnvironment("SECURE_NOTES_SHARDS", "0");
+        ServerConfig badEnvironment;
+        bool badEnvironmentFails = !ServerConfig::load(3, argv, badEnvironment);
+
+        clearEnvironment("SECURE_NOTES_PORT");
+        clearEnvironment("SECURE_NOTES_SQLITE_CACHE_KB");
+        clearEnvironment("SECURE_NOTES_GROUP_COMMIT_MAX_BATCH");
+        clearEnvironment("SECURE_NOTES_SHARDS");
+
+        if (loaded && config.port == 9100 && config.workerCount() == 3 && config.db_path == "file.db" &&
+            config.sqlite.synchronous == "FULL" && config.sqlite.mmap_bytes == 256LL * 1024 * 1024 &&
+            config.sqlite.cache_kb == 8192 && config.storage == "memory" && config.bind_address == "0.0.0.0" &&
+            config.group_commit_window_ms == 5 && config.group_commit_max_batch == 64 &&
+            config.publicUrl() == "https://notes.example" && rejects && badEnvironmentFails) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail(config.toJson().dump());
+        }
+    }
+    std::remove(configPath.c_str());
+
+    // Test 16.2: The SQLite settings reach every pooled connection
+    result.total++;
+    printTest("16.2 - Cache, mmap and synchronous settings apply to pooled connections");
+    {
+        removeDatabase(TEST_DB_PATH);
+        SqliteTuning tuning;
+        tuning.cache_kb = 4096;
+        tuning.mmap_bytes = 8 * 1024 * 1024;
+        tuning.synchronous = "FULL";
+        bool applied = true;
+        {
+            ConnectionPool pool(TEST_DB_PATH, 2, 1000, tuning);
+            auto first = pool.acquire();
+            auto second = pool.acquire();
+            for (Connection* conn : {&*first, &*second}) {
+                auto pragma = [conn](const char* sql) {
+                    sqlite3_stmt* stmt;
+                    long long value = -1;
+                    if (sqlite3_prepare_v2(conn->handle, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+                        if (sqlite3_step(stmt) == SQLITE_ROW) {
+                            value = sqlite3_column_int64(stmt, 0);
+                        }
+                        sqlite3_finalize(stmt);
+                    }
+                    return value;
+                };
+                // synchronous: 0 OFF, 1 NORMAL, 2 FULL, 3 EXTRA
+                applied = applied && pragma("PRAGMA cache_size") == -4096 && pragma("PRAGMA synchronous") == 2 &&
+                          pragma("PRAGMA mmap_size") == 8 * 1024 * 1024;
+            }
+        }
+
+        if (applied) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("pragmas differ from the tuning");
+        }
+    }
+    removeDatabase(TEST_DB_PATH);
+
+    std::cout << "\nServer Configuration: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 17: STREAMED UPLOADS
+// ============================================
+
+// Hands out `bytes` in slices of `chunk` bytes; fails on the call after `fail_after` slices
+ContentStore::ChunkSource sliceSource(const std::vector<unsigned char>& bytes, size_t chunk, int fail_after = -1) {
+    return [&bytes, chunk, fail_after, pos = size_t(0), calls = 0](std::vector<unsigned char>& out) mutable {
+        if (calls++ == fail_after) {
+            return false;
+        }
+        size_t length = std::min(chunk, bytes.size() - pos);
+        out.assign(bytes.begin() + pos, bytes.begin() + pos + length);
+        pos += length;
+        return true;
+    };
+}
+
+TestResult testStreamedUploads() {
+    printHeader("CATEGORY 17: STREAMED UPLOADS");
+    TestResult result;
+
+    const std::string shardedPath = "db_test_stream.db";
+    auto removeFiles = [&shardedPath] {
+        removeDatabase(TEST_DB_PATH);
+        std::filesystem::remove_all(TEST_SEGMENT_DIR);
+        removeDatabase(shardedPath);
+        for (int shard = 0; shard < 2; shard++) {
+            removeDatabase(ShardedStorage::shardPath(shardedPath, shard));
+        }
+    };
+    removeFiles();
+
+    // Slices of 1000 bytes (not a multiple of 3), so base64 is never built per chunk
+    std::vector<unsigned char> large(100000);
+    for (size_t i = 0; i < large.size(); i++) {
+        large[i] = static_cast<unsigned char>(i * 7 + 3);
+    }
+    std::vector<unsigned char> small(large.begin(), large.begin() + 500);
+
+    // Test 17.1 - 17.3: Raw chunks read back as the same note on every engine
+    {
+        Database segments(TEST_DB_PATH, 2, std::make_unique<SegmentContentStore>(TEST_SEGMENT_DIR, 1024, 64 * 1024, 0));
+        ShardedStorage sharded(shardedPath, 2, 2);
+        MemoryStorage memory;
+        std::pair<const char*, Storage*> engines[] = {{"17.1 - SQLite with segment files", &segments},
+                                                      {"17.2 - Sharded SQLite (2 shards)", &sharded},
+                                                      {"17.3 - In-memory engine", &memory}};
+        for (const auto& engine : engines) {
+            result.total++;
+            printTest(std::string(engine.first) + ": streamed notes round-trip, bad sources store nothing");
+            Storage& storage = *engine.second;
+            storage.init();
+            storage.createUser("streamer", "hash", "salt", "04");
+            int userId = storage.getUserByUsername("streamer").id;
+
+            int big = storage.saveNoteStream(userId, large.size(), sliceSource(large, 1000), "key", "iv", "big.bin");
+            int tiny = storage.saveNoteStream(userId, small.size(), sliceSource(small, 1000), "key2", "iv2", "tiny.bin");
+            int empty = storage.saveNoteStream(userId, 0, sliceSource(small, 1000), "key3", "iv3", "empty.bin");
+            // Source fails midway, ends early, or delivers more than announced
+            int failed = storage.saveNoteStream(userId, large.size(), sliceSource(large, 1000, 50), "k", "i", "f.bin");
+            int shorter = storage.saveNoteStream(userId, large.size() + 10, sliceSource(large, 1000), "k", "i", "s.bin");
+            int longer = storage.saveNoteStream(userId, small.size() - 10, sliceSource(small, 1000), "k", "i", "l.bin");
+
+            NoteData bigNote = storage.getNoteById(big);
+            NoteData tinyNote = storage.getNoteById(tiny);
+            size_t listed = storage.listNotes(userId, Storage::NoteCursor(), 100).notes.size();
+            bool stored = big != -1 && tiny != -1 && empty != -1 &&
+                          bigNote.encrypted_content == Crypto::base64Encode(large) && bigNote.filename == "big.bin" &&
+                          tinyNote.encrypted_content == Crypto::base64Encode(small) && tinyNote.wrapped_key == "key2" &&
+                          storage.getNoteById(empty).encrypted_content.empty();
+            bool rejected = failed == -1 && shorter == -1 && longer == -1 && listed == 3;
+
+            if (stored && rejected) {
+                printPass();
+                result.passed++;
+            } else {
+                printFail("stored=" + std::to_string(stored) + " failed=" + std::to_string(failed) +
+                          " shorter=" + std::to_string(shorter) + " longer=" + std::to_string(longer) +
+                          " listed=" + std::to_string(listed));
+            }
+        }
+    }
+
+    // Test 17.4: Large streamed notes land in segment files, a failed one leaves no index row
+    result.total++;
+    printTest("17.4 - Streamed notes use segment files like base64 uploads");
+    {
+        long long indexed = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM ContentSegments");
+        long long rows = queryInt(TEST_DB_PATH, "SELECT COUNT(*) FROM NoteContents");
+        long long inlineBytes = queryInt(TEST_DB_PATH, "SELECT SUM(length(encrypted_content)) FROM NoteContents");
+        if (indexed == 1 && rows == 3 && inlineBytes == 500) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("indexed=" + std::to_string(indexed) + " rows=" + std::to_string(rows) +
+                      " inline bytes=" + std::to_string(inlineBytes));
+        }
+    }
+
+    removeFiles();
+
+    std::cout << "\nStreamed Uploads: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 18: RANGE READS
+// ============================================
+
+// Every kind of range against `bytes`; empty string if all match
+std::string checkRanges(Storage& storage, int note_id, int owner_id, const std::vector<unsigned char>& bytes) {
+    const long long size = static_cast<long long>(bytes.size());
+    struct Case {
+        long long offset;
+        long long length;
+        long long first;     // Expected first byte, -1 = unsatisfiable
+        long long returned;  // Expected byte count
+    };
+    const Case cases[] = {
+        {0, -1, 0, size},                 // Whole note
+        {1000, 5000, 1000, 5000},         // Middle
+        {size - 10, 100, size - 10, 10},  // Clipped at the end
+        {size - 1, -1, size - 1, 1},      // Open-ended, last byte
+        {-300, -1, size - 300, 300},      // Suffix
+        {-(size + 50), -1, 0, size},      // Suffix longer than the note
+        {size, -1, -1, 0},                // Past the end
+    };
+    for (const Case& c : cases) {
+        ContentStore::ByteRange range;
+        range.offset = c.offset;
+        range.length = c.length;
+        NoteData note;
+        ContentStore::RangeData data;
+        auto access = storage.getNoteRangeForOwner(note_id, owner_id, range, note, data);
+        std::string label = "range " + std::to_string(c.offset) + "+" + std::to_string(c.length);
+        if (access != Storage::NoteAccess::Ok || data.total_size != size || data.offset != c.first ||
+            static_cast<long long>(data.bytes.size()) != c.returned || note.wrapped_key != "key" ||
+            !note.encrypted_content.empty()) {
+            return label + ": offset=" + std::to_string(data.offset) + " bytes=" + std::to_string(data.bytes.size());
+        }
+        if (c.first >= 0 && !std::equal(data.bytes.begin(), data.bytes.end(),
+                                        reinterpret_cast<const char*>(bytes.data()) + c.first)) {
+            return label + ": wrong bytes";
+        }
+    }
+
+    NoteData note;
+    ContentStore::RangeData data;
+    if (storage.getNoteRangeForOwner(note_id, owner_id + 1000, ContentStore::ByteRange(), note, data) !=
+            Storage::NoteAccess::Forbidden ||
+        storage.getNoteRangeForOwner(note_id + 1000, owner_id, ContentStore::ByteRange(), note, data) !=
+            Storage::NoteAccess::NotFound) {
+        return "access checks";
+    }
+    return "";
+}
+
+TestResult testRangeReads() {
+    printHeader("CATEGORY 18: RANGE READS");
+    TestResult result;
+
+    const std::string shardedPath = "db_test_range.db";
+    auto removeFiles = [&shardedPath] {
+        removeDatabase(TEST_DB_PATH);
+        std::filesystem::remove_all(TEST_SEGMENT_DIR);
+        removeDatabase(shardedPath);
+        for (int shard = 0; shard < 2; shard++) {
+            removeDatabase(ShardedStorage::shardPath(shardedPath, shard));
+        }
+    };
+    removeFiles();
+
+    // 100001 bytes: not a multiple of 3, so the in-memory engine's last quad is padded
+    std::vector<unsigned char> bytes(100001);
+    for (size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<unsigned char>(i * 11 + i / 256);
+    }
+    std::string encoded = Crypto::base64Encode(bytes);
+
+    // Test 18.1 - 18.4: Same answers from every place a ciphertext can live
+    {
+        Database inlined(TEST_DB_PATH, 2);
+        Database segments("db_test_range_segments.db", 2,
+                          std::make_unique<SegmentContentStore>(TEST_SEGMENT_DIR, 1024, 1024 * 1024, 0));
+        ShardedStorage sharded(shardedPath, 2, 2);
+        MemoryStorage memory;
+        std::pair<const char*, Storage*> engines[] = {{"18.1 - Inline SQLite blob", &inlined},
+                                                      {"18.2 - Segment file", &segments},
+                                                      {"18.3 - Sharded SQLite (2 shards)", &sharded},
+                                                      {"18.4 - In-memory engine", &memory}};
+        for (const auto& engine : engines) {
+            result.total++;
+            printTest(std::string(engine.first) + ": byte ranges, suffixes and past-the-end reads");
+            Storage& storage = *engine.second;
+            storage.init();
+            storage.createUser("reader", "hash", "salt", "04");
+            int userId = storage.getUserByUsername("reader").id;
+            int noteId = storage.saveNote(userId, encoded, "key", "iv", "range.bin");
+
+            std::string failure = checkRanges(storage, noteId, userId, bytes);
+            if (failure.empty()) {
+                printPass();
+                result.passed++;
+            } else {
+                printFail(failure);
+            }
+        }
+    }
+    removeDatabase("db_test_range_segments.db");
+
+    // Test 18.5: An empty note has a whole, but no range
+    result.total++;
+    printTest("18.5 - Empty note: whole read succeeds, any range is unsatisfiable");
+    {
+        Database db(TEST_DB_PATH, 1);
+        db.init();
+        int userId = db.getUserByUsername("reader").id;
+        int noteId = db.saveNote(userId, "", "key", "iv", "empty.bin");
+        NoteData note;
+        ContentStore::RangeData whole;
+        ContentStore::RangeData suffix;
+        ContentStore::ByteRange last;
+        last.offset = -1;
+        db.getNoteRangeForOwner(noteId, userId, ContentStore::ByteRange(), note, whole);
+        db.getNoteRangeForOwner(noteId, userId, last, note, suffix);
+        if (whole.offset == 0 && whole.bytes.empty() && whole.total_size == 0 && suffix.offset == -1) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("whole offset=" + std::to_string(whole.offset) + " suffix offset=" + std::to_string(suffix.offset));
+        }
+    }
+
+    removeFiles();
+
+    std::cout << "\nRange Reads: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 19: WIRE FORMATS
+// ============================================
+
+TestResult testWireFormats() {
+    printHeader("CATEGORY 19: WIRE FORMATS");
+    TestResult result;
+
+    std::vector<unsigned char> ciphertext(1000);
+    for (size_t i = 0; i < ciphertext.size(); i++) {
+        ciphertext[i] = static_cast<unsigned char>(i * 7 + 3);
+    }
+    NoteData note;
+    note.note_id = 42;
+    note.encrypted_content = Crypto::base64Encode(ciphertext);
+    note.wrapped_key = Crypto::base64Encode(std::vector<unsigned char>(48, 0x5a));
+    note.iv_hex = Crypto::base64Encode(std::vector<unsigned char>(12, 0x11));
+    note.filename = "notes.txt";
+    note.created_at = 1700000000;
+    nlohmann::json original = note;
+
+    // Test 19.1 - 19.2: Byte strings on the wire, the same JSON after decoding
+    std::pair<const char*, WireFormat::Format> formats[] = {{"19.1 - CBOR", WireFormat::Format::Cbor},
+                                                            {"19.2 - MessagePack", WireFormat::Format::MsgPack}};
+    for (const auto& format : formats) {
+        result.total++;
+        printTest(std::string(format.first) + ": ciphertext, key and IV travel as raw bytes and round-trip");
+        std::string body = WireFormat::encode(original, format.second);
+        nlohmann::json wire = format.second == WireFormat::Format::Cbor ? nlohmann::json::from_cbor(body)
+                                                                        : nlohmann::json::from_msgpack(body);
+        nlohmann::json decoded = WireFormat::decode(body, format.second);
+        bool binary = wire["encrypted_content"].is_binary() && wire["wrapped_key"].is_binary() &&
+                      wire["iv_hex"].is_binary() && wire["filename"].is_string();
+        if (binary && decoded == original && body.size() < original.dump().size() * 4 / 5) {
+            printPass(std::to_string(original.dump().size()) + " bytes as JSON, " + std::to_string(body.size()));
+            result.passed++;
+        } else {
+            printFail("binary=" + std::to_string(binary) + " equal=" + std::to_string(decoded == original) +
+                      " size=" + std::to_string(body.size()));
+        }
+    }
+
+    // Test 19.3: A value that would not encode back to itself stays a string
+    result.total++;
+    printTest("19.3 - Non-canonical base64/hex is left as text");
+    {
+        nlohmann::json value = {{"wrapped_key", "not base64!"},
+                                {"iv_hex", "QUJD"},
+                                {"salt", "ABCDEF"},
+                                {"user_access_list", {{{"send_public_key_hex", "04abcd"}, {"wrapped_key", "QQ="}}}}};
+        std::string body = WireFormat::encode(value, WireFormat::Format::Cbor);
+        nlohmann::json wire = nlohmann::json::from_cbor(body);
+        bool kept = wire["wrapped_key"].is_string() && wire["salt"].is_string() &&
+                    wire["user_access_list"][0]["wrapped_key"].is_string();
+        bool converted = wire["iv_hex"].is_binary() && wire["user_access_list"][0]["send_public_key_hex"].is_binary();
+        if (kept && converted && WireFormat::decode(body, WireFormat::Format::Cbor) == value) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("kept=" + std::to_string(kept) + " converted=" + std::to_string(converted));
+        }
+    }
+
+    // Test 19.4: Content-Type and Accept parsing
+    result.total++;
+    printTest("19.4 - Content-Type/Accept: parameters, case, fallbacks to JSON");
+    {
+        using F = WireFormat::Format;
+        WireFormat::Format named = F::Json;
+        bool ok = WireFormat::fromContentType("application/cbor") == F::Cbor &&
+                  WireFormat::fromContentType("Application/MsgPack; charset=binary") == F::MsgPack &&
+                  WireFormat::fromContentType("application/x-msgpack") == F::MsgPack &&
+                  WireFormat::fromContentType("") == F::Json &&
+                  WireFormat::fromContentType("text/plain") == F::Json &&
+                  WireFormat::fromAccept("text/html, application/cbor;q=0.9, application/json") == F::Cbor &&
+                  WireFormat::fromAccept("application/json, application/cbor") == F::Json &&
+                  WireFormat::fromAccept("image/png") == F::Json &&
+                  WireFormat::fromName("msgpack", named) && named == F::MsgPack &&
+                  !WireFormat::fromName("xml", named) &&
+                  std::string(WireFormat::contentType(F::Cbor)) == "application/cbor";
+        if (ok) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail();
+        }
+    }
+
+    // Test 19.5: Malformed bodies throw, as json::parse does
+    result.total++;
+    printTest("19.5 - Truncated CBOR/MessagePack body is rejected");
+    {
+        int rejected = 0;
+        for (WireFormat::Format format : {WireFormat::Format::Cbor, WireFormat::Format::MsgPack}) {
+            std::string body = WireFormat::encode(original, format);
+            try {
+                WireFormat::decode(body.substr(0, body.size() / 2), format);
+            } catch (const std::exception&) {
+                rejected++;
+            }
+        }
+        if (rejected == 2) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail(std::to_string(rejected) + "/2 rejected");
+        }
+    }
+
+    // Test 19.6: The server keeps an upload's ciphertext as raw bytes
+    result.total++;
+    printTest("19.6 - decode() with a raw field leaves only that byte string binary");
+    {
+        std::string body = WireFormat::encode(original, WireFormat::Format::MsgPack);
+        nlohmann::json decoded = WireFormat::decode(body, WireFormat::Format::MsgPack, "encrypted_content");
+        bool raw = decoded["encrypted_content"] == nlohmann::json::binary(ciphertext);
+        bool text = decoded["wrapped_key"] == original["wrapped_key"] && decoded["iv_hex"] == original["iv_hex"];
+        if (raw && text) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("raw=" + std::to_string(raw) + " text=" + std::to_string(text));
+        }
+    }
+
+    // Test 19.7 - 19.9: Raw ciphertext in, raw share content out, same note as a base64 upload
+    const int shards = 2;
+    removeShardedDatabase(shards);
+    {
+        Database sqlite(TEST_DB_PATH, 2);
+        MemoryStorage memory;
+        ShardedStorage sharded(TEST_DB_PATH + ".raw", shards, 2);
+        sqlite.init();
+        sharded.init();
+        std::pair<const char*, Storage*> engines[] = {{"19.7 - SQLite engine", &sqlite},
+                                                      {"19.8 - In-memory engine", &memory},
+                                                      {"19.9 - Sharded engine", &sharded}};
+        std::string bytes(ciphertext.begin(), ciphertext.end());
+        for (const auto& engine : engines) {
+            result.total++;
+            printTest(std::string(engine.first) + ": raw upload and raw share read skip base64");
+            Storage& storage = *engine.second;
+            storage.createUser("owner", "hash", "salt", "04");
+            int owner = storage.getUserByUsername("owner").id;
+
+            Storage::NewNote rawNote{owner, bytes, "key", "iv", "raw.bin"};
+            rawNote.raw_content = true;
+            Storage::NewNote badNote{owner, "not base64!", "key", "iv", "bad.bin"};
+            std::vector<int> ids = storage.saveNotes({rawNote, badNote});
+            bool saved = ids.size() == 2 && ids[0] != -1 && ids[1] == -1 &&
+                         storage.getNoteById(ids[0]).encrypted_content == note.encrypted_content;
+
+            // Twice, so the SQLite engine goes through both the cold and the cached link path
+            std::string token = saved ? storage.createShareLink(ids[0], owner, {{"reader", "send", "wrapped"}}, 3600) : "";
+            bool shared = !token.empty();
+            for (int i = 0; i < 2 && shared; i++) {
+                ContentStore::RangeData data;
+                auto link = storage.getShareLinkRaw(token, "reader", data);
+                shared = link.valid && link.note_id == ids[0] && link.encrypted_content.empty() &&
+                         link.wrapped_key == "wrapped" && data.bytes == bytes &&
+                         data.total_size == static_cast<long long>(bytes.size());
+            }
+            ContentStore::RangeData denied;
+            bool refused = !storage.getShareLinkRaw(token, "stranger", denied).valid && denied.bytes.empty();
+
+            if (saved && shared && refused) {
+                printPass();
+                result.passed++;
+            } else {
+                printFail("saved=" + std::to_string(saved) + " shared=" + std::to_string(shared) +
+                          " refused=" + std::to_string(refused));
+            }
+        }
+    }
+    removeShardedDatabase(shards);
+    for (int shard = 0; shard < shards; shard++) {
+        removeDatabase(ShardedStorage::shardPath(TEST_DB_PATH + ".raw", shard));
+    }
+    removeDatabase(TEST_DB_PATH + ".raw");
+
+    std::cout << "\nWire Formats: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// TEST CATEGORY 20: VERIFIED TOKEN CACHE
+// ============================================
+
+TestResult testTokenCache() {
+    printHeader("CATEGORY 20: VERIFIED TOKEN CACHE");
+    TestResult result;
+
+    std::string token = Auth::generateToken(7, "alice");
+
+    // Test 20.1: Second lookup is a hit with the same payload as a full verification
+    result.total++;
+    printTest("20.1 - Valid token: verified once, then served from the cache");
+    {
+        CacheStats before = Auth::tokenCacheStats();
+        TokenPayload first = Auth::verifyTokenCached(token);
+        TokenPayload second = Auth::verifyTokenCached(token);
+        TokenPayload full = Auth::verifyToken(token);
+        CacheStats after = Auth::tokenCacheStats();
+        bool same = first.valid && second.valid && second.user_id == full.user_id &&
+                    second.username == full.username && second.exp == full.exp;
+        if (same && after.hits == before.hits + 1 && after.entries == before.entries + 1) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("valid=" + std::to_string(second.valid) + " hits " + std::to_string(before.hits) +
+                      " -> " + std::to_string(after.hits));
+        }
+    }
+
+    // Test 20.2: A cached token does not vouch for a tampered copy, and failures are not cached
+    result.total++;
+    printTest("20.2 - Tampered and malformed tokens are rejected and never cached");
+    {
+        std::string tampered = token;
+        tampered[tampered.size() - 1] = tampered.back() == '0' ? '1' : '0';
+        std::string forged = Crypto::base64Encode(std::vector<unsigned char>{'1', ':', 'r', ':', '9'}) +
+                             token.substr(token.find('.'));
+        CacheStats before = Auth::tokenCacheStats();
+        bool rejected = true;
+        for (int i = 0; i < 2; i++) {
+            for (const std::string& bad : {tampered, forged, std::string(), std::string("no-dot")}) {
+                rejected = rejected && !Auth::verifyTokenCached(bad).valid;
+            }
+        }
+        CacheStats after = Auth::tokenCacheStats();
+        if (rejected && after.entries == before.entries && after.hits == before.hits) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail("rejected=" + std::to_string(rejected) + " entries " + std::to_string(before.entries) +
+                      " -> " + std::to_string(after.entries));
+        }
+    }
+
+    // Test 20.3: Many threads verifying the same tokens agree with verifyToken
+    result.total++;
+    printTest("20.3 - Concurrent lookups of 200 tokens from 8 threads");
+    {
+        std::vector<std::string> tokens;
+        for (int i = 0; i < 200; i++) {
+            tokens.push_back(Auth::generateToken(1000 + i, "user" + std::to_string(i)));
+        }
+        std::atomic<int> wrong(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&tokens, &wrong, t] {
+                for (int round = 0; round < 20; round++) {
+                    for (size_t i = 0; i < tokens.size(); i++) {
+                        size_t index = (i + t * 25) % tokens.size();
+                        TokenPayload payload = Auth::verifyTokenCached(tokens[index]);
+                        if (!payload.valid || payload.user_id != 1000 + static_cast<int>(index)) {
+                            wrong++;
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (wrong == 0) {
+            printPass();
+            result.passed++;
+        } else {
+            printFail(std::to_string(wrong.load()) + " wrong payloads");
+        }
+    }
+
+    std::cout << "\nToken Cache: " << result.passed << "/" << result.total << " tests passed\n\n";
+    return result;
+}
+
+// ============================================
+// MAIN TEST RUNNER
+// ============================================
+
+int main() {
+    std::cout << "\033[34m\033[1m";
+    std::cout << std::string(60, '=') << "\n";
+    std::cout << "  SECURE NOTE APP - STORAGE TEST SUITE\n";
+    std::cout << std::string(60, '=') << "\n";
+    std::cout << "\033[0m\n";
+
+    int totalPassed = 0;
+    int totalTests = 0;
+
+    auto r1 = testQueryPlans();
+    totalPassed += r1.passed;
+    totalTests += r1.total;
+
+    auto r2 = testNotes();
+    totalPassed += r2.passed;
+    totalTests += r2.total;
+
+    auto r3 = testDeletion();
+    totalPassed += r3.passed;
+    totalTests += r3.total;
+
+    auto r4 = testOutgoingShares();
+    totalPassed += r4.passed;
+    totalTests += r4.total;
+
+    auto r5 = testExpirySweep();
+    totalPassed += r5.passed;
+    totalTests += r5.total;
+
+    auto r6 = testGroupCommit();
+    totalPassed += r6.passed;
+    totalTests += r6.total;
+
+    auto r7 = testContentStorage();
+    totalPassed += r7.passed;
+    totalTests += r7.total;
+
+    auto r8 = testSegmentFiles();
+    totalPassed += r8.passed;
+    totalTests += r8.total;
+
+    auto r9 = testStorageEngines();
+    totalPassed += r9.passed;
+    totalTests += r9.total;
+
+    auto r10 = testShardedStorage();
+    totalPassed += r10.passed;
+    totalTests += r10.total;
+
+    auto r11 = testUserCache();
+    totalPassed += r11.passed;
+    totalTests += r11.total;
+
+    auto r12 = testLinkCache();
+    totalPassed += r12.passed;
+    totalTests += r12.total;
+
+    auto r13 = testShareTokens();
+    totalPassed += r13.passed;
+    totalTests += r13.total;
+
+    auto r14 = testBackup();
+    totalPassed += r14.passed;
+    totalTests += r14.total;
+
+    auto r15 = testMigrations();
+    totalPassed += r15.passed;
+    totalTests += r15.total;
+
+    auto r16 = testServerConfig();
+    totalPassed += r16.passed;
+    totalTests += r16.total;
+
+    auto r17 = testStreamedUploads();
+    totalPassed += r17.passed;
+    totalTests += r17.total;
+
+    auto r18 = testRangeReads();
+    totalPassed += r18.passed;
+    totalTests += r18.total;
+
+    auto r19 = testWireFormats();
+    totalPassed += r19.passed;
+    totalTests += r19.total;
+
+    auto r20 = testTokenCache();
+    totalPassed += r20.passed;
+    totalTests += r20.total;
+
+    printHeader("FINAL RESULTS");
+    std::cout << "\033[1mTotal: " << totalPassed << "/" << totalTests << "\033[0m tests passed\n\n";
+
+    return (totalPassed == totalTests) ? 0 : 1;
+}
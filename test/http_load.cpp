@@ -0,0 +1,126 @@
+// http_load.cpp - Closed-loop HTTP load generator for a running server (used by thread_sweep.ps1)
+// Compile: g++ test/http_load.cpp -o http_load.exe -std=c++17 -I vendor -D_WIN32_WINNT=0x0A00 -lws2_32 -lwsock32
+// Run: .\http_load.exe [--host localhost] [--port 8080] [--clients 32] [--seconds 10] [--note-kb 4] [--write-percent 10]
+//      Prints one CSV line: clients,seconds,requests,errors,requests_per_second,p50_ms,p99_ms
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <random>
+#include <cstdlib>
+#include "../vendor/httplib.h"
+#include "../vendor/json.hpp"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "localhost";
+    int port = 8080;
+    int clients = 32;
+    int seconds = 10;
+    int note_kb = 4;
+    int write_percent = 10;
+};
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+        if (name == "--host") {
+            options.host = value;
+        } else if (name == "--port") {
+            options.port = std::atoi(value.c_str());
+        } else if (name == "--clients") {
+            options.clients = std::max(1, std::atoi(value.c_str()));
+        } else if (name == "--seconds") {
+            options.seconds = std::max(1, std::atoi(value.c_str()));
+        } else if (name == "--note-kb") {
+            options.note_kb = std::max(1, std::atoi(value.c_str()));
+        } else if (name == "--write-percent") {
+            options.write_percent = std::min(100, std::max(0, std::atoi(value.c_str())));
+        }
+    }
+    return options;
+}
+
+// Base64 of note_kb KB; the server only checks that the ciphertext is valid base64
+std::string noteContent(int note_kb) {
+    return std::string(note_kb * 1024 / 3 * 4, 'A');
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parseOptions(argc, argv);
+
+    // One user for the whole run, with a note every reader fetches
+    httplib::Client setup(options.host, options.port);
+    std::string username = "load_" + std::to_string(std::random_device{}());
+    json account = {{"username", username}, {"password", "load-password"},
+                    {"receive_public_key_hex", "04" + std::string(128, '0')}};
+    setup.Post("/register", httplib::Headers(), account.dump(), "application/json");
+    auto login = setup.Post("/login", httplib::Headers(), account.dump(), "application/json");
+    if (!login || login->status != 200) {
+        std::cerr << "Login failed, is the server running on " << options.host << ":" << options.port << "?\n";
+        return 1;
+    }
+    httplib::Headers auth = {{"Authorization", "Bearer " + json::parse(login->body)["token"].get<std::string>()}};
+
+    json note = {{"encrypted_content", noteContent(options.note_kb)}, {"wrapped_key", "key"},
+                 {"iv_hex", "00112233445566778899aabbccddeeff"}, {"filename", "load.bin"}};
+    const std::string noteBody = note.dump();
+    auto upload = setup.Post("/upload", auth, noteBody, "application/json");
+    if (!upload || upload->status != 200) {
+        std::cerr << "Upload failed\n";
+        return 1;
+    }
+    const std::string notePath = "/note/" + std::to_string(json::parse(upload->body)["note_id"].get<int>());
+
+    std::atomic<bool> stop{false};
+    std::atomic<long long> errors{0};
+    std::vector<std::vector<double>> latencies(options.clients);
+    std::vector<std::thread> clients;
+    for (int c = 0; c < options.clients; c++) {
+        clients.emplace_back([&, c] {
+            httplib::Client client(options.host, options.port);
+            client.set_keep_alive(true);
+            std::mt19937 random(c);
+            while (!stop) {
+                bool write = static_cast<int>(random() % 100) < options.write_percent;
+                auto start = Clock::now();
+                auto res = write ? client.Post("/upload", auth, noteBody, "application/json")
+                                 : client.Get(notePath, auth);
+                double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                if (!res || res->status != 200) {
+                    errors++;
+                } else {
+                    latencies[c].push_back(ms);
+                }
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    stop = true;
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    std::vector<double> all;
+    for (const auto& samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double fraction) {
+        return all.empty() ? 0.0 : all[static_cast<size_t>(fraction * (all.size() - 1))];
+    };
+
+    std::cout << options.clients << "," << options.seconds << "," << all.size() << "," << errors << ","
+              << static_cast<double>(all.size()) / options.seconds << "," << percentile(0.50) << ","
+              << percentile(0.99) << std::endl;
+    return 0;
+}
@@ -0,0 +1,86 @@
+# Thread sweep: throughput of the server for several worker_threads values
+# Chạy: .\test\thread_sweep.ps1 [-Threads 1,2,4,8,16,32] [-Clients 64] [-Seconds 10] [-WritePercent 10]
+# Cần server_app.exe (build_all.ps1) và http_load.exe:
+#   g++ test/http_load.cpp -o http_load.exe -std=c++17 -I vendor -D_WIN32_WINNT=0x0A00 -lws2_32 -lwsock32
+param(
+    [int[]]$Threads = @(1, 2, 4, 8, 16, 32),
+    [int]$Clients = 64,
+    [int]$Seconds = 10,
+    [int]$NoteKb = 4,
+    [int]$WritePercent = 10,
+    [int]$Port = 18080
+)
+
+$dbPath = "thread_sweep.db"
+
+function Remove-SweepDatabase {
+    Remove-Item "$dbPath", "$dbPath-wal", "$dbPath-shm" -Force -ErrorAction SilentlyContinue
+    Remove-Item "thread_sweep.segments" -Recurse -Force -ErrorAction SilentlyContinue
+}
+
+foreach ($exe in ".\server_app.exe", ".\http_load.exe") {
+    if (-not (Test-Path $exe)) {
+        Write-Host "✗ Không tìm thấy $exe" -ForegroundColor Red
+        exit 1
+    }
+}
+
+Write-Host "=" * 60 -ForegroundColor Blue
+Write-Host "  THREAD SWEEP: $Clients clients, $Seconds s, $WritePercent% uploads, note $NoteKb KB" -ForegroundColor Blue
+Write-Host "=" * 60 -ForegroundColor Blue
+
+$results = @()
+foreach ($t in $Threads) {
+    # Mỗi lần chạy một DB mới; cấu hình qua biến môi trường (ServerConfig)
+    Remove-SweepDatabase
+    $env:SECURE_NOTES_WORKER_THREADS = "$t"
+    $env:SECURE_NOTES_PORT = "$Port"
+    $env:SECURE_NOTES_DB_PATH = $dbPath
+    $server = Start-Process -FilePath ".\server_app.exe" -PassThru -WindowStyle Hidden `
+        -RedirectStandardOutput "thread_sweep_server.log" -RedirectStandardError "thread_sweep_server.err"
+
+    # Đợi server lắng nghe
+    $ready = $false
+    for ($i = 0; $i -lt 50 -and -not $ready; $i++) {
+        try {
+            Invoke-WebRequest -Uri "http://localhost:$Port/" -TimeoutSec 1 -ErrorAction Stop | Out-Null
+            $ready = $true
+        } catch {
+            Start-Sleep -Milliseconds 200
+        }
+    }
+    if (-not $ready) {
+        Write-Host "✗ Server không khởi động với $t threads" -ForegroundColor Red
+        Stop-Process -Id $server.Id -Force -ErrorAction SilentlyContinue
+        continue
+    }
+
+    $line = & .\http_load.exe --port $Port --clients $Clients --seconds $Seconds --note-kb $NoteKb --write-percent $WritePercent
+    Stop-Process -Id $server.Id -Force -ErrorAction SilentlyContinue
+    Start-Sleep -Milliseconds 500
+
+    # clients,seconds,requests,errors,requests_per_second,p50_ms,p99_ms
+    $fields = "$line".Split(",")
+    if ($fields.Count -lt 7) {
+        Write-Host "✗ http_load thất bại với $t threads" -ForegroundColor Red
+        continue
+    }
+    $results += [pscustomobject]@{
+        Threads = $t
+        "Req/s" = [math]::Round([double]$fields[4], 0)
+        "p50 ms" = [math]::Round([double]$fields[5], 2)
+        "p99 ms" = [math]::Round([double]$fields[6], 2)
+        Errors = [int]$fields[3]
+    }
+    Write-Host ("{0,4} threads: {1,10:N0} req/s" -f $t, [double]$fields[4])
+}
+
+Remove-Item Env:SECURE_NOTES_WORKER_THREADS, Env:SECURE_NOTES_PORT, Env:SECURE_NOTES_DB_PATH -ErrorAction SilentlyContinue
+Remove-SweepDatabase
+
+Write-Host ""
+$results | Format-Table -AutoSize
+if ($results.Count -gt 0) {
+    $peak = $results | Sort-Object -Property "Req/s" -Descending | Select-Object -First 1
+    Write-Host "Đỉnh: $($peak.Threads) worker threads, $($peak.'Req/s') req/s" -ForegroundColor Green
+}